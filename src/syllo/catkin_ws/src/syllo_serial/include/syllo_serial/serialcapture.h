@@ -0,0 +1,153 @@
+/*!
+\file    serialcapture.h
+\brief   Timestamped capture of the bytes sent and received on a serial port (Linux only).
+
+serialib hands every chunk it writes or reads to SerialCapture::Record(),
+which only copies it into a lock-free ring buffer (one per direction). A
+background thread merges both rings in time order and writes them to disk,
+so the port owner never waits for the file.
+
+File layout (native byte order) :
+    SerialCaptureHeader                         once, at the start of the file
+    SerialCaptureRecord + Length bytes          for every chunk
+
+The file is read back with SerialCaptureReader.
+*/
+
+
+#ifndef SERIALCAPTURE_H
+#define SERIALCAPTURE_H
+
+#ifdef __linux__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <thread>
+#include <atomic>
+
+// Default size of each ring buffer (power of two)
+#define SERIALCAPTURE_RING_SIZE (1 << 20)
+// How often the writer thread empties the rings (ms)
+#define SERIALCAPTURE_PERIOD_MS 20
+
+#define SERIALCAPTURE_MAGIC "SCAP"
+#define SERIALCAPTURE_VERSION 1
+
+
+#pragma pack(push, 1)
+struct SerialCaptureHeader
+{
+    char            Magic[4];                                           // SERIALCAPTURE_MAGIC
+    uint16_t        Version;
+    uint16_t        HeaderSize;                                         // sizeof(SerialCaptureHeader)
+    uint32_t        Bauds;                                              // Line rate, 0 if unknown
+    uint32_t        Reserved;
+    uint64_t        StartTime_ns;                                       // Wall clock when the capture started
+};
+
+struct SerialCaptureRecord
+{
+    uint64_t        Time_ns;                                            // Monotonic time since the capture started
+    uint16_t        Length;                                             // Bytes following the record
+    uint8_t         Direction;                                          // SerialCapture::Tx or SerialCapture::Rx
+    uint8_t         Reserved;
+};
+#pragma pack(pop)
+
+
+
+/*!  \class     SerialCapture
+     \brief     Tees the traffic of a serial port into a capture file from a background thread.
+                Record() may be called by one thread per direction concurrently.
+   */
+class SerialCapture
+{
+public:
+    enum Direction
+    {
+        Tx = 0,
+        Rx = 1
+    };
+
+    struct Stats
+    {
+        unsigned long   Records;                                        // Chunks written to the file
+        unsigned long   Bytes;                                          // Payload bytes written to the file
+        unsigned long   DroppedRecords;                                 // Chunks lost to a full ring
+        unsigned long   DroppedBytes;
+        unsigned long   WriteErrors;
+    };
+
+    SerialCapture();
+    ~SerialCapture();
+
+    // Create the file and start the writer thread
+    char    Open(const char *FileName, const unsigned int Bauds=0, const unsigned int RingSize=SERIALCAPTURE_RING_SIZE);
+
+    // Write what is left in the rings and close the file
+    void    Close();
+
+    bool    IsOpen() const { return Running; }
+
+    // Copy a chunk into the ring buffer of its direction. Never blocks : the
+    // chunk is dropped (and counted) if the ring is full.
+    void    Record(Direction Dir, const void *Buffer, unsigned int NbBytes);
+    void    Record(Direction Dir, const struct iovec *Iov, int IovCnt);
+
+    Stats   GetStats() const;
+
+private:
+    struct Ring
+    {
+        unsigned char           *Buffer;
+        std::atomic<uint64_t>   In;                                     // Total bytes written by the producer
+        std::atomic<uint64_t>   Out;                                    // Total bytes consumed by the writer
+        unsigned long           DroppedRecords;                         // Only touched by the producer
+        unsigned long           DroppedBytes;
+    };
+
+    void    Writer();
+    bool    WriteRecords(bool Final);
+    void    PeekRing(const Ring &R, uint64_t Pos, void *Dest, unsigned int NbBytes) const;
+
+    FILE                *File;
+    Ring                Rings[2];
+    unsigned int        RingSize;
+    struct timespec     StartTime;
+    std::thread         Thread;
+    std::atomic<bool>   Running;
+
+    std::atomic<unsigned long> Records;
+    std::atomic<unsigned long> Bytes;
+    unsigned long       WriteErrors;
+};
+
+
+
+/*!  \class     SerialCaptureReader
+     \brief     Sequential reader of a file written by SerialCapture.
+   */
+class SerialCaptureReader
+{
+public:
+    SerialCaptureReader();
+    ~SerialCaptureReader();
+
+    // Open a capture and check its header
+    char    Open(const char *FileName);
+    void    Close();
+
+    const SerialCaptureHeader & GetHeader() const { return Header; }
+
+    // Read the next record and its bytes (Buffer must hold 65535 bytes)
+    char    Next(SerialCaptureRecord *pRecord, void *Buffer);
+
+private:
+    FILE                *File;
+    SerialCaptureHeader Header;
+};
+
+#endif // __linux__
+
+#endif // SERIALCAPTURE_H
@@ -22,6 +22,7 @@ This is a licence-free software, it can be used by anyone who try to build a bet
 
 // Used for TimeOut operations
 #include <sys/time.h>
+#include <time.h>
 // Include for windows
 #if defined (_WIN32) || defined( _WIN64)
     // Accessing to the serial port under Windows
@@ -40,6 +41,15 @@ This is a licence-free software, it can be used by anyone who try to build a bet
     #include <fcntl.h>
     #include <unistd.h>
     #include <sys/ioctl.h>
+    #include <sys/uio.h>
+    #include <poll.h>
+    #include <linux/serial.h>
+    // Maximum number of ports watched by serialib::WaitForData
+    #define SERIALIB_MAX_WAIT 16
+    // Size of the receive ring buffer (power of two)
+    #define SERIALIB_RX_BUFFER_SIZE 4096
+    // Traffic capture, see serialcapture.h
+    class SerialCapture;
 #endif
 
 
@@ -66,7 +76,7 @@ public:
 
 
     // Open a device
-    char    Open        (const char *Device,const unsigned int Bauds);
+    char    Open        (const char *Device,const unsigned int Bauds,const bool LowLatency=false);
 
     // Close the current device
     void    Close();
@@ -107,9 +117,25 @@ public:
     // Write an array of bytes
     char    Write       (const void *Buffer, const unsigned int NbBytes);
 
+#ifdef __linux__
+    // Write several buffers with a single system call (scatter-gather)
+    char    WriteV      (const struct iovec *Iov, int IovCnt);
+
+    // Write as much of several buffers as the port accepts right now
+    int     WriteVNonBlocking(const struct iovec *Iov, int IovCnt);
+#endif
+
     // Read an array of byte (with timeout)
     int     Read        (void *Buffer,unsigned int MaxNbBytes,const unsigned int TimeOut_ms=NULL);
 
+    // Read the bytes already received, up to MaxNbBytes (with timeout)
+    int     ReadAvailable(void *Buffer,unsigned int MaxNbBytes,const unsigned int TimeOut_ms=0);
+
+#ifdef __linux__
+    // Read the bytes already received, up to MaxNbBytes, without ever waiting
+    int     ReadNonBlocking(void *Buffer,unsigned int MaxNbBytes);
+#endif
+
 
     // _________________________
     // ::: Special operation :::
@@ -121,6 +147,44 @@ public:
     // Return the number of bytes in the received buffer
     int     Peek();
 
+#ifdef __linux__
+    // Block until one of several ports has data to read (with timeout)
+    static int WaitForData(serialib *const *Ports, int NbPorts, int *Ready, const unsigned int TimeOut_ms=0);
+
+    // File descriptor of the device, for use in an external event loop.
+    // Bytes already in the receive buffer do not wake up a poll() on it,
+    // check GetRxBuffered() first.
+    int     GetFd() const { return fd; }
+
+    // Effective configuration of an opened port
+    struct Config
+    {
+        unsigned int    Bauds;                                          // Line rate actually set by the driver
+        bool            LowLatency;                                     // ASYNC_LOW_LATENCY set on the driver
+        int             LatencyTimer_ms;                                // USB-serial latency timer, -1 if none
+    };
+
+    // Read back the configuration of the port from the driver
+    char    GetConfig(Config *pConfig);
+
+    // Ask the driver to push received bytes to userspace immediately
+    char    SetLowLatency(bool Enable);
+
+    // USB-serial adapter latency timer (FTDI defaults to 16 ms)
+    int     GetLatencyTimer();
+    char    SetLatencyTimer(int Latency_ms);
+
+    // Receive buffer statistics
+    unsigned int    GetRxBuffered() const { return RxIn-RxOut; }
+    unsigned int    GetRxHighWater() const { return RxHighWater; }
+    unsigned long   GetRxOverruns() const { return RxOverruns; }
+    void            ResetRxStats();
+
+    // Tee every byte written and received into a capture (NULL to stop).
+    // The capture must stay opened until it is detached.
+    void    SetCapture(SerialCapture *Capture) { this->Capture=Capture; }
+#endif
+
 private:
     // Read a string (no timeout)
     int     ReadStringNoTimeOut  (char *String,char FinalChar,unsigned int MaxNbBytes);
@@ -131,7 +195,25 @@ private:
     COMMTIMEOUTS    timeouts;
 #endif
 #ifdef __linux__
+    // Sleep until the device is readable or the timeout of Timer expires
+    int     WaitReadable(class TimeOut &Timer, unsigned int TimeOut_ms);
+
+    // Receive buffer : filled by large reads, drained by the Read functions
+    int     ReceiveBytes(class TimeOut &Timer, unsigned int TimeOut_ms);
+    int     FillRxBuffer();
+    unsigned int PopRxBuffer(void *Buffer, unsigned int MaxNbBytes);
+
+    // Line rates without a Bxxx constant are set through termios2
+    char    SetCustomBauds(unsigned int Bauds);
+
     int             fd;
+    char            DeviceName[32];                                     // Kernel name of the tty (ttyUSB0)
+    unsigned char   RxBuffer[SERIALIB_RX_BUFFER_SIZE];
+    unsigned int    RxIn;                                               // Total bytes written in RxBuffer
+    unsigned int    RxOut;                                              // Total bytes read from RxBuffer
+    unsigned int    RxHighWater;                                        // Largest number of bytes buffered
+    unsigned long   RxOverruns;                                         // Reads that filled the whole buffer
+    SerialCapture   *Capture;                                           // Traffic capture, NULL if none
 #endif
 
 };
@@ -156,7 +238,11 @@ public:
     unsigned long int   ElapsedTime_ms();
 
 private:    
+#ifdef __linux__
+    struct timespec     PreviousTime;                                   // Monotonic, immune to clock changes
+#else
     struct timeval      PreviousTime;
+#endif
 };
 
 
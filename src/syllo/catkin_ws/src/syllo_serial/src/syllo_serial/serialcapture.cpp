@@ -0,0 +1,410 @@
+/*!
+\file    serialcapture.cpp
+\brief   Timestamped capture of the bytes sent and received on a serial port (Linux only).
+*/
+
+#include "syllo_serial/serialcapture.h"
+
+#ifdef __linux__
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <new>
+
+// Largest chunk a single record can hold
+#define SERIALCAPTURE_MAX_RECORD 65535
+
+
+
+// Nanoseconds elapsed since Start on the monotonic clock
+static uint64_t ElapsedNs(const struct timespec &Start)
+{
+     struct timespec Now;
+     clock_gettime(CLOCK_MONOTONIC,&Now);
+     return (uint64_t)(Now.tv_sec-Start.tv_sec)*1000000000ULL+Now.tv_nsec-Start.tv_nsec;
+}
+
+
+
+// Copy bytes into a ring of Size bytes (power of two) at position In, wrapping around the end
+static void CopyToRing(unsigned char *Ring, unsigned int Size, uint64_t &In, const void *Data, size_t NbBytes)
+{
+     const unsigned char *Src=(const unsigned char*)Data;
+     while (NbBytes>0)
+     {
+	  unsigned int Pos=In&(Size-1);
+	  size_t Chunk=Size-Pos;
+	  if (Chunk>NbBytes) Chunk=NbBytes;
+	  memcpy(Ring+Pos,Src,Chunk);
+	  Src+=Chunk;
+	  NbBytes-=Chunk;
+	  In+=Chunk;
+     }
+}
+
+
+
+//_____________________________________
+// ::: Constructors and destructors :::
+
+
+/*!
+  \brief Constructor of the class SerialCapture. Nothing is captured until Open()
+*/
+SerialCapture::SerialCapture() : Running(false), Records(0), Bytes(0)
+{
+     File=NULL;
+     RingSize=0;
+     WriteErrors=0;
+     for (int i=0;i<2;i++)
+     {
+	  Rings[i].Buffer=NULL;
+	  Rings[i].In=0;
+	  Rings[i].Out=0;
+	  Rings[i].DroppedRecords=0;
+	  Rings[i].DroppedBytes=0;
+     }
+}
+
+
+/*!
+  \brief Destructor of the class SerialCapture. Flush and close the capture file
+*/
+SerialCapture::~SerialCapture()
+{
+     Close();
+}
+
+
+
+//_________________________________________
+// ::: Configuration and initialization :::
+
+
+/*!
+  \brief Create the capture file and start the writer thread
+  \param FileName : name of the capture file (overwritten if it exists)
+  \param Bauds : line rate stored in the file header (informative)
+  \param RingSize : size of each ring buffer, rounded up to a power of two
+  \return 1 success
+  \return -1 capture already opened
+  \return -2 file not created
+  \return -3 ring buffers not allocated
+*/
+char SerialCapture::Open(const char *FileName, const unsigned int Bauds, const unsigned int RingSize)
+{
+     if (Running) return -1;                                             // Already capturing
+
+     unsigned int Size=1;                                                // Power of two, holds the largest record
+     while (Size<RingSize || Size<SERIALCAPTURE_MAX_RECORD+sizeof(SerialCaptureRecord)) Size<<=1;
+
+     File=fopen(FileName,"wb");
+     if (File==NULL) return -2;                                          // File not created
+
+     for (int i=0;i<2;i++)
+     {
+	  Rings[i].Buffer=new (std::nothrow) unsigned char[Size];
+	  if (Rings[i].Buffer==NULL)
+	  {
+	       delete [] Rings[0].Buffer;
+	       Rings[0].Buffer=NULL;
+	       fclose(File);
+	       File=NULL;
+	       return -3;                                                 // Allocation failed
+	  }
+	  Rings[i].In=0;
+	  Rings[i].Out=0;
+	  Rings[i].DroppedRecords=0;
+	  Rings[i].DroppedBytes=0;
+     }
+     this->RingSize=Size;
+     Records=0;
+     Bytes=0;
+     WriteErrors=0;
+
+     SerialCaptureHeader Header;
+     memset(&Header,0,sizeof(Header));
+     memcpy(Header.Magic,SERIALCAPTURE_MAGIC,4);
+     Header.Version=SERIALCAPTURE_VERSION;
+     Header.HeaderSize=sizeof(Header);
+     Header.Bauds=Bauds;
+     struct timespec Wall;
+     clock_gettime(CLOCK_REALTIME,&Wall);
+     Header.StartTime_ns=(uint64_t)Wall.tv_sec*1000000000ULL+Wall.tv_nsec;
+     if (fwrite(&Header,sizeof(Header),1,File)!=1) WriteErrors++;
+
+     clock_gettime(CLOCK_MONOTONIC,&StartTime);
+     Running=true;
+     Thread=std::thread(&SerialCapture::Writer,this);
+     return 1;                                                           // Success
+}
+
+
+/*!
+  \brief Stop the writer thread once the rings are empty and close the file
+*/
+void SerialCapture::Close()
+{
+     if (!Running) return;
+     Running=false;
+     Thread.join();                                                      // The writer drains the rings first
+     fclose(File);
+     File=NULL;
+     for (int i=0;i<2;i++)
+     {
+	  delete [] Rings[i].Buffer;
+	  Rings[i].Buffer=NULL;
+     }
+}
+
+
+
+//___________________
+// ::: Recording :::
+
+
+/*!
+  \brief Copy a chunk of traffic into the ring buffer of its direction
+  Only one thread may record each direction. The chunk is dropped if the ring
+  is full, the caller is never blocked.
+  \param Dir : SerialCapture::Tx for written bytes, SerialCapture::Rx for read bytes
+  \param Buffer : bytes of the chunk
+  \param NbBytes : number of bytes in the chunk
+*/
+void SerialCapture::Record(Direction Dir, const void *Buffer, unsigned int NbBytes)
+{
+     struct iovec Iov;
+     const char *Data=(const char*)Buffer;
+     do
+     {
+	  Iov.iov_base=(void*)Data;
+	  Iov.iov_len=NbBytes>SERIALCAPTURE_MAX_RECORD ? SERIALCAPTURE_MAX_RECORD : NbBytes;
+	  Record(Dir,&Iov,1);
+	  Data+=Iov.iov_len;
+	  NbBytes-=Iov.iov_len;
+     } while (NbBytes>0);
+}
+
+
+/*!
+  \brief Copy a scattered chunk of traffic (as given to writev / readv) into the ring buffer of its direction
+  \param Dir : SerialCapture::Tx for written bytes, SerialCapture::Rx for read bytes
+  \param Iov : buffers of the chunk, in order
+  \param IovCnt : number of buffers in Iov
+*/
+void SerialCapture::Record(Direction Dir, const struct iovec *Iov, int IovCnt)
+{
+     if (!Running) return;
+
+     size_t NbBytes=0;
+     for (int i=0;i<IovCnt;i++) NbBytes+=Iov[i].iov_len;
+     if (NbBytes==0) return;
+     if (NbBytes>SERIALCAPTURE_MAX_RECORD)                               // Split into several records
+     {
+	  for (int i=0;i<IovCnt;i++) Record(Dir,Iov[i].iov_base,Iov[i].iov_len);
+	  return;
+     }
+
+     Ring &R=Rings[Dir];
+     uint64_t In=R.In.load(std::memory_order_relaxed);
+     uint64_t Free=RingSize-(In-R.Out.load(std::memory_order_acquire));
+     if (Free<sizeof(SerialCaptureRecord)+NbBytes)                       // Writer fell behind
+     {
+	  R.DroppedRecords++;
+	  R.DroppedBytes+=NbBytes;
+	  return;
+     }
+
+     SerialCaptureRecord Rec;
+     Rec.Time_ns=ElapsedNs(StartTime);
+     Rec.Length=NbBytes;
+     Rec.Direction=Dir;
+     Rec.Reserved=0;
+
+     CopyToRing(R.Buffer,RingSize,In,&Rec,sizeof(Rec));
+     for (int i=0;i<IovCnt;i++) CopyToRing(R.Buffer,RingSize,In,Iov[i].iov_base,Iov[i].iov_len);
+     R.In.store(In,std::memory_order_release);                           // Publish the record
+}
+
+
+/*!
+  \brief Return the capture statistics
+  The dropped counters are written by the recording threads and may lag slightly.
+*/
+SerialCapture::Stats SerialCapture::GetStats() const
+{
+     Stats S;
+     S.Records=Records;
+     S.Bytes=Bytes;
+     S.DroppedRecords=Rings[Tx].DroppedRecords+Rings[Rx].DroppedRecords;
+     S.DroppedBytes=Rings[Tx].DroppedBytes+Rings[Rx].DroppedBytes;
+     S.WriteErrors=WriteErrors;
+     return S;
+}
+
+
+
+//_____________________
+// ::: Writer thread :::
+
+
+/*!
+  \brief Copy bytes out of a ring without consuming them
+*/
+void SerialCapture::PeekRing(const Ring &R, uint64_t Pos, void *Dest, unsigned int NbBytes) const
+{
+     unsigned int Start=Pos&(RingSize-1);
+     unsigned int First=RingSize-Start;                                  // Bytes before the end of the ring
+     if (First>NbBytes) First=NbBytes;
+     memcpy(Dest,R.Buffer+Start,First);
+     memcpy((unsigned char*)Dest+First,R.Buffer,NbBytes-First);          // Wrapped part
+}
+
+
+/*!
+  \brief Move the records published so far from both rings to the file, oldest first
+  \param Final : flush the file even if nothing was written
+  \return true if at least one record was written
+*/
+bool SerialCapture::WriteRecords(bool Final)
+{
+     uint64_t In[2],Out[2];
+     for (int i=0;i<2;i++)
+     {
+	  In[i]=Rings[i].In.load(std::memory_order_acquire);
+	  Out[i]=Rings[i].Out.load(std::memory_order_relaxed);
+     }
+
+     bool Written=false;
+     SerialCaptureRecord Rec[2];
+     bool Valid[2]={false,false};
+     for (;;)
+     {
+	  for (int i=0;i<2;i++)
+	       if (!Valid[i] && Out[i]!=In[i])
+	       {
+		    PeekRing(Rings[i],Out[i],&Rec[i],sizeof(SerialCaptureRecord));
+		    Valid[i]=true;
+	       }
+	  if (!Valid[0] && !Valid[1]) break;
+
+	  int i=(Valid[0] && (!Valid[1] || Rec[0].Time_ns<=Rec[1].Time_ns)) ? 0 : 1;
+	  const Ring &R=Rings[i];
+	  unsigned int Size=sizeof(SerialCaptureRecord)+Rec[i].Length;
+	  unsigned int Start=Out[i]&(RingSize-1);
+	  unsigned int First=RingSize-Start;
+	  if (First>Size) First=Size;
+	  if (fwrite(R.Buffer+Start,1,First,File)!=First ||                  // Record, possibly wrapped
+	      fwrite(R.Buffer,1,Size-First,File)!=Size-First)
+	       WriteErrors++;
+	  Out[i]+=Size;
+	  Rings[i].Out.store(Out[i],std::memory_order_release);            // Hand the space back
+	  Valid[i]=false;
+
+	  Records++;
+	  Bytes+=Rec[i].Length;
+	  Written=true;
+     }
+     if (Written || Final) fflush(File);
+     return Written;
+}
+
+
+/*!
+  \brief Body of the writer thread : empty the rings periodically until Close()
+*/
+void SerialCapture::Writer()
+{
+     struct timespec Period;
+     Period.tv_sec=0;
+     Period.tv_nsec=SERIALCAPTURE_PERIOD_MS*1000000L;
+     while (Running)
+     {
+	  nanosleep(&Period,NULL);
+	  WriteRecords(false);
+     }
+     WriteRecords(true);                                                 // Whatever arrived before Close()
+}
+
+
+
+//____________________________
+// ::: Reading a capture :::
+
+
+/*!
+  \brief Constructor of the class SerialCaptureReader
+*/
+SerialCaptureReader::SerialCaptureReader()
+{
+     File=NULL;
+     memset(&Header,0,sizeof(Header));
+}
+
+
+/*!
+  \brief Destructor of the class SerialCaptureReader
+*/
+SerialCaptureReader::~SerialCaptureReader()
+{
+     Close();
+}
+
+
+/*!
+  \brief Open a capture file and check its header
+  \param FileName : name of the capture file
+  \return 1 success
+  \return -1 file not found
+  \return -2 not a capture file
+  \return -3 unsupported version
+*/
+char SerialCaptureReader::Open(const char *FileName)
+{
+     Close();
+     File=fopen(FileName,"rb");
+     if (File==NULL) return -1;                                          // File not found
+     if (fread(&Header,sizeof(Header),1,File)!=1 ||
+	 memcmp(Header.Magic,SERIALCAPTURE_MAGIC,4)!=0)
+     {
+	  Close();
+	  return -2;                                                      // Not a capture
+     }
+     if (Header.Version!=SERIALCAPTURE_VERSION || Header.HeaderSize<sizeof(Header))
+     {
+	  Close();
+	  return -3;                                                      // Unsupported version
+     }
+     fseek(File,Header.HeaderSize,SEEK_SET);                             // Skip fields of later versions
+     return 1;                                                           // Success
+}
+
+
+/*!
+  \brief Close the capture file
+*/
+void SerialCaptureReader::Close()
+{
+     if (File!=NULL) fclose(File);
+     File=NULL;
+}
+
+
+/*!
+  \brief Read the next record of the capture
+  \param pRecord : header of the record (time, direction, length)
+  \param Buffer : bytes of the record, must hold up to 65535 bytes
+  \return 1 success
+  \return 0 end of the capture
+  \return -1 truncated record
+*/
+char SerialCaptureReader::Next(SerialCaptureRecord *pRecord, void *Buffer)
+{
+     if (File==NULL) return 0;
+     if (fread(pRecord,sizeof(SerialCaptureRecord),1,File)!=1) return 0; // End of capture
+     if (fread(Buffer,1,pRecord->Length,File)!=pRecord->Length) return -1;
+     return 1;                                                           // Success
+}
+
+#endif // __linux__
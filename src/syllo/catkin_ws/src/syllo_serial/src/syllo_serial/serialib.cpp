@@ -1,619 +1,1149 @@
-/*!
-  \file    serialib.cpp
-  \brief   Class to manage the serial port
-  \author  Philippe Lucidarme (University of Angers) <serialib@googlegroups.com>
-  \version 1.2
-  \date    28 avril 2011
-
-  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
-  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
-  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY CLAIM,
-  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
-  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-
-
-  This is a licence-free software, it can be used by anyone who try to build a better world.
-*/
-
-#include <syllo_serial/serialib.h>
-
-#include <string.h>
-#include <stdio.h>
-
-#include <iostream>
-
-
-
-/*!
-  \brief      Constructor of the class serialib.
-*/
-// Class constructor
-serialib::serialib()
-{}
-
-
-/*!
-  \brief      Destructor of the class serialib. It close the connection
-*/
-// Class desctructor
-serialib::~serialib()
-{
-     Close();
-}
-
-
-
-//_________________________________________
-// ::: Configuration and initialization :::
-
-
-
-/*!
-  \brief Open the serial port
-  \param Device : Port name (COM1, COM2, ... for Windows ) or (/dev/ttyS0, /dev/ttyACM0, /dev/ttyUSB0 ... for linux)
-  \param Bauds : Baud rate of the serial port.
-
-  \n Supported baud rate for Windows :
-  - 110
-  - 300
-  - 600
-  - 1200
-  - 2400
-  - 4800
-  - 9600
-  - 14400
-  - 19200
-  - 38400
-  - 56000
-  - 57600
-  - 115200
-  - 128000
-  - 256000
-
-  \n Supported baud rate for Linux :\n
-  - 110
-  - 300
-  - 600
-  - 1200
-  - 2400
-  - 4800
-  - 9600
-  - 19200
-  - 38400
-  - 57600
-  - 115200
-
-  \return 1 success
-  \return -1 device not found
-  \return -2 error while opening the device
-  \return -3 error while getting port parameters
-  \return -4 Speed (Bauds) not recognized
-  \return -5 error while writing port parameters
-  \return -6 error while writing timeout parameters
-*/
-char serialib::Open(const char *Device,const unsigned int Bauds)
-{
-#if defined (_WIN32) || defined( _WIN64)
-
-     // Open serial port
-     hSerial = CreateFileA(  Device,GENERIC_READ | GENERIC_WRITE,0,0,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,0);
-     if(hSerial==INVALID_HANDLE_VALUE) {
-	  if(GetLastError()==ERROR_FILE_NOT_FOUND)
-	       return -1;                                                  // Device not found
-	  return -2;                                                      // Error while opening the device
-     }
-
-     // Set parameters
-     DCB dcbSerialParams = {0};                                          // Structure for the port parameters
-     dcbSerialParams.DCBlength=sizeof(dcbSerialParams);
-     if (!GetCommState(hSerial, &dcbSerialParams))                       // Get the port parameters
-	  return -3;                                                      // Error while getting port parameters
-     switch (Bauds)                                                      // Set the speed (Bauds)
-     {
-     case 110  :     dcbSerialParams.BaudRate=CBR_110; break;
-     case 300  :     dcbSerialParams.BaudRate=CBR_300; break;
-     case 600  :     dcbSerialParams.BaudRate=CBR_600; break;
-     case 1200 :     dcbSerialParams.BaudRate=CBR_1200; break;
-     case 2400 :     dcbSerialParams.BaudRate=CBR_2400; break;
-     case 4800 :     dcbSerialParams.BaudRate=CBR_4800; break;
-     case 9600 :     dcbSerialParams.BaudRate=CBR_9600; break;
-     case 14400 :    dcbSerialParams.BaudRate=CBR_14400; break;
-     case 19200 :    dcbSerialParams.BaudRate=CBR_19200; break;
-     case 38400 :    dcbSerialParams.BaudRate=CBR_38400; break;
-     case 56000 :    dcbSerialParams.BaudRate=CBR_56000; break;
-     case 57600 :    dcbSerialParams.BaudRate=CBR_57600; break;
-     case 115200 :   dcbSerialParams.BaudRate=CBR_115200; break;
-     case 128000 :   dcbSerialParams.BaudRate=CBR_128000; break;
-     case 256000 :   dcbSerialParams.BaudRate=CBR_256000; break;
-     default : return -4;
-     }    
-     dcbSerialParams.ByteSize=8;                                         // 8 bit data
-     dcbSerialParams.StopBits=ONESTOPBIT;                                // One stop bit
-     dcbSerialParams.Parity=NOPARITY;                                    // No parity
-     if(!SetCommState(hSerial, &dcbSerialParams))                        // Write the parameters
-	  return -5;                                                      // Error while writing
-
-     // Set TimeOut
-     timeouts.ReadIntervalTimeout=0;                                     // Set the Timeout parameters
-     timeouts.ReadTotalTimeoutConstant=MAXDWORD;                         // No TimeOut
-     timeouts.ReadTotalTimeoutMultiplier=0;
-     timeouts.WriteTotalTimeoutConstant=MAXDWORD;
-     timeouts.WriteTotalTimeoutMultiplier=0;
-     if(!SetCommTimeouts(hSerial, &timeouts))                            // Write the parameters
-	  return -6;                                                      // Error while writting the parameters
-     return 1;                                                           // Opening successfull
-
-#endif
-#ifdef __linux__    
-     struct termios options;                                             // Structure with the device's options
-
-
-     // Open device
-     fd = open(Device, O_RDWR | O_NOCTTY | O_NDELAY);                    // Open port
-     if (fd == -1) return -2;                                            // If the device is not open, return -1
-     fcntl(fd, F_SETFL, FNDELAY);                                        // Open the device in nonblocking mode
-
-     // Set parameters
-     tcgetattr(fd, &options);                                            // Get the current options of the port
-     bzero(&options, sizeof(options));                                   // Clear all the options
-     speed_t         Speed;
-     switch (Bauds)                                                      // Set the speed (Bauds)
-     {
-     case 110  :     Speed=B110; break;
-     case 300  :     Speed=B300; break;
-     case 600  :     Speed=B600; break;
-     case 1200 :     Speed=B1200; break;
-     case 2400 :     Speed=B2400; break;
-     case 4800 :     Speed=B4800; break;
-     case 9600 :     Speed=B9600; break;
-     case 19200 :    Speed=B19200; break;
-     case 38400 :    Speed=B38400; break;
-     case 57600 :    Speed=B57600; break;
-     case 115200 :   Speed=B115200; break;
-     default : return -4;
-     }
-     cfsetispeed(&options, Speed);                                       // Set the baud rate at 115200 bauds
-     cfsetospeed(&options, Speed);
-     options.c_cflag |= ( CLOCAL | CREAD |  CS8);                        // Configure the device : 8 bits, no parity, no control
-     options.c_iflag |= ( IGNPAR | IGNBRK );
-     options.c_cc[VTIME]=0;                                              // Timer unused
-     options.c_cc[VMIN]=0;                                               // At least on character before satisfy reading
-     tcsetattr(fd, TCSANOW, &options);                                   // Activate the settings
-     return (1);                                                         // Success
-#endif
-}
-
-
-/*!
-  \brief Close the connection with the current device
-*/
-void serialib::Close()
-{
-#if defined (_WIN32) || defined( _WIN64)
-     CloseHandle(hSerial);
-#endif
-#ifdef __linux__
-     close (fd);
-#endif
-}
-
-
-
-
-//___________________________________________
-// ::: Read/Write operation on characters :::
-
-
-
-/*!
-  \brief Write a char on the current serial port
-  \param Byte : char to send on the port (must be terminated by '\0')
-  \return 1 success
-  \return -1 error while writting data
-*/
-char serialib::WriteChar(const char Byte)
-{
-#if defined (_WIN32) || defined( _WIN64)
-     DWORD dwBytesWritten;                                               // Number of bytes written
-     if(!WriteFile(hSerial,&Byte,1,&dwBytesWritten,NULL))                // Write the char
-	  return -1;                                                      // Error while writing
-     return 1;                                                           // Write operation successfull
-#endif
-#ifdef __linux__
-     if (write(fd,&Byte,1)!=1)                                           // Write the char
-	  return -1;                                                      // Error while writting
-     return 1;                                                           // Write operation successfull
-#endif
-}
-
-
-
-//________________________________________
-// ::: Read/Write operation on strings :::
-
-
-/*!
-  \brief Write a string on the current serial port
-  \param String : string to send on the port (must be terminated by '\0')
-  \return 1 success
-  \return -1 error while writting data
-*/
-char serialib::WriteString(const char *String)
-{
-#if defined (_WIN32) || defined( _WIN64)
-     DWORD dwBytesWritten;                                               // Number of bytes written
-     if(!WriteFile(hSerial,String,strlen(String),&dwBytesWritten,NULL))  // Write the string
-	  return -1;                                                      // Error while writing
-     return 1;                                                           // Write operation successfull
-#endif
-#ifdef __linux__
-     int Lenght=strlen(String);                                          // Lenght of the string
-     if (write(fd,String,Lenght)!=Lenght)                                // Write the string
-	  return -1;                                                      // error while writing
-     return 1;                                                           // Write operation successfull
-#endif
-}
-
-// _____________________________________
-// ::: Read/Write operation on bytes :::
-
-
-
-/*!
-  \brief Write an array of data on the current serial port
-  \param Buffer : array of bytes to send on the port
-  \param NbBytes : number of byte to send
-  \return 1 success
-  \return -1 error while writting data
-*/
-char serialib::Write(const void *Buffer, const unsigned int NbBytes)
-{
-#if defined (_WIN32) || defined( _WIN64)
-     DWORD dwBytesWritten;                                               // Number of byte written
-     if(!WriteFile(hSerial, Buffer, NbBytes, &dwBytesWritten, NULL))     // Write data
-	  return -1;                                                      // Error while writing
-     return 1;                                                           // Write operation successfull
-#endif
-#ifdef __linux__
-     if (write (fd,Buffer,NbBytes)!=(ssize_t)NbBytes)                              // Write data
-	  return -1;                                                      // Error while writing
-     return 1;                                                           // Write operation successfull
-#endif
-}
-
-
-
-/*!
-  \brief Wait for a byte from the serial device and return the data read
-  \param pByte : data read on the serial device
-  \param TimeOut_ms : delay of timeout before giving up the reading
-  If set to zero, timeout is disable (Optional)
-  \return 1 success
-  \return 0 Timeout reached
-  \return -1 error while setting the Timeout
-  \return -2 error while reading the byte
-*/
-char serialib::ReadChar(char *pByte,unsigned int TimeOut_ms)
-{
-#if defined (_WIN32) || defined(_WIN64)
-
-     DWORD dwBytesRead = 0;
-     timeouts.ReadTotalTimeoutConstant=TimeOut_ms;                       // Set the TimeOut
-     if(!SetCommTimeouts(hSerial, &timeouts))                            // Write the parameters
-	  return -1;                                                      // Error while writting the parameters
-     if(!ReadFile(hSerial,pByte, 1, &dwBytesRead, NULL))                 // Read the byte
-	  return -2;                                                      // Error while reading the byte
-     if (dwBytesRead==0) return 0;                                       // Return 1 if the timeout is reached
-     return 1;                                                           // Success
-#endif
-#ifdef __linux__
-     TimeOut         Timer;                                              // Timer used for timeout
-     Timer.InitTimer();                                                  // Initialise the timer
-     while (Timer.ElapsedTime_ms()<TimeOut_ms || TimeOut_ms==0)          // While Timeout is not reached
-     {
-	  switch (read(fd,pByte,1)) {                                     // Try to read a byte on the device
-	  case 1  : return 1;                                             // Read successfull
-	  case -1 : return -2;                                            // Error while reading
-	  }
-     }
-     return 0;
-#endif
-}
-
-/*!
-  \brief Read a string from the serial device (without TimeOut)
-  \param String : string read on the serial device
-  \param FinalChar : final char of the string
-  \param MaxNbBytes : maximum allowed number of bytes read
-  \return >0 success, return the number of bytes read
-  \return -1 error while setting the Timeout
-  \return -2 error while reading the byte
-  \return -3 MaxNbBytes is reached
-*/
-int serialib::ReadStringNoTimeOut(char *String,char FinalChar,unsigned int MaxNbBytes)
-{
-     unsigned int    NbBytes=0;                                          // Number of bytes read
-     char            ret;                                                // Returned value from Read
-     while (NbBytes<MaxNbBytes)                                          // While the buffer is not full
-     {                                                                   // Read a byte with the restant time
-	  ret=ReadChar(&String[NbBytes],0);
-	  if (ret==1)                                                     // If a byte has been read
-	  {
-	       if (String[NbBytes]==FinalChar)                             // Check if it is the final char
-	       {
-		    String  [++NbBytes]=0;                                  // Yes : add the end character 0
-		    return NbBytes;                                         // Return the number of bytes read
-	       }
-	       NbBytes++;                                                  // If not, just increase the number of bytes read
-	  }
-	  if (ret<0) return ret;                                          // Error while reading : return the error number
-     }
-     return -3;                                                          // Buffer is full : return -3
-}
-
-/*!
-  \brief Read a string from the serial device (with timeout)
-  \param String : string read on the serial device
-  \param FinalChar : final char of the string
-  \param MaxNbBytes : maximum allowed number of bytes read
-  \param TimeOut_ms : delay of timeout before giving up the reading (optional)
-  \return  >0 success, return the number of bytes read
-  \return  0 timeout is reached
-  \return -1 error while setting the Timeout
-  \return -2 error while reading the byte
-  \return -3 MaxNbBytes is reached
-*/
-int serialib::ReadString(char *String,char FinalChar,unsigned int MaxNbBytes,unsigned int TimeOut_ms)
-{
-     if (TimeOut_ms==0)
-	  return ReadStringNoTimeOut(String,FinalChar,MaxNbBytes);
-
-     unsigned int    NbBytes=0;                                          // Number of bytes read
-     char            ret;                                                // Returned value from Read
-     TimeOut         Timer;                                              // Timer used for timeout
-     long int        TimeOutParam;
-     Timer.InitTimer();                                                  // Initialize the timer
-
-     while (NbBytes<MaxNbBytes)                                          // While the buffer is not full
-     {                                                                   // Read a byte with the restant time
-	  TimeOutParam=TimeOut_ms-Timer.ElapsedTime_ms();                 // Compute the TimeOut for the call of ReadChar
-	  if (TimeOutParam>0)                                             // If the parameter is higher than zero
-	  {
-	       ret=ReadChar(&String[NbBytes],TimeOutParam);                // Wait for a byte on the serial link            
-	       if (ret==1)                                                 // If a byte has been read
-	       {
-
-		    if (String[NbBytes]==FinalChar)                         // Check if it is the final char
-		    {
-			 String  [++NbBytes]=0;                              // Yes : add the end character 0
-			 return NbBytes;                                     // Return the number of bytes read
-		    }
-		    NbBytes++;                                              // If not, just increase the number of bytes read
-	       }
-	       if (ret<0) return ret;                                      // Error while reading : return the error number
-	  }
-	  if (Timer.ElapsedTime_ms()>TimeOut_ms) {                        // Timeout is reached
-	       String[NbBytes]=0;                                          // Add the end caracter
-	       return 0;                                                   // Return 0
-	  }
-     }
-     return -3;                                                          // Buffer is full : return -3
-}
-
-#define IDLE_STATE 0
-#define DATA_LENGTH_0_STATE 1
-#define DATA_LENGTH_1_STATE 2
-#define DATA_STATE 3
-#define CHECKSUM_STATE 4
-
-#define ESC 0x7d
-#define esc(byte) ((byte) ^ 0x20)
-
-int serialib::ReadString_Digi_API(char *String,char StartChar,unsigned int MaxNbBytes,unsigned int TimeOut_ms)
-{
-     if (TimeOut_ms==0)
-	  return ReadStringNoTimeOut(String,StartChar,MaxNbBytes);
-
-     unsigned int    NbBytes=0;                                          // Number of bytes read
-     char            ret;                                                // Returned value from Read
-     TimeOut         Timer;                                              // Timer used for timeout
-     long int        TimeOutParam;
-     Timer.InitTimer();                                                  // Initialize the timer
-
-     int state = IDLE_STATE;
-     int dataLength = 0;
-
-     while (NbBytes<MaxNbBytes)                                          // While the buffer is not full
-     {                                                                   // Read a byte with the restant time
-	  TimeOutParam=TimeOut_ms-Timer.ElapsedTime_ms();                 // Compute the TimeOut for the call of ReadChar
-	  if (TimeOutParam>0)                                             // If the parameter is higher than zero
-	  {
-	       ret=ReadChar(&String[NbBytes],TimeOutParam);                // Wait for a byte on the serial link            
-	       if (ret==1)                                                 // If a byte has been read
-	       {
-		    switch (state) {
-		    case IDLE_STATE:
-			 if (String[NbBytes]==StartChar) {
-			      state = DATA_LENGTH_0_STATE;
-			      NbBytes++;
-			 }
-			 break;
-		    case DATA_LENGTH_0_STATE:
-			 if (String[NbBytes]==ESC) {
-			      ret=ReadChar(&String[NbBytes],TimeOutParam);
-			      String[NbBytes] = esc(String[NbBytes]);
-			 }
-			 state = DATA_LENGTH_1_STATE;
-			 dataLength = (String[NbBytes] << 8) & 0xFF00;
-			 NbBytes++;
-			 break;
-		    case DATA_LENGTH_1_STATE:
-			 if (String[NbBytes]==ESC) {
-			      ret=ReadChar(&String[NbBytes],TimeOutParam);
-			      String[NbBytes] = esc(String[NbBytes]);
-			 }
-			 state = DATA_STATE;
-			 dataLength += ((String[NbBytes]) & 0x00FF);
-			 NbBytes++;
-			 break;
-		    case DATA_STATE:
-			 if (String[NbBytes]==ESC) {
-			      ret=ReadChar(&String[NbBytes],TimeOutParam);
-			      String[NbBytes] = esc(String[NbBytes]);
-			 }
-			 NbBytes++;
-			 dataLength--;
-			 
-			 if (dataLength == 0) {
-			      state = CHECKSUM_STATE;
-			 }
-			 break;
-		    case CHECKSUM_STATE:
-			 if (String[NbBytes]==ESC) {
-			      ret=ReadChar(&String[NbBytes],TimeOutParam);
-			      String[NbBytes] = esc(String[NbBytes]);
-			 }
-			 
-			 NbBytes++;
-			 return NbBytes;
-
-			 break;
-		    default:
-			 break;
-		    }
-		    
-		    
-		    //if (String[NbBytes]==StartChar)                         // Check if it is the start char
-		    //{
-		    //	 String  [++NbBytes]=0;                              // Yes : add the end character 0
-		    //	 return NbBytes;                                     // Return the number of bytes read
-		    //}
-		    //NbBytes++;                                              // If not, just increase the number of bytes read
-	       }
-	       if (ret<0) return ret;                                      // Error while reading : return the error number
-	  }
-	  if (Timer.ElapsedTime_ms()>TimeOut_ms) {                        // Timeout is reached
-	       String[NbBytes]=0;                                          // Add the end caracter
-	       return 0;                                                   // Return 0
-	  }
-     }
-     return -3;                                                          // Buffer is full : return -3
-}
-
-
-/*!
-  \brief Read an array of bytes from the serial device (with timeout)
-  \param Buffer : array of bytes read from the serial device
-  \param MaxNbBytes : maximum allowed number of bytes read
-  \param TimeOut_ms : delay of timeout before giving up the reading
-  \return 1 success, return the number of bytes read
-  \return 0 Timeout reached
-  \return -1 error while setting the Timeout
-  \return -2 error while reading the byte
-*/
-int serialib::Read (void *Buffer,unsigned int MaxNbBytes,unsigned int TimeOut_ms)
-{
-#if defined (_WIN32) || defined(_WIN64)
-     DWORD dwBytesRead = 0;
-     timeouts.ReadTotalTimeoutConstant=(DWORD)TimeOut_ms;                // Set the TimeOut
-     if(!SetCommTimeouts(hSerial, &timeouts))                            // Write the parameters
-	  return -1;                                                      // Error while writting the parameters
-     if(!ReadFile(hSerial,Buffer,(DWORD)MaxNbBytes,&dwBytesRead, NULL))  // Read the bytes from the serial device
-	  return -2;                                                      // Error while reading the byte
-     if (dwBytesRead!=(DWORD)MaxNbBytes) return 0;                       // Return 0 if the timeout is reached
-     return 1;                                                           // Success
-#endif
-#ifdef __linux__
-     TimeOut          Timer;                                             // Timer used for timeout
-     Timer.InitTimer();                                                  // Initialise the timer
-     unsigned int     NbByteRead=0;
-     while (Timer.ElapsedTime_ms()<TimeOut_ms || TimeOut_ms==0)          // While Timeout is not reached
-     {
-	  unsigned char* Ptr=(unsigned char*)Buffer+NbByteRead;           // Compute the position of the current byte
-	  int Ret=read(fd,(void*)Ptr,MaxNbBytes-NbByteRead);              // Try to read a byte on the device
-	  if (Ret==-1) return -2;                                         // Error while reading
-	  if (Ret>0) {                                                    // One or several byte(s) has been read on the device
-	       NbByteRead+=Ret;                                            // Increase the number of read bytes
-	       if (NbByteRead>=MaxNbBytes)                                 // Success : bytes has been read
-		    return 1;
-	  }
-     }
-     return 0;                                                           // Timeout reached, return 0
-#endif
-}
-
-
-
-
-// _________________________
-// ::: Special operation :::
-
-
-
-/*!
-  \brief Empty receiver buffer (UNIX only)
-*/
-
-void serialib::FlushReceiver()
-{
-#ifdef __linux__
-     tcflush(fd,TCIFLUSH);
-#endif
-}
-
-
-
-/*!
-  \brief  Return the number of bytes in the received buffer (UNIX only)
-  \return The number of bytes in the received buffer
-*/
-int serialib::Peek()
-{
-     int Nbytes=0;
-#ifdef __linux__
-     ioctl(fd, FIONREAD, &Nbytes);
-#endif
-     return Nbytes;
-}
-
-// ******************************************
-//  Class TimeOut
-// ******************************************
-
-
-/*!
-  \brief      Constructor of the class TimeOut.
-*/
-// Constructor
-TimeOut::TimeOut()
-{}
-
-/*!
-  \brief      Initialise the timer. It writes the current time of the day in the structure PreviousTime.
-*/
-//Initialize the timer
-void TimeOut::InitTimer()
-{
-     gettimeofday(&PreviousTime, NULL);
-}
-
-/*!
-  \brief      Returns the time elapsed since initialization.  It write the current time of the day in the structure CurrentTime.
-  Then it returns the difference between CurrentTime and PreviousTime.
-  \return     The number of microseconds elapsed since the functions InitTimer was called.
-*/
-//Return the elapsed time since initialization
-unsigned long int TimeOut::ElapsedTime_ms()
-{
-     struct timeval CurrentTime;
-     int sec,usec;
-     gettimeofday(&CurrentTime, NULL);                                   // Get current time
-     sec=CurrentTime.tv_sec-PreviousTime.tv_sec;                         // Compute the number of second elapsed since last call
-     usec=CurrentTime.tv_usec-PreviousTime.tv_usec;                      // Compute
-     if (usec<0) {                                                       // If the previous usec is higher than the current one
-	  usec=1000000-PreviousTime.tv_usec+CurrentTime.tv_usec;          // Recompute the microseonds
-	  sec--;                                                          // Substract one second
-     }
-     return sec*1000+usec/1000;
-}
-
+/*!
+  \file    serialib.cpp
+  \brief   Class to manage the serial port
+  \author  Philippe Lucidarme (University of Angers) <serialib@googlegroups.com>
+  \version 1.2
+  \date    28 avril 2011
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+  PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE X CONSORTIUM BE LIABLE FOR ANY CLAIM,
+  DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+  This is a licence-free software, it can be used by anyone who try to build a better world.
+*/
+
+#include <syllo_serial/serialib.h>
+#include <syllo_serial/serialcapture.h>
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <iostream>
+
+
+#ifdef __linux__
+// termios2 as seen by the kernel (asm-generic layout). <asm/termbits.h>
+// cannot be included next to the glibc <termios.h>, so the structure and
+// the ioctls that use it are declared here.
+struct serialib_termios2
+{
+     tcflag_t        c_iflag;
+     tcflag_t        c_oflag;
+     tcflag_t        c_cflag;
+     tcflag_t        c_lflag;
+     cc_t            c_line;
+     cc_t            c_cc[19];
+     speed_t         c_ispeed;
+     speed_t         c_ospeed;
+};
+#define SERIALIB_TCGETS2        _IOR('T', 0x2A, struct serialib_termios2)
+#define SERIALIB_TCSETS2        _IOW('T', 0x2B, struct serialib_termios2)
+#define SERIALIB_BOTHER         0010000                                 // Speed given in c_ispeed / c_ospeed
+#define SERIALIB_IBSHIFT        16                                      // Shift of the input speed in c_cflag
+#endif
+
+
+
+/*!
+  \brief      Constructor of the class serialib.
+*/
+// Class constructor
+serialib::serialib()
+{
+#ifdef __linux__
+     fd=-1;
+     DeviceName[0]=0;
+     RxIn=RxOut=0;
+     ResetRxStats();
+     Capture=NULL;
+#endif
+}
+
+
+/*!
+  \brief      Destructor of the class serialib. It close the connection
+*/
+// Class desctructor
+serialib::~serialib()
+{
+     Close();
+}
+
+
+
+//_________________________________________
+// ::: Configuration and initialization :::
+
+
+
+/*!
+  \brief Open the serial port
+  \param Device : Port name (COM1, COM2, ... for Windows ) or (/dev/ttyS0, /dev/ttyACM0, /dev/ttyUSB0 ... for linux)
+  \param Bauds : Baud rate of the serial port.
+  \param LowLatency : set ASYNC_LOW_LATENCY and a 1 ms USB-serial latency timer
+  when the driver allows it (Linux only, optional)
+
+  \n Supported baud rate for Windows :
+  - 110
+  - 300
+  - 600
+  - 1200
+  - 2400
+  - 4800
+  - 9600
+  - 14400
+  - 19200
+  - 38400
+  - 56000
+  - 57600
+  - 115200
+  - 128000
+  - 256000
+
+  \n Supported baud rate for Linux :\n
+  - 110
+  - 300
+  - 600
+  - 1200
+  - 2400
+  - 4800
+  - 9600
+  - 19200
+  - 38400
+  - 57600
+  - 115200
+  - 230400
+  - 460800
+  - 500000
+  - 576000
+  - 921600
+  - 1000000
+  - 1500000
+  - 2000000
+  - any other rate supported by the driver (termios2 / BOTHER)
+
+  \return 1 success
+  \return -1 device not found
+  \return -2 error while opening the device
+  \return -3 error while getting port parameters
+  \return -4 Speed (Bauds) not recognized
+  \return -5 error while writing port parameters
+  \return -6 error while writing timeout parameters
+*/
+char serialib::Open(const char *Device,const unsigned int Bauds,const bool LowLatency)
+{
+#if defined (_WIN32) || defined( _WIN64)
+
+     // Open serial port
+     hSerial = CreateFileA(  Device,GENERIC_READ | GENERIC_WRITE,0,0,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,0);
+     if(hSerial==INVALID_HANDLE_VALUE) {
+	  if(GetLastError()==ERROR_FILE_NOT_FOUND)
+	       return -1;                                                  // Device not found
+	  return -2;                                                      // Error while opening the device
+     }
+
+     // Set parameters
+     DCB dcbSerialParams = {0};                                          // Structure for the port parameters
+     dcbSerialParams.DCBlength=sizeof(dcbSerialParams);
+     if (!GetCommState(hSerial, &dcbSerialParams))                       // Get the port parameters
+	  return -3;                                                      // Error while getting port parameters
+     switch (Bauds)                                                      // Set the speed (Bauds)
+     {
+     case 110  :     dcbSerialParams.BaudRate=CBR_110; break;
+     case 300  :     dcbSerialParams.BaudRate=CBR_300; break;
+     case 600  :     dcbSerialParams.BaudRate=CBR_600; break;
+     case 1200 :     dcbSerialParams.BaudRate=CBR_1200; break;
+     case 2400 :     dcbSerialParams.BaudRate=CBR_2400; break;
+     case 4800 :     dcbSerialParams.BaudRate=CBR_4800; break;
+     case 9600 :     dcbSerialParams.BaudRate=CBR_9600; break;
+     case 14400 :    dcbSerialParams.BaudRate=CBR_14400; break;
+     case 19200 :    dcbSerialParams.BaudRate=CBR_19200; break;
+     case 38400 :    dcbSerialParams.BaudRate=CBR_38400; break;
+     case 56000 :    dcbSerialParams.BaudRate=CBR_56000; break;
+     case 57600 :    dcbSerialParams.BaudRate=CBR_57600; break;
+     case 115200 :   dcbSerialParams.BaudRate=CBR_115200; break;
+     case 128000 :   dcbSerialParams.BaudRate=CBR_128000; break;
+     case 256000 :   dcbSerialParams.BaudRate=CBR_256000; break;
+     default :       dcbSerialParams.BaudRate=Bauds; break;              // Let the driver accept or refuse it
+     }    
+     dcbSerialParams.ByteSize=8;                                         // 8 bit data
+     dcbSerialParams.StopBits=ONESTOPBIT;                                // One stop bit
+     dcbSerialParams.Parity=NOPARITY;                                    // No parity
+     if(!SetCommState(hSerial, &dcbSerialParams))                        // Write the parameters
+	  return -5;                                                      // Error while writing
+
+     // Set TimeOut
+     timeouts.ReadIntervalTimeout=0;                                     // Set the Timeout parameters
+     timeouts.ReadTotalTimeoutConstant=MAXDWORD;                         // No TimeOut
+     timeouts.ReadTotalTimeoutMultiplier=0;
+     timeouts.WriteTotalTimeoutConstant=MAXDWORD;
+     timeouts.WriteTotalTimeoutMultiplier=0;
+     if(!SetCommTimeouts(hSerial, &timeouts))                            // Write the parameters
+	  return -6;                                                      // Error while writting the parameters
+     return 1;                                                           // Opening successfull
+
+#endif
+#ifdef __linux__    
+     struct termios options;                                             // Structure with the device's options
+
+
+     // Open device
+     fd = open(Device, O_RDWR | O_NOCTTY | O_NDELAY);                    // Open port
+     if (fd == -1) return -2;                                            // If the device is not open, return -1
+     fcntl(fd, F_SETFL, FNDELAY);                                        // Open the device in nonblocking mode
+     RxIn=RxOut=0;                                                       // Empty the receive buffer
+
+     // Set parameters
+     tcgetattr(fd, &options);                                            // Get the current options of the port
+     bzero(&options, sizeof(options));                                   // Clear all the options
+     speed_t         Speed;
+     switch (Bauds)                                                      // Set the speed (Bauds)
+     {
+     case 110  :     Speed=B110; break;
+     case 300  :     Speed=B300; break;
+     case 600  :     Speed=B600; break;
+     case 1200 :     Speed=B1200; break;
+     case 2400 :     Speed=B2400; break;
+     case 4800 :     Speed=B4800; break;
+     case 9600 :     Speed=B9600; break;
+     case 19200 :    Speed=B19200; break;
+     case 38400 :    Speed=B38400; break;
+     case 57600 :    Speed=B57600; break;
+     case 115200 :   Speed=B115200; break;
+     case 230400 :   Speed=B230400; break;
+     case 460800 :   Speed=B460800; break;
+     case 500000 :   Speed=B500000; break;
+     case 576000 :   Speed=B576000; break;
+     case 921600 :   Speed=B921600; break;
+     case 1000000 :  Speed=B1000000; break;
+     case 1500000 :  Speed=B1500000; break;
+     case 2000000 :  Speed=B2000000; break;
+     case 0 :        return -4;
+     default :       Speed=B0; break;                                    // Custom rate, set with termios2 below
+     }
+     if (Speed!=B0)
+     {
+	  cfsetispeed(&options, Speed);                                   // Set the baud rate
+	  cfsetospeed(&options, Speed);
+     }
+     options.c_cflag |= ( CLOCAL | CREAD |  CS8);                        // Configure the device : 8 bits, no parity, no control
+     options.c_iflag |= ( IGNPAR | IGNBRK );
+     options.c_cc[VTIME]=0;                                              // Timer unused
+     options.c_cc[VMIN]=0;                                               // At least on character before satisfy reading
+     tcsetattr(fd, TCSANOW, &options);                                   // Activate the settings
+     if (Speed==B0 && SetCustomBauds(Bauds)!=1)
+	  return -4;                                                      // Speed refused by the driver
+
+     char Path[PATH_MAX];                                                // Kernel name of the tty, for sysfs
+     const char *Name=realpath(Device,Path) ? Path : Device;             // Follow /dev/serial/by-id links
+     const char *Slash=strrchr(Name,'/');
+     strncpy(DeviceName,Slash ? Slash+1 : Name,sizeof(DeviceName)-1);
+     DeviceName[sizeof(DeviceName)-1]=0;
+
+     if (LowLatency)                                                     // Best effort : ptys and most
+     {                                                                   // built-in UARTs have no timer
+	  SetLowLatency(true);
+	  SetLatencyTimer(1);
+     }
+     return (1);                                                         // Success
+#endif
+}
+
+
+#ifdef __linux__
+/*!
+  \brief Set a line rate that has no Bxxx constant (Linux only)
+  \param Bauds : Baud rate of the serial port
+  \return 1 success
+  \return -1 error while getting or writing the port parameters
+*/
+char serialib::SetCustomBauds(unsigned int Bauds)
+{
+     struct serialib_termios2 Options;
+     if (ioctl(fd,SERIALIB_TCGETS2,&Options)<0) return -1;               // Get the current options
+     Options.c_cflag&=~(CBAUD | (CBAUD<<SERIALIB_IBSHIFT));              // Clear both speeds
+     Options.c_cflag|=SERIALIB_BOTHER | (SERIALIB_BOTHER<<SERIALIB_IBSHIFT);
+     Options.c_ispeed=Bauds;
+     Options.c_ospeed=Bauds;
+     if (ioctl(fd,SERIALIB_TCSETS2,&Options)<0) return -1;               // Write the options
+     return 1;
+}
+
+
+
+/*!
+  \brief Read back the configuration of the port (Linux only)
+  \param pConfig : effective line rate, low latency flag and latency timer
+  \return 1 success
+  \return -1 error while getting the port parameters
+*/
+char serialib::GetConfig(Config *pConfig)
+{
+     struct serialib_termios2 Options;
+     if (ioctl(fd,SERIALIB_TCGETS2,&Options)<0) return -1;               // The driver reports the real rate
+     pConfig->Bauds=Options.c_ospeed;
+
+     struct serial_struct Serial;
+     pConfig->LowLatency=(ioctl(fd,TIOCGSERIAL,&Serial)==0 && (Serial.flags & ASYNC_LOW_LATENCY));
+     pConfig->LatencyTimer_ms=GetLatencyTimer();
+     return 1;
+}
+
+
+
+/*!
+  \brief Set or clear ASYNC_LOW_LATENCY on the driver (Linux only)
+  With the flag set, received bytes are pushed to the reader as soon as
+  they arrive instead of being batched by the tty layer.
+  \param Enable : true to set the flag, false to clear it
+  \return 1 success
+  \return -1 the driver does not support it
+*/
+char serialib::SetLowLatency(bool Enable)
+{
+     struct serial_struct Serial;
+     if (ioctl(fd,TIOCGSERIAL,&Serial)<0) return -1;
+     if (Enable) Serial.flags|=ASYNC_LOW_LATENCY;
+     else Serial.flags&=~ASYNC_LOW_LATENCY;
+     if (ioctl(fd,TIOCSSERIAL,&Serial)<0) return -1;
+     return 1;
+}
+
+
+
+/*!
+  \brief Read the latency timer of a USB-serial adapter (Linux only)
+  The adapter holds received bytes for up to this delay before sending
+  them to the host (16 ms by default on FTDI chips).
+  \return >=0 latency timer in milliseconds
+  \return -1 the adapter has no latency timer
+*/
+int serialib::GetLatencyTimer()
+{
+     char Path[96];
+     snprintf(Path,sizeof(Path),"/sys/class/tty/%s/device/latency_timer",DeviceName);
+     FILE *File=fopen(Path,"r");
+     if (File==NULL) return -1;
+     int Latency=-1;
+     if (fscanf(File,"%d",&Latency)!=1) Latency=-1;
+     fclose(File);
+     return Latency;
+}
+
+
+
+/*!
+  \brief Write the latency timer of a USB-serial adapter (Linux only)
+  Writing the sysfs attribute usually needs root or a udev rule.
+  \param Latency_ms : latency timer in milliseconds (1 to 255)
+  \return 1 success
+  \return -1 the adapter has no latency timer or it can not be written
+*/
+char serialib::SetLatencyTimer(int Latency_ms)
+{
+     char Path[96];
+     snprintf(Path,sizeof(Path),"/sys/class/tty/%s/device/latency_timer",DeviceName);
+     FILE *File=fopen(Path,"w");
+     if (File==NULL) return -1;
+     int Ret=fprintf(File,"%d",Latency_ms);
+     if (fclose(File)!=0 || Ret<0) return -1;
+     return 1;
+}
+#endif
+
+
+
+/*!
+  \brief Close the connection with the current device
+*/
+void serialib::Close()
+{
+#if defined (_WIN32) || defined( _WIN64)
+     CloseHandle(hSerial);
+#endif
+#ifdef __linux__
+     close (fd);
+#endif
+}
+
+
+
+
+//___________________________________________
+// ::: Read/Write operation on characters :::
+
+
+
+/*!
+  \brief Write a char on the current serial port
+  \param Byte : char to send on the port (must be terminated by '\0')
+  \return 1 success
+  \return -1 error while writting data
+*/
+char serialib::WriteChar(const char Byte)
+{
+#if defined (_WIN32) || defined( _WIN64)
+     DWORD dwBytesWritten;                                               // Number of bytes written
+     if(!WriteFile(hSerial,&Byte,1,&dwBytesWritten,NULL))                // Write the char
+	  return -1;                                                      // Error while writing
+     return 1;                                                           // Write operation successfull
+#endif
+#ifdef __linux__
+     if (write(fd,&Byte,1)!=1)                                           // Write the char
+	  return -1;                                                      // Error while writting
+     if (Capture) Capture->Record(SerialCapture::Tx,&Byte,1);
+     return 1;                                                           // Write operation successfull
+#endif
+}
+
+
+
+//________________________________________
+// ::: Read/Write operation on strings :::
+
+
+/*!
+  \brief Write a string on the current serial port
+  \param String : string to send on the port (must be terminated by '\0')
+  \return 1 success
+  \return -1 error while writting data
+*/
+char serialib::WriteString(const char *String)
+{
+#if defined (_WIN32) || defined( _WIN64)
+     DWORD dwBytesWritten;                                               // Number of bytes written
+     if(!WriteFile(hSerial,String,strlen(String),&dwBytesWritten,NULL))  // Write the string
+	  return -1;                                                      // Error while writing
+     return 1;                                                           // Write operation successfull
+#endif
+#ifdef __linux__
+     int Lenght=strlen(String);                                          // Lenght of the string
+     if (write(fd,String,Lenght)!=Lenght)                                // Write the string
+	  return -1;                                                      // error while writing
+     if (Capture) Capture->Record(SerialCapture::Tx,String,Lenght);
+     return 1;                                                           // Write operation successfull
+#endif
+}
+
+// _____________________________________
+// ::: Read/Write operation on bytes :::
+
+
+
+/*!
+  \brief Write an array of data on the current serial port
+  \param Buffer : array of bytes to send on the port
+  \param NbBytes : number of byte to send
+  \return 1 success
+  \return -1 error while writting data
+*/
+char serialib::Write(const void *Buffer, const unsigned int NbBytes)
+{
+#if defined (_WIN32) || defined( _WIN64)
+     DWORD dwBytesWritten;                                               // Number of byte written
+     if(!WriteFile(hSerial, Buffer, NbBytes, &dwBytesWritten, NULL))     // Write data
+	  return -1;                                                      // Error while writing
+     return 1;                                                           // Write operation successfull
+#endif
+#ifdef __linux__
+     if (write (fd,Buffer,NbBytes)!=(ssize_t)NbBytes)                              // Write data
+	  return -1;                                                      // Error while writing
+     if (Capture) Capture->Record(SerialCapture::Tx,Buffer,NbBytes);
+     return 1;                                                           // Write operation successfull
+#endif
+}
+
+
+
+#ifdef __linux__
+/*!
+  \brief Write several buffers on the current serial port with one writev() call
+  The buffers are sent back to back, in order, without being copied into an
+  intermediate buffer. A short write (full output queue of the non-blocking
+  port) is completed by waiting for the port to drain and writing the rest.
+  \param Iov : array of buffers to send on the port
+  \param IovCnt : number of buffers in Iov (at most IOV_MAX)
+  \return 1 success
+  \return -1 error while writting data
+*/
+char serialib::WriteV(const struct iovec *Iov, int IovCnt)
+{
+     ssize_t Ret;
+     do Ret=writev(fd,Iov,IovCnt);                                       // Write everything at once
+     while (Ret<0 && errno==EINTR);
+     if (Ret<0)
+     {
+	  if (errno!=EAGAIN && errno!=EWOULDBLOCK) return -1;             // Error while writing
+	  Ret=0;
+     }
+
+     size_t Skip=Ret;                                                    // Bytes already sent
+     for (int i=0;i<IovCnt;i++)
+     {
+	  if (Skip>=Iov[i].iov_len)                                       // Buffer fully written
+	  {
+	       Skip-=Iov[i].iov_len;
+	       continue;
+	  }
+	  const char *Data=(const char*)Iov[i].iov_base+Skip;             // Finish a short write
+	  size_t Left=Iov[i].iov_len-Skip;
+	  Skip=0;
+	  while (Left>0)
+	  {
+	       struct pollfd Pfd;                                         // Wait until the port can accept data
+	       Pfd.fd=fd;
+	       Pfd.events=POLLOUT;
+	       if (poll(&Pfd,1,-1)<0 && errno!=EINTR) return -1;
+	       ssize_t n=write(fd,Data,Left);
+	       if (n<0)
+	       {
+		    if (errno==EINTR || errno==EAGAIN || errno==EWOULDBLOCK) continue;
+		    return -1;                                            // Error while writing
+	       }
+	       Data+=n;
+	       Left-=n;
+	  }
+     }
+     if (Capture) Capture->Record(SerialCapture::Tx,Iov,IovCnt);
+     return 1;                                                           // Write operation successfull
+}
+
+
+
+/*!
+  \brief Write several buffers on the current serial port without waiting for it (Linux only)
+  A single writev() sends what the output queue of the non-blocking port
+  can take. The caller keeps the rest and writes it once the port is
+  writable again (POLLOUT).
+  \param Iov : array of buffers to send on the port
+  \param IovCnt : number of buffers in Iov (at most IOV_MAX)
+  \return >=0 number of bytes written, 0 if the output queue is full
+  \return -1 error while writting data
+*/
+int serialib::WriteVNonBlocking(const struct iovec *Iov, int IovCnt)
+{
+     ssize_t Ret;
+     do Ret=writev(fd,Iov,IovCnt);
+     while (Ret<0 && errno==EINTR);
+     if (Ret<0)
+     {
+	  if (errno!=EAGAIN && errno!=EWOULDBLOCK) return -1;             // Error while writing
+	  return 0;                                                       // Output queue full
+     }
+
+     if (Capture)                                                        // Only the bytes written
+     {
+	  size_t Left=Ret;
+	  int Full=0;
+	  while (Full<IovCnt && Iov[Full].iov_len<=Left) Left-=Iov[Full++].iov_len;
+	  Capture->Record(SerialCapture::Tx,Iov,Full);
+	  if (Left>0) Capture->Record(SerialCapture::Tx,Iov[Full].iov_base,Left);
+     }
+     return Ret;
+}
+#endif
+
+
+
+/*!
+  \brief Wait for a byte from the serial device and return the data read
+  \param pByte : data read on the serial device
+  \param TimeOut_ms : delay of timeout before giving up the reading
+  If set to zero, timeout is disable (Optional)
+  \return 1 success
+  \return 0 Timeout reached
+  \return -1 error while setting the Timeout
+  \return -2 error while reading the byte
+*/
+char serialib::ReadChar(char *pByte,unsigned int TimeOut_ms)
+{
+#if defined (_WIN32) || defined(_WIN64)
+
+     DWORD dwBytesRead = 0;
+     timeouts.ReadTotalTimeoutConstant=TimeOut_ms;                       // Set the TimeOut
+     if(!SetCommTimeouts(hSerial, &timeouts))                            // Write the parameters
+	  return -1;                                                      // Error while writting the parameters
+     if(!ReadFile(hSerial,pByte, 1, &dwBytesRead, NULL))                 // Read the byte
+	  return -2;                                                      // Error while reading the byte
+     if (dwBytesRead==0) return 0;                                       // Return 1 if the timeout is reached
+     return 1;                                                           // Success
+#endif
+#ifdef __linux__
+     if (RxIn==RxOut)                                                    // Nothing buffered : wait for the device
+     {
+	  TimeOut     Timer;                                              // Timer used for timeout
+	  Timer.InitTimer();                                              // Initialise the timer
+	  int Ret=ReceiveBytes(Timer,TimeOut_ms);
+	  if (Ret<=0) return Ret;                                         // Timeout reached or error
+     }
+     *pByte=RxBuffer[RxOut++ & (SERIALIB_RX_BUFFER_SIZE-1)];             // Serve the byte from the buffer
+     return 1;                                                           // Read successfull
+#endif
+}
+
+/*!
+  \brief Read a string from the serial device (without TimeOut)
+  \param String : string read on the serial device
+  \param FinalChar : final char of the string
+  \param MaxNbBytes : maximum allowed number of bytes read
+  \return >0 success, return the number of bytes read
+  \return -1 error while setting the Timeout
+  \return -2 error while reading the byte
+  \return -3 MaxNbBytes is reached
+*/
+int serialib::ReadStringNoTimeOut(char *String,char FinalChar,unsigned int MaxNbBytes)
+{
+     unsigned int    NbBytes=0;                                          // Number of bytes read
+     char            ret;                                                // Returned value from Read
+     while (NbBytes<MaxNbBytes)                                          // While the buffer is not full
+     {                                                                   // Read a byte with the restant time
+	  ret=ReadChar(&String[NbBytes],0);
+	  if (ret==1)                                                     // If a byte has been read
+	  {
+	       if (String[NbBytes]==FinalChar)                             // Check if it is the final char
+	       {
+		    String  [++NbBytes]=0;                                  // Yes : add the end character 0
+		    return NbBytes;                                         // Return the number of bytes read
+	       }
+	       NbBytes++;                                                  // If not, just increase the number of bytes read
+	  }
+	  if (ret<0) return ret;                                          // Error while reading : return the error number
+     }
+     return -3;                                                          // Buffer is full : return -3
+}
+
+/*!
+  \brief Read a string from the serial device (with timeout)
+  \param String : string read on the serial device
+  \param FinalChar : final char of the string
+  \param MaxNbBytes : maximum allowed number of bytes read
+  \param TimeOut_ms : delay of timeout before giving up the reading (optional)
+  \return  >0 success, return the number of bytes read
+  \return  0 timeout is reached
+  \return -1 error while setting the Timeout
+  \return -2 error while reading the byte
+  \return -3 MaxNbBytes is reached
+*/
+int serialib::ReadString(char *String,char FinalChar,unsigned int MaxNbBytes,unsigned int TimeOut_ms)
+{
+     if (TimeOut_ms==0)
+	  return ReadStringNoTimeOut(String,FinalChar,MaxNbBytes);
+
+     unsigned int    NbBytes=0;                                          // Number of bytes read
+     char            ret;                                                // Returned value from Read
+     TimeOut         Timer;                                              // Timer used for timeout
+     long int        TimeOutParam;
+     Timer.InitTimer();                                                  // Initialize the timer
+
+     while (NbBytes<MaxNbBytes)                                          // While the buffer is not full
+     {                                                                   // Read a byte with the restant time
+	  TimeOutParam=TimeOut_ms-Timer.ElapsedTime_ms();                 // Compute the TimeOut for the call of ReadChar
+	  if (TimeOutParam>0)                                             // If the parameter is higher than zero
+	  {
+	       ret=ReadChar(&String[NbBytes],TimeOutParam);                // Wait for a byte on the serial link            
+	       if (ret==1)                                                 // If a byte has been read
+	       {
+
+		    if (String[NbBytes]==FinalChar)                         // Check if it is the final char
+		    {
+			 String  [++NbBytes]=0;                              // Yes : add the end character 0
+			 return NbBytes;                                     // Return the number of bytes read
+		    }
+		    NbBytes++;                                              // If not, just increase the number of bytes read
+	       }
+	       if (ret<0) return ret;                                      // Error while reading : return the error number
+	  }
+	  if (Timer.ElapsedTime_ms()>TimeOut_ms) {                        // Timeout is reached
+	       String[NbBytes]=0;                                          // Add the end caracter
+	       return 0;                                                   // Return 0
+	  }
+     }
+     return -3;                                                          // Buffer is full : return -3
+}
+
+#define IDLE_STATE 0
+#define DATA_LENGTH_0_STATE 1
+#define DATA_LENGTH_1_STATE 2
+#define DATA_STATE 3
+#define CHECKSUM_STATE 4
+
+#define ESC 0x7d
+#define esc(byte) ((byte) ^ 0x20)
+
+int serialib::ReadString_Digi_API(char *String,char StartChar,unsigned int MaxNbBytes,unsigned int TimeOut_ms)
+{
+     if (TimeOut_ms==0)
+	  return ReadStringNoTimeOut(String,StartChar,MaxNbBytes);
+
+     unsigned int    NbBytes=0;                                          // Number of bytes read
+     char            ret;                                                // Returned value from Read
+     TimeOut         Timer;                                              // Timer used for timeout
+     long int        TimeOutParam;
+     Timer.InitTimer();                                                  // Initialize the timer
+
+     int state = IDLE_STATE;
+     int dataLength = 0;
+
+     while (NbBytes<MaxNbBytes)                                          // While the buffer is not full
+     {                                                                   // Read a byte with the restant time
+	  TimeOutParam=TimeOut_ms-Timer.ElapsedTime_ms();                 // Compute the TimeOut for the call of ReadChar
+	  if (TimeOutParam>0)                                             // If the parameter is higher than zero
+	  {
+	       ret=ReadChar(&String[NbBytes],TimeOutParam);                // Wait for a byte on the serial link            
+	       if (ret==1)                                                 // If a byte has been read
+	       {
+		    switch (state) {
+		    case IDLE_STATE:
+			 if (String[NbBytes]==StartChar) {
+			      state = DATA_LENGTH_0_STATE;
+			      NbBytes++;
+			 }
+			 break;
+		    case DATA_LENGTH_0_STATE:
+			 if (String[NbBytes]==ESC) {
+			      ret=ReadChar(&String[NbBytes],TimeOutParam);
+			      String[NbBytes] = esc(String[NbBytes]);
+			 }
+			 state = DATA_LENGTH_1_STATE;
+			 dataLength = (String[NbBytes] << 8) & 0xFF00;
+			 NbBytes++;
+			 break;
+		    case DATA_LENGTH_1_STATE:
+			 if (String[NbBytes]==ESC) {
+			      ret=ReadChar(&String[NbBytes],TimeOutParam);
+			      String[NbBytes] = esc(String[NbBytes]);
+			 }
+			 state = DATA_STATE;
+			 dataLength += ((String[NbBytes]) & 0x00FF);
+			 NbBytes++;
+			 break;
+		    case DATA_STATE:
+			 if (String[NbBytes]==ESC) {
+			      ret=ReadChar(&String[NbBytes],TimeOutParam);
+			      String[NbBytes] = esc(String[NbBytes]);
+			 }
+			 NbBytes++;
+			 dataLength--;
+			 
+			 if (dataLength == 0) {
+			      state = CHECKSUM_STATE;
+			 }
+			 break;
+		    case CHECKSUM_STATE:
+			 if (String[NbBytes]==ESC) {
+			      ret=ReadChar(&String[NbBytes],TimeOutParam);
+			      String[NbBytes] = esc(String[NbBytes]);
+			 }
+			 
+			 NbBytes++;
+			 return NbBytes;
+
+			 break;
+		    default:
+			 break;
+		    }
+		    
+		    
+		    //if (String[NbBytes]==StartChar)                         // Check if it is the start char
+		    //{
+		    //	 String  [++NbBytes]=0;                              // Yes : add the end character 0
+		    //	 return NbBytes;                                     // Return the number of bytes read
+		    //}
+		    //NbBytes++;                                              // If not, just increase the number of bytes read
+	       }
+	       if (ret<0) return ret;                                      // Error while reading : return the error number
+	  }
+	  if (Timer.ElapsedTime_ms()>TimeOut_ms) {                        // Timeout is reached
+	       String[NbBytes]=0;                                          // Add the end caracter
+	       return 0;                                                   // Return 0
+	  }
+     }
+     return -3;                                                          // Buffer is full : return -3
+}
+
+
+/*!
+  \brief Read an array of bytes from the serial device (with timeout)
+  \param Buffer : array of bytes read from the serial device
+  \param MaxNbBytes : maximum allowed number of bytes read
+  \param TimeOut_ms : delay of timeout before giving up the reading
+  \return 1 success, return the number of bytes read
+  \return 0 Timeout reached
+  \return -1 error while setting the Timeout
+  \return -2 error while reading the byte
+*/
+int serialib::Read (void *Buffer,unsigned int MaxNbBytes,unsigned int TimeOut_ms)
+{
+#if defined (_WIN32) || defined(_WIN64)
+     DWORD dwBytesRead = 0;
+     timeouts.ReadTotalTimeoutConstant=(DWORD)TimeOut_ms;                // Set the TimeOut
+     if(!SetCommTimeouts(hSerial, &timeouts))                            // Write the parameters
+	  return -1;                                                      // Error while writting the parameters
+     if(!ReadFile(hSerial,Buffer,(DWORD)MaxNbBytes,&dwBytesRead, NULL))  // Read the bytes from the serial device
+	  return -2;                                                      // Error while reading the byte
+     if (dwBytesRead!=(DWORD)MaxNbBytes) return 0;                       // Return 0 if the timeout is reached
+     return 1;                                                           // Success
+#endif
+#ifdef __linux__
+     TimeOut          Timer;                                             // Timer used for timeout
+     Timer.InitTimer();                                                  // Initialise the timer
+     unsigned int     NbByteRead=PopRxBuffer(Buffer,MaxNbBytes);        // Start with the buffered bytes
+     while (NbByteRead<MaxNbBytes)
+     {
+	  int Ret=ReceiveBytes(Timer,TimeOut_ms);                         // Sleep until more bytes arrive
+	  if (Ret<=0) return Ret;                                         // Timeout reached or error
+	  unsigned char* Ptr=(unsigned char*)Buffer+NbByteRead;           // Compute the position of the current byte
+	  NbByteRead+=PopRxBuffer(Ptr,MaxNbBytes-NbByteRead);             // Increase the number of read bytes
+     }
+     return 1;                                                           // Success : bytes has been read
+#endif
+}
+
+
+/*!
+  \brief Read the bytes already received by the serial device in a single call
+  Waits until at least one byte is available, then returns the buffered
+  bytes (up to MaxNbBytes) without waiting for more.
+  \param Buffer : array of bytes read from the serial device
+  \param MaxNbBytes : maximum allowed number of bytes read
+  \param TimeOut_ms : delay of timeout before giving up the reading
+  If set to zero, timeout is disable (Optional)
+  \return >0 success, return the number of bytes read
+  \return 0 Timeout reached
+  \return -1 error while setting the Timeout
+  \return -2 error while reading the bytes
+*/
+int serialib::ReadAvailable (void *Buffer,unsigned int MaxNbBytes,unsigned int TimeOut_ms)
+{
+#if defined (_WIN32) || defined(_WIN64)
+     DWORD dwBytesRead = 0;
+     timeouts.ReadTotalTimeoutConstant=(DWORD)TimeOut_ms;                // Set the TimeOut
+     if(!SetCommTimeouts(hSerial, &timeouts))                            // Write the parameters
+	  return -1;                                                      // Error while writting the parameters
+     if(!ReadFile(hSerial,Buffer,(DWORD)MaxNbBytes,&dwBytesRead, NULL))  // Read the bytes from the serial device
+	  return -2;                                                      // Error while reading the byte
+     return dwBytesRead;                                                 // Number of bytes read, 0 on timeout
+#endif
+#ifdef __linux__
+     if (RxIn==RxOut)                                                    // Nothing buffered : wait for the device
+     {
+	  TimeOut     Timer;                                              // Timer used for timeout
+	  Timer.InitTimer();                                              // Initialise the timer
+	  int Ret=ReceiveBytes(Timer,TimeOut_ms);
+	  if (Ret<=0) return Ret;                                         // Timeout reached or error
+     }
+     return PopRxBuffer(Buffer,MaxNbBytes);                              // Return the number of bytes read
+#endif
+}
+
+
+
+#ifdef __linux__
+/*!
+  \brief Read the bytes already received by the serial device without waiting (Linux only)
+  Returns the buffered bytes, or whatever the driver holds right now, and
+  never sleeps : meant for an event loop that was told the port is readable.
+  A wake-up with nothing to read returns 0.
+  \param Buffer : array of bytes read from the serial device
+  \param MaxNbBytes : maximum allowed number of bytes read
+  \return >0 success, return the number of bytes read
+  \return 0 no data available
+  \return -1 error while polling the device
+  \return -2 error while reading the bytes (or device hung up)
+*/
+int serialib::ReadNonBlocking (void *Buffer,unsigned int MaxNbBytes)
+{
+     if (RxIn==RxOut)                                                    // Nothing buffered : ask the device
+     {
+	  struct pollfd   Pfd;
+	  Pfd.fd=fd;
+	  Pfd.events=POLLIN;
+	  int Ret;
+	  do Ret=poll(&Pfd,1,0);                                          // Zero timeout : only check
+	  while (Ret<0 && errno==EINTR);
+	  if (Ret<0) return -1;                                           // Error while polling
+	  if (Ret==0) return 0;                                           // No data available
+	  Ret=FillRxBuffer();
+	  if (Ret<=0) return Ret;                                         // Spurious wake-up or error
+     }
+     return PopRxBuffer(Buffer,MaxNbBytes);                              // Return the number of bytes read
+}
+#endif
+
+
+
+
+// _________________________
+// ::: Special operation :::
+
+
+
+/*!
+  \brief Empty receiver buffer (UNIX only)
+*/
+
+void serialib::FlushReceiver()
+{
+#ifdef __linux__
+     tcflush(fd,TCIFLUSH);
+     RxOut=RxIn;                                                         // Drop the buffered bytes too
+#endif
+}
+
+
+
+#ifdef __linux__
+/*!
+  \brief Sleep in poll() until the device is readable (Linux only)
+  \param Timer : timer started at the beginning of the read operation
+  \param TimeOut_ms : timeout of the whole read operation, zero waits forever
+  \return 1 data available (or hang up / error pending on the device)
+  \return 0 Timeout reached
+  \return -1 error while waiting
+*/
+int serialib::WaitReadable(TimeOut &Timer, unsigned int TimeOut_ms)
+{
+     struct pollfd   Pfd;
+     Pfd.fd=fd;
+     Pfd.events=POLLIN;
+     for (;;)
+     {
+	  int Wait=-1;                                                    // No timeout : block until data
+	  if (TimeOut_ms>0)
+	  {
+	       unsigned long Elapsed=Timer.ElapsedTime_ms();
+	       if (Elapsed>=TimeOut_ms) return 0;                          // Timeout reached
+	       Wait=TimeOut_ms-Elapsed;                                    // Remaining time
+	  }
+	  int Ret=poll(&Pfd,1,Wait);
+	  if (Ret>0) return 1;                                            // Device readable
+	  if (Ret<0 && errno!=EINTR) return -1;                           // Error while waiting
+     }
+}
+
+
+
+/*!
+  \brief Wait for the device and move everything it holds into the receive buffer (Linux only)
+  The receive buffer must be empty.
+  \param Timer : timer started at the beginning of the read operation
+  \param TimeOut_ms : timeout of the whole read operation, zero waits forever
+  \return >0 number of bytes received
+  \return 0 Timeout reached
+  \return -2 error while reading (or device hung up)
+*/
+int serialib::ReceiveBytes(TimeOut &Timer, unsigned int TimeOut_ms)
+{
+     for (;;)
+     {
+	  int Wait=WaitReadable(Timer,TimeOut_ms);                        // Sleep until data arrives
+	  if (Wait==0) return 0;                                          // Timeout reached
+	  if (Wait<0) return -2;                                          // Error while waiting
+	  int Ret=FillRxBuffer();
+	  if (Ret!=0) return Ret;                                         // Bytes received or error
+     }
+}
+
+
+
+/*!
+  \brief Move everything the readable device holds into the receive buffer (Linux only)
+  The receive buffer must be empty. A single readv() takes as many bytes as
+  the buffer can hold, so a whole response costs one or two system calls.
+  \return >0 number of bytes received
+  \return 0 nothing to read after all
+  \return -2 error while reading (or device hung up)
+*/
+int serialib::FillRxBuffer()
+{
+     unsigned int In=RxIn & (SERIALIB_RX_BUFFER_SIZE-1);                  // Free space, wrapping around the end
+     unsigned int Free=SERIALIB_RX_BUFFER_SIZE-(RxIn-RxOut);
+     struct iovec Iov[2];
+     Iov[0].iov_base=RxBuffer+In;
+     Iov[0].iov_len=SERIALIB_RX_BUFFER_SIZE-In;
+     if (Iov[0].iov_len>Free) Iov[0].iov_len=Free;
+     Iov[1].iov_base=RxBuffer;
+     Iov[1].iov_len=Free-Iov[0].iov_len;
+
+     ssize_t Ret=readv(fd,Iov,Iov[1].iov_len>0 ? 2 : 1);                  // Grab everything the driver holds
+     if (Ret>0)
+     {
+	  RxIn+=Ret;
+	  if (RxIn-RxOut>RxHighWater) RxHighWater=RxIn-RxOut;              // Track the buffer usage
+	  if ((unsigned int)Ret==Free) RxOverruns++;                       // Reader falls behind the device
+	  if (Capture)
+	  {
+	       if ((size_t)Ret<=Iov[0].iov_len) Iov[0].iov_len=Ret;           // Only the bytes received
+	       Iov[1].iov_len=Ret-Iov[0].iov_len;
+	       Capture->Record(SerialCapture::Rx,Iov,Iov[1].iov_len>0 ? 2 : 1);
+	  }
+	  return Ret;
+     }
+     if (Ret==0) return -2;                                               // Readable but empty : device hung up
+     if (errno!=EAGAIN && errno!=EINTR) return -2;                        // Error while reading
+     return 0;
+}
+
+
+
+/*!
+  \brief Copy bytes out of the receive buffer (Linux only)
+  \param Buffer : destination of the bytes
+  \param MaxNbBytes : maximum number of bytes copied
+  \return The number of bytes copied
+*/
+unsigned int serialib::PopRxBuffer(void *Buffer, unsigned int MaxNbBytes)
+{
+     unsigned int NbBytes=RxIn-RxOut;
+     if (NbBytes>MaxNbBytes) NbBytes=MaxNbBytes;
+     unsigned int Out=RxOut & (SERIALIB_RX_BUFFER_SIZE-1);
+     unsigned int First=SERIALIB_RX_BUFFER_SIZE-Out;                     // Bytes before the end of the buffer
+     if (First>NbBytes) First=NbBytes;
+     memcpy(Buffer,RxBuffer+Out,First);
+     memcpy((unsigned char*)Buffer+First,RxBuffer,NbBytes-First);        // Wrapped part
+     RxOut+=NbBytes;
+     return NbBytes;
+}
+
+
+
+/*!
+  \brief Reset the receive buffer statistics (Linux only)
+*/
+void serialib::ResetRxStats()
+{
+     RxHighWater=RxIn-RxOut;
+     RxOverruns=0;
+}
+
+
+
+/*!
+  \brief Wait until at least one of several serial ports has data to read (Linux only)
+  The calling thread sleeps in a single poll() on all the ports.
+  \param Ports : ports to watch (opened)
+  \param NbPorts : number of ports in Ports (at most SERIALIB_MAX_WAIT)
+  \param Ready : for each port, set to 1 if it can be read without blocking, 0 otherwise
+  \param TimeOut_ms : delay of timeout before giving up the waiting
+  If set to zero, timeout is disable (Optional)
+  \return >0 number of ports ready to be read
+  \return 0 Timeout reached
+  \return -1 error while waiting
+*/
+int serialib::WaitForData(serialib *const *Ports, int NbPorts, int *Ready, const unsigned int TimeOut_ms)
+{
+     if (NbPorts<=0 || NbPorts>SERIALIB_MAX_WAIT) return -1;            // Too many ports for one call
+     struct pollfd   Pfd[SERIALIB_MAX_WAIT];
+     for (int i=0;i<NbPorts;i++)
+     {
+	  Pfd[i].fd=Ports[i]->fd;
+	  Pfd[i].events=POLLIN;
+	  Pfd[i].revents=0;
+     }
+
+     bool            Buffered=false;                                     // Some data already waits in a buffer
+     for (int i=0;i<NbPorts;i++)
+	  if (Ports[i]->RxIn!=Ports[i]->RxOut) Buffered=true;
+
+     TimeOut         Timer;                                              // Timer used for timeout
+     Timer.InitTimer();
+     int             Ret;
+     for (;;)
+     {
+	  int Wait=-1;                                                    // No timeout : block until data
+	  if (Buffered)
+	       Wait=0;                                                     // Only collect the other ports
+	  else if (TimeOut_ms>0)
+	  {
+	       unsigned long Elapsed=Timer.ElapsedTime_ms();
+	       Wait=Elapsed>=TimeOut_ms ? 0 : TimeOut_ms-Elapsed;          // Remaining time
+	  }
+	  Ret=poll(Pfd,NbPorts,Wait);
+	  if (Ret>=0) break;
+	  if (errno!=EINTR) return -1;                                    // Error while waiting
+     }
+
+     Ret=0;
+     for (int i=0;i<NbPorts;i++)
+     {
+	  Ready[i]=(Pfd[i].revents!=0 || Ports[i]->RxIn!=Ports[i]->RxOut); // Data, hang up or error pending
+	  Ret+=Ready[i];
+     }
+     return Ret;
+}
+#endif
+
+
+
+/*!
+  \brief  Return the number of bytes in the received buffer (UNIX only)
+  \return The number of bytes in the received buffer (driver and serialib buffers)
+*/
+int serialib::Peek()
+{
+     int Nbytes=0;
+#ifdef __linux__
+     ioctl(fd, FIONREAD, &Nbytes);
+     Nbytes+=RxIn-RxOut;
+#endif
+     return Nbytes;
+}
+
+// ******************************************
+//  Class TimeOut
+// ******************************************
+
+
+/*!
+  \brief      Constructor of the class TimeOut.
+*/
+// Constructor
+TimeOut::TimeOut()
+{}
+
+/*!
+  \brief      Initialise the timer. It writes the current time of the day in the structure PreviousTime.
+*/
+//Initialize the timer
+void TimeOut::InitTimer()
+{
+#ifdef __linux__
+     clock_gettime(CLOCK_MONOTONIC, &PreviousTime);
+#else
+     gettimeofday(&PreviousTime, NULL);
+#endif
+}
+
+/*!
+  \brief      Returns the time elapsed since initialization.  It write the current time of the day in the structure CurrentTime.
+  Then it returns the difference between CurrentTime and PreviousTime.
+  \return     The number of microseconds elapsed since the functions InitTimer was called.
+*/
+//Return the elapsed time since initialization
+unsigned long int TimeOut::ElapsedTime_ms()
+{
+#ifdef __linux__
+     struct timespec CurrentTime;
+     clock_gettime(CLOCK_MONOTONIC, &CurrentTime);                       // Get current time, never goes backwards
+     long long nsec=(CurrentTime.tv_sec-PreviousTime.tv_sec)*1000000000LL
+	  +(CurrentTime.tv_nsec-PreviousTime.tv_nsec);                    // Nanoseconds elapsed
+     return nsec/1000000;
+#else
+     struct timeval CurrentTime;
+     int sec,usec;
+     gettimeofday(&CurrentTime, NULL);                                   // Get current time
+     sec=CurrentTime.tv_sec-PreviousTime.tv_sec;                         // Compute the number of second elapsed since last call
+     usec=CurrentTime.tv_usec-PreviousTime.tv_usec;                      // Compute
+     if (usec<0) {                                                       // If the previous usec is higher than the current one
+	  usec=1000000-PreviousTime.tv_usec+CurrentTime.tv_usec;          // Recompute the microseonds
+	  sec--;                                                          // Substract one second
+     }
+     return sec*1000+usec/1000;
+#endif
+}
+
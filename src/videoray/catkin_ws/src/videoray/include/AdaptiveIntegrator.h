@@ -0,0 +1,189 @@
+#ifndef ADAPTIVE_INTEGRATOR_H_
+#define ADAPTIVE_INTEGRATOR_H_
+/// ---------------------------------------------------------------------------
+/// @file AdaptiveIntegrator.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// Error-controlled integration of the vehicle model for the simulators,
+/// sampled at their fixed output rate.
+///
+/// odeint's dense output Dormand-Prince stepper picks its own steps to
+/// hold the local error within the tolerances: long steps while the
+/// vehicle cruises, short ones through thrust transients and the fast
+/// yaw-rate mode. The state is interpolated at the end of each output
+/// period, so the simulators publish on an exact grid whatever the steps
+/// were. The model's input (thrust) is constant over a period; the
+/// stepper carries on across periods while it stays the same and starts
+/// again from the interpolated state when it changes, so no step ever
+/// straddles a thrust change.
+///
+/// Accepted steps, rejected steps and restarts are counted; the
+/// rejections come from the error checker, which the dense output stepper
+/// otherwise hides.
+///
+/// ----------------------------------------------------------------------------
+
+#include <algorithm>
+
+#include <boost/numeric/odeint.hpp>
+
+template <class State>
+class AdaptiveIntegrator {
+public:
+
+     struct Config {
+          double abs_tol;
+          double rel_tol;
+          double initial_dt;             // first step (s)
+     };
+
+     struct Stats {
+          unsigned long outputs;
+          unsigned long steps;           // accepted
+          unsigned long rejected;
+          unsigned long restarts;        // first call and thrust changes
+          double last_dt;                // proposed next step (s)
+     };
+
+     // The tolerances of odeint's integrate(), which videoray_sim used
+     static Config default_config()
+     {
+          Config config;
+          config.abs_tol = 1.0e-6;
+          config.rel_tol = 1.0e-6;
+          config.initial_dt = 0.01;
+          return config;
+     }
+
+     AdaptiveIntegrator(const Config &config = default_config())
+          : config_(config), dense_(controlled_type(
+                 error_checker_type(config.abs_tol, config.rel_tol, &stats_))),
+            initialized_(false), time_(0)
+     {
+          reset_stats();
+     }
+
+     // Advances x by one output period. restart says the system's input
+     // changed since the previous call (or x was set from outside), so
+     // the stepper starts from x rather than from its own last step.
+     template <class System>
+     void advance(System system, State &x, double period, bool restart)
+     {
+          if (restart || !initialized_) {
+               double dt = config_.initial_dt;
+               if (initialized_) {
+                    dt = std::min(dense_.current_time_step(), period);
+               }
+               dense_.initialize(x, time_, dt);
+               initialized_ = true;
+               stats_.restarts++;
+          }
+
+          time_ += period;
+          while (dense_.current_time() < time_) {
+               dense_.do_step(system);
+               stats_.steps++;
+          }
+          dense_.calc_state(time_, x);
+          stats_.outputs++;
+          stats_.last_dt = dense_.current_time_step();
+     }
+
+     const Stats & stats() const { return stats_; }
+
+     void reset_stats()
+     {
+          stats_.outputs = 0;
+          stats_.steps = 0;
+          stats_.rejected = 0;
+          stats_.restarts = 0;
+          stats_.last_dt = 0;
+     }
+
+protected:
+private:
+     typedef boost::numeric::odeint::runge_kutta_dopri5<State> stepper_type;
+     typedef boost::numeric::odeint::default_error_checker<
+          typename stepper_type::value_type,
+          typename stepper_type::algebra_type,
+          typename stepper_type::operations_type> base_checker_type;
+
+     // odeint's error checker, counting the steps it turns down
+     class CountingErrorChecker : public base_checker_type {
+     public:
+          typedef typename base_checker_type::value_type value_type;
+          typedef typename base_checker_type::algebra_type algebra_type;
+
+          CountingErrorChecker(value_type abs_tol = 1.0e-6,
+                               value_type rel_tol = 1.0e-6,
+                               Stats *stats = NULL)
+               : base_checker_type(abs_tol, rel_tol), stats_(stats) { }
+
+          template <class S, class D, class E, class T>
+          value_type error(const S &x_old, const D &dxdt_old, E &x_err,
+                           T dt) const
+          {
+               algebra_type algebra;
+               return error(algebra, x_old, dxdt_old, x_err, dt);
+          }
+
+          template <class S, class D, class E, class T>
+          value_type error(algebra_type &algebra, const S &x_old,
+                           const D &dxdt_old, E &x_err, T dt) const
+          {
+               value_type max_error = base_checker_type::error(
+                    algebra, x_old, dxdt_old, x_err, dt);
+               if (max_error > 1.0 && stats_ != NULL) {
+                    stats_->rejected++;
+               }
+               return max_error;
+          }
+
+     private:
+          Stats *stats_;
+     };
+
+     typedef CountingErrorChecker error_checker_type;
+     typedef boost::numeric::odeint::controlled_runge_kutta<
+          stepper_type, error_checker_type> controlled_type;
+     typedef boost::numeric::odeint::dense_output_runge_kutta<
+          controlled_type> dense_type;
+
+     Config config_;
+     Stats stats_;
+     dense_type dense_;
+     bool initialized_;
+     double time_;
+
+     // The error checker keeps a pointer to stats_
+     AdaptiveIntegrator(const AdaptiveIntegrator &);
+     AdaptiveIntegrator & operator=(const AdaptiveIntegrator &);
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef AUTOPILOT_H_
+#define AUTOPILOT_H_
+/// ---------------------------------------------------------------------------
+/// @file Autopilot.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Heading and depth autopilot running on the host, one tick per decoded
+/// nav block. It replaces the vehicle's own auto heading and auto depth:
+/// the outputs are thruster commands, heading through the port/starboard
+/// difference and depth through the vertical thruster.
+///
+/// Each axis is a PID with the derivative taken on the measurement. The
+/// rate comes from a complementary filter of the differentiated heading
+/// (depth) and the vehicle's yaw (heave) acceleration, so the D term is
+/// not just amplified sensor noise. Gains are scheduled on the operator's
+/// forward thrust and interpolated between breakpoints; the integral is
+/// kept in thrust units, so a gain change does not bump the output.
+/// Integrator windup is prevented twice: the integral only accumulates
+/// within a band around the setpoint, so a long approach does not charge
+/// it, and by back-calculation, which drives it back towards what the
+/// thruster can deliver while the output saturates.
+///
+/// A tick is a few dozen floating point operations on fixed-size state,
+/// nothing is allocated (see autopilot_bench). The sign conventions are
+/// those of execControlLaw() in videoray_sim_and_control.
+///
+/// ----------------------------------------------------------------------------
+
+#include "CsrMap.h"
+
+class Autopilot {
+public:
+
+     struct Gains {
+          double kp;                     // thrust per degree (metre)
+          double ki;                     // thrust per degree second
+          double kd;                     // thrust per degree per second
+     };
+
+     // Gains at increasing forward thrust breakpoints, linearly
+     // interpolated in between and held beyond the ends
+     static const int MAX_BREAKPOINTS = 4;
+     struct Schedule {
+          double band;                   // integrate within +/- band
+          int count;
+          double thrust[MAX_BREAKPOINTS];
+          Gains gains[MAX_BREAKPOINTS];
+     };
+
+     struct Config {
+          Schedule heading;
+          Schedule depth;
+          double max_thrust;             // thruster command limit
+          double tracking;               // back-calculation gain (1/s)
+          double rate_tau;               // complementary filter (s)
+          double yaw_accel_scale;        // nav yaw_accel to deg/s^2
+          double heave_accel_scale;      // nav heave_accel to m/s^2
+          double gravity;                // removed from the heave axis
+                                         // (m/s^2)
+          double max_dt;                 // longer nav gaps restart the
+                                         // rate estimate (s)
+     };
+
+     // What the operator asks for. A disabled axis passes the operator's
+     // thrust through and has its integral reset.
+     struct Setpoint {
+          bool heading_enabled;
+          bool depth_enabled;
+          double heading;                // deg
+          double depth;                  // m
+          int port_thrust;
+          int star_thrust;
+          int vert_thrust;
+     };
+
+     struct Output {
+          int port_thrust;
+          int star_thrust;
+          int vert_thrust;
+          double heading_error;          // deg, wrapped to +/-180
+          double depth_error;            // m
+          bool saturated;                // an axis hit the thrust limit
+     };
+
+     // Gains tuned on videoray_sim, softer at full forward thrust where
+     // the hull adds yaw damping
+     static Config default_config();
+
+     Autopilot(const Config &config = default_config());
+
+     void set_config(const Config &config);
+
+     // One nav block, time on any monotonic scale (s)
+     void update(const NavData &nav, double time, const Setpoint &setpoint,
+                 Output &output);
+
+     void reset();
+
+protected:
+private:
+     struct Axis {
+          bool valid;                    // last and rate hold a sample
+          double last;
+          double rate;
+          double integral;               // thrust units
+     };
+
+     Config config_;
+     Axis heading_;
+     Axis depth_;
+     double last_time_;
+
+     static Gains interpolate(const Schedule &schedule, double thrust);
+     void estimate_rate(Axis &axis, double value, double delta,
+                        double accel, double dt);
+     double control(Axis &axis, const Schedule &schedule, double thrust,
+                    double error, double limit, double dt);
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef BUS_SCHEDULER_H_
+#define BUS_SCHEDULER_H_
+/// ---------------------------------------------------------------------------
+/// @file BusScheduler.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Decides what goes on the tether in each control cycle (a slot). The
+/// tether is half duplex and shared by every device on it, so each job is
+/// described by the bytes its request and response occupy on the wire. A
+/// slot carries at most the bytes the line rate allows in one slot period.
+///
+/// Periodic jobs (control, nav, status) run at their own rates. One-shot
+/// jobs (camera keys, manipulator commands) wait in a queue until they run
+/// or their deadline passes. Within a slot the jobs run highest priority
+/// first, earliest deadline first among equal priorities. A job that does
+/// not fit in what is left of the slot waits for the next one and the slot
+/// is counted as an overrun; nothing is silently stretched. Every slot a
+/// job waits raises its priority by one, so on an oversubscribed link the
+/// low priority jobs run less often instead of never.
+///
+/// The scheduler does no I/O itself and is used from a single thread.
+///
+/// ----------------------------------------------------------------------------
+
+#include <functional>
+
+class BusScheduler {
+public:
+
+     enum Status_t
+     {
+          Success = 0,
+          Failure
+     };
+
+     // Queues the job's frames, false if they could not be queued
+     typedef std::function<bool()> Send;
+
+     struct Stats {
+          unsigned long slots;
+          unsigned long overruns;        // slots that could not run every
+                                         // due job
+          unsigned long deferred;        // job runs pushed to a later slot
+          unsigned long expired;         // one-shots dropped at deadline
+          unsigned long failed;          // Send returned false
+          unsigned long one_shots;       // one-shots sent
+          double utilization;            // periodic demand / link capacity
+          double load_max;               // fullest slot / slot capacity
+          const char *last_deferred;     // name of the last deferred job
+     };
+
+     static const int MAX_PERIODIC = 8;
+     static const int MAX_ONE_SHOTS = 16;
+
+     BusScheduler();
+
+     // 8N1 framing: the link carries baud / 10 bytes per second
+     void set_link(unsigned int baud, double slot_rate);
+
+     // Priorities: higher runs first. bytes is request plus response.
+     Status_t add_periodic(const char *name, double rate, int bytes,
+                           int priority, const Send &send);
+     Status_t submit(const char *name, int priority, double deadline,
+                     int bytes, const Send &send);
+
+     // Removes every job, the statistics are kept
+     void clear();
+
+     // Runs the jobs due at now, times on the CLOCK_MONOTONIC scale
+     void run_slot(double now);
+
+     bool oversubscribed() const;
+     const Stats & stats() const;
+
+protected:
+private:
+     struct Job {
+          const char *name;
+          int priority;
+          int bytes;
+          double period;                 // 0 for a one-shot
+          double due;                    // next run of a periodic job
+          double deadline;
+          int age;                       // slots waited since due
+          Send send;
+     };
+
+     Job periodic_[MAX_PERIODIC];
+     int periodic_count_;
+
+     Job one_shots_[MAX_ONE_SHOTS];
+     int one_shot_count_;
+
+     double bytes_per_sec_;
+     double slot_period_;
+     double slot_bytes_;                 // 0: unlimited
+     Stats stats_;
+
+     void update_utilization();
+     static bool before(const Job *a, const Job *b);
+};
+
+#endif
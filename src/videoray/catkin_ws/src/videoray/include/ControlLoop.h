@@ -0,0 +1,208 @@
+#ifndef CONTROL_LOOP_H_
+#define CONTROL_LOOP_H_
+/// ---------------------------------------------------------------------------
+/// @file ControlLoop.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Vehicle I/O cycle on its own thread. Every period the thread wakes up at
+/// an absolute CLOCK_MONOTONIC deadline, takes the latest Command written by
+/// the ROS thread, sends it to the vehicle together with the telemetry
+/// requests, and goes back to sleep until the next deadline. Slow callbacks
+/// or blocking calls on the ROS thread therefore never delay a thruster
+/// update.
+///
+/// Each cycle is one slot of a BusScheduler: control, nav and status run
+/// as periodic jobs at their own rates, camera keys and manipulator
+/// commands as one-shots, all within the bytes the tether carries per cycle.
+///
+/// With host_autopilot set in the Command, heading and depth are held by
+/// the host's Autopilot instead of the vehicle's: it runs in this thread
+/// once per new nav block and its thruster commands replace the
+/// operator's on the enabled axes.
+///
+/// With set_estimator() a NavEstimator dead-reckons the vehicle in this
+/// thread: it is propagated every cycle with the thruster commands just
+/// sent, corrected by each new nav block, and its estimate handed to the
+/// ROS thread at the cycle rate.
+///
+/// The wakeup lateness of every cycle is recorded. A cycle that ends after
+/// the next deadline is a miss; the missed periods are skipped rather than
+/// run back to back.
+///
+/// ----------------------------------------------------------------------------
+
+#include <thread>
+#include <atomic>
+
+#include "VideoRayComm.h"
+#include "LatestValue.h"
+#include "BusScheduler.h"
+#include "Autopilot.h"
+#include "NavEstimator.h"
+
+class ControlLoop {
+public:
+
+     enum Status_t
+     {
+          Success = 0,
+          Failure
+     };
+
+     // Everything the vehicle is told in one cycle
+     struct Command {
+          int port_thrust;
+          int star_thrust;
+          int vert_thrust;
+          int lights;
+          int tilt;
+          int desired_heading;            // -1 disables auto heading
+          int desired_depth;              // -1 disables auto depth
+          bool host_autopilot;            // the host holds heading/depth
+          VideoRayComm::ManipState_t manip_state;
+
+          // Camera menu key, sent once each time cam_seq changes
+          VideoRayComm::CamCtrl_t cam_cmd;
+          unsigned int cam_seq;
+     };
+
+     struct Timing {
+          unsigned long cycles;
+          unsigned long misses;           // cycles that overran the period
+          unsigned long skipped;          // periods skipped after a miss
+          double period;                  // seconds
+          double lateness_mean;           // wakeup after the deadline (s)
+          double lateness_max;
+          double jitter;                  // std. deviation of the lateness
+          double exec_max;                // longest cycle body (s)
+          unsigned long autopilot_ticks;
+          double autopilot_mean;          // time per autopilot tick (s)
+          double autopilot_max;
+          double estimator_mean;          // time per estimator cycle (s)
+          double estimator_max;
+     };
+
+     // What the host autopilot was asked for and answered on its last tick
+     struct AutopilotState {
+          Autopilot::Setpoint setpoint;
+          Autopilot::Output output;
+     };
+
+     ControlLoop(VideoRayComm &comm);
+     ~ControlLoop();
+
+     // Telemetry request rates, before start(). Both default to the cycle
+     // rate for nav and 1 Hz for status.
+     void set_rates(double nav_rate, double status_rate);
+
+     // Before start()
+     void set_autopilot(const Autopilot::Config &config);
+
+     // Before start(), turns the navigation estimator on
+     void set_estimator(const NavEstimator::Config &config);
+
+     // Starts the I/O thread. A priority > 0 asks for SCHED_FIFO, which
+     // falls back to the normal scheduler without the privilege.
+     Status_t start(double rate, int rt_priority = 0);
+     void stop();
+
+     // Without start(): an external event loop calls prepare() once and
+     // then cycle() at every deadline (CLOCK_MONOTONIC seconds). cycle()
+     // returns how many of the following deadlines already passed.
+     Status_t prepare(double rate);
+     int cycle(double deadline);
+
+     // ROS thread side, never blocks
+     void set_command(const Command &command);
+     Timing timing();
+     BusScheduler::Stats bus_stats();
+
+     // True if the estimate was updated since the previous call
+     bool estimate(NavEstimator::Estimate &estimate);
+
+     // True if the host autopilot ticked since the previous call
+     bool autopilot_state(AutopilotState &state);
+
+     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+protected:
+private:
+     VideoRayComm &comm_;
+     std::thread thread_;
+     std::atomic<bool> running_;
+     double rate_;
+     double nav_rate_;
+     double status_rate_;
+
+     LatestValue<Command> command_;
+     LatestValue<Timing> timing_;
+     Timing last_timing_;
+
+     // Accumulated by cycle()
+     Timing cycle_timing_;
+     double lateness_sum_;
+     double lateness_sq_sum_;
+
+     // I/O thread only
+     BusScheduler scheduler_;
+     VideoRayComm::ManipState_t manip_state_;
+     double manip_deadline_;
+     unsigned int cam_seq_;
+     double cam_deadline_;
+
+     Autopilot autopilot_;
+     bool autopilot_active_;
+     unsigned long nav_updates_;
+     double nav_time_;
+     Autopilot::Output autopilot_output_;
+     double autopilot_sum_;
+     LatestValue<AutopilotState> autopilot_state_;
+     void run_autopilot(Command &command,
+                        const VideoRayComm::Telemetry &telemetry, double now);
+
+     NavEstimator estimator_;
+     bool estimating_;
+     unsigned long estimator_nav_updates_;
+     double estimator_time_;
+     double estimator_sum_;
+     LatestValue<NavEstimator::Estimate> estimate_;
+     void run_estimator(const Command &command,
+                        const VideoRayComm::Telemetry &telemetry, double now);
+
+     LatestValue<BusScheduler::Stats> bus_stats_;
+     BusScheduler::Stats last_bus_stats_;
+
+     void run();
+     void add_jobs();
+     void apply(const Command &command, double now);
+};
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef CSR_MAP_H_
+#define CSR_MAP_H_
+/// ---------------------------------------------------------------------------
+/// @file CsrMap.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Compile-time description of the VideoRay CSR blocks returned in response
+/// payloads. Each field names the struct member it fills, its byte offset,
+/// width, signedness and the scale to engineering units. The Block template
+/// expands the field list into straight-line code, so decoding a payload is
+/// one pass of loads and constant multiplies with no branches. encode() is
+/// the inverse and is used to build payloads on the vehicle side.
+///
+/// Moving or rescaling a register is a one-line edit of the layouts at the
+/// bottom of this file.
+///
+/// ----------------------------------------------------------------------------
+
+#include <math.h>
+#include <stdint.h>
+
+namespace csr {
+
+// Little-endian raw register value
+template <int Width, bool Signed> struct Raw;
+
+template <> struct Raw<1, false> {
+     static int get(const uint8_t *p) { return p[0]; }
+};
+template <> struct Raw<1, true> {
+     static int get(const uint8_t *p) { return (int8_t)p[0]; }
+};
+template <> struct Raw<2, false> {
+     static int get(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+};
+template <> struct Raw<2, true> {
+     static int get(const uint8_t *p) { return (int16_t)(p[0] | (p[1] << 8)); }
+};
+
+// One register: value = raw * ScaleNum / ScaleDen, stored in T::*Member
+template <typename T, double T::*Member, int Offset, int Width, bool Signed,
+          long ScaleNum = 1, long ScaleDen = 1>
+struct Field {
+     static constexpr int end = Offset + Width;
+     static constexpr double scale = (double)ScaleNum / ScaleDen;
+
+     static void decode(const uint8_t *payload, T &out)
+     {
+          out.*Member = Raw<Width, Signed>::get(payload + Offset) * scale;
+     }
+
+     static void encode(const T &in, uint8_t *payload)
+     {
+          long raw = lround(in.*Member / scale);
+          for (int i = 0; i < Width; i++) {
+               payload[Offset + i] = (raw >> (8 * i)) & 0xFF;
+          }
+     }
+};
+
+template <typename... Fields> struct MaxEnd;
+
+template <> struct MaxEnd<> {
+     static constexpr int value = 0;
+};
+
+template <typename F, typename... Rest> struct MaxEnd<F, Rest...> {
+     static constexpr int value = F::end > MaxEnd<Rest...>::value ?
+          F::end : MaxEnd<Rest...>::value;
+};
+
+// A CSR block: the payload has to hold at least size bytes
+template <typename T, typename... Fields>
+struct Block {
+     typedef T Data;
+     static constexpr int size = MaxEnd<Fields...>::value;
+
+     static void decode(const uint8_t *payload, T &out)
+     {
+          int expand[] = { 0, (Fields::decode(payload, out), 0)... };
+          (void)expand;
+     }
+
+     static void encode(const T &in, uint8_t *payload)
+     {
+          int expand[] = { 0, (Fields::encode(in, payload), 0)... };
+          (void)expand;
+     }
+};
+
+} // namespace csr
+
+////////////////////////////////////////
+// Navigation data (flags 0x05 response)
+////////////////////////////////////////
+struct NavData {
+     double device_id;
+     double heading;          // deg
+     double pitch;            // deg
+     double roll;             // deg
+     double depth;            // m
+     double yaw_accel;
+     double pitch_accel;
+     double roll_accel;
+     double surge_accel;
+     double sway_accel;
+     double heave_accel;
+     double raw_mag_x;
+     double raw_mag_y;
+     double raw_mag_z;
+     double attitude;
+};
+
+typedef csr::Block<NavData,
+     csr::Field<NavData, &NavData::device_id,    0, 1, false>,
+     csr::Field<NavData, &NavData::heading,      1, 2, true, 1, 10>,
+     csr::Field<NavData, &NavData::pitch,        3, 2, true, 1, 10>,
+     csr::Field<NavData, &NavData::roll,         5, 2, true, 1, 10>,
+     csr::Field<NavData, &NavData::depth,        7, 2, true, 1, 10>,
+     csr::Field<NavData, &NavData::yaw_accel,    9, 2, true, 1, 1000>,
+     csr::Field<NavData, &NavData::pitch_accel, 11, 2, true, 1, 1000>,
+     csr::Field<NavData, &NavData::roll_accel,  13, 2, true, 1, 1000>,
+     csr::Field<NavData, &NavData::surge_accel, 15, 2, true, 1, 1000>,
+     csr::Field<NavData, &NavData::sway_accel,  17, 2, true, 1, 1000>,
+     csr::Field<NavData, &NavData::heave_accel, 19, 2, true, 1, 1000>,
+     csr::Field<NavData, &NavData::raw_mag_x,   21, 2, true>,
+     csr::Field<NavData, &NavData::raw_mag_y,   23, 2, true>,
+     csr::Field<NavData, &NavData::raw_mag_z,   25, 2, true>,
+     csr::Field<NavData, &NavData::attitude,    27, 2, true>
+     > NavBlock;
+
+////////////////////////////////////////
+// Status block (flags 0x8E, CSR 0x7A)
+////////////////////////////////////////
+struct StatusData {
+     double water_temperature;
+     double tether_voltage;
+     double voltage_12v;
+     double current_12v;
+     double internal_temperature;
+     double humidity;
+     double comm_err_count;
+};
+
+typedef csr::Block<StatusData,
+     csr::Field<StatusData, &StatusData::water_temperature,     0, 2, true>,
+     csr::Field<StatusData, &StatusData::tether_voltage,        2, 2, true>,
+     csr::Field<StatusData, &StatusData::voltage_12v,           4, 2, true>,
+     csr::Field<StatusData, &StatusData::current_12v,           6, 2, true>,
+     csr::Field<StatusData, &StatusData::internal_temperature,  8, 2, true>,
+     csr::Field<StatusData, &StatusData::humidity,             10, 2, true>,
+     csr::Field<StatusData, &StatusData::comm_err_count,       12, 2, false>
+     > StatusBlock;
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef CSR_SHADOW_H_
+#define CSR_SHADOW_H_
+/// ---------------------------------------------------------------------------
+/// @file CsrShadow.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Host side copy of the writable part of a CSR map. Two images are kept:
+/// the values the host wants and the values last sent to the vehicle. A
+/// register is dirty while the two differ, so setting a register back to
+/// the value already on the vehicle costs nothing.
+///
+/// dirty_ranges() turns the dirty registers into as few writes as makes
+/// sense: two dirty runs separated by fewer clean registers than the cost of
+/// a frame header are sent as one write.
+///
+/// ----------------------------------------------------------------------------
+
+#include <stdint.h>
+
+class CsrShadow {
+public:
+
+     static const int SIZE = 256;
+
+     struct Range {
+          int addr;
+          int length;
+     };
+
+     CsrShadow();
+
+     // Registers are only refreshed once they are tracked
+     void track(int addr, int length);
+
+     void set(int addr, uint8_t value);
+     void set(int addr, const void *data, int length);
+     uint8_t get(int addr) const;
+     const uint8_t * data() const;
+
+     // Marks tracked registers dirty, so they are sent again even if the
+     // host believes the vehicle holds them already
+     void invalidate();
+     void invalidate(int addr, int length);
+
+     bool dirty() const;
+     bool dirty(int addr, int length) const;
+
+     // Fills at most max ranges covering every dirty register (in address
+     // order) and returns how many were filled. Runs closer than merge_gap
+     // clean registers are merged.
+     int dirty_ranges(Range *ranges, int max, int merge_gap) const;
+
+     // The range went out: the vehicle now holds the wanted values
+     void mark_sent(int addr, int length);
+
+protected:
+private:
+     uint8_t wanted_[SIZE];
+     uint8_t sent_[SIZE];
+     bool dirty_[SIZE];
+     bool tracked_[SIZE];
+     int dirty_count_;
+
+     void update(int addr);
+};
+
+#endif
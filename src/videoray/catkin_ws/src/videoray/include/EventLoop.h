@@ -0,0 +1,121 @@
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+/// ---------------------------------------------------------------------------
+/// @file EventLoop.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Drives several vehicles, each on its own port, from a single thread.
+/// One epoll set holds every port, every transmit queue and a timerfd
+/// firing at the control rate. On each timer expiration the control cycle
+/// of every vehicle runs back to back; between expirations the thread only
+/// wakes up to decode what the ports receive. The cost grows with the
+/// number of vehicles, not with the number of threads.
+///
+/// The VideoRayComm objects have to be built in Polled mode. No call waits
+/// on a port: a port that does not take all its frames is watched for
+/// EPOLLOUT until it has sent the rest. A vehicle whose port fails
+/// (unplugged adapter, read error, hang-up) is dropped from the loop and
+/// reported; the other vehicles keep running.
+///
+/// ----------------------------------------------------------------------------
+
+#include <thread>
+#include <atomic>
+
+#include "VideoRayComm.h"
+#include "ControlLoop.h"
+#include "LatestValue.h"
+
+class EventLoop {
+public:
+
+     enum Status_t
+     {
+          Success = 0,
+          Failure
+     };
+
+     struct Stats {
+          unsigned long cycles;          // timer expirations handled
+          unsigned long skipped;         // expirations missed, loop behind
+          double cpu_time;               // CPU seconds used by the loop
+          double cycle_max;              // longest all-vehicle cycle (s)
+          int active;                    // vehicles still serviced
+          int failed;                    // vehicles dropped after a failure
+     };
+
+     static const int MAX_VEHICLES = 32;
+
+     EventLoop();
+     ~EventLoop();
+
+     // Before start(). The control loops are prepared by start(), their
+     // own start() must not be called.
+     Status_t add(VideoRayComm &comm, ControlLoop &control);
+
+     // A priority > 0 asks for SCHED_FIFO, like ControlLoop::start()
+     Status_t start(double rate, int rt_priority = 0);
+     void stop();
+
+     // Any thread
+     Stats stats();
+
+protected:
+private:
+     struct Vehicle {
+          VideoRayComm *comm;
+          ControlLoop *control;
+          bool active;
+          bool watch_writable;           // EPOLLOUT set on the port
+     };
+
+     Vehicle vehicles_[MAX_VEHICLES];
+     int count_;
+
+     int epoll_fd_;
+     int timer_fd_;
+     int stop_fd_;
+     double period_;
+
+     std::thread thread_;
+     std::atomic<bool> running_;
+
+     // Written by the loop, read by stats()
+     Stats loop_stats_;
+     LatestValue<Stats> stats_;
+     Stats last_stats_;
+
+     void run();
+     void transmit(int index, Stats &stats);
+     void drop(Vehicle &vehicle, Stats &stats, const char *reason);
+};
+
+#endif
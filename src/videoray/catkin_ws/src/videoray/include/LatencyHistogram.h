@@ -0,0 +1,174 @@
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+/// ---------------------------------------------------------------------------
+/// @file LatencyHistogram.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Distribution of latencies with a bounded relative error, in the manner
+/// of an HDR histogram. Values are kept in microseconds: below 32 us every
+/// value has a bucket of its own, above that every power of two is split
+/// into 16 buckets, so a value is known to within 1/16 (6%) of itself from
+/// 1 us up to an hour in a fixed array of counters. Recording is a couple
+/// of shifts and an increment, nothing is allocated.
+///
+/// Two copies of the same histogram taken at different times give the
+/// distribution of what was recorded in between (since()), which is how a
+/// periodic report shows the recent latencies rather than the lifetime.
+///
+/// ----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <string.h>
+
+class LatencyHistogram {
+public:
+     static const int SUB_BITS = 4;
+     static const int SUB_COUNT = 1 << SUB_BITS;
+     static const int BUCKETS = (33 - SUB_BITS) * SUB_COUNT;
+
+     LatencyHistogram()
+     {
+          reset();
+     }
+
+     void reset()
+     {
+          memset(counts_, 0, sizeof(counts_));
+          count_ = 0;
+          sum_ = 0;
+     }
+
+     // Seconds. Negative values count as 0, values past an hour as an hour.
+     void record(double seconds)
+     {
+          uint32_t us;
+          if (seconds <= 0) {
+               us = 0;
+          } else if (seconds >= 4294.0) {
+               us = 0xFFFFFFFFu;
+          } else {
+               us = (uint32_t)(seconds * 1e6 + 0.5);
+          }
+          counts_[index(us)]++;
+          count_++;
+          sum_ += us;
+     }
+
+     void add(const LatencyHistogram &other)
+     {
+          for (int i = 0; i < BUCKETS; i++) {
+               counts_[i] += other.counts_[i];
+          }
+          count_ += other.count_;
+          sum_ += other.sum_;
+     }
+
+     // What was recorded after earlier was copied from this histogram
+     LatencyHistogram since(const LatencyHistogram &earlier) const
+     {
+          LatencyHistogram delta;
+          for (int i = 0; i < BUCKETS; i++) {
+               delta.counts_[i] = counts_[i] - earlier.counts_[i];
+          }
+          delta.count_ = count_ - earlier.count_;
+          delta.sum_ = sum_ - earlier.sum_;
+          return delta;
+     }
+
+     unsigned long count() const
+     {
+          return (unsigned long)count_;
+     }
+
+     // Seconds
+     double mean() const
+     {
+          return count_ > 0 ? (double)sum_ / count_ * 1e-6 : 0;
+     }
+
+     // Smallest value (seconds) that at least p percent of the recorded
+     // values do not exceed, rounded up to the end of its bucket. 0 when
+     // nothing was recorded.
+     double percentile(double p) const
+     {
+          if (count_ == 0) {
+               return 0;
+          }
+          uint64_t target = (uint64_t)(p / 100.0 * count_ + 0.999999);
+          if (target < 1) {
+               target = 1;
+          } else if (target > count_) {
+               target = count_;
+          }
+          uint64_t seen = 0;
+          for (int i = 0; i < BUCKETS; i++) {
+               seen += counts_[i];
+               if (seen >= target) {
+                    return highest(i) * 1e-6;
+               }
+          }
+          return highest(BUCKETS - 1) * 1e-6;
+     }
+
+     double max() const
+     {
+          return percentile(100.0);
+     }
+
+protected:
+private:
+     uint32_t counts_[BUCKETS];
+     uint64_t count_;
+     uint64_t sum_;                      // microseconds
+
+     static int index(uint32_t us)
+     {
+          if (us < 2 * SUB_COUNT) {
+               return (int)us;
+          }
+          int msb = 31 - __builtin_clz(us);
+          int shift = msb - SUB_BITS;
+          return shift * SUB_COUNT + (int)(us >> shift);
+     }
+
+     // Largest value falling in bucket i
+     static double highest(int i)
+     {
+          if (i < 2 * SUB_COUNT) {
+               return i;
+          }
+          int shift = i / SUB_COUNT - 1;
+          double sub = i % SUB_COUNT + SUB_COUNT;
+          return (sub + 1) * (double)(1u << shift) - 1;
+     }
+};
+
+#endif
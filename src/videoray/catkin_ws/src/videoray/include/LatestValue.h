@@ -0,0 +1,87 @@
+#ifndef LATEST_VALUE_H_
+#define LATEST_VALUE_H_
+/// ---------------------------------------------------------------------------
+/// @file LatestValue.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Hands the most recent value of T from one writer thread to one reader
+/// thread without locks (triple buffering). The writer fills its private
+/// buffer and swaps it with the shared middle buffer; the reader swaps its
+/// private buffer with the middle one when a new value is there. Neither
+/// side ever waits for the other, intermediate values are overwritten.
+///
+/// ----------------------------------------------------------------------------
+
+#include <atomic>
+
+template <class T>
+class LatestValue {
+public:
+     LatestValue(const T &initial = T()) : middle_(1)
+     {
+          buffers_[0] = buffers_[1] = buffers_[2] = initial;
+          write_ = 0;
+          read_ = 2;
+     }
+
+     // Writer side
+     void write(const T &value)
+     {
+          buffers_[write_] = value;
+          write_ = middle_.exchange(write_ | FRESH, std::memory_order_acq_rel)
+               & INDEX;
+     }
+
+     // Reader side. Copies the latest value and returns true if it was
+     // written since the previous read.
+     bool read(T &value)
+     {
+          bool fresh = (middle_.load(std::memory_order_relaxed) & FRESH) != 0;
+          if (fresh) {
+               read_ = middle_.exchange(read_, std::memory_order_acq_rel)
+                    & INDEX;
+          }
+          value = buffers_[read_];
+          return fresh;
+     }
+
+protected:
+private:
+     static const unsigned int INDEX = 0x3;
+     static const unsigned int FRESH = 0x4;
+
+     T buffers_[3];
+     std::atomic<unsigned int> middle_;
+     unsigned int write_;
+     unsigned int read_;
+};
+
+#endif
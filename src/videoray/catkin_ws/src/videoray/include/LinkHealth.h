@@ -0,0 +1,96 @@
+#ifndef LINK_HEALTH_H_
+#define LINK_HEALTH_H_
+/// ---------------------------------------------------------------------------
+/// @file LinkHealth.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Turns VideoRayComm::LinkStats into what the nodes publish: the link
+/// fields of videoray::Status and a diagnostic_msgs status for the
+/// /diagnostics topic. Each update() closes a reporting period; latencies,
+/// error ratios and byte rates are computed over that period, so a tether
+/// that starts degrading shows up within one period instead of being
+/// averaged into the lifetime figures.
+///
+/// The level is an error when the port failed or the vehicle answered none
+/// of the period's requests, a warning when timeouts, corrupt frames or
+/// the 99th percentile latency cross their thresholds.
+///
+/// ----------------------------------------------------------------------------
+
+#include <string>
+
+#include "ros/ros.h"
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include "videoray/Status.h"
+#include "VideoRayComm.h"
+
+class LinkHealth {
+public:
+     LinkHealth(const std::string &name, const std::string &hardware_id);
+
+     // Closes the reporting period at now (seconds, any monotonic scale)
+     void update(const VideoRayComm::LinkStats &stats, bool healthy,
+                 double now);
+
+     // Vehicle status as decoded plus the link fields. comm_err_count adds
+     // the errors seen by the host to the vehicle's own count.
+     void fill_status(const StatusData &vehicle, videoray::Status &msg) const;
+
+     void fill_diagnostics(diagnostic_msgs::DiagnosticStatus &status) const;
+
+     unsigned char level() const;
+
+protected:
+private:
+     std::string name_;
+     std::string hardware_id_;
+
+     VideoRayComm::LinkStats stats_;
+     VideoRayComm::LinkStats last_;
+     bool started_;
+     double last_time_;
+     double period_;
+
+     // Over the last period
+     LatencyHistogram window_[VideoRayComm::Transaction_Count];
+     LatencyHistogram window_all_;
+     unsigned long requests_;
+     unsigned long responses_;
+     unsigned long timeouts_;
+     unsigned long frame_errors_;
+     unsigned long frames_in_;
+
+     unsigned char level_;
+     std::string message_;
+     void raise(unsigned char level);
+};
+
+#endif
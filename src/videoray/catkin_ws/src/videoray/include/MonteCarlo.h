@@ -0,0 +1,206 @@
+#ifndef MONTE_CARLO_H_
+#define MONTE_CARLO_H_
+/// ---------------------------------------------------------------------------
+/// @file MonteCarlo.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Monte Carlo rollouts of the VideoRay model for mission risk
+/// assessment. Every run flies the same thruster schedule (a list of
+/// segments). Each run has its own hydrodynamic coefficients and initial
+/// state, drawn around the nominal Pro III values with the given spread.
+/// The result holds every run's final state. On request it also holds
+/// the position and heading trajectory at a fixed period. summarize()
+/// reduces the final states to percentiles.
+///
+/// The runs are integrated in batches laid out as structure-of-arrays,
+/// four vehicles per SIMD operation (see MonteCarloKernel.h). They use the
+/// AVX2 kernel when the CPU has AVX2 and FMA, and the portable one
+/// otherwise. The batches are spread over worker threads. The draws of a
+/// run depend only on the seed and the run's index, so the result does
+/// not depend on the thread count or the batch size.
+///
+/// ----------------------------------------------------------------------------
+
+#include <vector>
+#include <atomic>
+
+class MonteCarlo {
+public:
+
+     enum Status_t
+     {
+          Success = 0,
+          Failure
+     };
+
+     enum Kernel_t
+     {
+          Auto_Kernel = 0,                // AVX2 when the CPU has it
+          Generic_Kernel,
+          Avx2_Kernel
+     };
+
+     // State order of VideoRayModel in videoray_sim_and_control
+     static const int STATE_SIZE = 12;
+     enum State_t
+     {
+          U = 0, V, W, P, Q, R, XPos, YPos, ZPos, Phi, Theta, Psi
+     };
+
+     // Names and values as in octave/videoray_pro_3_params.m
+     struct Params {
+          double X_udot;
+          double Y_vdot;
+          double Z_wdot;
+          double N_rdot;
+          double Xu;
+          double Yv;
+          double Nr;
+          double Zw;
+          double Xuu;
+          double Yvv;
+          double Nrr;
+          double Zww;
+          double Ct_forw;
+          double Ct_back;
+          double Ct_vert_forw;
+          double Ct_vert_back;
+     };
+
+     // Relative 1-sigma of each coefficient group, and absolute 1-sigma
+     // of the initial state
+     struct Spread {
+          double added_mass;
+          double linear_drag;
+          double quadratic_drag;
+          double thrust;
+          double velocity;               // m/s, u v w
+          double position;               // m, x y z
+          double attitude;               // rad, roll pitch yaw
+     };
+
+     // Thruster commands held for duration seconds, saturated to +/-150
+     // like in videoray_sim
+     struct Segment {
+          double duration;
+          double port;
+          double star;
+          double vert;
+     };
+
+     struct Config {
+          Params params;
+          Spread spread;
+          double initial[STATE_SIZE];
+          double dt;                     // RK4 step (s)
+          double record_period;          // trajectory sample period (s),
+                                         // 0 keeps final states only
+          int runs;
+          int threads;                   // 0 uses every core
+          int batch;                     // vehicles per batch
+          unsigned long seed;
+          Kernel_t kernel;
+     };
+
+     struct Result {
+          int runs;
+          int samples;                   // trajectory samples per run
+          std::vector<double> final_state;    // runs x STATE_SIZE
+          std::vector<float> trajectory;      // runs x samples x
+                                              // (x, y, z, yaw)
+          double elapsed;                // wall clock seconds
+          double vehicle_steps;          // RK4 steps summed over runs
+          Kernel_t kernel;
+          int threads;
+     };
+
+     struct Stat {
+          double mean;
+          double sigma;
+          double min;
+          double p05;
+          double p50;
+          double p95;
+          double max;
+     };
+
+     struct Summary {
+          Stat x;                        // m
+          Stat y;
+          Stat depth;
+          Stat heading;                  // deg, yaw of the model, around
+                                         // the circular mean
+          Stat speed;                    // m/s, horizontal
+          Stat miss;                     // horizontal distance from the
+                                         // mean end point (m)
+     };
+
+     static Params pro3_params();
+     static Config default_config();
+
+     // True if this build has the AVX2 kernel and the CPU can run it
+     static bool avx2_available();
+
+     MonteCarlo(const Config &config = default_config());
+
+     void set_config(const Config &config);
+     void set_mission(const std::vector<Segment> &mission);
+
+     Status_t run(Result &result);
+
+     static void summarize(const Result &result, Summary &summary);
+
+protected:
+private:
+     // A stretch of constant input ending at a trajectory sample or at the
+     // end of a segment
+     struct Interval {
+          double port;
+          double star;
+          double vert;
+          int steps;
+          bool record;
+     };
+
+     Config config_;
+     std::vector<Segment> mission_;
+     std::vector<Interval> plan_;
+     int samples_;
+     double steps_;
+
+     Kernel_t kernel_;
+     std::atomic<int> next_batch_;
+     void plan();
+     void run_batches(Result &result);
+     void draw(int run, double *coef, double *state) const;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef MONTE_CARLO_KERNEL_H_
+#define MONTE_CARLO_KERNEL_H_
+/// ---------------------------------------------------------------------------
+/// @file MonteCarloKernel.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// The batched VideoRay model behind MonteCarlo. The lanes are laid out
+/// as structure-of-arrays: one array per state and one per coefficient,
+/// with one vehicle per array slot. advance() takes four vehicles at a
+/// time, keeps their states in registers for all the RK4 steps of an
+/// interval, and writes them back once.
+///
+/// The equations are those of VideoRayModel on the 12-state vector of
+/// videoray_sim_and_control. Each derivative evaluation takes one sincos
+/// per angle; tan(theta) and 1/cos(theta) are formed from it.
+///
+/// The template is instantiated twice, with Vec4 in MonteCarlo.cpp and
+/// with Avx2Vec4 in MonteCarloAvx2.cpp, which is the only file built with
+/// -mavx2 -mfma. The functions here are static and the lane types come
+/// from an anonymous namespace in SimdVec.h, so both instantiations and
+/// all they call have internal linkage. The AVX2 copy cannot replace the
+/// generic one at link time.
+///
+/// ----------------------------------------------------------------------------
+
+#include "SimdVec.h"
+
+namespace mc {
+
+// State order of VideoRayModel in videoray_sim_and_control
+enum State_t
+{
+     U = 0, V, W, P, Q, R, XPos, YPos, ZPos, Phi, Theta, Psi,
+     State_Count
+};
+
+// Per lane coefficients, the added mass terms also as inverses
+enum Coef_t
+{
+     X_udot = 0, Y_vdot, Inv_X_udot, Inv_Y_vdot, Inv_Z_wdot, Inv_N_rdot,
+     Xu, Yv, Nr, Zw, Xuu, Yvv, Nrr, Zww,
+     Ct_forw, Ct_back, Ct_vert_forw, Ct_vert_back,
+     Coef_Count
+};
+
+struct Lanes {
+     int count;                          // a multiple of 4
+     double *state[State_Count];
+     double *coef[Coef_Count];
+};
+
+// Thruster commands, shared by every lane during an interval
+struct Input {
+     double port;
+     double star;
+     double vert;
+};
+
+template <class L>
+struct Forces {
+     L X, N, Z;
+};
+
+template <class L>
+static inline void derivative(const L *x, L *dx, const L *k,
+                              const Forces<L> &f)
+{
+     L u = x[U], v = x[V], w = x[W], p = x[P], q = x[Q], r = x[R];
+
+     dx[U] = (-k[Y_vdot] * v * r + k[Xu] * u + k[Xuu] * u * abs_lanes(u) +
+              f.X) * k[Inv_X_udot];
+     dx[V] = (k[X_udot] * u * r + k[Yv] * v + k[Yvv] * v * abs_lanes(v)) *
+          k[Inv_Y_vdot];
+     dx[W] = (k[Zw] * w + k[Zww] * w * abs_lanes(w) + f.Z) * k[Inv_Z_wdot];
+     dx[P] = L(0.0);
+     dx[Q] = L(0.0);
+     dx[R] = (k[Nr] * r + k[Nrr] * r * abs_lanes(r) + f.N) * k[Inv_N_rdot];
+
+     L s1, c1, s2, c2, s3, c3;
+     sincos_lanes(x[Phi], s1, c1);
+     sincos_lanes(x[Theta], s2, c2);
+     sincos_lanes(x[Psi], s3, c3);
+     L sec2 = L(1.0) / c2;
+     L t2 = s2 * sec2;
+
+     dx[XPos] = c3*c2*u + (c3*s2*s1 - s3*c1)*v + (s3*s1 + c3*c1*s2)*w;
+     dx[YPos] = s3*c2*u + (c1*c3 + s1*s2*s3)*v + (c1*s2*s3 - c3*s1)*w;
+     dx[ZPos] = -s2*u + c2*s1*v + c1*c2*w;
+
+     L yaw_term = q*s1 + r*c1;
+     dx[Phi] = p + yaw_term*t2;
+     dx[Theta] = q*c1 - r*s1;
+     dx[Psi] = yaw_term*sec2;
+}
+
+// Runs steps RK4 steps of dt on every lane
+template <class L>
+static void advance(const Lanes &lanes, const Input &input, double dt,
+                    int steps)
+{
+     const L half(0.5 * dt), full(dt), sixth(dt / 6.0), two(2.0);
+     for (int i = 0; i < lanes.count; i += L::WIDTH) {
+          L k[Coef_Count];
+          for (int c = 0; c < Coef_Count; c++) {
+               k[c] = L::load(lanes.coef[c] + i);
+          }
+          L x[State_Count];
+          for (int s = 0; s < State_Count; s++) {
+               x[s] = L::load(lanes.state[s] + i);
+          }
+
+          // The command's sign picks the thrust coefficient
+          L ct_port = input.port >= 0 ? k[Ct_forw] : k[Ct_back];
+          L ct_star = input.star >= 0 ? k[Ct_forw] : k[Ct_back];
+          L ct_vert = input.vert >= 0 ? k[Ct_vert_forw] : k[Ct_vert_back];
+          L thrust_port = ct_port * L(input.port);
+          L thrust_star = ct_star * L(input.star);
+          Forces<L> f;
+          f.X = thrust_port + thrust_star;
+          f.N = thrust_star - thrust_port;
+          f.Z = ct_vert * L(input.vert);
+
+          L k1[State_Count], k2[State_Count], k3[State_Count];
+          L k4[State_Count], t[State_Count];
+          for (int n = 0; n < steps; n++) {
+               derivative(x, k1, k, f);
+               for (int s = 0; s < State_Count; s++) {
+                    t[s] = mul_add(half, k1[s], x[s]);
+               }
+               derivative(t, k2, k, f);
+               for (int s = 0; s < State_Count; s++) {
+                    t[s] = mul_add(half, k2[s], x[s]);
+               }
+               derivative(t, k3, k, f);
+               for (int s = 0; s < State_Count; s++) {
+                    t[s] = mul_add(full, k3[s], x[s]);
+               }
+               derivative(t, k4, k, f);
+               for (int s = 0; s < State_Count; s++) {
+                    L sum = k1[s] + k4[s] + two * (k2[s] + k3[s]);
+                    x[s] = mul_add(sixth, sum, x[s]);
+               }
+          }
+
+          for (int s = 0; s < State_Count; s++) {
+               x[s].store(lanes.state[s] + i);
+          }
+     }
+}
+
+}
+
+// One instantiation per file, see above
+void monte_carlo_advance_generic(const mc::Lanes &lanes,
+                                 const mc::Input &input, double dt,
+                                 int steps);
+void monte_carlo_advance_avx2(const mc::Lanes &lanes, const mc::Input &input,
+                              double dt, int steps);
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef NAV_ESTIMATOR_H_
+#define NAV_ESTIMATOR_H_
+/// ---------------------------------------------------------------------------
+/// @file NavEstimator.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Dead-reckoning navigation for a vehicle without position fixes. An
+/// extended Kalman filter runs the VideoRay Pro III model (the
+/// coefficients of octave/videoray_pro_3_params.m) with the thruster
+/// commands as its input, and corrects it with every nav block: heading,
+/// depth and the surge, sway, heave and yaw accelerations.
+///
+/// The state is the position north/east/down of where the filter started,
+/// the body velocities u, v, w, the yaw and the yaw rate. Roll and pitch
+/// are not estimated; the measured ones rotate the velocities and remove
+/// gravity from the accelerometers. Horizontal position is unobserved, its
+/// covariance grows with time and is reported as position_sigma.
+///
+/// Drag is integrated implicitly. N_rdot is small against the quadratic
+/// yaw damping, and explicit Euler at a 20 ms control period goes unstable
+/// above about 1 rad/s of yaw rate. Longer predictions are cut into steps
+/// of at most max_step.
+///
+/// All matrices are fixed-size Eigen types: predict() and update() never
+/// allocate (see nav_estimator_bench). A class holding a NavEstimator by
+/// value needs EIGEN_MAKE_ALIGNED_OPERATOR_NEW as well.
+///
+/// ----------------------------------------------------------------------------
+
+#include <Eigen/Dense>
+
+#include "CsrMap.h"
+
+class NavEstimator {
+public:
+
+     enum State_t
+     {
+          North = 0,
+          East,
+          Down,
+          Surge,
+          Sway,
+          Heave,
+          Yaw,
+          YawRate,
+          State_Count
+     };
+
+     enum Measurement_t
+     {
+          Heading_Measurement = 0,
+          Depth_Measurement,
+          Surge_Measurement,
+          Sway_Measurement,
+          Heave_Measurement,
+          YawAccel_Measurement,
+          Measurement_Count
+     };
+
+     typedef Eigen::Matrix<double, State_Count, 1> StateVector;
+     typedef Eigen::Matrix<double, State_Count, State_Count> StateMatrix;
+
+     // Added mass, drag and thrust coefficients, names as in the octave
+     // model
+     struct Model {
+          double X_udot;
+          double Y_vdot;
+          double Z_wdot;
+          double N_rdot;
+          double Xu;
+          double Yv;
+          double Nr;
+          double Zw;
+          double Xuu;
+          double Yvv;
+          double Nrr;
+          double Zww;
+          double Ct_forw;
+          double Ct_back;
+          double Ct_vert_forw;
+          double Ct_vert_back;
+     };
+
+     struct Config {
+          Model model;
+          double process_noise[State_Count];      // per sqrt(s), state units
+          double measurement_noise[Measurement_Count]; // std. deviations
+          double initial_sigma[State_Count];
+          double accel_scale[3];         // nav surge/sway/heave to m/s^2
+          double yaw_accel_scale;        // nav yaw_accel to rad/s^2
+          double gravity;                // m/s^2
+          double max_step;               // longest integration step (s)
+     };
+
+     struct Estimate {
+          double north;                  // m from the start
+          double east;
+          double down;
+          double surge;                  // body velocities (m/s)
+          double sway;
+          double heave;
+          double roll;                   // rad, as measured
+          double pitch;                  // rad, as measured
+          double yaw;                    // rad, within [0, 2 pi)
+          double yaw_rate;               // rad/s
+          double position_sigma;         // horizontal 1-sigma (m)
+          unsigned long updates;         // nav blocks fused
+     };
+
+     static Config default_config();
+
+     NavEstimator(const Config &config = default_config());
+
+     void set_config(const Config &config);
+
+     // Back to the origin, at rest; the next nav block sets yaw and depth
+     void reset();
+
+     // Thruster commands held until the next call
+     void set_thrust(int port, int star, int vert);
+
+     // Propagates state and covariance by dt seconds
+     void predict(double dt);
+
+     // Fuses one nav block at the filter's current time
+     void update(const NavData &nav);
+
+     // The state dt seconds ahead, covariance and filter left untouched
+     void extrapolate(double dt, Estimate &estimate) const;
+
+     const StateVector & state() const { return x_; }
+     const StateMatrix & covariance() const { return P_; }
+
+     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+protected:
+private:
+     typedef Eigen::Matrix<double, Measurement_Count, 1> MeasurementVector;
+     typedef Eigen::Matrix<double, Measurement_Count, State_Count>
+          MeasurementMatrix;
+     typedef Eigen::Matrix<double, Measurement_Count, Measurement_Count>
+          InnovationMatrix;
+
+     Config config_;
+     StateVector x_;
+     StateMatrix P_;
+     StateMatrix Q_;                     // per second
+     InnovationMatrix R_;
+
+     double X_;                          // forces from the thrusters
+     double N_;
+     double Z_;
+     double roll_;
+     double pitch_;
+     bool initialized_;
+     unsigned long updates_;
+
+     void step(StateVector &x, double dt, StateMatrix *F) const;
+     void accelerations(const StateVector &x, double accel[4],
+                        MeasurementMatrix *H) const;
+};
+
+#endif
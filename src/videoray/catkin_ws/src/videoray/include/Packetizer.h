@@ -39,26 +39,89 @@
 /// 
 /// ----------------------------------------------------------------------------
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
 class Packetizer {
+public:
+     // Largest payload the length byte can describe
+     static const int MAX_PAYLOAD = 255;
+     static const int HEADER_SIZE = 7;
+     // Header + payload + total checksum
+     static const int MAX_PACKET_SIZE = HEADER_SIZE + MAX_PAYLOAD + 1;
+
+     // A decoded frame. payload points either into the chunk that
+     // was passed to feed() or, for a frame that straddled two chunks, into
+     // the Packetizer's carry buffer. Either way it is only valid until the
+     // next call to feed() or next().
+     struct Frame {
+          unsigned char network_id;
+          unsigned char flags;
+          unsigned char csr_addr;
+          int length;
+          const uint8_t *payload;
+     };
+
+     // A frame laid out for a gather write. The header and the total
+     // checksum are built in place and the payload is only referenced, so
+     // the caller's buffer must stay untouched until the frame is sent.
+     struct TxFrame {
+          uint8_t header[HEADER_SIZE];
+          const uint8_t *payload;
+          int length;
+          uint8_t trailer;
+     };
+
+     // Decoder health counters
+     struct Stats {
+          unsigned long frames;           // frames that passed both checksums
+          unsigned long sync_errors;      // sync byte not followed by its pair
+          unsigned long hdr_chk_errors;
+          unsigned long total_chk_errors;
+          unsigned long skipped_bytes;    // bytes discarded between frames
+          unsigned long dropped_bytes;    // unread bytes lost to a full carry
+     };
+
 private:
      unsigned char network_id_;
      unsigned char flags_;
      unsigned char csr_addr_;
      unsigned char length_;
-     unsigned char header_chk_sum_;
-     unsigned char total_chk_sum_;
 
-     const unsigned char REQUEST_SYNC_MSB_;
-     const unsigned char REQUEST_SYNC_LSB_;
-     const unsigned char RESPONSE_SYNC_MSB_;
-     const unsigned char RESPONSE_SYNC_LSB_;
+     // Sync bytes of the frames we send and of the frames we decode
+     const unsigned char TX_SYNC_MSB_;
+     const unsigned char TX_SYNC_LSB_;
+     const unsigned char RX_SYNC_MSB_;
+     const unsigned char RX_SYNC_LSB_;
      
-     char *packet_;
+     // Storage is fixed at construction so that encoding and decoding never
+     // touch the heap on the control path.
+     char packet_[MAX_PACKET_SIZE];
+     char payload_[MAX_PAYLOAD];
 
      unsigned char generate_check_sum(char *buf, int length);
 
-     int count_;
      int rx_bytes_;
+     uint8_t rx_byte_;
+
+     // Bulk decoder state. carry_ holds bytes of a frame that straddles
+     // chunks, from carry_start_ up to carry_len_. It has room for one
+     // frame plus the unread tail of a previous chunk.
+     const uint8_t *chunk_;
+     size_t chunk_len_;
+     size_t chunk_pos_;
+     uint8_t carry_[2 * MAX_PACKET_SIZE];
+     int carry_start_;
+     int carry_len_;
+
+     Stats stats_;
+
+     int check_frame(const uint8_t *p, size_t avail);
+     void emit_frame(const uint8_t *p, Frame &frame);
+     void compact_carry();
+     void resync_carry(int from);
+     bool next_carried(Frame &frame);
 
 protected:
 public:
@@ -72,7 +135,15 @@ public:
           Sync_Err = 4
      };
 
-     Packetizer();
+     // A Host sends requests (0xFA 0xAF) and decodes responses (0xFD 0xDF),
+     // a Device (the vehicle, or an emulator of it) does the opposite.
+     enum Role_t
+     {
+          Host = 0,
+          Device
+     };
+
+     Packetizer(Role_t role = Host);
 
      void set_network_id(unsigned char network_id);
      void set_flags(unsigned char flags);
@@ -81,9 +152,34 @@ public:
      
      int generate_packet(char **packet);
 
+     // Scatter-gather transmit: build_frame() fills frame from the current
+     // network id, flags and CSR address without copying data, and
+     // frame_iovec() lays out any number of frames for one writev() call.
+     // Returns the number of iovec entries used (at most 3 per frame).
+     void build_frame(TxFrame &frame, const void *data, int length);
+     static int frame_iovec(const TxFrame *frames, int count, 
+                            struct iovec *iov);
+
      void reset();
      Packetizer::Status_t receive_packet(unsigned char byte);
      int get_payload(char ** packet);
+
+     // Header of the last packet completed by receive_packet() (or of the
+     // next packet to send)
+     unsigned char network_id() const;
+     unsigned char flags() const;
+     unsigned char csr_addr() const;
+
+     // Bulk decoder: hand over whatever chunk read() returned, then call
+     // next() until it returns false to collect every complete frame in it.
+     // A partial frame at the end of the chunk is completed by the next
+     // chunk. Frames that fail the header or payload checksum are dropped
+     // and the stream is rescanned from the byte after their sync word.
+     void feed(const uint8_t *buf, size_t len);
+     bool next(Frame &frame);
+
+     const Stats & stats() const;
+     void clear_stats();
 };
 
 #endif
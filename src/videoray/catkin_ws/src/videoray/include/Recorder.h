@@ -0,0 +1,145 @@
+#ifndef RECORDER_H_
+#define RECORDER_H_
+/// ---------------------------------------------------------------------------
+/// @file Recorder.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// rosbag recorder that lives inside a node. The topics are subscribed once
+/// at construction. While idle, incoming messages are kept in a pre-trigger
+/// ring bounded in time and in bytes; start() hands the ring to the writer,
+/// so the bag begins a few seconds before the trigger instead of after a
+/// new process has subscribed. A background thread writes the bag (with
+/// optional LZ4 chunk compression) while the node keeps running; messages
+/// that would take the write queue past the memory limit are dropped and
+/// counted.
+///
+/// Bags are written as <directory>/<prefix>_<date>.bag.active and renamed
+/// when closed, like rosbag record.
+///
+/// ----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "ros/ros.h"
+#include <rosbag/bag.h>
+#include <topic_tools/shape_shifter.h>
+
+class Recorder {
+public:
+
+     enum Status_t
+     {
+          Success = 0,
+          Failure
+     };
+
+     struct Config {
+          std::string directory;
+          std::string prefix;
+          double pre_trigger;            // seconds kept before start()
+          size_t pre_trigger_bytes;      // ceiling of the pre-trigger ring
+          size_t memory_limit;           // ceiling of the write queue
+          bool lz4;                      // compress bag chunks with LZ4
+          unsigned int chunk_size;       // bytes per bag chunk
+     };
+
+     struct Stats {
+          unsigned long messages;        // messages written to bags
+          unsigned long bytes;
+          unsigned long dropped;         // messages over the memory limit
+          unsigned long dropped_bytes;
+          size_t queued_bytes;           // waiting for the writer
+     };
+
+     Recorder(ros::NodeHandle &n, const std::vector<std::string> &topics,
+              const Config &config);
+     ~Recorder();
+
+     // Opens a new bag holding the pre-trigger ring and everything received
+     // until stop(). Fails while the previous bag is still being written.
+     Status_t start();
+
+     // Returns at once, the writer finishes and closes the bag
+     void stop();
+
+     bool recording();
+     std::string filename();
+     Stats stats();
+
+protected:
+private:
+     typedef topic_tools::ShapeShifter Message;
+
+     struct Entry {
+          std::string topic;
+          ros::Time time;
+          boost::shared_ptr<Message const> msg;
+          boost::shared_ptr<ros::M_string> connection_header;
+          size_t size;
+     };
+
+     Config config_;
+     std::vector<ros::Subscriber> subs_;
+
+     std::mutex mutex_;
+     std::condition_variable cond_;
+
+     // Messages received while idle, oldest first
+     std::deque<Entry> ring_;
+     size_t ring_bytes_;
+
+     // Messages of the current bag not written yet, plus the batch the
+     // writer is busy with
+     std::deque<Entry> pending_;
+     size_t pending_bytes_;
+     size_t writing_bytes_;
+
+     bool recording_;
+     bool running_;
+     bool bag_busy_;                // a bag is opened or waiting to close
+     bool close_requested_;
+     std::string filename_;
+     Stats stats_;
+
+     rosbag::Bag bag_;
+     std::thread thread_;
+
+     void callback(const ros::MessageEvent<Message const> &event,
+                   const std::string &topic);
+     void writer();
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef SIM_CLOCK_H_
+#define SIM_CLOCK_H_
+/// ---------------------------------------------------------------------------
+/// @file SimClock.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// Paces a simulator loop and, in simulated time mode, owns the ROS clock.
+///
+/// Without ~sim_time the loop behaves as the simulators always did: one
+/// step per period of ros::Rate, dt measured with ros::Time::now().
+///
+/// With ~sim_time the simulator advances its own time by exactly one
+/// period per step and publishes it on /clock, so every node started with
+/// /use_sim_time follows it (ros::Rate, ros::Time::now(), timers). The
+/// loop is paced on the wall clock by ~real_time_factor: 1 is real time,
+/// 10 runs ten times faster, 0 steps as fast as the CPU allows. With
+/// ~lockstep each step also waits, up to ~lockstep_timeout wall seconds,
+/// for the controller's next output, so a slow controller cannot fall
+/// behind the vehicle however fast the simulation runs.
+///
+/// ----------------------------------------------------------------------------
+
+#include "ros/ros.h"
+
+class SimClock {
+public:
+
+     struct Config {
+          double rate;                   // steps per simulated second
+          bool sim_time;                 // own and publish /clock
+          double real_time_factor;       // simulated per wall second,
+                                         // 0 is as fast as possible
+          bool lockstep;                 // wait for controller output
+          double lockstep_timeout;       // wall seconds
+     };
+
+     struct Stats {
+          unsigned long steps;
+          double sim_elapsed;            // s
+          double wall_elapsed;           // s
+          unsigned long lockstep_timeouts;
+     };
+
+     // Real time at 10 Hz
+     static Config default_config();
+
+     // Reads ~rate, ~sim_time, ~real_time_factor, ~lockstep and
+     // ~lockstep_timeout over the defaults in config
+     static void get_params(Config &config);
+
+     SimClock(ros::NodeHandle &node, const Config &config = default_config());
+
+     // Start of the step about to be simulated and its length (s)
+     const ros::Time & now() const { return time_; }
+     double dt() const { return dt_; }
+
+     // Call from the subscriber callbacks of the controller's output
+     void command_received() { commands_++; }
+
+     // Ends a step: advances and publishes the clock, then waits for the
+     // wall clock and, in lockstep, for the controller
+     void step();
+
+     const Stats & stats() const { return stats_; }
+
+     // Steps and elapsed times, printed by the simulators on exit
+     void print_stats() const;
+
+protected:
+private:
+     Config config_;
+     Stats stats_;
+     ros::Publisher clock_pub_;
+     ros::Rate rate_;
+     ros::Duration period_;
+     ros::Time time_;
+     double dt_;
+
+     ros::Time sim_origin_;
+     ros::WallTime wall_origin_;
+     ros::WallTime wall_start_;
+
+     unsigned long commands_;
+     unsigned long commands_seen_;
+     bool timeout_reported_;
+
+     void publish_clock();
+     void wait_for_command();
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef SIM_INTEGRATOR_H_
+#define SIM_INTEGRATOR_H_
+/// ---------------------------------------------------------------------------
+/// @file SimIntegrator.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// The simulators' choice of integrator, made from their ROS parameters.
+///
+/// ~stepper picks rosenbrock4 (StiffIntegrator, stable at any step on the
+/// stiff yaw mode, the default) or dopri5 (AdaptiveIntegrator). ~abs_tol
+/// and ~rel_tol set the tolerances of either. advance() goes to the one
+/// picked, with the model's own Jacobian for rosenbrock4.
+///
+/// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string>
+
+#include "ros/ros.h"
+
+#include "AdaptiveIntegrator.h"
+#include "StiffIntegrator.h"
+
+template <class State>
+class SimIntegrator {
+public:
+     typedef typename AdaptiveIntegrator<State>::Config Tolerances;
+     typedef typename AdaptiveIntegrator<State>::Stats Stats;
+
+     struct Config {
+          bool stiff;                    // rosenbrock4, otherwise dopri5
+          Tolerances tolerances;
+     };
+
+     // rosenbrock4 with AdaptiveIntegrator's tolerances
+     static Config default_config()
+     {
+          Config config;
+          config.stiff = true;
+          config.tolerances = AdaptiveIntegrator<State>::default_config();
+          return config;
+     }
+
+     // Reads ~stepper, ~abs_tol and ~rel_tol over the defaults in config
+     static void get_params(Config &config)
+     {
+          ros::NodeHandle private_node("~");
+          std::string stepper = config.stiff ? "rosenbrock4" : "dopri5";
+          private_node.param("stepper", stepper, stepper);
+          private_node.param("abs_tol", config.tolerances.abs_tol,
+                             config.tolerances.abs_tol);
+          private_node.param("rel_tol", config.tolerances.rel_tol,
+                             config.tolerances.rel_tol);
+          if (stepper != "rosenbrock4" && stepper != "dopri5") {
+               ROS_WARN("Unknown ~stepper %s, using rosenbrock4",
+                        stepper.c_str());
+               stepper = "rosenbrock4";
+          }
+          config.stiff = (stepper == "rosenbrock4");
+     }
+
+     SimIntegrator(const Config &config = default_config())
+          : config_(config), adaptive_(config.tolerances),
+            stiff_(config.tolerances) { }
+
+     // Advances x by one output period, restart as in AdaptiveIntegrator
+     template <class Model>
+     void advance(const Model &model, State &x, double period, bool restart)
+     {
+          if (config_.stiff) {
+               stiff_.advance(model, typename Model::Jacobian(), x, period,
+                              restart);
+          } else {
+               adaptive_.advance(model, x, period, restart);
+          }
+     }
+
+     const char * name() const
+     {
+          return config_.stiff ? "rosenbrock4" : "dopri5";
+     }
+
+     const Stats & stats() const
+     {
+          return config_.stiff ? stiff_.stats() : adaptive_.stats();
+     }
+
+     // Step counts, printed by the simulators on exit
+     void print_stats() const
+     {
+          const Stats &steps = stats();
+          printf("Integrator: %s, %lu outputs, %lu steps (%.2f per output), "
+                 "%lu rejected, %lu restarts\n", name(), steps.outputs,
+                 steps.steps,
+                 steps.outputs > 0 ? (double)steps.steps / steps.outputs : 0.0,
+                 steps.rejected, steps.restarts);
+     }
+
+protected:
+private:
+     Config config_;
+     AdaptiveIntegrator<State> adaptive_;
+     StiffIntegrator<State> stiff_;
+};
+
+#endif
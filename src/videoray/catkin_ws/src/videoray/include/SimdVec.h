@@ -0,0 +1,236 @@
+#ifndef SIMD_VEC_H_
+#define SIMD_VEC_H_
+/// ---------------------------------------------------------------------------
+/// @file SimdVec.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Four doubles handled as one value, for code that runs the same
+/// arithmetic over several independent vehicles. Vec4 is plain C++ and
+/// builds everywhere. Avx2Vec4 keeps the four lanes in a single ymm
+/// register; it is only defined when the translation unit is compiled for
+/// AVX2 and FMA (-mavx2 -mfma), and the caller has to check the CPU at
+/// run time before using such code.
+///
+/// Both types provide the same free functions: mul_add(), abs_lanes() and
+/// sincos_lanes(). Vec4 takes sine and cosine from libm. Avx2Vec4 computes
+/// them itself: the argument is reduced modulo pi/2 (Cody-Waite, three
+/// parts) and the Cephes polynomials are evaluated on [-pi/4, pi/4].
+/// They are accurate to a few ulp for |x| below 1e5.
+///
+/// Everything in this header is in an anonymous namespace. Each
+/// translation unit then keeps its own copies of the types and functions,
+/// and any template instantiated on them. Out-of-line copies emitted by
+/// a unit built with AVX2 cannot be linked into a generic one.
+///
+/// ----------------------------------------------------------------------------
+
+#include <math.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct Vec4 {
+     static const int WIDTH = 4;
+     double v[WIDTH];
+
+     Vec4() {}
+     Vec4(double a)
+     {
+          for (int i = 0; i < WIDTH; i++) v[i] = a;
+     }
+
+     static Vec4 load(const double *p)
+     {
+          Vec4 r;
+          for (int i = 0; i < WIDTH; i++) r.v[i] = p[i];
+          return r;
+     }
+
+     void store(double *p) const
+     {
+          for (int i = 0; i < WIDTH; i++) p[i] = v[i];
+     }
+};
+
+#define VEC4_OPERATOR(op)                                               \
+     inline Vec4 operator op(const Vec4 &a, const Vec4 &b)              \
+     {                                                                  \
+          Vec4 r;                                                       \
+          for (int i = 0; i < Vec4::WIDTH; i++) r.v[i] = a.v[i] op b.v[i]; \
+          return r;                                                     \
+     }
+
+VEC4_OPERATOR(+)
+VEC4_OPERATOR(-)
+VEC4_OPERATOR(*)
+VEC4_OPERATOR(/)
+
+#undef VEC4_OPERATOR
+
+inline Vec4 operator-(const Vec4 &a)
+{
+     Vec4 r;
+     for (int i = 0; i < Vec4::WIDTH; i++) r.v[i] = -a.v[i];
+     return r;
+}
+
+// a * b + c
+inline Vec4 mul_add(const Vec4 &a, const Vec4 &b, const Vec4 &c)
+{
+     Vec4 r;
+     for (int i = 0; i < Vec4::WIDTH; i++) r.v[i] = a.v[i] * b.v[i] + c.v[i];
+     return r;
+}
+
+inline Vec4 abs_lanes(const Vec4 &a)
+{
+     Vec4 r;
+     for (int i = 0; i < Vec4::WIDTH; i++) r.v[i] = fabs(a.v[i]);
+     return r;
+}
+
+inline void sincos_lanes(const Vec4 &x, Vec4 &s, Vec4 &c)
+{
+     for (int i = 0; i < Vec4::WIDTH; i++) {
+          s.v[i] = sin(x.v[i]);
+          c.v[i] = cos(x.v[i]);
+     }
+}
+
+#ifdef __AVX2__
+
+struct Avx2Vec4 {
+     static const int WIDTH = 4;
+     __m256d v;
+
+     Avx2Vec4() {}
+     Avx2Vec4(__m256d a) : v(a) {}
+     Avx2Vec4(double a) : v(_mm256_set1_pd(a)) {}
+
+     static Avx2Vec4 load(const double *p) { return _mm256_loadu_pd(p); }
+     void store(double *p) const { _mm256_storeu_pd(p, v); }
+};
+
+inline Avx2Vec4 operator+(const Avx2Vec4 &a, const Avx2Vec4 &b)
+{
+     return _mm256_add_pd(a.v, b.v);
+}
+
+inline Avx2Vec4 operator-(const Avx2Vec4 &a, const Avx2Vec4 &b)
+{
+     return _mm256_sub_pd(a.v, b.v);
+}
+
+inline Avx2Vec4 operator*(const Avx2Vec4 &a, const Avx2Vec4 &b)
+{
+     return _mm256_mul_pd(a.v, b.v);
+}
+
+inline Avx2Vec4 operator/(const Avx2Vec4 &a, const Avx2Vec4 &b)
+{
+     return _mm256_div_pd(a.v, b.v);
+}
+
+inline Avx2Vec4 operator-(const Avx2Vec4 &a)
+{
+     return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0));
+}
+
+inline Avx2Vec4 mul_add(const Avx2Vec4 &a, const Avx2Vec4 &b,
+                        const Avx2Vec4 &c)
+{
+     return _mm256_fmadd_pd(a.v, b.v, c.v);
+}
+
+inline Avx2Vec4 abs_lanes(const Avx2Vec4 &a)
+{
+     return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v);
+}
+
+inline void sincos_lanes(const Avx2Vec4 &x, Avx2Vec4 &s, Avx2Vec4 &c)
+{
+     // Nearest multiple of pi/2, and the remainder in [-pi/4, pi/4]
+     __m256d n = _mm256_round_pd(_mm256_mul_pd(x.v, 
+                                               _mm256_set1_pd(M_2_PI)),
+                                 _MM_FROUND_TO_NEAREST_INT | 
+                                 _MM_FROUND_NO_EXC);
+     __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(1.57079625129699707031),
+                                  x.v);
+     r = _mm256_fnmadd_pd(n, _mm256_set1_pd(7.54978941586159635336e-8), r);
+     r = _mm256_fnmadd_pd(n, _mm256_set1_pd(5.39030285815811905290e-15), r);
+     __m256d z = _mm256_mul_pd(r, r);
+
+     __m256d ps = _mm256_set1_pd(1.58962301576546568060e-10);
+     ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(-2.50507477628578072866e-8));
+     ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(2.75573136213857245213e-6));
+     ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(-1.98412698295895385996e-4));
+     ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(8.33333333332211858878e-3));
+     ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(-1.66666666666666307295e-1));
+     __m256d sin_r = _mm256_fmadd_pd(_mm256_mul_pd(r, z), ps, r);
+
+     __m256d pc = _mm256_set1_pd(-1.13585365213876817300e-11);
+     pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(2.08757008419747316778e-9));
+     pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(-2.75573141792967388112e-7));
+     pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(2.48015872888517045348e-5));
+     pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(-1.38888888888730564116e-3));
+     pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(4.16666666666665929218e-2));
+     __m256d cos_r = _mm256_fmadd_pd(_mm256_mul_pd(z, z), pc,
+                                     _mm256_fnmadd_pd(_mm256_set1_pd(0.5), z,
+                                                      _mm256_set1_pd(1.0)));
+
+     // Quadrant n mod 4: odd quadrants swap sine and cosine, the sine is
+     // negative in quadrants 2 and 3, the cosine in 1 and 2
+     __m256i q = _mm256_castpd_si256(
+          _mm256_add_pd(n, _mm256_set1_pd(6755399441055744.0)));
+     __m256i one = _mm256_set1_epi64x(1);
+     __m256i two = _mm256_set1_epi64x(2);
+     __m256d swap = _mm256_castsi256_pd(
+          _mm256_cmpeq_epi64(_mm256_and_si256(q, one), one));
+     __m256i q1 = _mm256_add_epi64(q, one);
+     __m256d sin_sign = _mm256_castsi256_pd(
+          _mm256_slli_epi64(_mm256_and_si256(q, two), 62));
+     __m256d cos_sign = _mm256_castsi256_pd(
+          _mm256_slli_epi64(_mm256_and_si256(q1, two), 62));
+
+     __m256d s0 = _mm256_blendv_pd(sin_r, cos_r, swap);
+     __m256d c0 = _mm256_blendv_pd(cos_r, sin_r, swap);
+     s.v = _mm256_xor_pd(s0, sin_sign);
+     c.v = _mm256_xor_pd(c0, cos_sign);
+}
+
+#endif
+
+} // namespace
+
+#endif
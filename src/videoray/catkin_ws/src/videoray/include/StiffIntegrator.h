@@ -0,0 +1,214 @@
+#ifndef STIFF_INTEGRATOR_H_
+#define STIFF_INTEGRATOR_H_
+/// ---------------------------------------------------------------------------
+/// @file StiffIntegrator.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// Linearly implicit integration of the vehicle model for the simulators,
+/// for the stiff yaw-rate mode.
+///
+/// With the Pro III's small yaw inertia (N_rdot) and quadratic yaw drag
+/// the yaw rate relaxes in (Nr + 2 Nrr |r|) / N_rdot, around -300/s in a
+/// hard turn. An explicit stepper has to follow that time scale for
+/// stability even after the transient has died out: RK4 at the 10 Hz
+/// output period diverges, Dormand-Prince keeps having its steps
+/// rejected. odeint's rosenbrock4 solves with the model's Jacobian at
+/// every step, is stable at any step size, and rosenbrock4_controller
+/// sizes the steps for accuracy alone.
+///
+/// Same use as AdaptiveIntegrator (dense output sampled every output
+/// period, restart on thrust changes, the same counters), but advance()
+/// also takes the Jacobian: jacobian(x, J) fills J with d(dxdt)/dx on a
+/// zeroed matrix. The model is autonomous, df/dt is zero. rosenbrock4
+/// works on ublas vectors; the model keeps its own state type and is
+/// called through adapters that copy the state.
+///
+/// ----------------------------------------------------------------------------
+
+#include <boost/numeric/odeint.hpp>
+
+#include "AdaptiveIntegrator.h"
+
+template <class State>
+class StiffIntegrator {
+public:
+     typedef boost::numeric::ublas::matrix<double> matrix_type;
+     typedef typename AdaptiveIntegrator<State>::Config Config;
+     typedef typename AdaptiveIntegrator<State>::Stats Stats;
+
+     static Config default_config()
+     {
+          return AdaptiveIntegrator<State>::default_config();
+     }
+
+     StiffIntegrator(const Config &config = default_config())
+          : config_(config), dense_(CountingController(config.abs_tol,
+                                                       config.rel_tol,
+                                                       &stats_)),
+            x_(State().size()), initialized_(false), time_(0)
+     {
+          reset_stats();
+     }
+
+     // Advances x by one output period, restart as in AdaptiveIntegrator
+     template <class System, class Jacobian>
+     void advance(System system, Jacobian jacobian, State &x, double period,
+                  bool restart)
+     {
+          std::pair<Derivative<System>, JacobianAdapter<Jacobian> > sys =
+               std::make_pair(Derivative<System>(system),
+                              JacobianAdapter<Jacobian>(jacobian));
+
+          if (restart || !initialized_) {
+               double dt = config_.initial_dt;
+               if (initialized_) {
+                    dt = std::min(dense_.current_time_step(), period);
+               }
+               std::copy(x.begin(), x.end(), x_.begin());
+               dense_.initialize(x_, time_, dt);
+               initialized_ = true;
+               stats_.restarts++;
+          }
+
+          time_ += period;
+          while (dense_.current_time() < time_) {
+               dense_.do_step(sys);
+               stats_.steps++;
+          }
+          dense_.calc_state(time_, x_);
+          std::copy(x_.begin(), x_.end(), x.begin());
+          stats_.outputs++;
+          stats_.last_dt = dense_.current_time_step();
+     }
+
+     const Stats & stats() const { return stats_; }
+
+     void reset_stats()
+     {
+          stats_.outputs = 0;
+          stats_.steps = 0;
+          stats_.rejected = 0;
+          stats_.restarts = 0;
+          stats_.last_dt = 0;
+     }
+
+protected:
+private:
+     typedef boost::numeric::ublas::vector<double> vector_type;
+     typedef boost::numeric::odeint::rosenbrock4<double> stepper_type;
+     typedef boost::numeric::odeint::rosenbrock4_controller<stepper_type>
+          base_controller_type;
+
+     // Sized by the fixed-size State, so the compiler sees it filled
+     static void copy_in(const vector_type &x, State &in)
+     {
+          for (size_t i = 0; i < in.size(); i++) {
+               in[i] = x[i];
+          }
+     }
+
+     template <class System>
+     struct Derivative {
+          System system;
+
+          Derivative(System s) : system(s) { }
+
+          void operator()(const vector_type &x, vector_type &dxdt, double t)
+          {
+               State in, out;
+               copy_in(x, in);
+               typename boost::numeric::odeint::unwrap_reference<
+                    System>::type &sys = system;
+               sys(in, out, t);
+               std::copy(out.begin(), out.end(), dxdt.begin());
+          }
+     };
+
+     template <class Jacobian>
+     struct JacobianAdapter {
+          Jacobian jacobian;
+
+          JacobianAdapter(Jacobian j) : jacobian(j) { }
+
+          void operator()(const vector_type &x, matrix_type &J, const double &,
+                          vector_type &dfdt)
+          {
+               State in;
+               copy_in(x, in);
+               J.clear();
+               typename boost::numeric::odeint::unwrap_reference<
+                    Jacobian>::type &jac = jacobian;
+               jac(in, J);
+               std::fill(dfdt.begin(), dfdt.end(), 0.0);
+          }
+     };
+
+     // odeint's controller, counting the steps it turns down
+     class CountingController : public base_controller_type {
+     public:
+          typedef typename base_controller_type::state_type state_type;
+          typedef typename base_controller_type::time_type time_type;
+
+          CountingController(double abs_tol = 1.0e-6, double rel_tol = 1.0e-6,
+                             Stats *stats = NULL)
+               : base_controller_type(abs_tol, rel_tol), stats_(stats) { }
+
+          template <class System>
+          boost::numeric::odeint::controlled_step_result
+          try_step(System sys, const state_type &x, time_type &t,
+                   state_type &xout, time_type &dt)
+          {
+               boost::numeric::odeint::controlled_step_result result =
+                    base_controller_type::try_step(sys, x, t, xout, dt);
+               if (result == boost::numeric::odeint::fail && stats_ != NULL) {
+                    stats_->rejected++;
+               }
+               return result;
+          }
+
+     private:
+          Stats *stats_;
+     };
+
+     typedef boost::numeric::odeint::rosenbrock4_dense_output<
+          CountingController> dense_type;
+
+     Config config_;
+     Stats stats_;
+     dense_type dense_;
+     vector_type x_;
+     bool initialized_;
+     double time_;
+
+     // The controller keeps a pointer to stats_
+     StiffIntegrator(const StiffIntegrator &);
+     StiffIntegrator & operator=(const StiffIntegrator &);
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef TRANSACTION_TABLE_H_
+#define TRANSACTION_TABLE_H_
+/// ---------------------------------------------------------------------------
+/// @file TransactionTable.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Requests that are waiting for their response. The vehicle answers with
+/// the network id, flags and CSR address of the request, so a response is
+/// matched to the oldest outstanding request with the same three values.
+/// Requests with the same key may be outstanding together; they are
+/// answered in order. Requests that are not answered within the timeout are
+/// expired by the receiving side.
+///
+/// The sending and receiving threads share the table through a mutex that
+/// is only held for a scan of at most MAX_IN_FLIGHT entries.
+///
+/// ----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <mutex>
+
+class TransactionTable {
+public:
+
+     struct Stats {
+          unsigned long requests;        // transactions started
+          unsigned long responses;       // responses matched to a request
+          unsigned long timeouts;        // requests expired without answer
+          unsigned long unsolicited;     // responses nobody was waiting for
+          unsigned long full;            // requests refused, table full
+     };
+
+     // Most requests outstanding at the same time
+     static const int MAX_IN_FLIGHT = 16;
+
+     TransactionTable();
+
+     // Registers a request before it is sent. Returns false if the table is
+     // full (the request may still be sent, its answer will be unsolicited).
+     bool begin(uint8_t network_id, uint8_t flags, uint8_t csr_addr,
+                double now);
+
+     // Forgets the newest request with this key (it could not be sent)
+     void cancel(uint8_t network_id, uint8_t flags, uint8_t csr_addr);
+
+     // Matches a response with the oldest request of the same key. Returns
+     // false for an unsolicited response, otherwise latency is set to the
+     // time the request was outstanding.
+     bool complete(uint8_t network_id, uint8_t flags, uint8_t csr_addr,
+                   double now, double &latency);
+
+     // Drops the requests outstanding for more than timeout seconds and
+     // returns how many were dropped
+     int expire(double now, double timeout);
+
+     // Requests outstanding with this key
+     int in_flight(uint8_t network_id, uint8_t flags, uint8_t csr_addr);
+     int in_flight();
+
+     Stats stats();
+
+protected:
+private:
+     struct Entry {
+          bool used;
+          uint8_t network_id;
+          uint8_t flags;
+          uint8_t csr_addr;
+          double sent;
+     };
+
+     std::mutex mutex_;
+     Entry entries_[MAX_IN_FLIGHT];
+     Stats stats_;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef TX_QUEUE_H_
+#define TX_QUEUE_H_
+/// ---------------------------------------------------------------------------
+/// @file TxQueue.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Transmit queue between one producer (the control loop) and a writer
+/// thread that owns the tty. enqueue() copies the payload into a ring slot
+/// and builds the frame in place; flush() publishes every frame enqueued
+/// since the last flush and wakes the writer, which sends them back to back
+/// with a single writev(). Neither call takes a lock or touches the tty.
+///
+/// Without a writer thread (attach() instead of start()) the queue is
+/// serviced by an event loop: event_fd() becomes readable after a flush and
+/// service() writes the flushed frames from the loop's thread. service()
+/// never waits for the port. What a full output queue does not take stays
+/// in the ring, and the loop calls service() again once the port is
+/// writable.
+///
+/// A byte budget derived from the line rate provides backpressure: a frame
+/// that does not fit in what the link can carry is refused instead of
+/// queueing up latency behind it.
+///
+/// ----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <thread>
+#include <atomic>
+
+#include "Packetizer.h"
+
+class serialib;
+
+class TxQueue {
+public:
+
+     enum Status_t
+     {
+          Success = 0,
+          Full,                  // no free slot, the writer is behind
+          Over_Budget            // the link can not carry the frame in time
+     };
+
+     struct Stats {
+          unsigned long frames;          // frames written to the tty
+          unsigned long bytes;           // bytes of those frames
+          unsigned long writes;          // writev() calls
+          unsigned long rejected_full;
+          unsigned long rejected_budget;
+          unsigned long write_errors;
+     };
+
+     // Number of frames the ring holds (power of two)
+     static const unsigned int SLOTS = 16;
+
+     TxQueue();
+     ~TxQueue();
+
+     // Starts the writer thread on an opened port
+     bool start(serialib *serial);
+
+     // No writer thread: the owner polls event_fd() and calls service()
+     bool attach(serialib *serial);
+     int event_fd();
+     void service();
+
+     // After service(): flushed frames are left because the port was full.
+     // The owner calls service() again when the port is writable.
+     bool blocked();
+
+     void stop();
+
+     // Byte budget: the link carries baud / 10 bytes per second and up to
+     // one cycle worth of bytes may be outstanding.
+     void set_budget(unsigned int baud, double cycle_rate);
+
+     // Producer side, called from a single thread
+     Status_t enqueue(Packetizer &packetizer, const void *data, int length);
+     void flush();
+
+     // Blocks until the writer has sent everything that was flushed
+     void drain();
+
+     // Only consistent when read from the producer thread
+     Stats stats();
+
+protected:
+private:
+     struct Slot {
+          Packetizer::TxFrame frame;
+          uint8_t payload[Packetizer::MAX_PAYLOAD];
+     };
+
+     Slot slots_[SLOTS];
+
+     // Slots [tail_, head_) are published to the writer, [head_, pending_)
+     // are filled but not flushed yet.
+     std::atomic<unsigned int> head_;
+     std::atomic<unsigned int> tail_;
+     unsigned int pending_;
+
+     // Without a writer thread: bytes of the frame at tail_ that a short
+     // write already sent
+     unsigned int sent_;
+     bool blocked_;
+
+     // Token bucket, in bytes
+     double bytes_per_sec_;
+     double budget_max_;
+     double budget_;
+     double budget_time_;
+
+     serialib *serial_;
+     int event_fd_;
+     std::thread thread_;
+     std::atomic<bool> running_;
+     bool threaded_;
+
+     std::atomic<unsigned long> frames_;
+     std::atomic<unsigned long> bytes_;
+     std::atomic<unsigned long> writes_;
+     std::atomic<unsigned long> write_errors_;
+     unsigned long rejected_full_;
+     unsigned long rejected_budget_;
+
+     void writer();
+     void send_flushed();
+     void write_available(const Packetizer::TxFrame *frames, int count,
+                          struct iovec *iov, int iovcnt);
+};
+
+#endif
@@ -39,10 +39,22 @@
 /// 
 /// ----------------------------------------------------------------------------
 
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
 #include "Packetizer.h"
+#include "CsrMap.h"
+#include "TxQueue.h"
+#include "TransactionTable.h"
+#include "CsrShadow.h"
+#include "LatencyHistogram.h"
 #include <syllo_serial/serialib.h>
+#include <syllo_serial/serialcapture.h>
 
 #define MANIP_CTRL_SIZE 0x8
+#define RX_BUF_SIZE 512
 
 class VideoRayComm {
 public:
@@ -70,8 +82,86 @@ public:
           Arrow_Left
      };
 
-     VideoRayComm();
+     // Latest decoded telemetry. The counters tell a new block from one
+     // that was already seen, the times are on the CLOCK_MONOTONIC scale.
+     struct Telemetry {
+          NavData nav;
+          StatusData status;
+          unsigned long nav_updates;
+          unsigned long status_updates;
+          double nav_time;
+          double status_time;
+          Packetizer::Stats decoder;
+     };
+
+     // Register writes sent by send_control_command()
+     struct RegisterStats {
+          unsigned long control_writes;  // full control blocks (keep-alive)
+          unsigned long delta_writes;    // writes of changed registers only
+          unsigned long delta_bytes;
+          unsigned long refreshes;       // full refreshes of the shadow
+     };
+
+     // Transactions whose latency is recorded
+     enum Transaction_t
+     {
+          Control_Transaction = 0,
+          Nav_Transaction,
+          Status_Transaction,
+          Camera_Transaction,
+          Transaction_Count
+     };
+
+     // Health of the tether as seen from the host, counted since the port
+     // was opened. A latency runs from the request being queued to its
+     // response being decoded.
+     struct LinkStats {
+          LatencyHistogram latency[Transaction_Count];
+          unsigned long requests;
+          unsigned long responses;
+          unsigned long timeouts;        // requests never answered
+          unsigned long unsolicited;     // answers nobody waited for
+          unsigned long sync_errors;
+          unsigned long checksum_errors; // header or payload
+          unsigned long read_errors;
+          unsigned long write_errors;
+          unsigned long frames_in;
+          unsigned long frames_out;
+          unsigned long bytes_in;
+          unsigned long bytes_out;
+     };
+
+     // Threaded: receive and transmit threads of its own. Polled: no
+     // threads, an event loop watches rx_fd() and tx_fd() and calls
+     // service_rx(), service_tx() and expire().
+     enum IoMode_t
+     {
+          Threaded = 0,
+          Polled
+     };
+
+     // Does not exit when the port fails to open, check healthy()
+     VideoRayComm(const std::string &device = "/dev/ttyUSB0", 
+                  unsigned int baud = 115200,
+                  IoMode_t mode = Threaded);
      ~VideoRayComm();
+
+     // False once the port failed to open or a read failed (unplugged)
+     bool healthy();
+     const std::string & device();
+
+     int rx_fd();
+     int tx_fd();
+     Status_t service_rx(double now);
+     void service_tx();
+     void expire(double now);
+
+     // The port did not take every frame, service_tx() again once rx_fd()
+     // is writable
+     bool tx_blocked();
+
+     // The event loop gave up on the port
+     void fail();
      
      Status_t set_desired_heading(int heading);
      Status_t set_desired_depth(int depth);
@@ -84,12 +174,28 @@ public:
 
      Status_t set_manipulator_state(ManipState_t state);
 
+     // Sends the registers changed since the last cycle, the full control
+     // block once per keep-alive period and every written register once per
+     // refresh period. Camera and manipulator frames queued meanwhile go out
+     // in the same write.
      Status_t send_control_command();
+
+     // Only updates the shadow, the next control command sends it
      Status_t set_depth_pid_parameters();     
 
+     // Off: the whole control block is sent every cycle, as before the
+     // shadow existed
+     void set_delta_writes(bool enable);
+     RegisterStats register_stats();
+
+     // Requests are only queued: the answers are decoded by the receive
+     // thread and show up in telemetry() a few milliseconds later. A new
+     // request is not sent while the previous one is still unanswered.
      Status_t send_nav_data_command();
      Status_t request_status();
 
+     Telemetry telemetry();
+
      double depth();
      double heading();
      double roll();
@@ -109,26 +215,55 @@ public:
 
      Status_t set_cam_cmd(CamCtrl_t cam_ctrl);
 
+     NavData nav_data();
+     StatusData status_data();
+
+     Packetizer::Stats decoder_stats();
+     TransactionTable::Stats transaction_stats();
+
+     // Sends every frame queued so far
+     void flush();
+
+     // Bytes each exchange occupies on the tether, request plus response
+     static int control_bytes();
+     static int nav_bytes();
+     static int status_bytes();
+     static int cam_cmd_bytes();
+     static int manipulator_bytes();
+
+     // Control loop rate, sizes the per-cycle transmit budget
+     void set_cycle_rate(double rate);
+     unsigned int baud();
+     TxQueue::Stats tx_stats();
+
+     // Any thread. Copies the histograms, meant for a periodic report.
+     LinkStats link_stats();
+     static const char * transaction_name(Transaction_t transaction);
+
+     // Records every byte sent and received on the tether to file until
+     // the object is destroyed. Replay with videoray_replay.
+     Status_t start_capture(const std::string &file);
+     SerialCapture::Stats capture_stats();
+
 protected:
 private:
-     double depth_;
-     double heading_;
-     double roll_;
-     double pitch_;
-     double water_temperature_;
-     double humidity_;
-     double internal_temperature_;
+     // Decoded CSR blocks, see CsrMap.h. Written by the receive thread.
+     std::mutex telemetry_mutex_;
+     Telemetry telemetry_;
+
      double water_ingress_;
-     double yaw_accel_;
-     double pitch_accel_;
-     double roll_accel_;
-     double surge_accel_;
-     double sway_accel_;
-     double heave_accel_;
-     
-     double rov_voltage_;
 
-     char tx_ctrl_data[15];
+     // Writable registers, as wanted by the host and as last sent. Only
+     // touched by the thread driving the control cycle.
+     CsrShadow shadow_;
+     bool delta_writes_;
+     double last_keepalive_;
+     double last_refresh_;
+     Status_t send_register_writes();
+
+     std::mutex register_stats_mutex_;
+     RegisterStats register_stats_;
+
      //char tx_sensor_data[7];
      char servo_ctrl_data[MANIP_CTRL_SIZE];
      
@@ -137,8 +272,41 @@ private:
      Packetizer packetizer_;
      Packetizer receiver_;
      serialib serial_;     
+     unsigned int baud_;
+     std::string device_;
+     IoMode_t mode_;
+     std::atomic<bool> healthy_;
+     SerialCapture capture_;
+
+     // Frames are written by the transmit thread
+     TxQueue tx_queue_;
+     Status_t queue_frame(const void *data, int length);
+
+     // Requests waiting for their response
+     TransactionTable transactions_;
+     Status_t send_request(unsigned char flags, unsigned char csr_addr);
+
+     // Receive thread: decodes responses as they arrive
+     std::thread rx_thread_;
+     std::atomic<bool> running_;
+     uint8_t rx_buf_[RX_BUF_SIZE];
+     void receive_loop();
+     void decode(const uint8_t *data, int length, double now);
+     void handle_response(const Packetizer::Frame &frame, double now);
+
+     // Latencies are recorded by the receiving side
+     std::mutex link_mutex_;
+     LatencyHistogram latency_[Transaction_Count];
+     std::atomic<unsigned long> bytes_in_;
+     std::atomic<unsigned long> read_errors_;
 
-     short swap_bytes(char *in, int msb, int lsb);
+     // Only touched by the receiving side
+     unsigned long timeouts_;
+     Packetizer::Stats reported_stats_;
+     unsigned long reported_timeouts_;
+     unsigned long reported_read_errors_;
+     double last_report_time_;
+     void report_link_errors(double now);
 };
 
 #endif
@@ -0,0 +1,152 @@
+#ifndef VIDEORAY_EMULATOR_H_
+#define VIDEORAY_EMULATOR_H_
+/// ---------------------------------------------------------------------------
+/// @file VideoRayEmulator.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Emulates a VideoRay Pro on the slave side of a pseudo-terminal, so that
+/// VideoRayComm (and the control node) can run without the vehicle. Requests
+/// are decoded and answered with the real Packetizer framing:
+///
+///   flags 0x03         control, written to the CSR map, nav block returned
+///   flags 0x05         nav data block
+///   flags 0x80 | n     read n bytes of the CSR map (status is 0x8E @ 0x7A)
+///   flags 0x01         write to the CSR map (camera menu), empty ack
+///   flags 0x00         write to the CSR map, no answer (manipulator 0x42)
+///
+/// Heading and depth follow the thruster commands through a crude first
+/// order model. Response latency, jitter, line rate, dropped answers and
+/// corrupted bytes are configurable.
+///
+/// ----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include "Packetizer.h"
+#include "CsrMap.h"
+
+class VideoRayEmulator {
+public:
+
+     enum Status_t
+     {
+          Success = 0,
+          Failure
+     };
+
+     struct Config {
+          double latency;             // seconds before answering a request
+          double jitter;              // uniform +/- seconds added to latency
+          unsigned int baud;          // emulated line rate, 0 for pty speed
+          double drop_prob;           // probability a request is not answered
+          double corrupt_prob;        // probability an answer has a bad byte
+          unsigned int seed;          // seed of the fault generator
+     };
+
+     struct Stats {
+          unsigned long requests;
+          unsigned long responses;
+          unsigned long dropped;
+          unsigned long corrupted;
+          unsigned long unknown;      // requests for another network id
+     };
+
+     VideoRayEmulator();
+     ~VideoRayEmulator();
+
+     // Creates the pty pair. If link is not empty, a symlink with that name
+     // is pointed at the slave device (removed again by close()).
+     Status_t open(const std::string &link = "");
+     void close();
+
+     // Path of the slave side, to be given to serialib / VideoRayComm
+     const std::string & device();
+
+     void set_config(const Config &config);
+     const Config & config();
+
+     // Serves requests for at most timeout seconds, returns the number of
+     // requests handled or -1 on error.
+     int step(double timeout);
+
+     // Serves requests from a background thread until stop()
+     Status_t start();
+     void stop();
+
+     // Only consistent while the emulator thread is stopped
+     const Stats & stats();
+     const NavData & nav();
+     const StatusData & status();
+
+     // The vehicle's register map as written by the host, 256 bytes
+     const uint8_t * registers();
+
+protected:
+private:
+     static const int CSR_SIZE = 256;
+     static const int VIDEORAY_ID = 0x01;
+     static const int MANIPULATOR_ID = 0x42;
+
+     int master_fd_;
+     int slave_fd_;
+     std::string device_;
+     std::string link_;
+
+     Config config_;
+     Stats stats_;
+     unsigned int rand_state_;
+
+     Packetizer receiver_;
+     Packetizer transmitter_;
+     uint8_t rx_buf_[512];
+
+     // Register images of the vehicle and of the manipulator
+     uint8_t csr_[CSR_SIZE];
+     uint8_t manip_csr_[CSR_SIZE];
+
+     NavData nav_;
+     StatusData status_;
+     double last_update_;
+
+     std::thread thread_;
+     std::atomic<bool> running_;
+
+     void handle(const Packetizer::Frame &request);
+     void respond(const Packetizer::Frame &request, const uint8_t *payload,
+                  int length);
+     void update_vehicle();
+     double uniform();
+};
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef VIDEORAY_MODEL_H_
+#define VIDEORAY_MODEL_H_
+/// ---------------------------------------------------------------------------
+/// @file VideoRayModel.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// The VideoRay dynamics model shared by the simulators, as an odeint
+/// system. The vehicle's coefficients are a parameter struct of
+/// constexpr members, a template argument. Every coefficient is therefore
+/// a compile-time constant: the divisions by the added mass terms become
+/// multiplications by folded inverses, and the whole derivative inlines
+/// into the stepper.
+///
+/// The only state a model holds is the thrust of the current period, set
+/// by set_throttle(). operator() and the Jacobian are const and use no
+/// globals, so each thread can fly its own vehicle.
+///
+/// The state is a boost::array of 6 (body velocities, as in videoray_sim)
+/// or 12 (plus earth-frame pose, as in videoray_sim_and_control):
+///
+///   0:  u     : surge velocity        6:  xpos  : earth x-pos
+///   1:  v     : sway velocity         7:  ypos  : earth y-pos
+///   2:  w     : heave velocity        8:  zpos  : earth z-pos
+///   3:  p     : roll rate             9:  phi   : roll angle
+///   4:  q     : pitch rate            10: theta : pitch angle
+///   5:  r     : yaw rate              11: psi   : yaw angle
+///
+/// An evaluation takes one sin and one cos per angle, which the compiler
+/// merges into sincos. tan(theta) and 1/cos(theta) are formed from them.
+///
+/// ----------------------------------------------------------------------------
+
+#include <math.h>
+#include <type_traits>
+
+// VideoRay Pro III, from octave/videoray_pro_3_params.m (Wei Wang's thesis,
+// "Autonomous Control of a Differential Thrust Micro ROV," page 19). The
+// members are only ever read by value, C++11 has no inline variables to
+// give them a definition in a header.
+struct VideoRayPro3 {
+     // Added mass terms, diagonal of the inertia matrix M
+     static constexpr double X_udot = 1.94;
+     static constexpr double Y_vdot = 6.05;
+     static constexpr double Z_wdot = 3.95;
+     static constexpr double N_rdot = 1.18e-2;
+
+     // Linear drag coefficients
+     static constexpr double Xu = -0.95;
+     static constexpr double Yv = -5.87;
+     static constexpr double Nr = -0.023;
+     static constexpr double Zw = -3.70;
+
+     // Quadratic drag coefficients
+     static constexpr double Xuu = -6.04;
+     static constexpr double Yvv = -30.73;
+     static constexpr double Nrr = -0.45;
+     static constexpr double Zww = -26.36;
+
+     // Thrust per unit of thruster input, forward and reverse
+     static constexpr double Ct_forw = 0.026667;
+     static constexpr double Ct_back = 0.026667;
+     static constexpr double Ct_vert_forw = 0.026667;
+     static constexpr double Ct_vert_back = 0.026667;
+
+     // Thruster input saturation limits
+     static constexpr double u_sat_low = -150;
+     static constexpr double u_sat_high = 150;
+};
+
+// VideoRay Pro 4. octave/videoray_pro_4_params.m has no model yet; this
+// stays incomplete so VideoRayModel<VideoRayPro4> does not compile until
+// it has one.
+struct VideoRayPro4;
+
+template <class Params>
+class VideoRayModel {
+public:
+     typedef Params params_type;
+
+     VideoRayModel() : X_(0), N_(0), Z_(0) { }
+
+     // Saturates the port, starboard and vertical thruster inputs and
+     // converts them to surge force X, yaw moment N and heave force Z
+     void set_throttle(double port, double star, double vert)
+     {
+          double thrust_port = thrust(saturate(port), Params::Ct_forw,
+                                      Params::Ct_back);
+          double thrust_star = thrust(saturate(star), Params::Ct_forw,
+                                      Params::Ct_back);
+          X_ = thrust_port + thrust_star;
+          N_ = thrust_star - thrust_port;
+          Z_ = thrust(saturate(vert), Params::Ct_vert_forw,
+                      Params::Ct_vert_back);
+     }
+
+     double X() const { return X_; }
+     double N() const { return N_; }
+     double Z() const { return Z_; }
+
+     template <class State>
+     void operator()(const State &x, State &dxdt, double) const
+     {
+          double u = x[0], v = x[1], w = x[2], r = x[5];
+
+          // Body frame velocity rates
+          dxdt[0] = (-Params::Y_vdot*v*r + Params::Xu*u +
+                     Params::Xuu*u*fabs(u) + X_) * (1.0 / Params::X_udot);
+          dxdt[1] = (Params::X_udot*u*r + Params::Yv*v +
+                     Params::Yvv*v*fabs(v)) * (1.0 / Params::Y_vdot);
+          dxdt[2] = (Params::Zw*w + Params::Zww*w*fabs(w) + Z_) *
+               (1.0 / Params::Z_wdot);
+          dxdt[3] = 0;
+          dxdt[4] = 0;
+          dxdt[5] = (Params::Nr*r + Params::Nrr*r*fabs(r) + N_) *
+               (1.0 / Params::N_rdot);
+
+          pose_rates(x, dxdt, HasPose<State>());
+     }
+
+     // d(dxdt)/dx for the rosenbrock4 stepper, on a zeroed J. The (5,5)
+     // term is the stiff one: the yaw rate relaxes in
+     // (Nr + 2*Nrr*|r|) / N_rdot, a few hundred per second in a hard turn.
+     // The thrust is constant over a step, so this needs no model.
+     struct Jacobian {
+          template <class State, class Matrix>
+          void operator()(const State &x, Matrix &J) const
+          {
+               double u = x[0], v = x[1], w = x[2], r = x[5];
+
+               J(0,0) = (Params::Xu + 2*Params::Xuu*fabs(u)) *
+                    (1.0 / Params::X_udot);
+               J(0,1) = -r * (Params::Y_vdot / Params::X_udot);
+               J(0,5) = -v * (Params::Y_vdot / Params::X_udot);
+               J(1,0) = r * (Params::X_udot / Params::Y_vdot);
+               J(1,1) = (Params::Yv + 2*Params::Yvv*fabs(v)) *
+                    (1.0 / Params::Y_vdot);
+               J(1,5) = u * (Params::X_udot / Params::Y_vdot);
+               J(2,2) = (Params::Zw + 2*Params::Zww*fabs(w)) *
+                    (1.0 / Params::Z_wdot);
+               J(5,5) = (Params::Nr + 2*Params::Nrr*fabs(r)) *
+                    (1.0 / Params::N_rdot);
+
+               pose_jacobian(x, J, HasPose<State>());
+          }
+     };
+
+protected:
+private:
+     template <class State>
+     struct HasPose
+          : std::integral_constant<bool, (State::static_size >= 12)> { };
+
+     // The one trig evaluation of a derivative or Jacobian
+     struct Attitude {
+          double s1, c1, s2, c2, s3, c3;
+          double sec2, t2;
+
+          Attitude(double phi, double theta, double psi)
+               : s1(sin(phi)), c1(cos(phi)), s2(sin(theta)), c2(cos(theta)),
+                 s3(sin(psi)), c3(cos(psi)), sec2(1.0 / c2), t2(s2 * sec2)
+          { }
+     };
+
+     static double saturate(double input)
+     {
+          if (input < Params::u_sat_low) {
+               return Params::u_sat_low;
+          } else if (input > Params::u_sat_high) {
+               return Params::u_sat_high;
+          }
+          return input;
+     }
+
+     // Ct is different for reverse and forward
+     static double thrust(double input, double Ct_forw, double Ct_back)
+     {
+          return input * (input >= 0 ? Ct_forw : Ct_back);
+     }
+
+     template <class State>
+     static void pose_rates(const State &, State &, std::false_type) { }
+
+     template <class State>
+     static void pose_rates(const State &x, State &dxdt, std::true_type)
+     {
+          double u = x[0], v = x[1], w = x[2];
+          double p = x[3], q = x[4], r = x[5];
+          Attitude a(x[9], x[10], x[11]);
+
+          // Earth frame position rates
+          dxdt[6] = a.c3*a.c2*u + (a.c3*a.s2*a.s1 - a.s3*a.c1)*v +
+               (a.s3*a.s1 + a.c3*a.c1*a.s2)*w;
+          dxdt[7] = a.s3*a.c2*u + (a.c1*a.c3 + a.s1*a.s2*a.s3)*v +
+               (a.c1*a.s2*a.s3 - a.c3*a.s1)*w;
+          dxdt[8] = -a.s2*u + a.c2*a.s1*v + a.c1*a.c2*w;
+
+          // Euler angle rates
+          double yaw_term = q*a.s1 + r*a.c1;
+          dxdt[9] = p + yaw_term*a.t2;
+          dxdt[10] = q*a.c1 - r*a.s1;
+          dxdt[11] = yaw_term*a.sec2;
+     }
+
+     template <class State, class Matrix>
+     static void pose_jacobian(const State &, Matrix &, std::false_type) { }
+
+     template <class State, class Matrix>
+     static void pose_jacobian(const State &x, Matrix &J, std::true_type)
+     {
+          double u = x[0], v = x[1], w = x[2];
+          double q = x[4], r = x[5];
+          Attitude a(x[9], x[10], x[11]);
+          double s1 = a.s1, c1 = a.c1, s2 = a.s2, c2 = a.c2;
+          double s3 = a.s3, c3 = a.c3, sec2 = a.sec2, t2 = a.t2;
+
+          // Earth frame position
+          J(6,0) = c3*c2;
+          J(6,1) = c3*s2*s1 - s3*c1;
+          J(6,2) = s3*s1 + c3*c1*s2;
+          J(6,9) = (c3*s2*c1 + s3*s1)*v + (s3*c1 - c3*s1*s2)*w;
+          J(6,10) = -c3*s2*u + c3*c2*s1*v + c3*c1*c2*w;
+          J(6,11) = -s3*c2*u - (s3*s2*s1 + c3*c1)*v + (c3*s1 - s3*c1*s2)*w;
+
+          J(7,0) = s3*c2;
+          J(7,1) = c1*c3 + s1*s2*s3;
+          J(7,2) = c1*s2*s3 - c3*s1;
+          J(7,9) = (c1*s2*s3 - s1*c3)*v - (s1*s2*s3 + c1*c3)*w;
+          J(7,10) = -s3*s2*u + s1*c2*s3*v + c1*c2*s3*w;
+          J(7,11) = c3*c2*u + (s1*s2*c3 - c1*s3)*v + (c1*s2*c3 + s3*s1)*w;
+
+          J(8,0) = -s2;
+          J(8,1) = c2*s1;
+          J(8,2) = c1*c2;
+          J(8,9) = c2*c1*v - c2*s1*w;
+          J(8,10) = -c2*u - s2*s1*v - s2*c1*w;
+
+          // Euler angles
+          J(9,3) = 1;
+          J(9,4) = s1*t2;
+          J(9,5) = c1*t2;
+          J(9,9) = (q*c1 - r*s1)*t2;
+          J(9,10) = (q*s1 + r*c1)*sec2*sec2;
+
+          J(10,4) = c1;
+          J(10,5) = -s1;
+          J(10,9) = -q*s1 - r*c1;
+
+          J(11,4) = s1*sec2;
+          J(11,5) = c1*sec2;
+          J(11,9) = (q*c1 - r*s1)*sec2;
+          J(11,10) = (q*s1 + r*c1)*t2*sec2;
+     }
+
+     // Thrust of the current period
+     double X_;
+     double N_;
+     double Z_;
+};
+
+#endif
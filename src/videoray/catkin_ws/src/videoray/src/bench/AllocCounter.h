@@ -0,0 +1,82 @@
+#ifndef ALLOC_COUNTER_H_
+#define ALLOC_COUNTER_H_
+/// ---------------------------------------------------------------------------
+/// @file AllocCounter.h
+/// @author Kevin DeMarco <kevin.demarco@gmail.com>
+///
+/// @version 1.0
+///
+/// ---------------------------------------------------------------------------
+/// @section LICENSE
+///
+/// The MIT License (MIT)
+/// Copyright (c) 2012 Kevin DeMarco
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in
+/// all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+/// ----------------------------------------------------------------------------
+/// @section DESCRIPTION
+///
+/// Allocation counting for the micro-benchmarks. The global operator new /
+/// delete are replaced with versions that count every allocation in
+/// alloc_count_, so a benchmark can prove that its timed loop never
+/// allocates. The replacements are definitions: include this file from the
+/// one source file of a benchmark only.
+///
+/// ----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <time.h>
+#include <new>
+
+static unsigned long alloc_count_ = 0;
+
+void * operator new(size_t size)
+{
+     alloc_count_++;
+     void *p = malloc(size == 0 ? 1 : size);
+     if (p == NULL) {
+          throw std::bad_alloc();
+     }
+     return p;
+}
+
+void * operator new[](size_t size)
+{
+     return operator new(size);
+}
+
+void operator delete(void *p)
+{
+     free(p);
+}
+
+void operator delete[](void *p)
+{
+     free(p);
+}
+
+// CLOCK_MONOTONIC in nanoseconds
+static double now_ns()
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#endif
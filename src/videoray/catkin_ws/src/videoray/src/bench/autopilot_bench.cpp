@@ -0,0 +1,139 @@
+//
+// Micro-benchmark for the host Autopilot tick.
+//
+// The autopilot closes the loop on a crude heading / depth plant, stepping
+// 90 degrees and 2 m so that both axes, the gain schedule and the
+// saturation path are exercised. Global operator new / delete count
+// allocations; the process exits with a non-zero status if a tick
+// allocates or if the 99th percentile tick takes 10 us or more.
+//
+// $ rosrun videoray autopilot_bench [ticks]
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "Autopilot.h"
+#include "AllocCounter.h"
+
+using std::cout;
+using std::endl;
+
+// Longest acceptable tick (ns)
+#define TICK_BUDGET_NS 10000.0
+
+// Nav block period of the plant (s)
+#define NAV_PERIOD 0.01
+
+// First order yaw rate and heave speed driven by the thrusters, in the
+// units of the nav block
+struct Plant {
+     double heading;                     // deg
+     double yaw_rate;                    // deg/s
+     double depth;                       // m
+     double heave;                       // m/s
+
+     void step(const Autopilot::Output &output, double dt, NavData &nav)
+     {
+          double turn = 0.5 * (output.star_thrust - output.port_thrust);
+          double yaw_accel = 0.3 * turn - 1.5 * yaw_rate;
+          double heave_accel = 0.004 * output.vert_thrust - 0.8 * heave;
+          yaw_rate += yaw_accel * dt;
+          heave += heave_accel * dt;
+          heading = fmod(heading + yaw_rate * dt + 360.0, 360.0);
+          depth += heave * dt;
+
+          memset(&nav, 0, sizeof(nav));
+          nav.heading = heading;
+          nav.depth = depth;
+          nav.yaw_accel = yaw_accel * M_PI / 180.0;
+          nav.heave_accel = 1.0 - heave_accel / 9.81;
+     }
+};
+
+int main(int argc, char **argv)
+{
+     long ticks = 1000000;
+     if (argc > 1) {
+          ticks = std::max(atol(argv[1]), 1L);
+     }
+
+     // Allocated up front, the timed loop only writes into it
+     std::vector<float> tick_ns(ticks);
+
+     Autopilot autopilot;
+     Autopilot::Setpoint setpoint;
+     memset(&setpoint, 0, sizeof(setpoint));
+     setpoint.heading_enabled = true;
+     setpoint.depth_enabled = true;
+
+     Autopilot::Output output;
+     memset(&output, 0, sizeof(output));
+     NavData nav;
+     Plant plant;
+     memset(&plant, 0, sizeof(plant));
+     plant.step(output, 0, nav);
+
+     // A new step every 30 s of plant time, forward thrust varying so the
+     // schedule is interpolated
+     long step_ticks = (long)(30.0 / NAV_PERIOD);
+     double settle_error = 0;
+     unsigned long saturated = 0;
+     unsigned long allocs_before = alloc_count_;
+     double total_start = now_ns();
+     for (long i = 0; i < ticks; i++) {
+          if (i % step_ticks == 0) {
+               long step = i / step_ticks;
+               setpoint.heading = (step % 4) * 90.0;
+               setpoint.depth = (step % 2) * 2.0 + 1.0;
+               setpoint.port_thrust = (step % 3) * 40;
+               setpoint.star_thrust = setpoint.port_thrust;
+          }
+
+          double start = now_ns();
+          autopilot.update(nav, 1.0 + i * NAV_PERIOD, setpoint, output);
+          tick_ns[i] = now_ns() - start;
+
+          if (output.saturated) {
+               saturated++;
+          }
+          if (i % step_ticks == step_ticks - 1) {
+               settle_error = std::max(settle_error,
+                                       fabs(output.heading_error) +
+                                       fabs(output.depth_error));
+          }
+          plant.step(output, NAV_PERIOD, nav);
+     }
+     double total_ns = now_ns() - total_start;
+     unsigned long tick_allocs = alloc_count_ - allocs_before;
+
+     std::sort(tick_ns.begin(), tick_ns.end());
+     double p50 = tick_ns[ticks / 2];
+     double p99 = tick_ns[(long)(ticks * 0.99)];
+     double worst = tick_ns[ticks - 1];
+
+     printf("ticks:                %ld\n", ticks);
+     printf("tick (with timing):   %8.1f ns mean, p50 %.0f ns, p99 %.0f ns, "
+            "max %.0f ns\n", total_ns / ticks, p50, p99, worst);
+     printf("saturated ticks:      %lu\n", saturated);
+     printf("error after 30 s:     %.3f (deg + m, worst step)\n",
+            settle_error);
+     printf("allocations:          %lu\n", tick_allocs);
+
+     if (tick_allocs != 0) {
+          cout << "FAIL: allocation in the autopilot tick" << endl;
+          return 1;
+     }
+     if (p99 >= TICK_BUDGET_NS) {
+          cout << "FAIL: autopilot tick over 10 us" << endl;
+          return 1;
+     }
+     cout << "PASS: zero allocations, ticks within budget" << endl;
+     return 0;
+}
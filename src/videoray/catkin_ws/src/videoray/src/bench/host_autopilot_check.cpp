@@ -0,0 +1,144 @@
+//
+// End-to-end check of the host autopilot path through ControlLoop.
+//
+// A VideoRayEmulator on a pty plays the vehicle, VideoRayComm talks to it
+// and ControlLoop::cycle() runs at its deadlines as in an event loop. The
+// operator asks for heading 90 deg and depth 2 m with ~host_autopilot on.
+// Every autopilot tick must see that setpoint, and the emulated vehicle
+// must turn and dive towards it. The process exits with a non-zero status
+// otherwise.
+//
+// $ rosrun videoray host_autopilot_check [seconds]
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <algorithm>
+
+#include "VideoRayEmulator.h"
+#include "VideoRayComm.h"
+#include "ControlLoop.h"
+
+using std::cout;
+using std::endl;
+
+// Cycle rate (Hz)
+#define RATE 20.0
+
+// Operator setpoint
+#define HEADING_SP 90
+#define DEPTH_SP 2
+
+static double to_seconds(const struct timespec &ts)
+{
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_ns(struct timespec &ts, long ns)
+{
+     ts.tv_nsec += ns;
+     while (ts.tv_nsec >= 1000000000L) {
+          ts.tv_nsec -= 1000000000L;
+          ts.tv_sec++;
+     }
+}
+
+int main(int argc, char **argv)
+{
+     double seconds = 3.0;
+     if (argc > 1) {
+          seconds = std::max(atof(argv[1]), 1.0);
+     }
+
+     VideoRayEmulator emulator;
+     VideoRayEmulator::Config emulator_config;
+     memset(&emulator_config, 0, sizeof(emulator_config));
+     emulator_config.seed = 1;
+     emulator.set_config(emulator_config);
+     if (emulator.open() != VideoRayEmulator::Success ||
+         emulator.start() != VideoRayEmulator::Success) {
+          cout << "FAIL: cannot start the emulator" << endl;
+          return 1;
+     }
+
+     VideoRayComm comm(emulator.device());
+     ControlLoop loop(comm);
+     if (!comm.healthy() || loop.prepare(RATE) != ControlLoop::Success) {
+          cout << "FAIL: cannot open " << emulator.device() << endl;
+          return 1;
+     }
+
+     ControlLoop::Command command;
+     memset(&command, 0, sizeof(command));
+     command.desired_heading = HEADING_SP;
+     command.desired_depth = DEPTH_SP;
+     command.host_autopilot = true;
+     command.manip_state = VideoRayComm::Idle;
+     command.cam_cmd = VideoRayComm::Enable;
+     loop.set_command(command);
+
+     long period_ns = (long)(1e9 / RATE);
+     int cycles = (int)(seconds * RATE + 0.5);
+     struct timespec deadline;
+     clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+     unsigned long ticks = 0;
+     unsigned long wrong = 0;
+     ControlLoop::AutopilotState state;
+     memset(&state, 0, sizeof(state));
+     for (int i = 0; i < cycles; i++) {
+          add_ns(deadline, period_ns);
+          while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                                 NULL) == EINTR) {
+          }
+          loop.cycle(to_seconds(deadline));
+
+          if (!loop.autopilot_state(state)) {
+               continue;
+          }
+          ticks++;
+          const Autopilot::Setpoint &sp = state.setpoint;
+          if (!sp.heading_enabled || !sp.depth_enabled ||
+              sp.heading != HEADING_SP || sp.depth != DEPTH_SP) {
+               if (wrong++ == 0) {
+                    printf("tick %lu: setpoint heading %.1f (%s), depth %.2f "
+                           "(%s)\n", ticks, sp.heading,
+                           sp.heading_enabled ? "on" : "off", sp.depth,
+                           sp.depth_enabled ? "on" : "off");
+               }
+          }
+     }
+     emulator.stop();
+
+     const NavData &nav = emulator.nav();
+     const ControlLoop::Timing timing = loop.timing();
+     printf("%d cycles, %lu autopilot ticks, mean tick %.2f us\n", cycles,
+            ticks, timing.autopilot_mean * 1e6);
+     printf("last setpoint: heading %.1f deg, depth %.2f m; error %.1f deg, "
+            "%.2f m\n", state.setpoint.heading, state.setpoint.depth,
+            state.output.heading_error, state.output.depth_error);
+     printf("emulated vehicle: heading %.1f deg, depth %.2f m\n",
+            nav.heading, nav.depth);
+
+     if (ticks == 0) {
+          cout << "FAIL: the autopilot never ticked" << endl;
+          return 1;
+     }
+     if (wrong > 0) {
+          cout << "FAIL: " << wrong << " ticks saw another setpoint" << endl;
+          return 1;
+     }
+     // Starting level at heading 0 and the surface, the vehicle has to be
+     // on its way to 90 deg and 2 m
+     if (nav.heading <= 0 || nav.heading > 180 || nav.depth <= 0) {
+          cout << "FAIL: the vehicle did not head for the setpoint" << endl;
+          return 1;
+     }
+     cout << "PASS: the operator's setpoint reaches the autopilot" << endl;
+     return 0;
+}
@@ -0,0 +1,103 @@
+//
+// Check that the keep-alive still reaches the control registers when the
+// transaction table is full.
+//
+// A VideoRayEmulator on a pty plays a vehicle that never answers, so every
+// control request stays in flight. Once all TransactionTable::MAX_IN_FLIGHT
+// slots are taken, a camera command leaves its own header in the
+// packetizer and the next control block goes out untracked. It must still
+// be written to CSR 0x00 of network id 1, where the emulator's register
+// map has to show the new thruster commands. The process exits with a
+// non-zero status otherwise.
+//
+// $ rosrun videoray keepalive_check
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "VideoRayEmulator.h"
+#include "VideoRayComm.h"
+
+using std::cout;
+using std::endl;
+
+// Thruster commands of the last control block
+#define PORT_THRUST 100
+#define STAR_THRUST -100
+#define VERT_THRUST 50
+
+// Between two control commands, long enough for the transmit thread to
+// empty its ring (microseconds)
+#define CYCLE_US 1000
+
+// Time the emulator is given to read the last frames (microseconds)
+#define SETTLE_US 200000
+
+int main()
+{
+     VideoRayEmulator emulator;
+     VideoRayEmulator::Config emulator_config;
+     memset(&emulator_config, 0, sizeof(emulator_config));
+     emulator_config.drop_prob = 1.0;
+     emulator_config.seed = 1;
+     emulator.set_config(emulator_config);
+     if (emulator.open() != VideoRayEmulator::Success ||
+         emulator.start() != VideoRayEmulator::Success) {
+          cout << "FAIL: cannot start the emulator" << endl;
+          return 1;
+     }
+
+     VideoRayComm comm(emulator.device());
+     if (!comm.healthy()) {
+          cout << "FAIL: cannot open " << emulator.device() << endl;
+          return 1;
+     }
+
+     // Every cycle sends the full control block as a request, and the link
+     // budget is wide enough that no frame is refused
+     comm.set_delta_writes(false);
+     comm.set_cycle_rate(1.0);
+
+     // The requests expire after 0.1 s, the whole table is taken well
+     // before that
+     for (int i = 0; i < TransactionTable::MAX_IN_FLIGHT; i++) {
+          comm.send_control_command();
+          usleep(CYCLE_US);
+     }
+     TransactionTable::Stats filled = comm.transaction_stats();
+
+     comm.set_cam_cmd(VideoRayComm::Arrow_Up);
+     comm.set_port_thruster(PORT_THRUST);
+     comm.set_starboard_thruster(STAR_THRUST);
+     comm.set_vertical_thruster(VERT_THRUST);
+     comm.send_control_command();
+     TransactionTable::Stats stats = comm.transaction_stats();
+
+     usleep(SETTLE_US);
+     emulator.stop();
+
+     const uint8_t *csr = emulator.registers();
+     int port = (int16_t)(csr[0] | csr[1] << 8);
+     int star = (int16_t)(csr[2] | csr[3] << 8);
+     int vert = (int16_t)(csr[4] | csr[5] << 8);
+     printf("%lu requests in flight, %lu refused\n", filled.requests,
+            stats.full);
+     printf("vehicle thrusters: port %d, starboard %d, vertical %d\n", port,
+            star, vert);
+
+     if (filled.requests != (unsigned long)TransactionTable::MAX_IN_FLIGHT ||
+         stats.full < 2) {
+          cout << "FAIL: the transaction table never filled" << endl;
+          return 1;
+     }
+     if (port != PORT_THRUST || star != STAR_THRUST || vert != VERT_THRUST) {
+          cout << "FAIL: the keep-alive missed the control registers" << endl;
+          return 1;
+     }
+     cout << "PASS: the keep-alive is written to 0x00 with a full table"
+          << endl;
+     return 0;
+}
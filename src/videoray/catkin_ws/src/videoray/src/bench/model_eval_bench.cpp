@@ -0,0 +1,273 @@
+//
+// Cost of one derivative evaluation of the VideoRay model.
+//
+// The globals path is the videoray_model() the simulators had before
+// VideoRayModel: coefficients and intermediates in mutable globals, tan
+// and cos(theta) called again after the sin / cos of each angle. The
+// template path is VideoRayModel<VideoRayPro3>, with the 12 states of
+// videoray_sim_and_control and the 6 of videoray_sim, and its Jacobian.
+// Each path runs over the same set of states spread over the flight
+// envelope. The last run gives every thread a model of its own to show
+// the template path is reentrant. Every path must agree with the globals
+// path to 1e-12; otherwise the process exits with a non-zero status.
+//
+// $ rosrun videoray model_eval_bench [evaluations]
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <thread>
+
+#include <boost/array.hpp>
+#include <boost/numeric/ublas/matrix.hpp>
+
+#include "VideoRayModel.h"
+
+using std::cout;
+using std::endl;
+
+typedef boost::array<double, 12> state_type;
+typedef boost::array<double, 6> velocity_type;
+typedef boost::numeric::ublas::matrix<double> matrix_type;
+typedef VideoRayModel<VideoRayPro3> model_type;
+
+// Distinct states cycled through, small enough to stay in L1
+#define STATES 256
+
+// Largest acceptable relative difference between two paths
+#define TOLERANCE 1e-12
+
+// Keeps the sums of paths that are not compared
+volatile double sink;
+
+static double now_seconds()
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// videoray_model() of videoray_sim_and_control before VideoRayModel
+namespace globals {
+
+double u, v, w, p, q, r;
+double xpos, ypos, zpos, phi, theta, psi;
+double c1, c2, c3, s1, s2, s3, t2;
+
+double X_udot = 1.94;
+double Y_vdot = 6.05;
+double Z_wdot = 3.95;
+double N_rdot = 1.18e-2;
+double Xu = -0.95;
+double Yv = -5.87;
+double Nr = -0.023;
+double Zw = -3.70;
+double Xuu = -6.04;
+double Yvv = -30.73;
+double Nrr = -0.45;
+double Zww = -26.36;
+
+double X = 0;
+double N = 0;
+double Z = 0;
+
+void videoray_model(const state_type &x, state_type &dxdt, double)
+{
+     u = x[0];
+     v = x[1];
+     w = x[2];
+     p = x[3];
+     q = x[4];
+     r = x[5];
+     xpos  = x[6];
+     ypos  = x[7];
+     zpos  = x[8];
+     phi   = x[9];
+     theta = x[10];
+     psi   = x[11];
+
+     dxdt[0] = (-Y_vdot*v*r + Xu*u + Xuu*u*fabs(u) + X) / X_udot;
+     dxdt[1] = (X_udot*u*r + Yv*v + Yvv*v*fabs(v)) / Y_vdot;
+     dxdt[2] = (Zw*w + Zww*w*fabs(w) + Z) / Z_wdot;
+     dxdt[3] = 0;
+     dxdt[4] = 0;
+     dxdt[5] = (Nr*r + Nrr*r*fabs(r) + N) / N_rdot;
+
+     c1 = cos(phi);
+     c2 = cos(theta);
+     c3 = cos(psi);
+     s1 = sin(phi);
+     s2 = sin(theta);
+     s3 = sin(psi);
+     t2 = tan(theta);
+
+     dxdt[6] = c3*c2*u + (c3*s2*s1-s3*c1)*v + (s3*s1+c3*c1*s2)*w;
+     dxdt[7] = s3*c2*u + (c1*c3+s1*s2*s3)*v + (c1*s2*s3-c3*s1)*w;
+     dxdt[8] = -s2*u + c2*s1*v + c1*c2*w;
+     dxdt[9] = p + (q*s1 + r*c1)*t2;
+     dxdt[10] = q*c1 - r*s1;
+     dxdt[11] = (q*s1 + r*c1)* (1 / cos(theta));
+}
+
+} // namespace globals
+
+static void random_states(std::vector<state_type> &states)
+{
+     std::mt19937 rng(1);
+     std::uniform_real_distribution<double> velocity(-1.5, 1.5);
+     std::uniform_real_distribution<double> rate(-2.0, 2.0);
+     std::uniform_real_distribution<double> position(-100, 100);
+     std::uniform_real_distribution<double> attitude(-0.5, 0.5);
+     std::uniform_real_distribution<double> heading(-M_PI, M_PI);
+     states.resize(STATES);
+     for (size_t i = 0; i < states.size(); i++) {
+          state_type &x = states[i];
+          x[0] = velocity(rng); x[1] = velocity(rng); x[2] = velocity(rng);
+          x[3] = rate(rng); x[4] = rate(rng); x[5] = rate(rng);
+          x[6] = position(rng); x[7] = position(rng); x[8] = position(rng);
+          x[9] = attitude(rng); x[10] = attitude(rng); x[11] = heading(rng);
+     }
+}
+
+static double relative_error(double a, double b)
+{
+     return fabs(a - b) / std::max(1.0, fabs(b));
+}
+
+// Sum of every derivative, so no evaluation can be dropped
+template <class System, class State>
+static double evaluate(System &system, const std::vector<State> &states,
+                       long evaluations)
+{
+     State dxdt;
+     double sum = 0;
+     for (long n = 0; n < evaluations; n++) {
+          system(states[n % STATES], dxdt, 0.0);
+          sum += dxdt[0] + dxdt[5] + dxdt[dxdt.size() - 1];
+     }
+     return sum;
+}
+
+struct Globals {
+     void operator()(const state_type &x, state_type &dxdt, double t)
+     {
+          globals::videoray_model(x, dxdt, t);
+     }
+};
+
+struct Jacobian {
+     matrix_type J;
+
+     Jacobian() : J(12, 12) { J.clear(); }
+
+     void operator()(const state_type &x, state_type &dxdt, double)
+     {
+          model_type::Jacobian()(x, J);
+          dxdt[0] = J(0, 0);
+          dxdt[5] = J(5, 5);
+          dxdt[11] = J(11, 10);
+     }
+};
+
+template <class System, class State>
+static double time_path(const char *name, System system,
+                        const std::vector<State> &states, long evaluations,
+                        double baseline, double *sum)
+{
+     evaluate(system, states, STATES);
+     double start = now_seconds();
+     *sum = evaluate(system, states, evaluations);
+     double ns = (now_seconds() - start) / evaluations * 1e9;
+     if (baseline > 0) {
+          printf("%-28s %8.1f ns/eval  %5.2fx\n", name, ns, baseline / ns);
+     } else {
+          printf("%-28s %8.1f ns/eval\n", name, ns);
+     }
+     return ns;
+}
+
+int main(int argc, char **argv)
+{
+     long evaluations = 10000000;
+     if (argc > 1) {
+          evaluations = std::max(atol(argv[1]), (long)STATES);
+     }
+
+     std::vector<state_type> states;
+     random_states(states);
+     std::vector<velocity_type> velocities(STATES);
+     for (int i = 0; i < STATES; i++) {
+          std::copy(states[i].begin(), states[i].begin() + 6,
+                    velocities[i].begin());
+     }
+
+     // Thrust of a descending turn, the same in every path
+     model_type model;
+     model.set_throttle(30, 60, 40);
+     globals::X = model.X();
+     globals::N = model.N();
+     globals::Z = model.Z();
+
+     // Every state, every component
+     double error = 0;
+     for (int i = 0; i < STATES; i++) {
+          state_type expected, dxdt;
+          velocity_type dvdt;
+          globals::videoray_model(states[i], expected, 0);
+          model(states[i], dxdt, 0);
+          model(velocities[i], dvdt, 0);
+          for (int s = 0; s < 12; s++) {
+               error = std::max(error, relative_error(dxdt[s], expected[s]));
+          }
+          for (int s = 0; s < 6; s++) {
+               error = std::max(error, relative_error(dvdt[s], expected[s]));
+          }
+     }
+
+     printf("%ld evaluations over %d states\n", evaluations, STATES);
+     double sum_globals, sum_model, sum_velocity, sum_jacobian;
+     double baseline = time_path("globals, 12 states", Globals(), states,
+                                 evaluations, 0, &sum_globals);
+     time_path("VideoRayModel, 12 states", model, states, evaluations,
+               baseline, &sum_model);
+     time_path("VideoRayModel, 6 states", model, velocities, evaluations,
+               baseline, &sum_velocity);
+     time_path("VideoRayModel::Jacobian", Jacobian(), states, evaluations,
+               0, &sum_jacobian);
+     error = std::max(error, relative_error(sum_model, sum_globals));
+     sink = sum_velocity + sum_jacobian;
+
+     // One model per thread, all evaluated at once
+     int threads = std::max((int)std::thread::hardware_concurrency(), 1);
+     std::vector<double> sums(threads);
+     std::vector<std::thread> workers;
+     double start = now_seconds();
+     for (int t = 0; t < threads; t++) {
+          workers.push_back(std::thread([&, t]() {
+                    model_type own;
+                    own.set_throttle(30, 60, 40);
+                    sums[t] = evaluate(own, states, evaluations);
+               }));
+     }
+     for (int t = 0; t < threads; t++) {
+          workers[t].join();
+          error = std::max(error, relative_error(sums[t], sum_model));
+     }
+     double elapsed = now_seconds() - start;
+     printf("VideoRayModel, %2d threads    %8.3g evals/s\n", threads,
+            threads * evaluations / elapsed);
+
+     printf("max relative error %.2g\n", error);
+     if (error > TOLERANCE) {
+          cout << "FAIL: VideoRayModel and the globals path disagree" << endl;
+          return 1;
+     }
+     cout << "PASS: VideoRayModel matches the globals path" << endl;
+     return 0;
+}
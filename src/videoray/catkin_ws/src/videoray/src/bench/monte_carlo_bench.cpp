@@ -0,0 +1,232 @@
+//
+// Throughput of the MonteCarlo engine against one vehicle at a time.
+//
+// The scalar path is what videoray_sim_and_control did before
+// VideoRayModel: odeint's runge_kutta4 on a boost::array<double, 12>,
+// sin/cos/tan from libm, one vehicle after the other. The engine flies
+// the same 60 s mission with the generic kernel, the AVX2 kernel (if the
+// CPU has it) and every core. Rates are in vehicle-steps per second.
+// With zero spread every engine run must end where the scalar run ends;
+// the process exits with a non-zero status if they differ by more than
+// 1e-6.
+//
+// $ rosrun videoray monte_carlo_bench [runs]
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <thread>
+
+#include <boost/array.hpp>
+#include <boost/numeric/odeint.hpp>
+
+#include "MonteCarlo.h"
+
+using std::cout;
+using std::endl;
+
+typedef boost::array<double, 12> state_type;
+
+// Scalar runs kept short, they only set the reference rate
+#define SCALAR_RUNS 64
+
+// Largest acceptable difference from the scalar path
+#define TOLERANCE 1e-6
+
+// Integration step (s)
+#define DT 0.01
+
+static double now_seconds()
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// videoray_model() of videoray_sim_and_control with the parameters in a
+// struct
+struct ScalarModel {
+     MonteCarlo::Params m;
+     double X, N, Z;
+
+     void operator()(const state_type &x, state_type &dxdt, double) const
+     {
+          double u = x[0], v = x[1], w = x[2];
+          double p = x[3], q = x[4], r = x[5];
+          double phi = x[9], theta = x[10], psi = x[11];
+
+          dxdt[0] = (-m.Y_vdot*v*r + m.Xu*u + m.Xuu*u*fabs(u) + X) / m.X_udot;
+          dxdt[1] = (m.X_udot*u*r + m.Yv*v + m.Yvv*v*fabs(v)) / m.Y_vdot;
+          dxdt[2] = (m.Zw*w + m.Zww*w*fabs(w) + Z) / m.Z_wdot;
+          dxdt[3] = 0;
+          dxdt[4] = 0;
+          dxdt[5] = (m.Nr*r + m.Nrr*r*fabs(r) + N) / m.N_rdot;
+
+          double c1 = cos(phi), c2 = cos(theta), c3 = cos(psi);
+          double s1 = sin(phi), s2 = sin(theta), s3 = sin(psi);
+          double t2 = tan(theta);
+
+          dxdt[6] = c3*c2*u + (c3*s2*s1-s3*c1)*v + (s3*s1+c3*c1*s2)*w;
+          dxdt[7] = s3*c2*u + (c1*c3+s1*s2*s3)*v + (c1*s2*s3-c3*s1)*w;
+          dxdt[8] = -s2*u + c2*s1*v + c1*c2*w;
+          dxdt[9] = p + (q*s1 + r*c1)*t2;
+          dxdt[10] = q*c1 - r*s1;
+          dxdt[11] = (q*s1 + r*c1) / cos(theta);
+     }
+};
+
+static void fly_scalar(const std::vector<MonteCarlo::Segment> &mission,
+                       const MonteCarlo::Config &config, state_type &x)
+{
+     boost::numeric::odeint::runge_kutta4<state_type> stepper;
+     ScalarModel model;
+     model.m = config.params;
+     for (int i = 0; i < 12; i++) {
+          x[i] = config.initial[i];
+     }
+     double t = 0;
+     for (size_t s = 0; s < mission.size(); s++) {
+          const MonteCarlo::Segment &segment = mission[s];
+          double port = segment.port * model.m.Ct_forw;
+          double star = segment.star * model.m.Ct_forw;
+          model.X = port + star;
+          model.N = star - port;
+          model.Z = segment.vert * model.m.Ct_vert_forw;
+          long steps = lround(segment.duration / config.dt);
+          for (long n = 0; n < steps; n++) {
+               stepper.do_step(model, x, t, config.dt);
+               t += config.dt;
+          }
+     }
+}
+
+static const char * kernel_name(MonteCarlo::Kernel_t kernel)
+{
+     return kernel == MonteCarlo::Avx2_Kernel ? "avx2" : "generic";
+}
+
+static void print_stat(const char *name, const MonteCarlo::Stat &stat)
+{
+     printf("  %-10s mean %8.2f  sigma %6.2f  p05 %8.2f  p50 %8.2f  "
+            "p95 %8.2f\n", name, stat.mean, stat.sigma, stat.p05, stat.p50,
+            stat.p95);
+}
+
+int main(int argc, char **argv)
+{
+     int runs = 4096;
+     if (argc > 1) {
+          runs = std::max(atoi(argv[1]), 1);
+     }
+
+     // Forward, a descending turn, then full ahead; all forward thrust so the
+     // Ct_forw coefficients apply to the scalar path as well
+     std::vector<MonteCarlo::Segment> mission;
+     MonteCarlo::Segment segment;
+     segment.duration = 20; segment.port = 40; segment.star = 40;
+     segment.vert = 0;
+     mission.push_back(segment);
+     segment.duration = 20; segment.port = 30; segment.star = 60;
+     segment.vert = 40;
+     mission.push_back(segment);
+     segment.duration = 20; segment.port = 60; segment.star = 60;
+     segment.vert = 0;
+     mission.push_back(segment);
+
+     MonteCarlo::Config config = MonteCarlo::default_config();
+     config.dt = DT;
+     config.initial[MonteCarlo::Theta] = 0.05;
+     double steps = 0;
+     for (size_t s = 0; s < mission.size(); s++) {
+          steps += lround(mission[s].duration / config.dt);
+     }
+
+     // Scalar reference
+     state_type reference;
+     double start = now_seconds();
+     for (int i = 0; i < SCALAR_RUNS; i++) {
+          fly_scalar(mission, config, reference);
+     }
+     double scalar_rate = SCALAR_RUNS * steps / (now_seconds() - start);
+     printf("runs: %d, %.0f steps of %.0f ms each\n", runs, steps, DT * 1e3);
+     printf("scalar odeint:        %10.3g vehicle-steps/s\n", scalar_rate);
+
+     // Engine, zero spread first: every run must match the reference
+     MonteCarlo::Config exact = config;
+     memset(&exact.spread, 0, sizeof(exact.spread));
+     exact.runs = 64;
+     bool failed = false;
+
+     int kernels[2] = { MonteCarlo::Generic_Kernel, MonteCarlo::Avx2_Kernel };
+     for (int k = 0; k < 2; k++) {
+          MonteCarlo::Kernel_t kernel = (MonteCarlo::Kernel_t)kernels[k];
+          if (kernel == MonteCarlo::Avx2_Kernel &&
+              !MonteCarlo::avx2_available()) {
+               printf("avx2:                 not available\n");
+               continue;
+          }
+          exact.kernel = kernel;
+          exact.threads = 1;
+          MonteCarlo engine(exact);
+          engine.set_mission(mission);
+          MonteCarlo::Result result;
+          engine.run(result);
+          double error = 0;
+          for (int i = 0; i < result.runs; i++) {
+               for (int s = 0; s < MonteCarlo::STATE_SIZE; s++) {
+                    error = std::max(error, fabs(result.final_state[
+                                   i * MonteCarlo::STATE_SIZE + s] -
+                                   reference[s]));
+               }
+          }
+
+          MonteCarlo::Config timed = config;
+          timed.runs = runs;
+          timed.kernel = kernel;
+          timed.threads = 1;
+          engine.set_config(timed);
+          engine.run(result);
+          double rate = result.vehicle_steps / result.elapsed;
+          printf("%-7s 1 thread:     %10.3g vehicle-steps/s, %5.1fx scalar, "
+                 "max error %.2g\n", kernel_name(kernel), rate,
+                 rate / scalar_rate, error);
+          if (error > TOLERANCE) {
+               failed = true;
+          }
+     }
+
+     MonteCarlo::Config timed = config;
+     timed.runs = runs;
+     timed.record_period = 1.0;
+     MonteCarlo engine(timed);
+     engine.set_mission(mission);
+     MonteCarlo::Result result;
+     engine.run(result);
+     double rate = result.vehicle_steps / result.elapsed;
+     printf("%-7s %2d cores:     %10.3g vehicle-steps/s, %5.1fx scalar "
+            "(%d trajectory samples per run)\n", kernel_name(result.kernel),
+            result.threads, rate, rate / scalar_rate, result.samples);
+
+     MonteCarlo::Summary summary;
+     MonteCarlo::summarize(result, summary);
+     printf("end of mission, %d perturbed runs:\n", result.runs);
+     print_stat("x (m)", summary.x);
+     print_stat("y (m)", summary.y);
+     print_stat("depth (m)", summary.depth);
+     print_stat("yaw (deg)", summary.heading);
+     print_stat("speed", summary.speed);
+     print_stat("miss (m)", summary.miss);
+
+     if (failed) {
+          cout << "FAIL: engine and scalar path disagree" << endl;
+          return 1;
+     }
+     cout << "PASS: engine matches the scalar path" << endl;
+     return 0;
+}
@@ -0,0 +1,200 @@
+//
+// Micro-benchmark for the NavEstimator, one predict() and one update()
+// per control cycle.
+//
+// A truth model (the Pro III equations of videoray_sim, integrated with
+// RK4 at 1 ms) is driven through turns, dives and straight runs; its
+// heading, depth and accelerations, with noise, make the nav blocks. The
+// benchmark reports the cost of each call and how far the dead-reckoned
+// position drifted. Global operator new / delete count allocations; the
+// process exits with a non-zero status if the filter allocates or if the
+// 99th percentile cycle takes 20 us or more.
+//
+// $ rosrun videoray nav_estimator_bench [cycles]
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+#include "NavEstimator.h"
+#include "AllocCounter.h"
+
+using std::cout;
+using std::endl;
+
+// Longest acceptable predict + update (ns)
+#define CYCLE_BUDGET_NS 20000.0
+
+// Control period (s) and truth integration step (s)
+#define CONTROL_PERIOD 0.02
+#define TRUTH_STEP 0.001
+
+// Level vehicle: u, v, w, r, then x, y, z and yaw
+struct Truth {
+     NavEstimator::Model m;
+     double s[8];
+     double X, N, Z;
+
+     void derivatives(const double *x, double *dx) const
+     {
+          double u = x[0], v = x[1], w = x[2], r = x[3], psi = x[7];
+          dx[0] = (-m.Y_vdot*v*r + m.Xu*u + m.Xuu*u*fabs(u) + X) / m.X_udot;
+          dx[1] = (m.X_udot*u*r + m.Yv*v + m.Yvv*v*fabs(v)) / m.Y_vdot;
+          dx[2] = (m.Zw*w + m.Zww*w*fabs(w) + Z) / m.Z_wdot;
+          dx[3] = (m.Nr*r + m.Nrr*r*fabs(r) + N) / m.N_rdot;
+          dx[4] = cos(psi)*u - sin(psi)*v;
+          dx[5] = sin(psi)*u + cos(psi)*v;
+          dx[6] = w;
+          dx[7] = r;
+     }
+
+     void step(double dt)
+     {
+          double k1[8], k2[8], k3[8], k4[8], t[8];
+          derivatives(s, k1);
+          for (int i = 0; i < 8; i++) t[i] = s[i] + 0.5 * dt * k1[i];
+          derivatives(t, k2);
+          for (int i = 0; i < 8; i++) t[i] = s[i] + 0.5 * dt * k2[i];
+          derivatives(t, k3);
+          for (int i = 0; i < 8; i++) t[i] = s[i] + dt * k3[i];
+          derivatives(t, k4);
+          for (int i = 0; i < 8; i++) {
+               s[i] += dt / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]);
+          }
+     }
+};
+
+int main(int argc, char **argv)
+{
+     long cycles = 100000;
+     if (argc > 1) {
+          cycles = std::max(atol(argv[1]), 1L);
+     }
+
+     // Allocated up front, the timed loop only writes into them
+     std::vector<float> predict_ns(cycles);
+     std::vector<float> update_ns(cycles);
+     std::vector<float> cycle_ns(cycles);
+
+     NavEstimator::Config config = NavEstimator::default_config();
+     NavEstimator estimator(config);
+     NavEstimator::Estimate estimate;
+
+     Truth truth;
+     memset(&truth, 0, sizeof(truth));
+     truth.m = config.model;
+     truth.s[6] = 2.0;
+
+     std::mt19937 rng(1);
+     std::normal_distribution<double> noise(0.0, 1.0);
+
+     // Thrust profile changes every 20 s of vehicle time
+     long segment = (long)(20.0 / CONTROL_PERIOD);
+     int port = 0, star = 0, vert = 0;
+     int substeps = (int)(CONTROL_PERIOD / TRUTH_STEP + 0.5);
+     double worst_error = 0;
+     double worst_ratio = 0;
+     double yaw_error = 0;
+     double truth_dx[8];
+
+     unsigned long allocs_before = alloc_count_;
+     for (long i = 0; i < cycles; i++) {
+          if (i % segment == 0) {
+               long k = i / segment;
+               int forward = (k % 3) * 40;
+               int turn = (k % 4 == 1) ? 30 : (k % 4 == 3 ? -20 : 0);
+               port = forward - turn;
+               star = forward + turn;
+               vert = (k % 5 == 2) ? 60 : (k % 5 == 4 ? -60 : 0);
+          }
+          const NavEstimator::Model &m = truth.m;
+          truth.X = m.Ct_forw * (port + star);
+          truth.N = m.Ct_forw * (star - port);
+          truth.Z = m.Ct_vert_forw * vert;
+          for (int j = 0; j < substeps; j++) {
+               truth.step(TRUTH_STEP);
+          }
+          truth.derivatives(truth.s, truth_dx);
+
+          // What the sensors see, level vehicle: the heave axis reads
+          // +1 g at rest
+          double u = truth.s[0], v = truth.s[1], r = truth.s[3];
+          NavData nav;
+          memset(&nav, 0, sizeof(nav));
+          nav.heading = fmod(truth.s[7] * 180.0 / M_PI + 720.0, 360.0) +
+               0.5 * noise(rng);
+          nav.depth = truth.s[6] + 0.02 * noise(rng);
+          nav.surge_accel = (truth_dx[0] - r * v) / 9.81 + 0.01 * noise(rng);
+          nav.sway_accel = (truth_dx[1] + r * u) / 9.81 + 0.01 * noise(rng);
+          nav.heave_accel = 1.0 - truth_dx[2] / 9.81 + 0.01 * noise(rng);
+          nav.yaw_accel = truth_dx[3] + 0.1 * noise(rng);
+
+          double start = now_ns();
+          estimator.set_thrust(port, star, vert);
+          estimator.predict(CONTROL_PERIOD);
+          double middle = now_ns();
+          estimator.update(nav);
+          estimator.extrapolate(0, estimate);
+          double end = now_ns();
+          predict_ns[i] = middle - start;
+          update_ns[i] = end - middle;
+          cycle_ns[i] = end - start;
+
+          double error = hypot(estimate.north - truth.s[4],
+                               estimate.east - truth.s[5]);
+          worst_error = std::max(worst_error, error);
+          if (estimate.position_sigma > 0) {
+               worst_ratio = std::max(worst_ratio,
+                                      error / estimate.position_sigma);
+          }
+          double dyaw = fabs(remainder(estimate.yaw - truth.s[7],
+                                       2 * M_PI));
+          yaw_error = std::max(yaw_error, dyaw);
+     }
+     unsigned long allocs = alloc_count_ - allocs_before;
+
+     double travelled = hypot(truth.s[4], truth.s[5]);
+     double error = hypot(estimate.north - truth.s[4],
+                          estimate.east - truth.s[5]);
+
+     std::sort(predict_ns.begin(), predict_ns.end());
+     std::sort(update_ns.begin(), update_ns.end());
+     std::sort(cycle_ns.begin(), cycle_ns.end());
+     long p50 = cycles / 2;
+     long p99 = (long)(cycles * 0.99);
+
+     printf("cycles:               %ld (%.0f s of vehicle time)\n", cycles,
+            cycles * CONTROL_PERIOD);
+     printf("predict:              p50 %.0f ns, p99 %.0f ns\n",
+            predict_ns[p50], predict_ns[p99]);
+     printf("update:               p50 %.0f ns, p99 %.0f ns\n",
+            update_ns[p50], update_ns[p99]);
+     printf("cycle:                p50 %.0f ns, p99 %.0f ns, max %.0f ns\n",
+            cycle_ns[p50], cycle_ns[p99], cycle_ns[cycles - 1]);
+     printf("position error:       %.2f m at the end, worst %.2f m, "
+            "%.2f m from the start\n", error, worst_error, travelled);
+     printf("position sigma:       %.2f m at the end, worst error %.1f "
+            "sigma\n", estimate.position_sigma, worst_ratio);
+     printf("depth error:          %.3f m\n",
+            fabs(estimate.down - truth.s[6]));
+     printf("yaw error:            %.2f deg worst\n", yaw_error * 180 / M_PI);
+     printf("allocations:          %lu\n", allocs);
+
+     if (allocs != 0) {
+          cout << "FAIL: allocation in the estimator" << endl;
+          return 1;
+     }
+     if (cycle_ns[p99] >= CYCLE_BUDGET_NS) {
+          cout << "FAIL: estimator cycle over 20 us" << endl;
+          return 1;
+     }
+     cout << "PASS: zero allocations, cycles within budget" << endl;
+     return 0;
+}
@@ -0,0 +1,197 @@
+//
+// Micro-benchmark for the Packetizer encode / decode paths.
+//
+// Global operator new / delete are replaced with counting versions so the
+// benchmark can prove that generate_packet(), build_frame(), receive_packet()
+// and the bulk feed() / next() decoder never allocate once the Packetizer has been
+// constructed. The process exits with a
+// non-zero status if any allocation is observed inside the timed loops.
+//
+// $ rosrun videoray packetizer_bench [iterations]
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Packetizer.h"
+#include "AllocCounter.h"
+
+using std::cout;
+using std::endl;
+
+// Builds a response frame (0xFD 0xDF sync) around payload
+static int build_response(unsigned char *frame, const unsigned char *payload,
+                          int length)
+{
+     frame[0] = 0xFD;
+     frame[1] = 0xDF;
+     frame[2] = 0x01;
+     frame[3] = 0x05;
+     frame[4] = 0x00;
+     frame[5] = length;
+     frame[6] = 0;
+     for (int i = 0; i < 6; i++) {
+          frame[6] ^= frame[i];
+     }
+     unsigned char sum = 0;
+     for (int i = 0; i < length; i++) {
+          frame[7+i] = payload[i];
+          sum ^= payload[i];
+     }
+     frame[7+length] = sum;
+     return 8 + length;
+}
+
+int main(int argc, char **argv)
+{
+     long iterations = 1000000;
+     if (argc > 1) {
+          iterations = atol(argv[1]);
+     }
+
+     Packetizer packetizer;
+     Packetizer receiver;
+
+     char tx_data[15];
+     for (int i = 0; i < 15; i++) {
+          tx_data[i] = i;
+     }
+
+     unsigned char nav_payload[29];
+     for (int i = 0; i < 29; i++) {
+          nav_payload[i] = i * 7;
+     }
+     unsigned char frame[Packetizer::MAX_PACKET_SIZE];
+     int frame_size = build_response(frame, nav_payload, 29);
+
+     ////////////////////
+     // Encode
+     ////////////////////
+     unsigned long allocs_before = alloc_count_;
+     double start = now_ns();
+     char *packet;
+     int bytes = 0;
+     unsigned char sink = 0;
+     for (long i = 0; i < iterations; i++) {
+          tx_data[0] = i;
+          packetizer.set_network_id(0x01);
+          packetizer.set_flags(0x03);
+          packetizer.set_csr_addr(0x00);
+          packetizer.set_data(tx_data, 15);
+          bytes = packetizer.generate_packet(&packet);
+          sink ^= packet[bytes-1];
+     }
+     double encode_ns = (now_ns() - start) / iterations;
+     unsigned long encode_allocs = alloc_count_ - allocs_before;
+
+     ////////////////////
+     // Scatter-gather encode
+     ////////////////////
+     // Header and trailer only, the payload is referenced by the iovec
+     Packetizer::TxFrame tx_frame;
+     struct iovec iov[3];
+     allocs_before = alloc_count_;
+     start = now_ns();
+     for (long i = 0; i < iterations; i++) {
+          tx_data[0] = i;
+          packetizer.build_frame(tx_frame, tx_data, 15);
+          sink ^= tx_frame.trailer;
+     }
+     double gather_ns = (now_ns() - start) / iterations;
+     unsigned long gather_allocs = alloc_count_ - allocs_before;
+
+     // Both encoders have to put the same bytes on the wire
+     int iovcnt = Packetizer::frame_iovec(&tx_frame, 1, iov);
+     int offset = 0;
+     bool gather_match = true;
+     for (int v = 0; v < iovcnt; v++) {
+          if (offset + (int)iov[v].iov_len > bytes || 
+              memcmp(packet + offset, iov[v].iov_base, iov[v].iov_len) != 0) {
+               gather_match = false;
+               break;
+          }
+          offset += iov[v].iov_len;
+     }
+     gather_match = gather_match && offset == bytes;
+
+     ////////////////////
+     // Decode
+     ////////////////////
+     allocs_before = alloc_count_;
+     start = now_ns();
+     long decoded = 0;
+     for (long i = 0; i < iterations; i++) {
+          for (int b = 0; b < frame_size; b++) {
+               if (receiver.receive_packet(frame[b]) == Packetizer::Success) {
+                    decoded++;
+               }
+          }
+          sink ^= receiver.get_payload(&packet);
+     }
+     double decode_ns = (now_ns() - start) / iterations;
+     unsigned long decode_allocs = alloc_count_ - allocs_before;
+
+     ////////////////////
+     // Bulk decode
+     ////////////////////
+     // A chunk holding several back-to-back frames, as a single read() of
+     // the tty would return them. The last frame is split across two chunks.
+     const int frames_per_chunk = 4;
+     unsigned char chunk[frames_per_chunk * Packetizer::MAX_PACKET_SIZE];
+     int chunk_size = 0;
+     for (int f = 0; f < frames_per_chunk; f++) {
+          memcpy(chunk + chunk_size, frame, frame_size);
+          chunk_size += frame_size;
+     }
+     int split = chunk_size - frame_size / 2;
+
+     Packetizer::Frame rx_frame;
+     allocs_before = alloc_count_;
+     start = now_ns();
+     long bulk_decoded = 0;
+     for (long i = 0; i < iterations / frames_per_chunk; i++) {
+          receiver.feed(chunk, split);
+          while (receiver.next(rx_frame)) {
+               sink ^= rx_frame.payload[rx_frame.length-1];
+               bulk_decoded++;
+          }
+          receiver.feed(chunk + split, chunk_size - split);
+          while (receiver.next(rx_frame)) {
+               sink ^= rx_frame.payload[rx_frame.length-1];
+               bulk_decoded++;
+          }
+     }
+     long bulk_expected = (iterations / frames_per_chunk) * frames_per_chunk;
+     double bulk_ns = (now_ns() - start) / (bulk_expected ? bulk_expected : 1);
+     unsigned long bulk_allocs = alloc_count_ - allocs_before;
+
+     printf("iterations:           %ld\n", iterations);
+     printf("generate_packet:      %8.1f ns/packet, %lu allocations\n",
+            encode_ns, encode_allocs);
+     printf("build_frame:          %8.1f ns/packet, %lu allocations\n",
+            gather_ns, gather_allocs);
+     printf("receive_packet:       %8.1f ns/frame (%d bytes), %lu allocations\n",
+            decode_ns, frame_size, decode_allocs);
+     printf("feed/next:            %8.1f ns/frame (%d bytes), %lu allocations\n",
+            bulk_ns, frame_size, bulk_allocs);
+     printf("frames decoded:       %ld / %ld (checksum sink %02X)\n", 
+            decoded, bulk_decoded, sink);
+
+     if (!gather_match) {
+          cout << "FAIL: build_frame and generate_packet disagree" << endl;
+          return 1;
+     }
+     if (decoded != iterations || bulk_decoded != bulk_expected) {
+          cout << "FAIL: decoder dropped frames" << endl;
+          return 1;
+     }
+     if (encode_allocs != 0 || gather_allocs != 0 || decode_allocs != 0 || bulk_allocs != 0) {
+          cout << "FAIL: allocation on the packet path" << endl;
+          return 1;
+     }
+     cout << "PASS: zero allocations" << endl;
+     return 0;
+}
@@ -0,0 +1,302 @@
+//
+// Step size and cost of the simulator's steppers on the stiff yaw mode.
+//
+// The Pro III model with its true yaw inertia (N_rdot = 1.18e-2) flies a
+// 300 s trajectory of cruising, hard turns, dives and reversing, its
+// thrust held over each 0.1 s output period as in the simulators. A
+// 0.1 ms RK4 run is the reference. Each stepper is scored on its mean
+// step, accepted and rejected steps, CPU time per simulated second and
+// worst error at the outputs. RK4 runs at fixed steps down from the
+// output period until it stays finite; Dormand-Prince (AdaptiveIntegrator)
+// and rosenbrock4 (StiffIntegrator) run at two tolerances. The analytic
+// Jacobian is first checked against finite differences along the
+// reference trajectory; the process exits with a non-zero status if it
+// disagrees or if rosenbrock4 misses its accuracy.
+//
+// $ rosrun videoray stiff_yaw_bench
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include <boost/array.hpp>
+#include <boost/numeric/odeint.hpp>
+
+#include "AdaptiveIntegrator.h"
+#include "StiffIntegrator.h"
+#include "VideoRayModel.h"
+
+using std::cout;
+using std::endl;
+
+typedef boost::array<double, 12> state_type;
+typedef StiffIntegrator<state_type>::matrix_type matrix_type;
+
+// Output period (s) and trajectory length (s)
+#define PERIOD 0.1
+#define DURATION 300.0
+
+// Reference RK4 step (s)
+#define REFERENCE_STEP 1e-4
+
+// rosenbrock4 at 1e-6 must be this close to the reference (m, m/s, rad)
+#define TOLERANCE 1e-3
+
+static double now_seconds()
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The simulators' model, counting its evaluations
+struct Model {
+     VideoRayModel<VideoRayPro3> vehicle;
+     mutable unsigned long evaluations;
+
+     void operator()(const state_type &x, state_type &dxdt, double t) const
+     {
+          evaluations++;
+          vehicle(x, dxdt, t);
+     }
+};
+
+typedef VideoRayModel<VideoRayPro3>::Jacobian Jacobian;
+
+// Port, starboard and vertical thrust over 10 s legs
+static void thrust(int tick, Model &model)
+{
+     static const double legs[][3] = {
+          {  60,   60,   0 },           // cruise
+          { -80,   80,   0 },           // hard turn on the spot
+          {  20,  100,  40 },           // descending turn
+          { 100,  100,   0 },           // full ahead
+          { 100, -100, -60 },           // hard turn the other way, rising
+          { -40,  -40,   0 },           // reverse
+          {   0,    0,   0 },           // drift
+     };
+     int count = sizeof(legs) / sizeof(legs[0]);
+     int leg = (int)(tick * PERIOD / 10.0) % count;
+     model.vehicle.set_throttle(legs[leg][0], legs[leg][1], legs[leg][2]);
+}
+
+static void initial_state(state_type &x)
+{
+     std::fill(x.begin(), x.end(), 0.0);
+     x[9] = 0.05;
+     x[10] = 0.05;
+}
+
+struct Score {
+     unsigned long steps;
+     unsigned long rejected;
+     unsigned long evaluations;
+     double seconds;
+     double error;
+     bool finite;
+};
+
+static double state_error(const state_type &a, const state_type &b)
+{
+     double error = 0;
+     for (size_t i = 0; i < a.size(); i++) {
+          error = std::max(error, fabs(a[i] - b[i]));
+     }
+     return error;
+}
+
+static bool state_finite(const state_type &x)
+{
+     for (size_t i = 0; i < x.size(); i++) {
+          if (!std::isfinite(x[i]) || fabs(x[i]) > 1e6) {
+               return false;
+          }
+     }
+     return true;
+}
+
+static void rk4(const std::vector<state_type> &reference, double dt,
+                Score &score)
+{
+     boost::numeric::odeint::runge_kutta4<state_type> stepper;
+     Model model;
+     model.evaluations = 0;
+     state_type x;
+     initial_state(x);
+     int substeps = (int)(PERIOD / dt + 0.5);
+     score.error = 0;
+     score.finite = true;
+     double start = now_seconds();
+     for (size_t tick = 1; tick < reference.size() && score.finite; tick++) {
+          thrust(tick - 1, model);
+          for (int i = 0; i < substeps; i++) {
+               stepper.do_step(boost::cref(model), x, 0.0, dt);
+          }
+          score.finite = state_finite(x);
+          score.error = std::max(score.error,
+                                 state_error(x, reference[tick]));
+     }
+     score.seconds = now_seconds() - start;
+     score.steps = (reference.size() - 1) * substeps;
+     score.rejected = 0;
+     score.evaluations = model.evaluations;
+}
+
+// AdaptiveIntegrator or StiffIntegrator
+template <class Integrator>
+static void advance(Integrator &integrator, Model &model, state_type &x,
+                    bool restart);
+
+template <>
+void advance(AdaptiveIntegrator<state_type> &integrator, Model &model,
+             state_type &x, bool restart)
+{
+     integrator.advance(boost::ref(model), x, PERIOD, restart);
+}
+
+template <>
+void advance(StiffIntegrator<state_type> &integrator, Model &model,
+             state_type &x, bool restart)
+{
+     integrator.advance(boost::ref(model), Jacobian(), x, PERIOD, restart);
+}
+
+template <class Integrator>
+static void adaptive(const std::vector<state_type> &reference, double tol,
+                     Score &score)
+{
+     typename Integrator::Config config = Integrator::default_config();
+     config.abs_tol = tol;
+     config.rel_tol = tol;
+     Integrator integrator(config);
+     Model model;
+     model.evaluations = 0;
+     state_type x;
+     initial_state(x);
+     score.error = 0;
+     score.finite = true;
+     double last_X = NAN, last_N = NAN, last_Z = NAN;
+     double start = now_seconds();
+     for (size_t tick = 1; tick < reference.size() && score.finite; tick++) {
+          thrust(tick - 1, model);
+          bool restart = (model.vehicle.X() != last_X ||
+                          model.vehicle.N() != last_N ||
+                          model.vehicle.Z() != last_Z);
+          last_X = model.vehicle.X();
+          last_N = model.vehicle.N();
+          last_Z = model.vehicle.Z();
+          advance(integrator, model, x, restart);
+          score.finite = state_finite(x);
+          score.error = std::max(score.error,
+                                 state_error(x, reference[tick]));
+     }
+     score.seconds = now_seconds() - start;
+     score.steps = integrator.stats().steps;
+     score.rejected = integrator.stats().rejected;
+     score.evaluations = model.evaluations;
+}
+
+static void print_score(const char *name, const Score &score)
+{
+     if (!score.finite) {
+          printf("%-22s diverged\n", name);
+          return;
+     }
+     printf("%-22s %8.2f %8lu %8lu %8lu %10.1f %10.2g\n", name,
+            DURATION / score.steps * 1e3, score.steps, score.rejected,
+            score.evaluations, score.seconds / DURATION * 1e6, score.error);
+}
+
+int main()
+{
+     int ticks = (int)(DURATION / PERIOD + 0.5);
+
+     // Reference trajectory at every output
+     std::vector<state_type> reference(ticks + 1);
+     boost::numeric::odeint::runge_kutta4<state_type> stepper;
+     Model model;
+     model.evaluations = 0;
+     initial_state(reference[0]);
+     state_type x = reference[0];
+     int substeps = (int)(PERIOD / REFERENCE_STEP + 0.5);
+     double jacobian_error = 0;
+     double fastest_mode = 0;
+     for (int tick = 1; tick <= ticks; tick++) {
+          thrust(tick - 1, model);
+          for (int i = 0; i < substeps; i++) {
+               stepper.do_step(boost::cref(model), x, 0.0, REFERENCE_STEP);
+          }
+          reference[tick] = x;
+
+          // Analytic against central differences
+          matrix_type J(12, 12);
+          J.clear();
+          Jacobian()(x, J);
+          for (int j = 0; j < 12; j++) {
+               double h = 1e-6 * std::max(1.0, fabs(x[j]));
+               state_type xp = x, xm = x, fp, fm;
+               xp[j] += h;
+               xm[j] -= h;
+               model(xp, fp, 0);
+               model(xm, fm, 0);
+               for (int i = 0; i < 12; i++) {
+                    double numeric = (fp[i] - fm[i]) / (2 * h);
+                    jacobian_error = std::max(jacobian_error,
+                                              fabs(numeric - J(i, j)) /
+                                              std::max(1.0, fabs(numeric)));
+               }
+          }
+          fastest_mode = std::max(fastest_mode, -J(5, 5));
+     }
+
+     printf("%.0f s, %.0f ms outputs, N_rdot %g: yaw-rate mode down to "
+            "%.0f/s, Jacobian error %.1g\n", DURATION, PERIOD * 1e3,
+            VideoRayPro3::N_rdot, -fastest_mode, jacobian_error);
+     printf("%-22s %8s %8s %8s %8s %10s %10s\n", "stepper", "step ms",
+            "steps", "rejected", "evals", "us/sim s", "max error");
+
+     Score score;
+     double steps[] = { 0.1, 0.05, 0.02, 0.01, 0.005, 0.002 };
+     for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+          rk4(reference, steps[i], score);
+          char name[32];
+          snprintf(name, sizeof(name), "rk4 %g ms", steps[i] * 1e3);
+          print_score(name, score);
+     }
+
+     double tolerances[] = { 1e-4, 1e-6 };
+     for (int i = 0; i < 2; i++) {
+          adaptive<AdaptiveIntegrator<state_type> >(reference, tolerances[i],
+                                                    score);
+          char name[32];
+          snprintf(name, sizeof(name), "dopri5 tol %g", tolerances[i]);
+          print_score(name, score);
+     }
+
+     Score stiff;
+     for (int i = 0; i < 2; i++) {
+          adaptive<StiffIntegrator<state_type> >(reference, tolerances[i],
+                                                 stiff);
+          char name[32];
+          snprintf(name, sizeof(name), "rosenbrock4 tol %g", tolerances[i]);
+          print_score(name, stiff);
+     }
+
+     // Central differences straddle the kink of v|v| at rest, which is
+     // worth a few 1e-5; a wrong term is off by far more
+     if (jacobian_error > 1e-4) {
+          cout << "FAIL: analytic Jacobian disagrees with the model" << endl;
+          return 1;
+     }
+     if (!stiff.finite || stiff.error > TOLERANCE) {
+          cout << "FAIL: rosenbrock4 off the reference" << endl;
+          return 1;
+     }
+     cout << "PASS: Jacobian matches, rosenbrock4 on the reference" << endl;
+     return 0;
+}
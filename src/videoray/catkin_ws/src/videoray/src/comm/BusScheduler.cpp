@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "BusScheduler.h"
+
+BusScheduler::BusScheduler()
+{
+     periodic_count_ = 0;
+     one_shot_count_ = 0;
+     bytes_per_sec_ = 0;
+     slot_period_ = 0;
+     slot_bytes_ = 0;
+     memset(&stats_, 0, sizeof(stats_));
+     stats_.last_deferred = "";
+}
+
+void BusScheduler::set_link(unsigned int baud, double slot_rate)
+{
+     bytes_per_sec_ = baud / 10.0;
+     slot_period_ = slot_rate > 0 ? 1.0 / slot_rate : 0;
+     slot_bytes_ = bytes_per_sec_ * slot_period_;
+     update_utilization();
+}
+
+BusScheduler::Status_t BusScheduler::add_periodic(const char *name,
+                                                  double rate, int bytes,
+                                                  int priority,
+                                                  const Send &send)
+{
+     if (periodic_count_ >= MAX_PERIODIC || rate <= 0) {
+          return BusScheduler::Failure;
+     }
+     Job &job = periodic_[periodic_count_++];
+     job.name = name;
+     job.priority = priority;
+     job.bytes = bytes;
+     job.period = 1.0 / rate;
+     job.due = 0;
+     job.deadline = 0;
+     job.age = 0;
+     job.send = send;
+
+     if (slot_bytes_ > 0 && bytes > slot_bytes_) {
+          printf("BusScheduler: %s needs %d bytes, a slot only carries "
+                 "%.0f\n", name, bytes, slot_bytes_);
+     }
+     update_utilization();
+     return BusScheduler::Success;
+}
+
+BusScheduler::Status_t BusScheduler::submit(const char *name, int priority,
+                                            double deadline, int bytes,
+                                            const Send &send)
+{
+     if (one_shot_count_ >= MAX_ONE_SHOTS) {
+          return BusScheduler::Failure;
+     }
+     Job &job = one_shots_[one_shot_count_++];
+     job.name = name;
+     job.priority = priority;
+     job.bytes = bytes;
+     job.period = 0;
+     job.due = 0;
+     job.deadline = deadline;
+     job.age = 0;
+     job.send = send;
+     return BusScheduler::Success;
+}
+
+void BusScheduler::clear()
+{
+     for (int i = 0; i < periodic_count_; i++) {
+          periodic_[i].send = Send();
+     }
+     for (int i = 0; i < one_shot_count_; i++) {
+          one_shots_[i].send = Send();
+     }
+     periodic_count_ = 0;
+     one_shot_count_ = 0;
+     update_utilization();
+}
+
+// Demand of the periodic jobs against the link capacity, reported as soon
+// as it exceeds what the link carries
+void BusScheduler::update_utilization()
+{
+     if (bytes_per_sec_ <= 0) {
+          stats_.utilization = 0;
+          return;
+     }
+     double demand = 0;
+     for (int i = 0; i < periodic_count_; i++) {
+          demand += periodic_[i].bytes / periodic_[i].period;
+     }
+     bool was_over = oversubscribed();
+     stats_.utilization = demand / bytes_per_sec_;
+     if (oversubscribed() && !was_over) {
+          printf("BusScheduler: periodic jobs need %.0f%% of the link "
+                 "(%.0f of %.0f bytes/s)\n", stats_.utilization * 100,
+                 demand, bytes_per_sec_);
+     }
+}
+
+bool BusScheduler::oversubscribed() const
+{
+     return stats_.utilization > 1.0;
+}
+
+const BusScheduler::Stats & BusScheduler::stats() const
+{
+     return stats_;
+}
+
+bool BusScheduler::before(const Job *a, const Job *b)
+{
+     if (a->priority + a->age != b->priority + b->age) {
+          return a->priority + a->age > b->priority + b->age;
+     }
+     return a->deadline < b->deadline;
+}
+
+void BusScheduler::run_slot(double now)
+{
+     stats_.slots++;
+
+     // A job is due if it falls within this slot
+     double horizon = now + slot_period_ / 2;
+
+     // One-shots past their deadline are dropped, the rest compete with
+     // the due periodic jobs
+     Job *ready[MAX_PERIODIC + MAX_ONE_SHOTS];
+     int count = 0;
+     for (int i = 0; i < periodic_count_; i++) {
+          Job &job = periodic_[i];
+          if (job.due <= horizon) {
+               job.deadline = job.due + job.period;
+               ready[count++] = &job;
+          }
+     }
+     int kept = 0;
+     for (int i = 0; i < one_shot_count_; i++) {
+          if (one_shots_[i].deadline < now) {
+               stats_.expired++;
+               continue;
+          }
+          if (kept != i) {
+               one_shots_[kept] = one_shots_[i];
+          }
+          kept++;
+     }
+     one_shot_count_ = kept;
+     for (int i = 0; i < one_shot_count_; i++) {
+          ready[count++] = &one_shots_[i];
+     }
+
+     // Insertion sort, there are only a handful of jobs
+     for (int i = 1; i < count; i++) {
+          Job *job = ready[i];
+          int j = i - 1;
+          for (; j >= 0 && before(job, ready[j]); j--) {
+               ready[j + 1] = ready[j];
+          }
+          ready[j + 1] = job;
+     }
+
+     double used = 0;
+     bool overrun = false;
+     for (int i = 0; i < count; i++) {
+          Job &job = *ready[i];
+
+          // The first job always runs, even one larger than a slot
+          if (slot_bytes_ > 0 && used > 0 && used + job.bytes > slot_bytes_) {
+               stats_.deferred++;
+               stats_.last_deferred = job.name;
+               job.age++;
+               overrun = true;
+               continue;
+          }
+
+          bool sent = job.send();
+          job.age = 0;
+          if (!sent) {
+               stats_.failed++;
+          } else {
+               used += job.bytes;
+          }
+
+          if (job.period > 0) {
+               // Missed periods are skipped, not made up in a burst
+               job.due += job.period;
+               if (job.due <= now) {
+                    job.due = now + job.period;
+               }
+          } else if (sent) {
+               job.send = Send();
+               job.deadline = -1;
+               stats_.one_shots++;
+          }
+     }
+
+     // Drop the one-shots that ran, keeping the queue in arrival order
+     kept = 0;
+     for (int i = 0; i < one_shot_count_; i++) {
+          if (one_shots_[i].deadline < 0) {
+               continue;
+          }
+          if (kept != i) {
+               one_shots_[kept] = one_shots_[i];
+          }
+          kept++;
+     }
+     one_shot_count_ = kept;
+
+     if (overrun) {
+          stats_.overruns++;
+     }
+     if (slot_bytes_ > 0 && used / slot_bytes_ > stats_.load_max) {
+          stats_.load_max = used / slot_bytes_;
+     }
+}
@@ -0,0 +1,129 @@
+#include <string.h>
+
+#include "CsrShadow.h"
+
+CsrShadow::CsrShadow()
+{
+     memset(wanted_, 0, sizeof(wanted_));
+     memset(sent_, 0, sizeof(sent_));
+     memset(dirty_, 0, sizeof(dirty_));
+     memset(tracked_, 0, sizeof(tracked_));
+     dirty_count_ = 0;
+}
+
+void CsrShadow::track(int addr, int length)
+{
+     for (int i = addr; i < addr + length && i < SIZE; i++) {
+          tracked_[i] = true;
+     }
+}
+
+// Dirty flag and counter follow the comparison of the two images
+void CsrShadow::update(int addr)
+{
+     bool dirty = wanted_[addr] != sent_[addr];
+     if (dirty != dirty_[addr]) {
+          dirty_[addr] = dirty;
+          dirty_count_ += dirty ? 1 : -1;
+     }
+}
+
+void CsrShadow::set(int addr, uint8_t value)
+{
+     if (addr < 0 || addr >= SIZE) {
+          return;
+     }
+     wanted_[addr] = value;
+     update(addr);
+}
+
+void CsrShadow::set(int addr, const void *data, int length)
+{
+     const uint8_t *bytes = (const uint8_t *)data;
+     for (int i = 0; i < length; i++) {
+          set(addr + i, bytes[i]);
+     }
+}
+
+uint8_t CsrShadow::get(int addr) const
+{
+     return wanted_[addr];
+}
+
+const uint8_t * CsrShadow::data() const
+{
+     return wanted_;
+}
+
+void CsrShadow::invalidate()
+{
+     invalidate(0, SIZE);
+}
+
+void CsrShadow::invalidate(int addr, int length)
+{
+     for (int i = addr; i < addr + length && i < SIZE; i++) {
+          if (tracked_[i] && !dirty_[i]) {
+               dirty_[i] = true;
+               dirty_count_++;
+          }
+     }
+}
+
+bool CsrShadow::dirty() const
+{
+     return dirty_count_ > 0;
+}
+
+bool CsrShadow::dirty(int addr, int length) const
+{
+     for (int i = addr; i < addr + length && i < SIZE; i++) {
+          if (dirty_[i]) {
+               return true;
+          }
+     }
+     return false;
+}
+
+int CsrShadow::dirty_ranges(Range *ranges, int max, int merge_gap) const
+{
+     int count = 0;
+     int i = 0;
+     while (i < SIZE && count < max) {
+          if (!dirty_[i]) {
+               i++;
+               continue;
+          }
+
+          // Extend the run over dirty registers and over clean gaps that
+          // are cheaper to resend than to start a new write for
+          int start = i;
+          int end = i + 1;
+          int j = end;
+          while (j < SIZE) {
+               if (dirty_[j]) {
+                    end = ++j;
+               } else if (j - end + 1 < merge_gap) {
+                    j++;
+               } else {
+                    break;
+               }
+          }
+          ranges[count].addr = start;
+          ranges[count].length = end - start;
+          count++;
+          i = end;
+     }
+     return count;
+}
+
+void CsrShadow::mark_sent(int addr, int length)
+{
+     for (int i = addr; i < addr + length && i < SIZE; i++) {
+          sent_[i] = wanted_[i];
+          if (dirty_[i]) {
+               dirty_[i] = false;
+               dirty_count_--;
+          }
+     }
+}
@@ -14,13 +14,22 @@
 // Total checksum is the last byte
 #define TOTAL_SUM  8
 
-#define HEADER_SIZE 7
+#define REQUEST_SYNC_MSB  0xFA
+#define REQUEST_SYNC_LSB  0xAF
+#define RESPONSE_SYNC_MSB 0xFD
+#define RESPONSE_SYNC_LSB 0xDF
 
-Packetizer::Packetizer() : REQUEST_SYNC_MSB_(0xFA), REQUEST_SYNC_LSB_(0xAF), 
-                           RESPONSE_SYNC_MSB_(0xFD), RESPONSE_SYNC_LSB_(0xDF) 
+Packetizer::Packetizer(Role_t role) 
+     : TX_SYNC_MSB_(role == Host ? REQUEST_SYNC_MSB : RESPONSE_SYNC_MSB), 
+       TX_SYNC_LSB_(role == Host ? REQUEST_SYNC_LSB : RESPONSE_SYNC_LSB), 
+       RX_SYNC_MSB_(role == Host ? RESPONSE_SYNC_MSB : REQUEST_SYNC_MSB), 
+       RX_SYNC_LSB_(role == Host ? RESPONSE_SYNC_LSB : REQUEST_SYNC_LSB) 
 {
-     count_ = 0;
-     packet_ = NULL;
+     length_ = 0;
+     rx_bytes_ = 0;
+
+     reset();
+     clear_stats();
 }
 
 void Packetizer::set_network_id(unsigned char network_id)
@@ -38,19 +47,35 @@ void Packetizer::set_csr_addr(unsigned char csr_addr)
      csr_addr_ = csr_addr;
 }
 
+unsigned char Packetizer::network_id() const
+{
+     return network_id_;
+}
+
+unsigned char Packetizer::flags() const
+{
+     return flags_;
+}
+
+unsigned char Packetizer::csr_addr() const
+{
+     return csr_addr_;
+}
+
 void Packetizer::set_data(char * data, int length)
 {
-     length_ = length;
-     
-     if (packet_) {
-          delete[] packet_;
+     if (length > MAX_PAYLOAD) {
+          length = MAX_PAYLOAD;
+     } else if (length < 0) {
+          length = 0;
      }
+     length_ = length;
 
      // Packet consists of:
      // HEADER_SIZE (7 bytes)
      // Payload Data (length bytes)
      // Final Checksum (1 byte)
-     packet_ = new char[HEADER_SIZE + length_ + 1];
+     // packet_ is sized for the largest payload, so it is reused as-is.
      
      // copy data to internal buffer
      memcpy(packet_ + PAYLOAD, data, length_);     
@@ -68,8 +93,8 @@ unsigned char Packetizer::generate_check_sum(char *buf, int length)
 int Packetizer::generate_packet(char ** packet)
 {
      // Build packet     
-     packet_[SYNC_1] = REQUEST_SYNC_MSB_;
-     packet_[SYNC_2] = REQUEST_SYNC_LSB_;
+     packet_[SYNC_1] = TX_SYNC_MSB_;
+     packet_[SYNC_2] = TX_SYNC_LSB_;
      packet_[NETWORK_ID] = network_id_;
      packet_[FLAGS] = flags_;
      packet_[CSR_ADDR] = csr_addr_;
@@ -83,103 +108,295 @@ int Packetizer::generate_packet(char ** packet)
      return (HEADER_SIZE + length_ + 1);
 }
 
+void Packetizer::build_frame(TxFrame &frame, const void *data, int length)
+{
+     if (length > MAX_PAYLOAD) {
+          length = MAX_PAYLOAD;
+     } else if (length < 0) {
+          length = 0;
+     }
+
+     frame.header[SYNC_1] = TX_SYNC_MSB_;
+     frame.header[SYNC_2] = TX_SYNC_LSB_;
+     frame.header[NETWORK_ID] = network_id_;
+     frame.header[FLAGS] = flags_;
+     frame.header[CSR_ADDR] = csr_addr_;
+     frame.header[LENGTH] = length;
+     frame.header[HDR_SUM] = generate_check_sum((char *)frame.header, 
+                                                HEADER_SIZE-1);
+
+     frame.payload = (const uint8_t *)data;
+     frame.length = length;
+     frame.trailer = generate_check_sum((char *)frame.payload, length);
+}
+
+int Packetizer::frame_iovec(const TxFrame *frames, int count, 
+                            struct iovec *iov)
+{
+     int n = 0;
+     for (int i = 0; i < count; i++) {
+          iov[n].iov_base = (void *)frames[i].header;
+          iov[n].iov_len = HEADER_SIZE;
+          n++;
+          if (frames[i].length > 0) {
+               iov[n].iov_base = (void *)frames[i].payload;
+               iov[n].iov_len = frames[i].length;
+               n++;
+          }
+          iov[n].iov_base = (void *)&frames[i].trailer;
+          iov[n].iov_len = 1;
+          n++;
+     }
+     return n;
+}
+
 void Packetizer::reset()
 {
-     count_ = 0;
+     chunk_ = NULL;
+     chunk_len_ = 0;
+     chunk_pos_ = 0;
+     carry_start_ = 0;
+     carry_len_ = 0;
 }
 
+const Packetizer::Stats & Packetizer::stats() const
+{
+     return stats_;
+}
+
+void Packetizer::clear_stats()
+{
+     memset(&stats_, 0, sizeof(stats_));
+}
+
+// Byte-at-a-time front end to the bulk decoder. The byte is handed to
+// feed() as a one byte chunk, so partial frames accumulate in the carry
+// buffer and get the same validation and resynchronization as bulk reads.
 Packetizer::Status_t Packetizer::receive_packet(unsigned char byte)
 {
-     bool in_prog = false;
-     bool sync_err = false;
+     Stats before = stats_;
 
-     switch (count_) {
-     case SYNC_1:
-          if (byte == RESPONSE_SYNC_MSB_) {
-               count_++;
-               in_prog = true;
-          } else {
-               sync_err = true;
-          }
-          break;
-
-     case SYNC_2:
-          if (byte == RESPONSE_SYNC_LSB_) {
-               count_++;
-               in_prog = true;
-          } else {
-               std::cout << "Sync Error" << std::endl;
-               count_ = 0;
-               sync_err = true;               
-          }
-          break;
-          
-     case NETWORK_ID:
-          network_id_ = byte;
-          count_++;
-          in_prog = true;
-          break;
-          
-     case FLAGS:
-          flags_ = byte;
-          count_++;
-          in_prog = true;
-          
-          break;
-     case CSR_ADDR:
-          csr_addr_ = byte;
-          count_++;
-          in_prog = true;
-          break;
-          
-     case LENGTH:
-          length_ = byte;
-          count_++;
-          in_prog = true;
-          
-          if (packet_) {
-               delete[] packet_;
-          }
-          packet_ = new char[length_];
-          rx_bytes_ = 0;
-
-          break;
-     case HDR_SUM:
-          header_chk_sum_ = byte;
-          count_++;
-          in_prog = true;
-
-          break;
-     case PAYLOAD:
-          packet_[rx_bytes_++] = byte;          
-          in_prog = true;
-          if (rx_bytes_ >= length_) {
-               count_++;
-          }
-          break;
-          
-     case TOTAL_SUM:
-          total_chk_sum_ = byte;
-          count_ = 0;
+     // If the last call completed a frame from the carry buffer alone, the
+     // previous byte is still unread. feed() moves it into the carry buffer
+     // before rx_byte_ is overwritten.
+     feed(NULL, 0);
+     rx_byte_ = byte;
+     feed(&rx_byte_, 1);
+
+     Frame frame;
+     if (next(frame)) {
+          network_id_ = frame.network_id;
+          flags_ = frame.flags;
+          csr_addr_ = frame.csr_addr;
+          length_ = frame.length;
+          memcpy(payload_, frame.payload, frame.length);
+          rx_bytes_ = frame.length;
           return Packetizer::Success;
+     }
+
+     if (stats_.total_chk_errors != before.total_chk_errors) {
+          return Packetizer::Total_Chk_Sum_Err;
+     } else if (stats_.hdr_chk_errors != before.hdr_chk_errors) {
+          return Packetizer::Hdr_Chk_Sum_Err;
+     } else if (carry_len_ == 0) {
+          // The byte is not part of any frame
+          return Packetizer::Sync_Err;
+     }
+     return Packetizer::In_Progress;
+}
+
+int Packetizer::get_payload(char ** packet)
+{
+     *packet = payload_;
+     return rx_bytes_;
+}
 
-          break;
+void Packetizer::feed(const uint8_t *buf, size_t len)
+{
+     // Bytes the caller never pulled out of the previous chunk stay in line
+     // ahead of the new chunk.
+     if (chunk_pos_ < chunk_len_) {
+          compact_carry();
+          size_t left = chunk_len_ - chunk_pos_;
+          if (left > sizeof(carry_) - carry_len_) {
+               stats_.dropped_bytes += left - (sizeof(carry_) - carry_len_);
+               left = sizeof(carry_) - carry_len_;
+          }
+          memcpy(carry_ + carry_len_, chunk_ + chunk_pos_, left);
+          carry_len_ += left;
+     }
 
-     default:
-          std::cout << "Error in state machine" << std::endl;
+     chunk_ = buf;
+     chunk_len_ = len;
+     chunk_pos_ = 0;
+}
+
+// Checks as much of the frame starting at p as is available. Returns the
+// frame size once a complete frame passes both checksums, 0 when more bytes
+// are needed to decide, and -1 when the frame is bad.
+int Packetizer::check_frame(const uint8_t *p, size_t avail)
+{
+     if (avail >= 2 && p[SYNC_2] != RX_SYNC_LSB_) {
+          stats_.sync_errors++;
+          return -1;
+     }
+     if (avail < (size_t)HEADER_SIZE) {
+          return 0;
      }
 
-     if (sync_err) {
-          return Packetizer::Sync_Err;
+     // Header checksum covers the sync word through the length byte
+     if ((p[0] ^ p[1] ^ p[2] ^ p[3] ^ p[4] ^ p[5]) != p[HDR_SUM]) {
+          stats_.hdr_chk_errors++;
+          return -1;
+     }
+
+     int size = HEADER_SIZE + p[LENGTH] + 1;
+     if (avail < (size_t)size) {
+          return 0;
      }
 
-     if (in_prog) {
-          return Packetizer::In_Progress;
+     // Total checksum covers the payload, matching generate_packet()
+     uint8_t sum = 0;
+     for (int i = PAYLOAD; i < size - 1; i++) {
+          sum ^= p[i];
      }
+     if (sum != p[size-1]) {
+          stats_.total_chk_errors++;
+          return -1;
+     }
+
+     stats_.frames++;
+     return size;
 }
 
-int Packetizer::get_payload(char ** packet)
+void Packetizer::emit_frame(const uint8_t *p, Frame &frame)
 {
-     *packet = packet_;
-     return rx_bytes_;
+     frame.network_id = p[NETWORK_ID];
+     frame.flags = p[FLAGS];
+     frame.csr_addr = p[CSR_ADDR];
+     frame.length = p[LENGTH];
+     frame.payload = p + PAYLOAD;
+}
+
+void Packetizer::compact_carry()
+{
+     if (carry_start_ > 0) {
+          memmove(carry_, carry_ + carry_start_, carry_len_ - carry_start_);
+          carry_len_ -= carry_start_;
+          carry_start_ = 0;
+     }
+}
+
+// Drops carried bytes up to the next candidate sync byte at or after from.
+void Packetizer::resync_carry(int from)
+{
+     const uint8_t *sync = NULL;
+     if (from < carry_len_) {
+          sync = (const uint8_t *)memchr(carry_ + from, RX_SYNC_MSB_,
+                                         carry_len_ - from);
+     }
+     if (sync == NULL) {
+          stats_.skipped_bytes += carry_len_;
+          carry_len_ = 0;
+     } else {
+          carry_start_ = sync - carry_;
+          stats_.skipped_bytes += carry_start_;
+          compact_carry();
+     }
+}
+
+// Completes a frame whose first bytes were carried over from an earlier
+// chunk. Only the bytes a frame still needs are taken from the chunk, and a
+// bad frame is rescanned from the byte after its sync word.
+bool Packetizer::next_carried(Frame &frame)
+{
+     compact_carry();
+     
+     while (carry_len_ > 0) {
+          if (carry_[SYNC_1] != RX_SYNC_MSB_) {
+               resync_carry(0);
+               continue;
+          }
+
+          int size = check_frame(carry_, carry_len_);
+          if (size > 0) {
+               emit_frame(carry_, frame);
+               // The payload stays in place until the next call
+               carry_start_ = size;
+               if (carry_start_ == carry_len_) {
+                    carry_start_ = carry_len_ = 0;
+               }
+               return true;
+          } else if (size < 0) {
+               resync_carry(1);
+               continue;
+          }
+
+          if (chunk_pos_ >= chunk_len_) {
+               return false;
+          }
+
+          int needed = HEADER_SIZE;
+          if (carry_len_ >= HEADER_SIZE) {
+               needed = HEADER_SIZE + carry_[LENGTH] + 1;
+          } else if (carry_len_ == 1) {
+               needed = 2;
+          }
+
+          size_t take = needed - carry_len_;
+          if (take > chunk_len_ - chunk_pos_) {
+               take = chunk_len_ - chunk_pos_;
+          }
+          memcpy(carry_ + carry_len_, chunk_ + chunk_pos_, take);
+          carry_len_ += take;
+          chunk_pos_ += take;
+     }
+     return false;
+}
+
+bool Packetizer::next(Frame &frame)
+{
+     if (carry_start_ > 0 || carry_len_ > 0) {
+          if (next_carried(frame)) {
+               return true;
+          }
+          if (carry_len_ > 0) {
+               // Chunk exhausted, the frame is still incomplete
+               return false;
+          }
+     }
+
+     while (chunk_pos_ < chunk_len_) {
+          size_t avail = chunk_len_ - chunk_pos_;
+          const uint8_t *sync = (const uint8_t *)memchr(chunk_ + chunk_pos_,
+                                                        RX_SYNC_MSB_,
+                                                        avail);
+          if (sync == NULL) {
+               stats_.skipped_bytes += avail;
+               chunk_pos_ = chunk_len_;
+               return false;
+          }
+          
+          stats_.skipped_bytes += (sync - chunk_) - chunk_pos_;
+          chunk_pos_ = sync - chunk_;
+          avail = chunk_len_ - chunk_pos_;
+
+          int size = check_frame(sync, avail);
+          if (size > 0) {
+               emit_frame(sync, frame);
+               chunk_pos_ += size;
+               return true;
+          } else if (size < 0) {
+               // Rescan from the byte after the failed sync word
+               chunk_pos_++;
+               continue;
+          }
+
+          // Partial frame at the end of the chunk
+          memcpy(carry_, sync, avail);
+          carry_len_ = avail;
+          chunk_pos_ = chunk_len_;
+          return false;
+     }
+     return false;
 }
@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include "TransactionTable.h"
+
+TransactionTable::TransactionTable()
+{
+     memset(entries_, 0, sizeof(entries_));
+     memset(&stats_, 0, sizeof(stats_));
+}
+
+bool TransactionTable::begin(uint8_t network_id, uint8_t flags,
+                             uint8_t csr_addr, double now)
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+          Entry &e = entries_[i];
+          if (!e.used) {
+               e.used = true;
+               e.network_id = network_id;
+               e.flags = flags;
+               e.csr_addr = csr_addr;
+               e.sent = now;
+               stats_.requests++;
+               return true;
+          }
+     }
+     stats_.full++;
+     return false;
+}
+
+void TransactionTable::cancel(uint8_t network_id, uint8_t flags,
+                              uint8_t csr_addr)
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     Entry *newest = NULL;
+     for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+          Entry &e = entries_[i];
+          if (e.used && e.network_id == network_id && e.flags == flags &&
+              e.csr_addr == csr_addr && (!newest || e.sent >= newest->sent)) {
+               newest = &e;
+          }
+     }
+     if (newest) {
+          newest->used = false;
+          stats_.requests--;
+     }
+}
+
+bool TransactionTable::complete(uint8_t network_id, uint8_t flags,
+                                uint8_t csr_addr, double now,
+                                double &latency)
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     Entry *oldest = NULL;
+     for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+          Entry &e = entries_[i];
+          if (e.used && e.network_id == network_id && e.flags == flags &&
+              e.csr_addr == csr_addr && (!oldest || e.sent < oldest->sent)) {
+               oldest = &e;
+          }
+     }
+     if (!oldest) {
+          stats_.unsolicited++;
+          return false;
+     }
+     oldest->used = false;
+     latency = now - oldest->sent;
+     stats_.responses++;
+     return true;
+}
+
+int TransactionTable::expire(double now, double timeout)
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     int expired = 0;
+     for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+          Entry &e = entries_[i];
+          if (e.used && now - e.sent > timeout) {
+               e.used = false;
+               expired++;
+          }
+     }
+     stats_.timeouts += expired;
+     return expired;
+}
+
+int TransactionTable::in_flight(uint8_t network_id, uint8_t flags,
+                                uint8_t csr_addr)
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     int count = 0;
+     for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+          const Entry &e = entries_[i];
+          if (e.used && e.network_id == network_id && e.flags == flags &&
+              e.csr_addr == csr_addr) {
+               count++;
+          }
+     }
+     return count;
+}
+
+int TransactionTable::in_flight()
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     int count = 0;
+     for (int i = 0; i < MAX_IN_FLIGHT; i++) {
+          if (entries_[i].used) {
+               count++;
+          }
+     }
+     return count;
+}
+
+TransactionTable::Stats TransactionTable::stats()
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     return stats_;
+}
@@ -0,0 +1,287 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#include <syllo_serial/serialib.h>
+
+#include "TxQueue.h"
+
+// Bits per byte on the wire (start, 8 data, stop)
+#define BITS_PER_BYTE 10.0
+
+static double monotonic_seconds()
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+TxQueue::TxQueue() : head_(0), tail_(0), running_(false), frames_(0),
+                     bytes_(0), writes_(0), write_errors_(0)
+{
+     threaded_ = false;
+     pending_ = 0;
+     sent_ = 0;
+     blocked_ = false;
+     serial_ = NULL;
+     event_fd_ = -1;
+     rejected_full_ = 0;
+     rejected_budget_ = 0;
+
+     // Unlimited until set_budget() is called
+     bytes_per_sec_ = 0;
+     budget_max_ = 0;
+     budget_ = 0;
+     budget_time_ = 0;
+}
+
+TxQueue::~TxQueue()
+{
+     stop();
+}
+
+bool TxQueue::start(serialib *serial)
+{
+     if (running_) {
+          return false;
+     }
+     event_fd_ = eventfd(0, 0);
+     if (event_fd_ < 0) {
+          printf("TxQueue: eventfd failed: %s\n", strerror(errno));
+          return false;
+     }
+     serial_ = serial;
+     running_ = true;
+     threaded_ = true;
+     thread_ = std::thread(&TxQueue::writer, this);
+     return true;
+}
+
+bool TxQueue::attach(serialib *serial)
+{
+     if (running_) {
+          return false;
+     }
+     event_fd_ = eventfd(0, EFD_NONBLOCK);
+     if (event_fd_ < 0) {
+          printf("TxQueue: eventfd failed: %s\n", strerror(errno));
+          return false;
+     }
+     serial_ = serial;
+     running_ = true;
+     threaded_ = false;
+     return true;
+}
+
+int TxQueue::event_fd()
+{
+     return event_fd_;
+}
+
+void TxQueue::service()
+{
+     uint64_t count;
+     if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN &&
+         errno != EINTR) {
+          printf("TxQueue: eventfd read failed: %s\n", strerror(errno));
+     }
+     send_flushed();
+}
+
+bool TxQueue::blocked()
+{
+     return blocked_;
+}
+
+void TxQueue::stop()
+{
+     if (!running_) {
+          return;
+     }
+     running_ = false;
+     if (threaded_) {
+          uint64_t one = 1;
+          if (write(event_fd_, &one, sizeof(one)) < 0) {
+               printf("TxQueue: cannot wake the writer\n");
+          }
+          thread_.join();
+     }
+     close(event_fd_);
+     event_fd_ = -1;
+}
+
+void TxQueue::set_budget(unsigned int baud, double cycle_rate)
+{
+     bytes_per_sec_ = baud / BITS_PER_BYTE;
+     budget_max_ = cycle_rate > 0 ? bytes_per_sec_ / cycle_rate : 0;
+     budget_ = budget_max_;
+     budget_time_ = monotonic_seconds();
+}
+
+TxQueue::Status_t TxQueue::enqueue(Packetizer &packetizer, const void *data,
+                                   int length)
+{
+     if (pending_ - tail_.load(std::memory_order_acquire) >= SLOTS) {
+          rejected_full_++;
+          return TxQueue::Full;
+     }
+
+     if (budget_max_ > 0) {
+          // Refill with what the line has sent since the last frame
+          double now = monotonic_seconds();
+          budget_ += (now - budget_time_) * bytes_per_sec_;
+          budget_time_ = now;
+          if (budget_ > budget_max_) {
+               budget_ = budget_max_;
+          }
+
+          int bytes = Packetizer::HEADER_SIZE + length + 1;
+          if (bytes > budget_) {
+               rejected_budget_++;
+               return TxQueue::Over_Budget;
+          }
+          budget_ -= bytes;
+     }
+
+     Slot &slot = slots_[pending_ & (SLOTS - 1)];
+     if (length > Packetizer::MAX_PAYLOAD) {
+          length = Packetizer::MAX_PAYLOAD;
+     } else if (length < 0) {
+          length = 0;
+     }
+     memcpy(slot.payload, data, length);
+     packetizer.build_frame(slot.frame, slot.payload, length);
+     pending_++;
+     return TxQueue::Success;
+}
+
+void TxQueue::flush()
+{
+     if (!running_ || pending_ == head_.load(std::memory_order_relaxed)) {
+          return;
+     }
+     head_.store(pending_, std::memory_order_release);
+
+     // eventfd is a counter: the write never blocks and several flushes
+     // before the writer wakes up collapse into one wakeup
+     uint64_t one = 1;
+     if (write(event_fd_, &one, sizeof(one)) < 0) {
+          printf("TxQueue: cannot wake the writer\n");
+     }
+}
+
+void TxQueue::drain()
+{
+     unsigned int head = head_.load(std::memory_order_relaxed);
+     while (running_ && tail_.load(std::memory_order_acquire) != head) {
+          std::this_thread::yield();
+     }
+}
+
+TxQueue::Stats TxQueue::stats()
+{
+     Stats stats;
+     stats.frames = frames_;
+     stats.bytes = bytes_;
+     stats.writes = writes_;
+     stats.rejected_full = rejected_full_;
+     stats.rejected_budget = rejected_budget_;
+     stats.write_errors = write_errors_;
+     return stats;
+}
+
+void TxQueue::writer()
+{
+     while (running_) {
+          uint64_t count;
+          if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EINTR) {
+               printf("TxQueue: eventfd read failed: %s\n", strerror(errno));
+               break;
+          }
+          send_flushed();
+     }
+}
+
+// Everything flushed so far goes out in one system call. Without a writer
+// thread the call does not wait for the port, see write_available().
+void TxQueue::send_flushed()
+{
+     struct iovec iov[3 * SLOTS];
+     Packetizer::TxFrame frames[SLOTS];
+
+     unsigned int tail = tail_.load(std::memory_order_relaxed);
+     unsigned int head = head_.load(std::memory_order_acquire);
+     if (tail == head) {
+          return;
+     }
+
+     int n = 0;
+     for (unsigned int i = tail; i != head; i++) {
+          frames[n++] = slots_[i & (SLOTS - 1)].frame;
+     }
+     int iovcnt = Packetizer::frame_iovec(frames, n, iov);
+     if (!threaded_) {
+          write_available(frames, n, iov, iovcnt);
+          return;
+     }
+     if (serial_->WriteV(iov, iovcnt) == 1) {
+          unsigned long bytes = 0;
+          for (int i = 0; i < iovcnt; i++) {
+               bytes += iov[i].iov_len;
+          }
+          frames_ += n;
+          bytes_ += bytes;
+     } else {
+          write_errors_++;
+     }
+     writes_++;
+     tail_.store(head, std::memory_order_release);
+}
+
+// Writes what the port takes right now, starting where the last short
+// write stopped. Frames sent in full free their slots, the rest of a
+// partly sent frame goes out on the next call.
+void TxQueue::write_available(const Packetizer::TxFrame *frames, int count,
+                              struct iovec *iov, int iovcnt)
+{
+     int first = 0;
+     size_t skip = sent_;
+     while (skip >= iov[first].iov_len) {
+          skip -= iov[first].iov_len;
+          first++;
+     }
+     iov[first].iov_base = (uint8_t *)iov[first].iov_base + skip;
+     iov[first].iov_len -= skip;
+
+     unsigned int tail = tail_.load(std::memory_order_relaxed);
+     int written = serial_->WriteVNonBlocking(iov + first, iovcnt - first);
+     writes_++;
+     if (written < 0) {
+          // Dropped, as the writer thread does
+          write_errors_++;
+          sent_ = 0;
+          blocked_ = false;
+          tail_.store(tail + count, std::memory_order_release);
+          return;
+     }
+
+     size_t done = sent_ + written;
+     int complete = 0;
+     for (; complete < count; complete++) {
+          size_t bytes = Packetizer::HEADER_SIZE + frames[complete].length + 1;
+          if (done < bytes) {
+               break;
+          }
+          done -= bytes;
+          bytes_ += bytes;
+     }
+     frames_ += complete;
+     sent_ = done;
+     blocked_ = complete < count;
+     tail_.store(tail + complete, std::memory_order_release);
+}
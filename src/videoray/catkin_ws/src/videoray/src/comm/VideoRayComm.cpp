@@ -1,5 +1,8 @@
 #include <iostream>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "VideoRayComm.h"
 
@@ -23,6 +26,7 @@
 #define AUTO_HEADING_MSB 14
 
 #define TX_CTRL_SIZE     15
+#define TX_CTRL_ADDR     0x00
 
 // These numbers correspond to their placement in the data packet
 #define AUTO_DEPTH_P_LSB 0
@@ -34,142 +38,251 @@
 #define AUTO_DEPTH_K_LSB 6
 #define AUTO_DEPTH_K_MSB 7
 
-////////////////////////////////
-//// RX Control Packet Defines
-////////////////////////////////
-//#define UNKNOWN_2   0
-//#define HEADING_LSB 1
-//#define HEADING_MSB 2
-//#define PITCH_LSB   3
-//#define PITCH_MSB   4
-//#define ROLL_LSB    5
-//#define ROLL_MSB    6
+#define DEPTH_PID_SIZE   8
+#define CAM_CTRL_SIZE    2
+#define DEPTH_PID_ADDR   0x26
 
-//////////////////////////////
-// RX Control Packet Defines
-// CSR Map Defines
-////////////////////////////
-//#define DEVICE_ID      0
-//#define DEPTH_LSB      1
-//#define DEPTH_MSB      2
-//#define HEADING_LSB    3
-//#define HEADING_MSB    4
-//#define PITCH_LSB      5
-//#define PITCH_MSB      6
-//#define ROLL_LSB       7
-//#define ROLL_MSB       8
-//#define YAW_ACC_LSB    9
-//#define YAW_ACC_MSB    10
-//#define PITCH_ACC_LSB  11
-//#define PITCH_ACC_MSB  12
-//#define ROLL_ACC_LSB   13
-//#define ROLL_ACC_MSB   14
-//#define SURGE_ACC_LSB  15
-//#define SURGE_ACC_MSB  16
-//#define SWAY_ACC_LSB   17
-//#define SWAY_ACC_MSB   18
-//#define HEAVE_ACC_LSB  19
-//#define HEAVE_ACC_MSB  20
-
-#define DEVICE_ID      0
-#define HEADING_LSB    1
-#define HEADING_MSB    2
-#define PITCH_LSB      3
-#define PITCH_MSB      4
-#define ROLL_LSB       5
-#define ROLL_MSB       6
-#define DEPTH_LSB      7
-#define DEPTH_MSB      8
-#define YAW_ACC_LSB    9
-#define YAW_ACC_MSB    10
-#define PITCH_ACC_LSB  11
-#define PITCH_ACC_MSB  12
-#define ROLL_ACC_LSB   13
-#define ROLL_ACC_MSB   14
-#define SURGE_ACC_LSB  15
-#define SURGE_ACC_MSB  16
-#define SWAY_ACC_LSB   17
-#define SWAY_ACC_MSB   18
-#define HEAVE_ACC_LSB  19
-#define HEAVE_ACC_MSB  20
-#define RAW_MAG_X_LSB  21
-#define RAW_MAG_X_MSB  22
-#define RAW_MAG_Y_LSB  23
-#define RAW_MAG_Y_MSB  24
-#define RAW_MAG_Z_LSB  25
-#define RAW_MAG_Z_MSB  26
-#define ATTITUDE_LSB   27
-#define ATTITUDE_MSB   28
-//#define HUMIDITY_LSB   29
-//#define HUMIDITY_MSB   30
-//#define WATER_TEMP_LSB 31
-//#define WATER_TEMP_MSB 32
-//#define ROV_PWR_LSB    33
-//#define ROV_PWR_MSB    34
-
-#define WATER_TEMP_LSB      00
-#define WATER_TEMP_MSB      01
-#define TETHER_VOLT_LSB     02
-#define TETHER_VOLT_MSB     03
-#define VOLTAGE_12V_LSB     04
-#define VOLTAGE_12V_MSB     05
-#define CURRENT_12V_LSB     06
-#define CURRENT_12V_MSB     07
-#define INTERNAL_TEMP_LSB   08
-#define INTERNAL_TEMP_MSB   09
-#define HUMIDITY_LSB        10 
-#define HUMIDITY_MSB        11
-#define COMM_ERR_COUNT_LSB  12
-#define COMM_ERR_COUNT_MSB  13
-
-
-#define ROV_PWR_LSB    33
-#define ROV_PWR_MSB    34
+// The control block is resent this often even if nothing changed, the
+// vehicle treats it as the keep-alive of the tether (seconds)
+#define KEEPALIVE_PERIOD 0.1
+
+// Every register written so far is resent this often, in case the vehicle
+// lost or reset one behind the host's back (seconds)
+#define REGISTER_REFRESH_PERIOD 1.0
+
+// Most register writes queued in one cycle besides the control block
+#define MAX_REGISTER_WRITES 4
+
+// Minimum time between link error reports (seconds)
+#define ERROR_REPORT_PERIOD 1.0
 
+// How long to wait for the ROV to answer before giving up (seconds)
+#define RESPONSE_TIMEOUT 0.1
+
+// Longest the receive thread blocks before checking for shutdown and
+// expired requests (milliseconds)
+#define RX_POLL_MS 20
+
+// Control cycle assumed for the transmit budget until set_cycle_rate()
+#define DEFAULT_CYCLE_RATE 50.0
 
 using std::cout;
 using std::endl;
 
-VideoRayComm::VideoRayComm()
+static double monotonic_seconds()
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+VideoRayComm::VideoRayComm(const std::string &device, unsigned int baud,
+                           IoMode_t mode)
+     : healthy_(false), running_(false), bytes_in_(0), read_errors_(0)
 {
      packetizer_.set_network_id(0x01);
+     device_ = device;
+     baud_ = baud;
+     mode_ = mode;
+
+     shadow_.track(TX_CTRL_ADDR, TX_CTRL_SIZE);
+     shadow_.set(TX_CTRL_ADDR + PORT_THRUST_LSB, 0);
+     shadow_.set(TX_CTRL_ADDR + PORT_THRUST_MSB, 0);
+     shadow_.set(TX_CTRL_ADDR + STAR_THRUST_LSB, 0);
+     shadow_.set(TX_CTRL_ADDR + STAR_THRUST_MSB, 0);
+     shadow_.set(TX_CTRL_ADDR + VERT_THRUST_LSB, 0);
+     shadow_.set(TX_CTRL_ADDR + VERT_THRUST_MSB, 0);
+     shadow_.set(TX_CTRL_ADDR + LIGHTS_LSB, 0);
+     shadow_.set(TX_CTRL_ADDR + CAM_TILT, 0);
+     shadow_.set(TX_CTRL_ADDR + CAM_FOCUS, 0);
+     shadow_.set(TX_CTRL_ADDR + UNKNOWN_0, 0x0);
+     shadow_.set(TX_CTRL_ADDR + UNKNOWN_1, 0x0);
+     shadow_.set(TX_CTRL_ADDR + AUTO_DEPTH_LSB, 0xFF);
+     shadow_.set(TX_CTRL_ADDR + AUTO_DEPTH_MSB, 0xFF);
+     shadow_.set(TX_CTRL_ADDR + AUTO_HEADING_LSB, 0xFF);
+     shadow_.set(TX_CTRL_ADDR + AUTO_HEADING_MSB, 0xFF);
+
+     // Nothing is known about the vehicle's registers yet, the first cycle
+     // sends them all
+     delta_writes_ = true;
+     last_keepalive_ = 0;
+     last_refresh_ = 0;
+     memset(&register_stats_, 0, sizeof(register_stats_));
      
+     memset(&telemetry_, 0, sizeof(telemetry_));
+     water_ingress_ = 0;
+
+     timeouts_ = 0;
+     reported_stats_ = receiver_.stats();
+     reported_timeouts_ = 0;
+     reported_read_errors_ = 0;
+     last_report_time_ = 0;
+
+     manip_state_ = VideoRayComm::Idle;
+
+     // A port that does not open only leaves this object unhealthy, the
+     // caller decides whether that is fatal
      int status;
-     status = serial_.Open("/dev/ttyUSB0", 115200);
+     status = serial_.Open(device.c_str(), baud, true);
      if (status != 1) {
-     	  cout << "Error while opening port. Permission problem ?" << endl;
-     	  exit(-1);
+     	  cout << "Error while opening port " << device 
+               << ". Permission problem ?" << endl;
+          return;
      }
      serial_.FlushReceiver();
 
-     tx_ctrl_data[PORT_THRUST_LSB] = 0;
-     tx_ctrl_data[PORT_THRUST_MSB] = 0;
-     tx_ctrl_data[STAR_THRUST_LSB] = 0;
-     tx_ctrl_data[STAR_THRUST_MSB] = 0;
-     tx_ctrl_data[VERT_THRUST_LSB] = 0;
-     tx_ctrl_data[VERT_THRUST_MSB] = 0;
-     tx_ctrl_data[LIGHTS_LSB] = 0;
-     tx_ctrl_data[CAM_TILT] = 0;
-     tx_ctrl_data[CAM_FOCUS] = 0;
-     tx_ctrl_data[UNKNOWN_0] = 0x0;
-     tx_ctrl_data[UNKNOWN_1] = 0x0;
-     tx_ctrl_data[AUTO_DEPTH_LSB] = 0xFF;
-     tx_ctrl_data[AUTO_DEPTH_MSB] = 0xFF;
-     tx_ctrl_data[AUTO_HEADING_LSB] = 0xFF;
-     tx_ctrl_data[AUTO_HEADING_MSB] = 0xFF;
-     
-     heading_ = 0;
-     pitch_ = 0;
-     roll_ = 0;
+     // The FTDI latency timer alone can exceed a whole control exchange
+     serialib::Config config;
+     if (serial_.GetConfig(&config) == 1) {
+          printf("VideoRayComm: %u baud, low latency %s, latency timer %d ms\n",
+                 config.Bauds, config.LowLatency ? "on" : "off", 
+                 config.LatencyTimer_ms);
+     }
 
-     manip_state_ = VideoRayComm::Idle;
+     tx_queue_.set_budget(baud, DEFAULT_CYCLE_RATE);
+     healthy_ = true;
+     if (mode == VideoRayComm::Polled) {
+          tx_queue_.attach(&serial_);
+          return;
+     }
+     tx_queue_.start(&serial_);
+
+     running_ = true;
+     rx_thread_ = std::thread(&VideoRayComm::receive_loop, this);
 }
 
 VideoRayComm::~VideoRayComm()
 {
+     running_ = false;
+     if (rx_thread_.joinable()) {
+          rx_thread_.join();
+     }
+     tx_queue_.stop();
+     serial_.SetCapture(NULL);
+     capture_.Close();
      serial_.Close();
 }
 
+void VideoRayComm::set_cycle_rate(double rate)
+{
+     tx_queue_.set_budget(baud_, rate);
+}
+
+unsigned int VideoRayComm::baud()
+{
+     return baud_;
+}
+
+const std::string & VideoRayComm::device()
+{
+     return device_;
+}
+
+bool VideoRayComm::healthy()
+{
+     return healthy_;
+}
+
+int VideoRayComm::rx_fd()
+{
+     return serial_.GetFd();
+}
+
+int VideoRayComm::tx_fd()
+{
+     return tx_queue_.event_fd();
+}
+
+// Decodes everything the tty holds without blocking, a wake-up with
+// nothing to read costs one poll(). The loop also empties serialib's own
+// buffer, which does not make the descriptor readable.
+VideoRayComm::Status_t VideoRayComm::service_rx(double now)
+{
+     do {
+          int bytes = serial_.ReadNonBlocking(rx_buf_, RX_BUF_SIZE);
+          if (bytes < 0) {
+               printf("VideoRayComm: %s: read failed\n", device_.c_str());
+               read_errors_++;
+               healthy_ = false;
+               return VideoRayComm::Failure;
+          }
+          decode(rx_buf_, bytes, now);
+     } while (serial_.GetRxBuffered() > 0);
+     return VideoRayComm::Success;
+}
+
+void VideoRayComm::fail()
+{
+     healthy_ = false;
+}
+
+void VideoRayComm::service_tx()
+{
+     tx_queue_.service();
+}
+
+bool VideoRayComm::tx_blocked()
+{
+     return tx_queue_.blocked();
+}
+
+void VideoRayComm::expire(double now)
+{
+     int expired = transactions_.expire(now, RESPONSE_TIMEOUT);
+     if (expired > 0) {
+          timeouts_ += expired;
+          report_link_errors(now);
+     }
+}
+
+void VideoRayComm::flush()
+{
+     tx_queue_.flush();
+}
+
+// A frame is the header, the payload and the checksum byte
+static int frame_bytes(int payload)
+{
+     return Packetizer::HEADER_SIZE + payload + 1;
+}
+
+int VideoRayComm::control_bytes()
+{
+     return frame_bytes(TX_CTRL_SIZE) + frame_bytes(NavBlock::size);
+}
+
+int VideoRayComm::nav_bytes()
+{
+     return frame_bytes(0) + frame_bytes(NavBlock::size);
+}
+
+int VideoRayComm::status_bytes()
+{
+     return frame_bytes(0) + frame_bytes(StatusBlock::size);
+}
+
+int VideoRayComm::cam_cmd_bytes()
+{
+     return frame_bytes(CAM_CTRL_SIZE) + frame_bytes(0);
+}
+
+// The manipulator does not answer
+int VideoRayComm::manipulator_bytes()
+{
+     return frame_bytes(MANIP_CTRL_SIZE);
+}
+
+void VideoRayComm::set_delta_writes(bool enable)
+{
+     delta_writes_ = enable;
+}
+
+VideoRayComm::RegisterStats VideoRayComm::register_stats()
+{
+     std::lock_guard<std::mutex> lock(register_stats_mutex_);
+     return register_stats_;
+}
+
 // Hard coded definitions for manipulator command
 char open_manip_data[] = {0x35,0x49,0x0,0x0,0x0,0x0,0x3,0x0};
 char close_manip_data[] = {0x35,0x49,0x0,0x0,0x0,0x0,0x2,0x0};
@@ -182,111 +295,76 @@ VideoRayComm::Status_t VideoRayComm::set_manipulator_state(VideoRayComm::ManipSt
           return VideoRayComm::Success;
      }
      
-     manip_state_ = state;
-     
-     char * packet;
-     int bytes;
-
-     // Generate Packet and grab reference to it
+     // Generate Packet around the manipulator payload
      packetizer_.set_network_id(0x42);
      packetizer_.set_flags(0x00);
      packetizer_.set_csr_addr(0xF0);          
 
-     if (manip_state_ == VideoRayComm::Opening) {
-          packetizer_.set_data(open_manip_data, MANIP_CTRL_SIZE);
-     } else if (manip_state_ == VideoRayComm::Closing) {
-          packetizer_.set_data(close_manip_data, MANIP_CTRL_SIZE);
+     const char *data;
+     if (state == VideoRayComm::Opening) {
+          data = open_manip_data;
+     } else if (state == VideoRayComm::Closing) {
+          data = close_manip_data;
      } else {
-          packetizer_.set_data(idle_manip_data, MANIP_CTRL_SIZE);
+          data = idle_manip_data;
      }
 
-     bytes = packetizer_.generate_packet(&packet);    
-
-     //for(int i = 0; i < bytes; i++) {
-     //     printf("%02X ",(unsigned char)packet[i]);
-     //}
-     //printf("\n");
-     
-     // Send the Tx Control packet over the serial line
-     serial_.Write((const void *)packet, bytes);     
+     // Goes out with the next control command. If the link is busy the
+     // state is not recorded, so the command is retried next cycle.
+     if (queue_frame(data, MANIP_CTRL_SIZE) != VideoRayComm::Success) {
+          return VideoRayComm::Failure;
+     }
+     manip_state_ = state;
 
      return VideoRayComm::Success;
 }
 
-#define CAM_CTRL_SIZE 2
-char enable_cam_menu[] =  {0xCA, 0x01};
-char arrow_right_data[] = {0xCA, 0x10};
-char arrow_left_data[] = {0xCA, 0x08};
-char arrow_down_data[] = {0xCA, 0x04};
-char arrow_up_data[] = {0xCA, 0x02};
+char enable_cam_menu[] = {(char)0xCA, 0x01};
+char arrow_right_data[] = {(char)0xCA, 0x10};
+char arrow_left_data[] = {(char)0xCA, 0x08};
+char arrow_down_data[] = {(char)0xCA, 0x04};
+char arrow_up_data[] = {(char)0xCA, 0x02};
 
 VideoRayComm::Status_t VideoRayComm::set_cam_cmd(VideoRayComm::CamCtrl_t cam_ctrl)
 {
-     char * packet;
-     int bytes;
-
-     // Generate Packet and grab reference to it
-     packetizer_.set_network_id(0x01);
-     packetizer_.set_flags(0x01);
-     packetizer_.set_csr_addr(0xF0);          
-
+     const char *data;
      if (cam_ctrl == VideoRayComm::Arrow_Up) {
-          packetizer_.set_data(arrow_up_data, CAM_CTRL_SIZE);
+          data = arrow_up_data;
      } else if (cam_ctrl == VideoRayComm::Arrow_Right) {
-          packetizer_.set_data(arrow_right_data, CAM_CTRL_SIZE);
+          data = arrow_right_data;
      } else if (cam_ctrl == VideoRayComm::Arrow_Down) {
-          packetizer_.set_data(arrow_down_data, CAM_CTRL_SIZE);
+          data = arrow_down_data;
      } else if (cam_ctrl == VideoRayComm::Arrow_Left) {
-          packetizer_.set_data(arrow_left_data, CAM_CTRL_SIZE);
+          data = arrow_left_data;
      } else if (cam_ctrl == VideoRayComm::Enable) {
-          packetizer_.set_data(enable_cam_menu, CAM_CTRL_SIZE);
-     } 
-
-     bytes = packetizer_.generate_packet(&packet);    
-
-     //for(int i = 0; i < bytes; i++) {
-     //     printf("%02X ",(unsigned char)packet[i]);
-     //}
-     //printf("\n");
-
-     // Send the Tx Control packet over the serial line
-     serial_.Write((const void *)packet, bytes);     
-
-     char byte;
-     Packetizer::Status_t status;
-     do {
-          if (serial_.ReadChar(&byte,0) == 1) {
-               status = receiver_.receive_packet(byte);
-          } else {
-               // Did not receive a byte, break out.
-               printf("Error reading byte.\n");
-               break;
-          }          
-     } while(status == Packetizer::In_Progress);
-     
-     if (status == Packetizer::Success) {
-          bytes = receiver_.get_payload(&packet);          
-          //for (int x = 0 ; x < bytes ; x++) {
-          //     printf("%x ", (unsigned char)packet[x]);
-          //}
-          //printf("\n");                              
+          data = enable_cam_menu;
      } else {
-          printf("Cam Control - Decode Error.\n");
-          printf("Status: %d\n", status);
-          printf("Flushing receiver.\n");
-          serial_.FlushReceiver();
+          return VideoRayComm::Failure;
      }
 
-     return VideoRayComm::Success;}
+     // Generate Packet around the camera menu payload, it goes out with the
+     // next control command. The empty ack is matched by the receive thread.
+     bool tracked = transactions_.begin(0x01, 0x01, 0xF0, monotonic_seconds());
+     packetizer_.set_network_id(0x01);
+     packetizer_.set_flags(0x01);
+     packetizer_.set_csr_addr(0xF0);          
+     if (queue_frame(data, CAM_CTRL_SIZE) != VideoRayComm::Success) {
+          if (tracked) {
+               transactions_.cancel(0x01, 0x01, 0xF0);
+          }
+          return VideoRayComm::Failure;
+     }
+     return VideoRayComm::Success;
+}
 
 VideoRayComm::Status_t VideoRayComm::set_desired_heading(int heading)
 {
      if (heading > 360 || heading < 0) {
-          tx_ctrl_data[AUTO_HEADING_LSB] = 0xFF;
-          tx_ctrl_data[AUTO_HEADING_MSB] = 0xFF;
+          shadow_.set(TX_CTRL_ADDR + AUTO_HEADING_LSB, 0xFF);
+          shadow_.set(TX_CTRL_ADDR + AUTO_HEADING_MSB, 0xFF);
      } else {
-          tx_ctrl_data[AUTO_HEADING_LSB] = heading & 0x00FF;
-          tx_ctrl_data[AUTO_HEADING_MSB] = (heading & 0xFF00) >> 8;
+          shadow_.set(TX_CTRL_ADDR + AUTO_HEADING_LSB, heading & 0x00FF);
+          shadow_.set(TX_CTRL_ADDR + AUTO_HEADING_MSB, (heading & 0xFF00) >> 8);
      }
 
      return VideoRayComm::Success;
@@ -295,123 +373,133 @@ VideoRayComm::Status_t VideoRayComm::set_desired_heading(int heading)
 VideoRayComm::Status_t VideoRayComm::set_desired_depth(int depth)
 {
      if (depth < 0) {
-          tx_ctrl_data[AUTO_DEPTH_LSB] = 0xFF;
-          tx_ctrl_data[AUTO_DEPTH_MSB] = 0xFF;
+          shadow_.set(TX_CTRL_ADDR + AUTO_DEPTH_LSB, 0xFF);
+          shadow_.set(TX_CTRL_ADDR + AUTO_DEPTH_MSB, 0xFF);
      } else {
-          tx_ctrl_data[AUTO_DEPTH_LSB] = depth & 0x00FF;
-          tx_ctrl_data[AUTO_DEPTH_MSB] = (depth & 0xFF00) >> 8;
+          shadow_.set(TX_CTRL_ADDR + AUTO_DEPTH_LSB, depth & 0x00FF);
+          shadow_.set(TX_CTRL_ADDR + AUTO_DEPTH_MSB, (depth & 0xFF00) >> 8);
      }
      return VideoRayComm::Success;
 }
 
 VideoRayComm::Status_t VideoRayComm::set_focus(int focus)
 {
-     tx_ctrl_data[CAM_FOCUS] = focus;
+     shadow_.set(TX_CTRL_ADDR + CAM_FOCUS, focus);
      return VideoRayComm::Success;
 }
 
 VideoRayComm::Status_t VideoRayComm::set_camera_tilt(int tilt)
 {
-     tx_ctrl_data[CAM_TILT] = tilt;
+     shadow_.set(TX_CTRL_ADDR + CAM_TILT, tilt);
      return VideoRayComm::Success;
 }
 
 VideoRayComm::Status_t VideoRayComm::set_lights(int lights)
 {
-     tx_ctrl_data[LIGHTS_LSB] = lights;
+     shadow_.set(TX_CTRL_ADDR + LIGHTS_LSB, lights);
      return VideoRayComm::Success;
 }
 
 VideoRayComm::Status_t VideoRayComm::set_vertical_thruster(int thrust)
 {
-     tx_ctrl_data[VERT_THRUST_LSB] = thrust & 0x00FF;
-     tx_ctrl_data[VERT_THRUST_MSB] = (thrust & 0xFF00) >> 8;
+     shadow_.set(TX_CTRL_ADDR + VERT_THRUST_LSB, thrust & 0x00FF);
+     shadow_.set(TX_CTRL_ADDR + VERT_THRUST_MSB, (thrust & 0xFF00) >> 8);
      return VideoRayComm::Success;
 }
 
 VideoRayComm::Status_t VideoRayComm::set_port_thruster(int thrust)
 {
-     tx_ctrl_data[PORT_THRUST_LSB] = thrust & 0x00FF;
-     tx_ctrl_data[PORT_THRUST_MSB] = (thrust & 0xFF00) >> 8;
+     shadow_.set(TX_CTRL_ADDR + PORT_THRUST_LSB, thrust & 0x00FF);
+     shadow_.set(TX_CTRL_ADDR + PORT_THRUST_MSB, (thrust & 0xFF00) >> 8);
      return VideoRayComm::Success;
 }
 
 VideoRayComm::Status_t VideoRayComm::set_starboard_thruster(int thrust)
 {
-     tx_ctrl_data[STAR_THRUST_LSB] = thrust & 0x00FF;
-     tx_ctrl_data[STAR_THRUST_MSB] = (thrust & 0xFF00) >> 8;
+     shadow_.set(TX_CTRL_ADDR + STAR_THRUST_LSB, thrust & 0x00FF);
+     shadow_.set(TX_CTRL_ADDR + STAR_THRUST_MSB, (thrust & 0xFF00) >> 8);
      return VideoRayComm::Success;
 }
 
 VideoRayComm::Status_t VideoRayComm::send_control_command()
 {
-     char * packet;
-     int bytes;
+     double now = monotonic_seconds();
+     unsigned long control_writes = 0;
+     unsigned long refreshes = 0;
 
-     // Generate Packet and grab reference to it
-     packetizer_.set_network_id(0x01);
-     packetizer_.set_flags(0x03);
-     packetizer_.set_csr_addr(0x00);          
-     packetizer_.set_data(tx_ctrl_data, TX_CTRL_SIZE);
-     bytes = packetizer_.generate_packet(&packet);    
-     
-     // Send the Tx Control packet over the serial line
-     serial_.Write((const void *)packet, bytes);
-     
-     int test = 0;
-     char byte;
-     Packetizer::Status_t status;
-     do {
-          if (serial_.ReadChar(&byte,0) == 1) {
-               status = receiver_.receive_packet(byte);
-          } else {
-               // Did not receive a byte, break out.
-               printf("Error reading byte.\n");
+     if (now - last_refresh_ >= REGISTER_REFRESH_PERIOD) {
+          shadow_.invalidate();
+          last_refresh_ = now;
+          last_keepalive_ = 0;
+          refreshes = 1;
+     }
+
+     // The full control block goes out on the keep-alive period whether or
+     // not it changed. It is the only write the vehicle answers.
+     Status_t status = VideoRayComm::Success;
+     if (!delta_writes_ || now - last_keepalive_ >= KEEPALIVE_PERIOD) {
+          status = send_request(0x03, TX_CTRL_ADDR);
+          if (status != VideoRayComm::Success) {
+               // Nothing to match the answer with, but the command still goes
+               // out, under the control header send_request() set
+               status = queue_frame(shadow_.data() + TX_CTRL_ADDR, 
+                                    TX_CTRL_SIZE);
+          }
+          if (status == VideoRayComm::Success) {
+               shadow_.mark_sent(TX_CTRL_ADDR, TX_CTRL_SIZE);
+               last_keepalive_ = now;
+               control_writes = 1;
+          }
+     }
+
+     // Everything else that changed, camera and manipulator frames queued
+     // during this cycle go out in the same write
+     if (send_register_writes() != VideoRayComm::Success) {
+          status = VideoRayComm::Failure;
+     }
+     tx_queue_.flush();
+
+     std::lock_guard<std::mutex> lock(register_stats_mutex_);
+     register_stats_.control_writes += control_writes;
+     register_stats_.refreshes += refreshes;
+     return status;
+}
+
+// Queues one write (no response expected) per range of changed registers.
+// A register whose write is dropped stays dirty and is tried again on the
+// next cycle.
+VideoRayComm::Status_t VideoRayComm::send_register_writes()
+{
+     CsrShadow::Range ranges[MAX_REGISTER_WRITES];
+     int count = shadow_.dirty_ranges(ranges, MAX_REGISTER_WRITES, 
+                                      Packetizer::HEADER_SIZE + 1);
+     unsigned long bytes = 0;
+     int sent = 0;
+     for (; sent < count; sent++) {
+          packetizer_.set_network_id(0x01);
+          packetizer_.set_flags(0x00);
+          packetizer_.set_csr_addr(ranges[sent].addr);
+          if (queue_frame(shadow_.data() + ranges[sent].addr,
+                          ranges[sent].length) != VideoRayComm::Success) {
                break;
-          }       
-          test++;
-          if (test > 100) break;
-     } while(status == Packetizer::In_Progress);
-     
-     //if (status == Packetizer::Success) {
-     //     bytes = receiver_.get_payload(&packet);
-          
-          //for (int x = 0 ; x < bytes ; x++) {
-          //     printf("%x ", (unsigned char)packet[x]);
-          //}
-          //printf("\n");
-          //short temp = 0;
-          //temp = ((short)(packet[HEADING_MSB]) << 8) | packet[HEADING_LSB]; 
-          //heading_ = temp;
-          //
-          //temp = 0;
-          //temp = ((short)(packet[PITCH_MSB]) << 8) | packet[PITCH_LSB]; 
-          //pitch_ = temp;
-          //
-          //temp = 0;
-          //temp = ((short)(packet[ROLL_MSB]) << 8) | packet[ROLL_LSB]; 
-          //roll_ = temp;
-                    
-     //} else {
-     //     printf("Control Command - Decode Error.\n");
-     //     printf("Status: %d\n", status);
-     //     printf("Flushing receiver.\n");
-     //     serial_.FlushReceiver();
-     //}
-     serial_.FlushReceiver();
-     return VideoRayComm::Success;
+          }
+          shadow_.mark_sent(ranges[sent].addr, ranges[sent].length);
+          bytes += ranges[sent].length;
+     }
+
+     std::lock_guard<std::mutex> lock(register_stats_mutex_);
+     register_stats_.delta_writes += sent;
+     register_stats_.delta_bytes += bytes;
+     return sent == count ? VideoRayComm::Success : VideoRayComm::Failure;
 }
 
 // Just added for Steven's Institute
 VideoRayComm::Status_t VideoRayComm::set_depth_pid_parameters()
 {
-     char * packet;
-     int bytes;
-     
      // Holds data for addresses 0x26 through 0x2D
      // You should pass the values for these PID variables as parameters
      // into this function.
-     char data[8];
+     char data[DEPTH_PID_SIZE];
      data[AUTO_DEPTH_P_LSB] = 23; // arbitrary data.
      data[AUTO_DEPTH_P_MSB] = 23; // arbitrary data.
      data[AUTO_DEPTH_I_LSB] = 23; // arbitrary data.
@@ -421,77 +509,276 @@ VideoRayComm::Status_t VideoRayComm::set_depth_pid_parameters()
      data[AUTO_DEPTH_K_LSB] = 23; // arbitrary data.
      data[AUTO_DEPTH_K_MSB] = 23; // arbitrary data.
      
-     // Generate Packet and grab reference to it
-     packetizer_.set_network_id(0x01); // Network ID for videoray
-     packetizer_.set_flags(0x00); // No response expected
-     packetizer_.set_csr_addr(0x26);          
-     
-     packetizer_.set_data(data, 8);
-     bytes = packetizer_.generate_packet(&packet);    
+     // Written by the next control command, and refreshed from then on
+     shadow_.track(DEPTH_PID_ADDR, DEPTH_PID_SIZE);
+     shadow_.set(DEPTH_PID_ADDR, data, DEPTH_PID_SIZE);
+     shadow_.invalidate(DEPTH_PID_ADDR, DEPTH_PID_SIZE);
 
-     // You might want to print out the contents of packet at this point and
-     // make sure that all of the bytes look correct as far as the
-     // communication protocol is concerned.
-     
-     // Send the Tx Control packet over the serial line
-     serial_.Write((const void *)packet, bytes);
-     
-     int test = 0;
-     char byte;
-     Packetizer::Status_t status;
-     do {
-          if (serial_.ReadChar(&byte,0) == 1) {
-               status = receiver_.receive_packet(byte);
-          } else {
-               // Did not receive a byte, break out.
-               printf("Error reading byte.\n");
-               break;
-          }       
-          test++;
-          if (test > 100) break;
-     } while(status == Packetizer::In_Progress);
+     return VideoRayComm::Success;
+}
+
+// Queues a frame with the current packetizer_ header. Nothing is sent
+// until the next tx_queue_.flush().
+VideoRayComm::Status_t VideoRayComm::queue_frame(const void *data, int length)
+{
+     if (!healthy_) {
+          return VideoRayComm::Failure;
+     }
+     TxQueue::Status_t status = tx_queue_.enqueue(packetizer_, data, length);
+     if (status == TxQueue::Full) {
+          printf("VideoRayComm: transmit queue full\n");
+          return VideoRayComm::Failure;
+     } else if (status == TxQueue::Over_Budget) {
+          printf("VideoRayComm: link budget exhausted, frame dropped\n");
+          return VideoRayComm::Failure;
+     }
+     return VideoRayComm::Success;
+}
+
+// Registers a request to the vehicle (network id 0x01) and queues it. The
+// payload is the control block for a control request, empty otherwise.
+// The header is set even when the table is full, a caller that sends the
+// frame untracked queues it under this request's address.
+VideoRayComm::Status_t VideoRayComm::send_request(unsigned char flags,
+                                                  unsigned char csr_addr)
+{
+     packetizer_.set_network_id(0x01);
+     packetizer_.set_flags(flags);
+     packetizer_.set_csr_addr(csr_addr);
+     if (!transactions_.begin(0x01, flags, csr_addr, monotonic_seconds())) {
+          return VideoRayComm::Failure;
+     }
+
+     Status_t status;
+     if (flags == 0x03) {
+          status = queue_frame(shadow_.data() + csr_addr, TX_CTRL_SIZE);
+     } else {
+          status = queue_frame(NULL, 0);
+     }
+     if (status != VideoRayComm::Success) {
+          transactions_.cancel(0x01, flags, csr_addr);
+     }
+     return status;
+}
+
+// Receive thread. Reads whatever the tty holds, decodes every complete
+// frame in it and expires the requests that were not answered in time.
+// Frames that fail their checksums are skipped by the decoder, which
+// resyncs on the following bytes instead of flushing them.
+void VideoRayComm::receive_loop()
+{
+     while (running_) {
+          int bytes = serial_.ReadAvailable(rx_buf_, RX_BUF_SIZE, RX_POLL_MS);
+          double now = monotonic_seconds();
+          if (bytes < 0) {
+               read_errors_++;
+               report_link_errors(now);
+               usleep(RX_POLL_MS * 1000);
+          } else if (bytes > 0) {
+               decode(rx_buf_, bytes, now);
+          }
+          expire(now);
+     }
+}
+
+void VideoRayComm::decode(const uint8_t *data, int length, double now)
+{
+     if (length <= 0) {
+          return;
+     }
+     bytes_in_ += length;
+     Packetizer::Frame frame;
+     receiver_.feed(data, length);
+     while (receiver_.next(frame)) {
+          handle_response(frame, now);
+     }
+     report_link_errors(now);
+
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     telemetry_.decoder = receiver_.stats();
+}
+
+// Matches a response with its request and publishes the telemetry it
+// carries. Late answers (their request already expired) are still decoded.
+void VideoRayComm::handle_response(const Packetizer::Frame &frame, double now)
+{
+     double latency;
+     if (transactions_.complete(frame.network_id, frame.flags, 
+                                frame.csr_addr, now, latency)) {
+          int transaction = -1;
+          if (frame.flags == 0x03) {
+               transaction = Control_Transaction;
+          } else if (frame.flags == 0x05) {
+               transaction = Nav_Transaction;
+          } else if (frame.flags == 0x8E) {
+               transaction = Status_Transaction;
+          } else if (frame.flags == 0x01) {
+               transaction = Camera_Transaction;
+          }
+          if (transaction >= 0) {
+               std::lock_guard<std::mutex> lock(link_mutex_);
+               latency_[transaction].record(latency);
+          }
+     }
+
+     if (frame.network_id != 0x01) {
+          return;
+     }
+     if (frame.flags == 0x05 && frame.csr_addr == 0x00 &&
+         frame.length >= NavBlock::size) {
+          NavData nav;
+          NavBlock::decode(frame.payload, nav);
+
+          std::lock_guard<std::mutex> lock(telemetry_mutex_);
+          telemetry_.nav = nav;
+          telemetry_.nav_updates++;
+          telemetry_.nav_time = now;
+     } else if (frame.flags == 0x8E && frame.csr_addr == 0x7A &&
+                frame.length >= StatusBlock::size) {
+          StatusData status;
+          StatusBlock::decode(frame.payload, status);
+
+          std::lock_guard<std::mutex> lock(telemetry_mutex_);
+          telemetry_.status = status;
+          telemetry_.status_updates++;
+          telemetry_.status_time = now;
+     }
+}
+
+// Prints a summary of new link errors at most once per ERROR_REPORT_PERIOD,
+// so a desync storm or a dead tether does not flood the console. The
+// counts themselves are in link_stats().
+void VideoRayComm::report_link_errors(double now)
+{
+     const Packetizer::Stats &stats = receiver_.stats();
+     unsigned long read_errors = read_errors_;
+     if (stats.sync_errors == reported_stats_.sync_errors &&
+         stats.hdr_chk_errors == reported_stats_.hdr_chk_errors &&
+         stats.total_chk_errors == reported_stats_.total_chk_errors &&
+         timeouts_ == reported_timeouts_ &&
+         read_errors == reported_read_errors_) {
+          return;
+     }
+
+     if (now - last_report_time_ < ERROR_REPORT_PERIOD) {
+          return;
+     }
      
-     //if (status == Packetizer::Success) {
-     //     bytes = receiver_.get_payload(&packet);
-          
-          //for (int x = 0 ; x < bytes ; x++) {
-          //     printf("%x ", (unsigned char)packet[x]);
-          //}
-          //printf("\n");
-          //short temp = 0;
-          //temp = ((short)(packet[HEADING_MSB]) << 8) | packet[HEADING_LSB]; 
-          //heading_ = temp;
-          //
-          //temp = 0;
-          //temp = ((short)(packet[PITCH_MSB]) << 8) | packet[PITCH_LSB]; 
-          //pitch_ = temp;
-          //
-          //temp = 0;
-          //temp = ((short)(packet[ROLL_MSB]) << 8) | packet[ROLL_LSB]; 
-          //roll_ = temp;
-                    
-     //} else {
-     //     printf("Control Command - Decode Error.\n");
-     //     printf("Status: %d\n", status);
-     //     printf("Flushing receiver.\n");
-     //     serial_.FlushReceiver();
-     //}
-     serial_.FlushReceiver();
+     printf("VideoRayComm: %s: sync errors %lu, header checksum %lu, "
+            "payload checksum %lu, %lu bytes skipped, timeouts %lu, "
+            "read errors %lu\n", device_.c_str(),
+            stats.sync_errors - reported_stats_.sync_errors,
+            stats.hdr_chk_errors - reported_stats_.hdr_chk_errors,
+            stats.total_chk_errors - reported_stats_.total_chk_errors,
+            stats.skipped_bytes - reported_stats_.skipped_bytes,
+            timeouts_ - reported_timeouts_,
+            read_errors - reported_read_errors_);
+
+     reported_stats_ = stats;
+     reported_timeouts_ = timeouts_;
+     reported_read_errors_ = read_errors;
+     last_report_time_ = now;
+}
+
+VideoRayComm::Telemetry VideoRayComm::telemetry()
+{
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_;
+}
+
+NavData VideoRayComm::nav_data()
+{
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav;
+}
+
+StatusData VideoRayComm::status_data()
+{
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.status;
+}
+
+Packetizer::Stats VideoRayComm::decoder_stats()
+{
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.decoder;
+}
+
+TransactionTable::Stats VideoRayComm::transaction_stats()
+{
+     return transactions_.stats();
+}
+
+TxQueue::Stats VideoRayComm::tx_stats()
+{
+     return tx_queue_.stats();
+}
+
+VideoRayComm::LinkStats VideoRayComm::link_stats()
+{
+     LinkStats stats;
+     {
+          std::lock_guard<std::mutex> lock(link_mutex_);
+          for (int i = 0; i < Transaction_Count; i++) {
+               stats.latency[i] = latency_[i];
+          }
+     }
+
+     TransactionTable::Stats transactions = transactions_.stats();
+     stats.requests = transactions.requests;
+     stats.responses = transactions.responses;
+     stats.timeouts = transactions.timeouts;
+     stats.unsolicited = transactions.unsolicited;
+
+     Packetizer::Stats decoder = decoder_stats();
+     stats.sync_errors = decoder.sync_errors;
+     stats.checksum_errors = decoder.hdr_chk_errors + 
+          decoder.total_chk_errors;
+     stats.frames_in = decoder.frames;
+     stats.bytes_in = bytes_in_;
+     stats.read_errors = read_errors_;
+
+     TxQueue::Stats tx = tx_queue_.stats();
+     stats.frames_out = tx.frames;
+     stats.bytes_out = tx.bytes;
+     stats.write_errors = tx.write_errors;
+     return stats;
+}
+
+const char * VideoRayComm::transaction_name(Transaction_t transaction)
+{
+     switch (transaction) {
+     case Control_Transaction:
+          return "control";
+     case Nav_Transaction:
+          return "nav";
+     case Status_Transaction:
+          return "status";
+     case Camera_Transaction:
+          return "camera";
+     default:
+          return "unknown";
+     }
+}
+
+VideoRayComm::Status_t VideoRayComm::start_capture(const std::string &file)
+{
+     if (capture_.Open(file.c_str(), baud_) != 1) {
+          printf("VideoRayComm: cannot create capture file %s\n", 
+                 file.c_str());
+          return VideoRayComm::Failure;
+     }
+     serial_.SetCapture(&capture_);
      return VideoRayComm::Success;
 }
 
-short VideoRayComm::swap_bytes(char *array, int msb, int lsb)
+SerialCapture::Stats VideoRayComm::capture_stats()
 {
-     short temp = 0;
-     temp = ((unsigned short)(array[msb] & 0xFF) << 8) | (array[lsb] & 0xFF);
-     return temp;
+     return capture_.GetStats();
 }
 
 VideoRayComm::Status_t VideoRayComm::send_nav_data_command()
 {
-     char * packet;
-     int bytes;
-
      //////////////////////
      // Tx Sensor Message
      //////////////////////
@@ -502,145 +789,70 @@ VideoRayComm::Status_t VideoRayComm::send_nav_data_command()
      //packetizer_.set_data(tx_ctrl_data, 0);
      
      // Navigation data vendor specific message...
-     packetizer_.set_network_id(0x01);
-     packetizer_.set_flags(0x5);
-     packetizer_.set_csr_addr(0x0);          
-     packetizer_.set_data(tx_ctrl_data, 0);
-
-     bytes = packetizer_.generate_packet(&packet);
-     
-     // Send the Tx Control packet over the serial line
-     serial_.Write((const void *)packet, bytes);
-     
-     char byte;
-     Packetizer::Status_t status;
-     do {
-          if (serial_.ReadChar(&byte,0) == 1) {
-               status = receiver_.receive_packet(byte);
-          } else {
-               // Did not receive a byte, break out.
-               printf("Error reading byte.\n");
-               break;
-          }          
-     } while(status == Packetizer::In_Progress);
-     
-     if (status == Packetizer::Success) {
-          bytes = receiver_.get_payload(&packet);
-          
-          //for (int x = 0 ; x < bytes ; x++) {
-          //     printf("%x ", (unsigned char)packet[x]);
-          //}
-          //printf("\n");
-                   
-          heading_ = swap_bytes(packet, HEADING_MSB, HEADING_LSB) / 10.0;
-          pitch_ = swap_bytes(packet, PITCH_MSB, PITCH_LSB) / 10.0;
-          roll_ = swap_bytes(packet, ROLL_MSB, ROLL_LSB) / 10.0;
-
-          depth_ = swap_bytes(packet, DEPTH_MSB, DEPTH_LSB) / 10.0;
-
-          yaw_accel_ = swap_bytes(packet, YAW_ACC_MSB, YAW_ACC_LSB) / 1000.0;
-          pitch_accel_ = swap_bytes(packet, PITCH_ACC_MSB, PITCH_ACC_LSB) / 1000.0;
-          roll_accel_ = swap_bytes(packet, ROLL_ACC_MSB, ROLL_ACC_LSB) / 1000.0;
-
-          surge_accel_ = swap_bytes(packet, SURGE_ACC_MSB, SURGE_ACC_LSB) / 1000.0;
-          sway_accel_ = swap_bytes(packet, SWAY_ACC_MSB, SWAY_ACC_LSB) / 1000.0;          
-          heave_accel_ = swap_bytes(packet, HEAVE_ACC_MSB, HEAVE_ACC_LSB) / 1000.0;          
-          
-     } else {
-          printf("Nav Data - Decode Error.\n");
-          printf("Status: %d\n", status);
-          printf("Flushing receiver.\n");
-          serial_.FlushReceiver();
+     if (transactions_.in_flight(0x01, 0x05, 0x00) > 0) {
+          return VideoRayComm::Success;
      }
-     return VideoRayComm::Success;
+     Status_t status = send_request(0x05, 0x00);
+     tx_queue_.flush();
+     return status;
 }
 
 VideoRayComm::Status_t VideoRayComm::request_status()
 {
-     char * packet;
-     int bytes;
-
-     packetizer_.set_network_id(0x01);
-     packetizer_.set_flags(0x8E);
-     packetizer_.set_csr_addr(0x7A);
-     packetizer_.set_data(tx_ctrl_data, 0);
-
-     bytes = packetizer_.generate_packet(&packet);
-     
-     // Send the Tx Control packet over the serial line
-     serial_.Write((const void *)packet, bytes);
-     
-     char byte;
-     Packetizer::Status_t status;
-     do {
-          if (serial_.ReadChar(&byte,0) == 1) {
-               status = receiver_.receive_packet(byte);
-          } else {
-               // Did not receive a byte, break out.
-               printf("Error reading byte.\n");
-               break;
-          }          
-     } while(status == Packetizer::In_Progress);
-     
-     if (status == Packetizer::Success) {
-          bytes = receiver_.get_payload(&packet);
-          
-          //for (int x = 0 ; x < bytes ; x++) {
-          //     printf("%x ", (unsigned char)packet[x]);
-          //}
-          //printf("\n");
-                   
-          rov_voltage_ = swap_bytes(packet,  VOLTAGE_12V_MSB, VOLTAGE_12V_LSB);
-          water_temperature_ = swap_bytes(packet, WATER_TEMP_MSB, WATER_TEMP_LSB);
-          humidity_ = swap_bytes(packet, HUMIDITY_MSB, HUMIDITY_LSB);
-          
-     } else {
-          printf("ROV Status - Decode Error.\n");
-          printf("Status: %d\n", status);
-          printf("Flushing receiver.\n");
-          serial_.FlushReceiver();
+     if (transactions_.in_flight(0x01, 0x8E, 0x7A) > 0) {
+          return VideoRayComm::Success;
      }
-     return VideoRayComm::Success;
+     Status_t status = send_request(0x8E, 0x7A);
+     tx_queue_.flush();
+     return status;
 }
 
 double VideoRayComm::heading()
 {
-     return heading_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav.heading;
 }
 
 double VideoRayComm::depth()
 {
-     return depth_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav.depth;
 }
 
 double VideoRayComm::roll()
 {
-     return roll_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav.roll;
 }
 
 double VideoRayComm::pitch()
 {
-     return pitch_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav.pitch;
 }
 
 double VideoRayComm::rov_voltage()
 {
-     return rov_voltage_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.status.voltage_12v;
 }
 
 double VideoRayComm::water_temperature()
 {
-     return water_temperature_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.status.water_temperature;
 }
 
 double VideoRayComm::humidity()
 {
-     return humidity_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.status.humidity;
 }
 
 double VideoRayComm::internal_temperature()
 {
-     return internal_temperature_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.status.internal_temperature;
 }
 
 double VideoRayComm::water_ingress()
@@ -650,31 +862,37 @@ double VideoRayComm::water_ingress()
 
 double VideoRayComm::yaw_accel()
 {
-     return yaw_accel_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav.yaw_accel;
 }
 
 double VideoRayComm::pitch_accel()
 {
-     return pitch_accel_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav.pitch_accel;
 }
 
 double VideoRayComm::roll_accel()
 {
-     return roll_accel_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav.roll_accel;
 }
 
 double VideoRayComm::surge_accel()
 {
-     return surge_accel_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav.surge_accel;
 }
 
 double VideoRayComm::sway_accel()
 {
-     return sway_accel_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav.sway_accel;
 }
 
 double VideoRayComm::heave_accel()
 {
-     return heave_accel_;
+     std::lock_guard<std::mutex> lock(telemetry_mutex_);
+     return telemetry_.nav.heave_accel;
 }
 
@@ -0,0 +1,217 @@
+#include <math.h>
+#include <string.h>
+
+#include "Autopilot.h"
+
+static double clamp(double value, double limit)
+{
+     if (value > limit) {
+          return limit;
+     } else if (value < -limit) {
+          return -limit;
+     }
+     return value;
+}
+
+// Degrees to (-180, 180]
+static double wrap_degrees(double angle)
+{
+     angle = fmod(angle, 360.0);
+     if (angle > 180.0) {
+          angle -= 360.0;
+     } else if (angle <= -180.0) {
+          angle += 360.0;
+     }
+     return angle;
+}
+
+static int round_thrust(double thrust)
+{
+     return (int)(thrust < 0 ? thrust - 0.5 : thrust + 0.5);
+}
+
+Autopilot::Config Autopilot::default_config()
+{
+     Config config;
+     memset(&config, 0, sizeof(config));
+
+     config.heading.band = 15;
+     config.heading.count = 2;
+     config.heading.thrust[0] = 0;
+     config.heading.gains[0].kp = 1.0;
+     config.heading.gains[0].ki = 0.05;
+     config.heading.gains[0].kd = 0.6;
+     config.heading.thrust[1] = 99;
+     config.heading.gains[1].kp = 0.5;
+     config.heading.gains[1].ki = 0.03;
+     config.heading.gains[1].kd = 0.4;
+
+     config.depth.band = 0.5;
+     config.depth.count = 2;
+     config.depth.thrust[0] = 0;
+     config.depth.gains[0].kp = 50;
+     config.depth.gains[0].ki = 5;
+     config.depth.gains[0].kd = 40;
+     config.depth.thrust[1] = 99;
+     config.depth.gains[1].kp = 40;
+     config.depth.gains[1].ki = 5;
+     config.depth.gains[1].kd = 30;
+
+     config.max_thrust = 99;
+     config.tracking = 2.0;
+     config.rate_tau = 0.2;
+
+     // The nav block scales accelerations by 1000; they are taken to be
+     // rad/s^2 for yaw and g for heave. The heave axis points up: it reads
+     // +1 g level at rest, so the reading is negated and gravity added back.
+     config.yaw_accel_scale = 180.0 / M_PI;
+     config.heave_accel_scale = -9.81;
+     config.gravity = 9.81;
+     config.max_dt = 0.5;
+     return config;
+}
+
+Autopilot::Autopilot(const Config &config)
+{
+     set_config(config);
+     reset();
+}
+
+void Autopilot::set_config(const Config &config)
+{
+     config_ = config;
+}
+
+void Autopilot::reset()
+{
+     memset(&heading_, 0, sizeof(heading_));
+     memset(&depth_, 0, sizeof(depth_));
+     last_time_ = 0;
+}
+
+Autopilot::Gains Autopilot::interpolate(const Schedule &schedule,
+                                        double thrust)
+{
+     Gains gains;
+     memset(&gains, 0, sizeof(gains));
+     if (schedule.count <= 0) {
+          return gains;
+     }
+     if (thrust <= schedule.thrust[0]) {
+          return schedule.gains[0];
+     }
+     for (int i = 1; i < schedule.count; i++) {
+          if (thrust < schedule.thrust[i]) {
+               const Gains &a = schedule.gains[i - 1];
+               const Gains &b = schedule.gains[i];
+               double t = (thrust - schedule.thrust[i - 1]) /
+                    (schedule.thrust[i] - schedule.thrust[i - 1]);
+               gains.kp = a.kp + t * (b.kp - a.kp);
+               gains.ki = a.ki + t * (b.ki - a.ki);
+               gains.kd = a.kd + t * (b.kd - a.kd);
+               return gains;
+          }
+     }
+     return schedule.gains[schedule.count - 1];
+}
+
+// Complementary filter: the acceleration carries the rate between samples,
+// the differentiated measurement pulls it back at the rate_tau time
+// constant. delta is the measured change since the last sample.
+void Autopilot::estimate_rate(Axis &axis, double value, double delta,
+                              double accel, double dt)
+{
+     if (!axis.valid || dt <= 0) {
+          axis.valid = true;
+          axis.last = value;
+          axis.rate = 0;
+          return;
+     }
+     double alpha = dt / (config_.rate_tau + dt);
+     double predicted = axis.rate + accel * dt;
+     axis.rate = predicted + alpha * (delta / dt - predicted);
+     axis.last = value;
+}
+
+// PID with the derivative on the measurement, gains scheduled on thrust.
+// The returned output is within +/-limit; back-calculation bleeds the
+// integral by what the limit cut off.
+double Autopilot::control(Axis &axis, const Schedule &schedule, 
+                          double thrust, double error, double limit, 
+                          double dt)
+{
+     Gains gains = interpolate(schedule, thrust);
+     double raw = gains.kp * error + axis.integral - gains.kd * axis.rate;
+     double output = clamp(raw, limit);
+     double integrate = fabs(error) < schedule.band ? gains.ki * error : 0;
+     axis.integral += dt * (integrate + config_.tracking * (output - raw));
+     axis.integral = clamp(axis.integral, limit);
+     return output;
+}
+
+void Autopilot::update(const NavData &nav, double time,
+                       const Setpoint &setpoint, Output &output)
+{
+     double dt = time - last_time_;
+     if (last_time_ <= 0 || dt <= 0 || dt > config_.max_dt) {
+          // First sample or a gap in the nav stream: no rate, no
+          // integration on this tick
+          heading_.valid = false;
+          depth_.valid = false;
+          dt = 0;
+     }
+     last_time_ = time;
+
+     estimate_rate(heading_, nav.heading,
+                   wrap_degrees(nav.heading - heading_.last),
+                   nav.yaw_accel * config_.yaw_accel_scale, dt);
+     double level = cos(nav.roll * M_PI / 180.0) *
+          cos(nav.pitch * M_PI / 180.0);
+     estimate_rate(depth_, nav.depth, nav.depth - depth_.last,
+                   nav.heave_accel * config_.heave_accel_scale +
+                   config_.gravity * level, dt);
+
+     double limit = config_.max_thrust;
+     double forward = 0.5 * (setpoint.port_thrust + setpoint.star_thrust);
+     double scheduled = fabs(forward);
+
+     output.saturated = false;
+     output.heading_error = 0;
+     output.depth_error = 0;
+
+     if (setpoint.heading_enabled) {
+          output.heading_error = wrap_degrees(setpoint.heading - nav.heading);
+          double turn = control(heading_, config_.heading, scheduled,
+                                output.heading_error, limit, dt);
+
+          // Turning has priority: the forward thrust gives way so the
+          // port/starboard difference survives the thruster limit
+          double room = limit - fabs(turn);
+          if (fabs(forward) > room) {
+               forward = forward > 0 ? room : -room;
+               output.saturated = true;
+          }
+          if (fabs(turn) >= limit) {
+               output.saturated = true;
+          }
+          output.port_thrust = round_thrust(forward - turn);
+          output.star_thrust = round_thrust(forward + turn);
+     } else {
+          heading_.integral = 0;
+          output.port_thrust = setpoint.port_thrust;
+          output.star_thrust = setpoint.star_thrust;
+     }
+
+     if (setpoint.depth_enabled) {
+          output.depth_error = setpoint.depth - nav.depth;
+          double vert = control(depth_, config_.depth, scheduled,
+                                output.depth_error, limit, dt);
+          if (fabs(vert) >= limit) {
+               output.saturated = true;
+          }
+          output.vert_thrust = round_thrust(vert);
+     } else {
+          depth_.integral = 0;
+          output.vert_thrust = setpoint.vert_thrust;
+     }
+}
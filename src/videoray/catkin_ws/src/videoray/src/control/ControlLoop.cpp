@@ -0,0 +1,452 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ControlLoop.h"
+
+// Status is requested once per second unless set_rates() says otherwise
+#define STATUS_RATE 1.0
+
+// Scheduler priorities, higher runs first
+#define CONTROL_PRIORITY 3
+#define NAV_PRIORITY     2
+#define MANIP_PRIORITY   2
+#define STATUS_PRIORITY  1
+#define CAM_PRIORITY     0
+
+// How long a one-shot may wait for room on the link (seconds)
+#define MANIP_DEADLINE 0.5
+#define CAM_DEADLINE   0.5
+
+// The host autopilot lets go of the thrusters when no nav block arrived
+// for this long (seconds)
+#define NAV_TIMEOUT 0.5
+
+static double to_seconds(const struct timespec &ts)
+{
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_ns(struct timespec &ts, long ns)
+{
+     ts.tv_nsec += ns;
+     while (ts.tv_nsec >= 1000000000L) {
+          ts.tv_nsec -= 1000000000L;
+          ts.tv_sec++;
+     }
+}
+
+static double monotonic_seconds()
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return to_seconds(ts);
+}
+
+ControlLoop::ControlLoop(VideoRayComm &comm) : comm_(comm), running_(false)
+{
+     rate_ = 0;
+     nav_rate_ = 0;
+     memset(&cycle_timing_, 0, sizeof(cycle_timing_));
+     lateness_sum_ = 0;
+     lateness_sq_sum_ = 0;
+     status_rate_ = STATUS_RATE;
+     memset(&last_timing_, 0, sizeof(last_timing_));
+     timing_.write(last_timing_);
+     last_bus_stats_ = scheduler_.stats();
+     bus_stats_.write(last_bus_stats_);
+
+     // The vehicle side starts with the manipulator idle
+     manip_state_ = VideoRayComm::Idle;
+     manip_deadline_ = 0;
+     cam_deadline_ = 0;
+
+     autopilot_active_ = false;
+     nav_updates_ = 0;
+     nav_time_ = 0;
+     memset(&autopilot_output_, 0, sizeof(autopilot_output_));
+     autopilot_sum_ = 0;
+
+     estimating_ = false;
+     estimator_nav_updates_ = 0;
+     estimator_time_ = 0;
+     estimator_sum_ = 0;
+
+     // Thrusters off, autopilots disabled until the first command
+     Command command;
+     memset(&command, 0, sizeof(command));
+     command.desired_heading = -1;
+     command.desired_depth = -1;
+     command.manip_state = VideoRayComm::Idle;
+     command.cam_cmd = VideoRayComm::Enable;
+     command_.write(command);
+     cam_seq_ = command.cam_seq;
+}
+
+ControlLoop::~ControlLoop()
+{
+     stop();
+}
+
+ControlLoop::Status_t ControlLoop::start(double rate, int rt_priority)
+{
+     if (running_ || prepare(rate) != ControlLoop::Success) {
+          return ControlLoop::Failure;
+     }
+
+     running_ = true;
+     thread_ = std::thread(&ControlLoop::run, this);
+
+     if (rt_priority > 0) {
+          struct sched_param param;
+          param.sched_priority = rt_priority;
+          int err = pthread_setschedparam(thread_.native_handle(), SCHED_FIFO,
+                                          &param);
+          if (err != 0) {
+               printf("ControlLoop: cannot use SCHED_FIFO priority %d: %s\n",
+                      rt_priority, strerror(err));
+          }
+     }
+     return ControlLoop::Success;
+}
+
+ControlLoop::Status_t ControlLoop::prepare(double rate)
+{
+     if (rate <= 0) {
+          return ControlLoop::Failure;
+     }
+     rate_ = rate;
+     if (nav_rate_ <= 0) {
+          nav_rate_ = rate;
+     }
+     scheduler_.clear();
+     scheduler_.set_link(comm_.baud(), rate);
+     add_jobs();
+
+     memset(&cycle_timing_, 0, sizeof(cycle_timing_));
+     cycle_timing_.period = 1.0 / rate;
+     lateness_sum_ = 0;
+     lateness_sq_sum_ = 0;
+     autopilot_sum_ = 0;
+     estimator_sum_ = 0;
+     estimator_time_ = 0;
+     return ControlLoop::Success;
+}
+
+void ControlLoop::stop()
+{
+     if (!running_) {
+          return;
+     }
+     running_ = false;
+     thread_.join();
+}
+
+void ControlLoop::set_rates(double nav_rate, double status_rate)
+{
+     nav_rate_ = nav_rate;
+     status_rate_ = status_rate;
+}
+
+void ControlLoop::set_autopilot(const Autopilot::Config &config)
+{
+     autopilot_.set_config(config);
+     autopilot_.reset();
+}
+
+void ControlLoop::set_estimator(const NavEstimator::Config &config)
+{
+     estimator_.set_config(config);
+     estimator_.reset();
+     estimating_ = true;
+}
+
+void ControlLoop::set_command(const Command &command)
+{
+     command_.write(command);
+}
+
+ControlLoop::Timing ControlLoop::timing()
+{
+     timing_.read(last_timing_);
+     return last_timing_;
+}
+
+BusScheduler::Stats ControlLoop::bus_stats()
+{
+     bus_stats_.read(last_bus_stats_);
+     return last_bus_stats_;
+}
+
+bool ControlLoop::estimate(NavEstimator::Estimate &estimate)
+{
+     return estimate_.read(estimate);
+}
+
+bool ControlLoop::autopilot_state(AutopilotState &state)
+{
+     return autopilot_state_.read(state);
+}
+
+void ControlLoop::add_jobs()
+{
+     scheduler_.add_periodic("control", rate_, VideoRayComm::control_bytes(),
+                             CONTROL_PRIORITY, [this] {
+               if (comm_.send_control_command() != VideoRayComm::Success) {
+                    printf("Exec Transfer Error!\n");
+                    return false;
+               }
+               return true;
+          });
+     scheduler_.add_periodic("nav", nav_rate_, VideoRayComm::nav_bytes(),
+                             NAV_PRIORITY, [this] {
+               if (comm_.send_nav_data_command() != VideoRayComm::Success) {
+                    printf("Exec Transfer Error!\n");
+                    return false;
+               }
+               return true;
+          });
+     if (status_rate_ > 0) {
+          scheduler_.add_periodic("status", status_rate_, 
+                                  VideoRayComm::status_bytes(),
+                                  STATUS_PRIORITY, [this] {
+                    if (comm_.request_status() != VideoRayComm::Success) {
+                         printf("Exec Transfer Error!\n");
+                         return false;
+                    }
+                    return true;
+               });
+     }
+}
+
+// Copies a command into the control packet and submits the one-off frames.
+// A one-shot that expires is submitted again on the next cycle.
+void ControlLoop::apply(const Command &command, double now)
+{
+     comm_.set_desired_heading(command.desired_heading);
+     comm_.set_desired_depth(command.desired_depth);
+     comm_.set_vertical_thruster(command.vert_thrust);
+     comm_.set_port_thruster(command.port_thrust);
+     comm_.set_starboard_thruster(command.star_thrust);
+     comm_.set_lights(command.lights);
+     comm_.set_camera_tilt(command.tilt);
+
+     if (command.cam_seq != cam_seq_ && now > cam_deadline_) {
+          VideoRayComm::CamCtrl_t cam_cmd = command.cam_cmd;
+          unsigned int cam_seq = command.cam_seq;
+          cam_deadline_ = now + CAM_DEADLINE;
+          scheduler_.submit("camera", CAM_PRIORITY, cam_deadline_,
+                            VideoRayComm::cam_cmd_bytes(), 
+                            [this, cam_cmd, cam_seq] {
+                    if (comm_.set_cam_cmd(cam_cmd) != VideoRayComm::Success) {
+                         return false;
+                    }
+                    cam_seq_ = cam_seq;
+                    cam_deadline_ = 0;
+                    return true;
+               });
+     }
+
+     if (command.manip_state != manip_state_ && now > manip_deadline_) {
+          VideoRayComm::ManipState_t state = command.manip_state;
+          manip_deadline_ = now + MANIP_DEADLINE;
+          scheduler_.submit("manipulator", MANIP_PRIORITY, manip_deadline_,
+                            VideoRayComm::manipulator_bytes(), 
+                            [this, state] {
+                    if (comm_.set_manipulator_state(state) != 
+                        VideoRayComm::Success) {
+                         printf("Error: Set Manipulator State\n");
+                         return false;
+                    }
+                    manip_state_ = state;
+                    manip_deadline_ = 0;
+                    return true;
+               });
+     }
+}
+
+// Steps the autopilot on a new nav block and puts its output in command.
+// Between nav blocks the last output is held; without nav the operator's
+// thrust goes through and the autopilot restarts when nav comes back.
+void ControlLoop::run_autopilot(Command &command,
+                                const VideoRayComm::Telemetry &telemetry,
+                                double now)
+{
+     // The vehicle's own autopilot stays off, apply() sends the -1s
+     bool heading = command.desired_heading >= 0;
+     bool depth = command.desired_depth >= 0;
+     double heading_sp = command.desired_heading;
+     double depth_sp = command.desired_depth;
+     command.desired_heading = -1;
+     command.desired_depth = -1;
+     if (!heading && !depth) {
+          autopilot_active_ = false;
+          return;
+     }
+
+     if (telemetry.nav_updates == 0 || now - telemetry.nav_time > NAV_TIMEOUT) {
+          autopilot_active_ = false;
+          return;
+     }
+     if (!autopilot_active_) {
+          autopilot_.reset();
+          autopilot_active_ = true;
+          nav_updates_ = telemetry.nav_updates - 1;
+     }
+
+     if (telemetry.nav_updates != nav_updates_) {
+          nav_updates_ = telemetry.nav_updates;
+
+          Autopilot::Setpoint setpoint;
+          setpoint.heading_enabled = heading;
+          setpoint.depth_enabled = depth;
+          setpoint.heading = heading ? heading_sp : 0;
+          setpoint.depth = depth ? depth_sp : 0;
+          setpoint.port_thrust = command.port_thrust;
+          setpoint.star_thrust = command.star_thrust;
+          setpoint.vert_thrust = command.vert_thrust;
+
+          double start = monotonic_seconds();
+          autopilot_.update(telemetry.nav, telemetry.nav_time, setpoint,
+                            autopilot_output_);
+          double elapsed = monotonic_seconds() - start;
+
+          AutopilotState state;
+          state.setpoint = setpoint;
+          state.output = autopilot_output_;
+          autopilot_state_.write(state);
+
+          Timing &timing = cycle_timing_;
+          timing.autopilot_ticks++;
+          autopilot_sum_ += elapsed;
+          timing.autopilot_mean = autopilot_sum_ / timing.autopilot_ticks;
+          if (elapsed > timing.autopilot_max) {
+               timing.autopilot_max = elapsed;
+          }
+     }
+
+     if (heading) {
+          command.port_thrust = autopilot_output_.port_thrust;
+          command.star_thrust = autopilot_output_.star_thrust;
+     }
+     if (depth) {
+          command.vert_thrust = autopilot_output_.vert_thrust;
+     }
+}
+
+// Brings the estimator to now with the thrust sent on the previous cycle,
+// fuses a nav block that came in since, and sets the thrust just sent as
+// the input for the next period. A nav block is fused when the cycle sees
+// it, up to a period after it was sampled.
+void ControlLoop::run_estimator(const Command &command,
+                                const VideoRayComm::Telemetry &telemetry,
+                                double now)
+{
+     double start = monotonic_seconds();
+     if (estimator_time_ > 0) {
+          estimator_.predict(now - estimator_time_);
+     }
+     estimator_time_ = now;
+     if (telemetry.nav_updates != estimator_nav_updates_) {
+          estimator_nav_updates_ = telemetry.nav_updates;
+          estimator_.update(telemetry.nav);
+     }
+     estimator_.set_thrust(command.port_thrust, command.star_thrust,
+                           command.vert_thrust);
+
+     NavEstimator::Estimate estimate;
+     estimator_.extrapolate(0, estimate);
+     estimate_.write(estimate);
+     double elapsed = monotonic_seconds() - start;
+
+     Timing &timing = cycle_timing_;
+     estimator_sum_ += elapsed;
+     timing.estimator_mean = estimator_sum_ / (timing.cycles + 1);
+     if (elapsed > timing.estimator_max) {
+          timing.estimator_max = elapsed;
+     }
+}
+
+void ControlLoop::run()
+{
+     long period_ns = (long)(1e9 / rate_);
+
+     struct timespec deadline;
+     clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+     while (running_) {
+          add_ns(deadline, period_ns);
+          while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                                 NULL) == EINTR) {
+          }
+
+          // Overran the next deadline: resume on the first deadline still
+          // ahead instead of bursting through the missed ones
+          int skipped = cycle(to_seconds(deadline));
+          for (int i = 0; i < skipped; i++) {
+               add_ns(deadline, period_ns);
+          }
+     }
+}
+
+int ControlLoop::cycle(double deadline)
+{
+     double wakeup = monotonic_seconds();
+     double lateness = wakeup - deadline;
+
+     Command command;
+     command_.read(command);
+     VideoRayComm::Telemetry telemetry;
+     if (command.host_autopilot || estimating_) {
+          telemetry = comm_.telemetry();
+     }
+     if (command.host_autopilot) {
+          run_autopilot(command, telemetry, wakeup);
+     } else {
+          autopilot_active_ = false;
+     }
+     apply(command, wakeup);
+     if (estimating_) {
+          run_estimator(command, telemetry, wakeup);
+     }
+
+     // Whatever the jobs queued goes out in one write
+     scheduler_.run_slot(wakeup);
+     comm_.flush();
+
+     double end = monotonic_seconds();
+     Timing &timing = cycle_timing_;
+     timing.cycles++;
+     lateness_sum_ += lateness;
+     lateness_sq_sum_ += lateness * lateness;
+     timing.lateness_mean = lateness_sum_ / timing.cycles;
+     double variance = lateness_sq_sum_ / timing.cycles -
+          timing.lateness_mean * timing.lateness_mean;
+     timing.jitter = variance > 0 ? sqrt(variance) : 0;
+     if (lateness > timing.lateness_max) {
+          timing.lateness_max = lateness;
+     }
+     if (end - wakeup > timing.exec_max) {
+          timing.exec_max = end - wakeup;
+     }
+
+     int skipped = 0;
+     double next = deadline + timing.period;
+     if (end > next) {
+          timing.misses++;
+          while (end > next) {
+               next += timing.period;
+               skipped++;
+          }
+          timing.skipped += skipped;
+     }
+
+     timing_.write(timing);
+     bus_stats_.write(scheduler_.stats());
+     return skipped;
+}
@@ -0,0 +1,274 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "EventLoop.h"
+
+// epoll tags: vehicle index times two, plus one for its transmit queue
+#define TIMER_TAG 0xFFFFFFFEu
+#define STOP_TAG  0xFFFFFFFFu
+
+static double to_seconds(const struct timespec &ts)
+{
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double clock_seconds(clockid_t clock)
+{
+     struct timespec ts;
+     clock_gettime(clock, &ts);
+     return to_seconds(ts);
+}
+
+EventLoop::EventLoop() : running_(false)
+{
+     count_ = 0;
+     epoll_fd_ = -1;
+     timer_fd_ = -1;
+     stop_fd_ = -1;
+     period_ = 0;
+     memset(&last_stats_, 0, sizeof(last_stats_));
+     stats_.write(last_stats_);
+}
+
+EventLoop::~EventLoop()
+{
+     stop();
+}
+
+EventLoop::Status_t EventLoop::add(VideoRayComm &comm, ControlLoop &control)
+{
+     if (running_ || count_ >= MAX_VEHICLES || !comm.healthy() ||
+         comm.tx_fd() < 0) {
+          return EventLoop::Failure;
+     }
+     Vehicle &vehicle = vehicles_[count_++];
+     vehicle.comm = &comm;
+     vehicle.control = &control;
+     vehicle.active = true;
+     vehicle.watch_writable = false;
+     return EventLoop::Success;
+}
+
+static bool watch(int epoll_fd, int fd, uint32_t tag)
+{
+     struct epoll_event event;
+     memset(&event, 0, sizeof(event));
+     event.events = EPOLLIN;
+     event.data.u32 = tag;
+     return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+EventLoop::Status_t EventLoop::start(double rate, int rt_priority)
+{
+     if (running_ || rate <= 0) {
+          return EventLoop::Failure;
+     }
+     period_ = 1.0 / rate;
+
+     epoll_fd_ = epoll_create1(0);
+     timer_fd_ = timerfd_create(CLOCK_MONOTONIC, 0);
+     stop_fd_ = eventfd(0, EFD_NONBLOCK);
+     if (epoll_fd_ < 0 || timer_fd_ < 0 || stop_fd_ < 0 ||
+         !watch(epoll_fd_, timer_fd_, TIMER_TAG) ||
+         !watch(epoll_fd_, stop_fd_, STOP_TAG)) {
+          printf("EventLoop: cannot set up epoll: %s\n", strerror(errno));
+          return EventLoop::Failure;
+     }
+
+     Stats &stats = loop_stats_;
+     memset(&stats, 0, sizeof(stats));
+     for (int i = 0; i < count_; i++) {
+          Vehicle &vehicle = vehicles_[i];
+          vehicle.control->prepare(rate);
+          if (!watch(epoll_fd_, vehicle.comm->rx_fd(), 2 * i) ||
+              !watch(epoll_fd_, vehicle.comm->tx_fd(), 2 * i + 1)) {
+               printf("EventLoop: cannot watch %s: %s\n",
+                      vehicle.comm->device().c_str(), strerror(errno));
+               vehicle.active = false;
+               stats.failed++;
+          } else {
+               stats.active++;
+          }
+     }
+     stats_.write(stats);
+
+     running_ = true;
+     thread_ = std::thread(&EventLoop::run, this);
+
+     if (rt_priority > 0) {
+          struct sched_param param;
+          param.sched_priority = rt_priority;
+          int err = pthread_setschedparam(thread_.native_handle(), SCHED_FIFO,
+                                          &param);
+          if (err != 0) {
+               printf("EventLoop: cannot use SCHED_FIFO priority %d: %s\n",
+                      rt_priority, strerror(err));
+          }
+     }
+     return EventLoop::Success;
+}
+
+void EventLoop::stop()
+{
+     if (!running_) {
+          return;
+     }
+     running_ = false;
+     uint64_t one = 1;
+     if (write(stop_fd_, &one, sizeof(one)) < 0) {
+          printf("EventLoop: cannot wake the loop\n");
+     }
+     thread_.join();
+     close(epoll_fd_);
+     close(timer_fd_);
+     close(stop_fd_);
+     epoll_fd_ = timer_fd_ = stop_fd_ = -1;
+}
+
+EventLoop::Stats EventLoop::stats()
+{
+     stats_.read(last_stats_);
+     return last_stats_;
+}
+
+// A failed port is taken out of the epoll set for good, the vehicle is no
+// longer commanded
+void EventLoop::drop(Vehicle &vehicle, Stats &stats, const char *reason)
+{
+     if (!vehicle.active) {
+          return;
+     }
+     epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, vehicle.comm->rx_fd(), NULL);
+     epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, vehicle.comm->tx_fd(), NULL);
+     vehicle.comm->fail();
+     vehicle.active = false;
+     stats.active--;
+     stats.failed++;
+     printf("EventLoop: %s %s, vehicle dropped, %d still running\n",
+            vehicle.comm->device().c_str(), reason, stats.active);
+}
+
+// Sends what the vehicle's port takes. While frames are left over, the
+// port is watched for EPOLLOUT as well, and that event sends the rest.
+void EventLoop::transmit(int index, Stats &stats)
+{
+     Vehicle &vehicle = vehicles_[index];
+     vehicle.comm->service_tx();
+     bool blocked = vehicle.comm->tx_blocked();
+     if (blocked == vehicle.watch_writable) {
+          return;
+     }
+
+     struct epoll_event event;
+     memset(&event, 0, sizeof(event));
+     event.events = blocked ? EPOLLIN | EPOLLOUT : EPOLLIN;
+     event.data.u32 = 2 * index;
+     if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, vehicle.comm->rx_fd(),
+                   &event) < 0) {
+          drop(vehicle, stats, "cannot be watched");
+          return;
+     }
+     vehicle.watch_writable = blocked;
+}
+
+void EventLoop::run()
+{
+     Stats &stats = loop_stats_;
+
+     // Absolute deadlines, so the timer does not drift
+     double deadline = clock_seconds(CLOCK_MONOTONIC) + period_;
+     struct itimerspec spec;
+     spec.it_value.tv_sec = (time_t)deadline;
+     spec.it_value.tv_nsec = (long)((deadline - spec.it_value.tv_sec) * 1e9);
+     spec.it_interval.tv_sec = (time_t)period_;
+     spec.it_interval.tv_nsec = (long)((period_ - spec.it_interval.tv_sec) *
+                                       1e9);
+     if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+          printf("EventLoop: cannot arm the timer: %s\n", strerror(errno));
+          return;
+     }
+
+     struct epoll_event events[2 * MAX_VEHICLES + 2];
+     while (running_) {
+          int n = epoll_wait(epoll_fd_, events, 2 * MAX_VEHICLES + 2, -1);
+          if (n < 0) {
+               if (errno == EINTR) {
+                    continue;
+               }
+               printf("EventLoop: epoll_wait failed: %s\n", strerror(errno));
+               break;
+          }
+
+          double now = clock_seconds(CLOCK_MONOTONIC);
+          bool tick = false;
+          for (int e = 0; e < n; e++) {
+               uint32_t tag = events[e].data.u32;
+               if (tag == STOP_TAG) {
+                    continue;
+               } else if (tag == TIMER_TAG) {
+                    uint64_t expirations = 0;
+                    if (read(timer_fd_, &expirations, sizeof(expirations)) ==
+                        (ssize_t)sizeof(expirations) && expirations > 0) {
+                         // Missed expirations are skipped, not made up
+                         stats.skipped += expirations - 1;
+                         deadline += (expirations - 1) * period_;
+                         tick = true;
+                    }
+                    continue;
+               }
+
+               Vehicle &vehicle = vehicles_[tag / 2];
+               if (!vehicle.active) {
+                    continue;
+               }
+               if (tag % 2 == 1) {
+                    transmit(tag / 2, stats);
+                    continue;
+               } else if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+                    drop(vehicle, stats, "hung up");
+                    continue;
+               }
+               if (events[e].events & EPOLLOUT) {
+                    transmit(tag / 2, stats);
+               }
+               if (vehicle.active && (events[e].events & EPOLLIN) &&
+                   vehicle.comm->service_rx(now) != VideoRayComm::Success) {
+                    drop(vehicle, stats, "read failed");
+               }
+          }
+
+          if (!tick) {
+               continue;
+          }
+
+          // Every vehicle's cycle, then its frames go out at once instead
+          // of waiting for the next epoll round
+          for (int i = 0; i < count_; i++) {
+               Vehicle &vehicle = vehicles_[i];
+               if (!vehicle.active) {
+                    continue;
+               }
+               vehicle.control->cycle(deadline);
+               transmit(i, stats);
+               vehicle.comm->expire(now);
+          }
+          deadline += period_;
+
+          double end = clock_seconds(CLOCK_MONOTONIC);
+          stats.cycles++;
+          if (end - now > stats.cycle_max) {
+               stats.cycle_max = end - now;
+          }
+          stats.cpu_time = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+          stats_.write(stats);
+     }
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+
+#include "LinkHealth.h"
+
+// Share of the period's requests that may time out before warning
+#define TIMEOUT_WARN_RATIO 0.02
+
+// Sync and checksum errors per frame received before warning
+#define FRAME_ERROR_WARN_RATIO 0.01
+
+// 99th percentile latency above which the link is reported slow (s)
+#define LATENCY_WARN 0.05
+
+LinkHealth::LinkHealth(const std::string &name,
+                       const std::string &hardware_id)
+     : name_(name), hardware_id_(hardware_id)
+{
+     // Value initialized: counters zero, histograms empty
+     stats_ = VideoRayComm::LinkStats();
+     last_ = stats_;
+     started_ = false;
+     last_time_ = 0;
+     period_ = 0;
+     requests_ = 0;
+     responses_ = 0;
+     timeouts_ = 0;
+     frame_errors_ = 0;
+     frames_in_ = 0;
+     level_ = diagnostic_msgs::DiagnosticStatus::OK;
+     message_ = "No data yet";
+}
+
+void LinkHealth::raise(unsigned char level)
+{
+     if (level > level_) {
+          level_ = level;
+     }
+}
+
+void LinkHealth::update(const VideoRayComm::LinkStats &stats, bool healthy,
+                        double now)
+{
+     last_ = stats_;
+     stats_ = stats;
+     period_ = started_ ? now - last_time_ : 0;
+     last_time_ = now;
+     started_ = true;
+
+     window_all_.reset();
+     for (int i = 0; i < VideoRayComm::Transaction_Count; i++) {
+          window_[i] = stats_.latency[i].since(last_.latency[i]);
+          window_all_.add(window_[i]);
+     }
+     requests_ = stats_.requests - last_.requests;
+     responses_ = stats_.responses - last_.responses;
+     timeouts_ = stats_.timeouts - last_.timeouts;
+     frame_errors_ = stats_.sync_errors - last_.sync_errors +
+          stats_.checksum_errors - last_.checksum_errors;
+     frames_in_ = stats_.frames_in - last_.frames_in;
+
+     // The worst finding sets the level, every finding is in the message
+     level_ = diagnostic_msgs::DiagnosticStatus::OK;
+     message_ = "";
+     char text[128];
+     if (!healthy) {
+          raise(diagnostic_msgs::DiagnosticStatus::ERROR);
+          message_ = "Port failed";
+     } else if (requests_ > 0 && responses_ == 0) {
+          raise(diagnostic_msgs::DiagnosticStatus::ERROR);
+          message_ = "No response from the vehicle";
+     }
+     if (requests_ > 0 && timeouts_ > TIMEOUT_WARN_RATIO * requests_ &&
+         responses_ > 0) {
+          raise(diagnostic_msgs::DiagnosticStatus::WARN);
+          snprintf(text, sizeof(text), "%lu of %lu requests timed out",
+                   timeouts_, requests_);
+          message_ += (message_.empty() ? "" : ", ") + std::string(text);
+     }
+     if (frame_errors_ > FRAME_ERROR_WARN_RATIO * (frames_in_ + 1)) {
+          raise(diagnostic_msgs::DiagnosticStatus::WARN);
+          snprintf(text, sizeof(text), "%lu corrupt frames", frame_errors_);
+          message_ += (message_.empty() ? "" : ", ") + std::string(text);
+     }
+     if (window_all_.percentile(99) > LATENCY_WARN) {
+          raise(diagnostic_msgs::DiagnosticStatus::WARN);
+          snprintf(text, sizeof(text), "99%% latency %.0f ms",
+                   window_all_.percentile(99) * 1e3);
+          message_ += (message_.empty() ? "" : ", ") + std::string(text);
+     }
+     if (message_.empty()) {
+          message_ = "OK";
+     }
+}
+
+unsigned char LinkHealth::level() const
+{
+     return level_;
+}
+
+void LinkHealth::fill_status(const StatusData &vehicle,
+                             videoray::Status &msg) const
+{
+     msg.water_temp = vehicle.water_temperature;
+     msg.tether_voltage = vehicle.tether_voltage;
+     msg.voltage_12V = vehicle.voltage_12v;
+     msg.current_12V = vehicle.current_12v;
+     msg.internal_temp = vehicle.internal_temperature;
+     msg.internal_relative_humidity = vehicle.humidity;
+     msg.comm_err_count = vehicle.comm_err_count + stats_.sync_errors +
+          stats_.checksum_errors + stats_.timeouts;
+
+     msg.sync_errors = stats_.sync_errors;
+     msg.checksum_errors = stats_.checksum_errors;
+     msg.timeouts = stats_.timeouts;
+     msg.bytes_in = stats_.bytes_in;
+     msg.bytes_out = stats_.bytes_out;
+     msg.latency_p50 = window_all_.percentile(50);
+     msg.latency_p99 = window_all_.percentile(99);
+     msg.latency_max = window_all_.max();
+}
+
+static void add_value(diagnostic_msgs::DiagnosticStatus &status,
+                      const std::string &key, const char *format, double value)
+{
+     char text[64];
+     snprintf(text, sizeof(text), format, value);
+     diagnostic_msgs::KeyValue kv;
+     kv.key = key;
+     kv.value = text;
+     status.values.push_back(kv);
+}
+
+void LinkHealth::fill_diagnostics(
+     diagnostic_msgs::DiagnosticStatus &status) const
+{
+     status.level = level_;
+     status.name = name_;
+     status.message = message_;
+     status.hardware_id = hardware_id_;
+     status.values.clear();
+
+     double rate = period_ > 0 ? 1.0 / period_ : 0;
+     add_value(status, "Requests/s", "%.1f", requests_ * rate);
+     add_value(status, "Responses/s", "%.1f", responses_ * rate);
+     add_value(status, "Bytes in/s", "%.0f",
+               (stats_.bytes_in - last_.bytes_in) * rate);
+     add_value(status, "Bytes out/s", "%.0f",
+               (stats_.bytes_out - last_.bytes_out) * rate);
+
+     for (int i = 0; i < VideoRayComm::Transaction_Count; i++) {
+          const LatencyHistogram &window = window_[i];
+          std::string name = VideoRayComm::transaction_name(
+               (VideoRayComm::Transaction_t)i);
+          if (window.count() == 0) {
+               continue;
+          }
+          add_value(status, name + " latency p50 (ms)", "%.2f",
+                    window.percentile(50) * 1e3);
+          add_value(status, name + " latency p99 (ms)", "%.2f",
+                    window.percentile(99) * 1e3);
+          add_value(status, name + " latency max (ms)", "%.2f",
+                    window.max() * 1e3);
+     }
+
+     // Totals since the port was opened
+     add_value(status, "Timeouts", "%.0f", stats_.timeouts);
+     add_value(status, "Sync errors", "%.0f", stats_.sync_errors);
+     add_value(status, "Checksum errors", "%.0f", stats_.checksum_errors);
+     add_value(status, "Unsolicited responses", "%.0f", stats_.unsolicited);
+     add_value(status, "Read errors", "%.0f", stats_.read_errors);
+     add_value(status, "Write errors", "%.0f", stats_.write_errors);
+     add_value(status, "Bytes in", "%.0f", stats_.bytes_in);
+     add_value(status, "Bytes out", "%.0f", stats_.bytes_out);
+}
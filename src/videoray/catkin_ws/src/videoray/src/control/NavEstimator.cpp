@@ -0,0 +1,333 @@
+#include <math.h>
+#include <string.h>
+
+#include "NavEstimator.h"
+#include "VideoRayModel.h"
+
+static double wrap_pi(double angle)
+{
+     angle = fmod(angle + M_PI, 2 * M_PI);
+     if (angle < 0) {
+          angle += 2 * M_PI;
+     }
+     return angle - M_PI;
+}
+
+static double wrap_2pi(double angle)
+{
+     angle = fmod(angle, 2 * M_PI);
+     if (angle < 0) {
+          angle += 2 * M_PI;
+     }
+     return angle;
+}
+
+static double sign(double value)
+{
+     return value < 0 ? -1.0 : 1.0;
+}
+
+NavEstimator::Config NavEstimator::default_config()
+{
+     Config config;
+     memset(&config, 0, sizeof(config));
+
+     // octave/videoray_pro_3_params.m, as VideoRayPro3
+     Model &model = config.model;
+     model.X_udot = VideoRayPro3::X_udot;
+     model.Y_vdot = VideoRayPro3::Y_vdot;
+     model.Z_wdot = VideoRayPro3::Z_wdot;
+     model.N_rdot = VideoRayPro3::N_rdot;
+     model.Xu = VideoRayPro3::Xu;
+     model.Yv = VideoRayPro3::Yv;
+     model.Nr = VideoRayPro3::Nr;
+     model.Zw = VideoRayPro3::Zw;
+     model.Xuu = VideoRayPro3::Xuu;
+     model.Yvv = VideoRayPro3::Yvv;
+     model.Nrr = VideoRayPro3::Nrr;
+     model.Zww = VideoRayPro3::Zww;
+     model.Ct_forw = VideoRayPro3::Ct_forw;
+     model.Ct_back = VideoRayPro3::Ct_back;
+     model.Ct_vert_forw = VideoRayPro3::Ct_vert_forw;
+     model.Ct_vert_back = VideoRayPro3::Ct_vert_back;
+
+     // The kinematics are exact, the dynamics are not: tether drag and
+     // currents enter as velocity noise. The thrust coefficients are a
+     // guess (see the TODO in the octave file), so yaw follows the compass
+     // rather than the integrated yaw rate.
+     config.process_noise[North] = 0.01;
+     config.process_noise[East] = 0.01;
+     config.process_noise[Down] = 0.01;
+     config.process_noise[Surge] = 0.1;
+     config.process_noise[Sway] = 0.1;
+     config.process_noise[Heave] = 0.1;
+     config.process_noise[Yaw] = 0.2;
+     config.process_noise[YawRate] = 1.0;
+
+     config.measurement_noise[Heading_Measurement] = 2.0 * M_PI / 180.0;
+     config.measurement_noise[Depth_Measurement] = 0.05;
+     config.measurement_noise[Surge_Measurement] = 0.5;
+     config.measurement_noise[Sway_Measurement] = 0.5;
+     config.measurement_noise[Heave_Measurement] = 0.5;
+     config.measurement_noise[YawAccel_Measurement] = 2.0;
+
+     config.initial_sigma[North] = 0.1;
+     config.initial_sigma[East] = 0.1;
+     config.initial_sigma[Down] = 0.1;
+     config.initial_sigma[Surge] = 0.1;
+     config.initial_sigma[Sway] = 0.1;
+     config.initial_sigma[Heave] = 0.1;
+     config.initial_sigma[Yaw] = 0.1;
+     config.initial_sigma[YawRate] = 0.1;
+
+     // Accelerations in g, rad/s^2 for yaw, as for the Autopilot. The
+     // heave axis points up and reads +1 g level at rest.
+     config.accel_scale[0] = 9.81;
+     config.accel_scale[1] = 9.81;
+     config.accel_scale[2] = -9.81;
+     config.yaw_accel_scale = 1.0;
+     config.gravity = 9.81;
+     config.max_step = 0.02;
+     return config;
+}
+
+NavEstimator::NavEstimator(const Config &config)
+{
+     set_config(config);
+     reset();
+}
+
+void NavEstimator::set_config(const Config &config)
+{
+     config_ = config;
+     Q_.setZero();
+     for (int i = 0; i < State_Count; i++) {
+          Q_(i, i) = config.process_noise[i] * config.process_noise[i];
+     }
+     R_.setZero();
+     for (int i = 0; i < Measurement_Count; i++) {
+          R_(i, i) = config.measurement_noise[i] * config.measurement_noise[i];
+     }
+}
+
+void NavEstimator::reset()
+{
+     x_.setZero();
+     P_.setZero();
+     for (int i = 0; i < State_Count; i++) {
+          P_(i, i) = config_.initial_sigma[i] * config_.initial_sigma[i];
+     }
+     X_ = N_ = Z_ = 0;
+     roll_ = pitch_ = 0;
+     initialized_ = false;
+     updates_ = 0;
+}
+
+// Same thrust curves as videoray_sim
+void NavEstimator::set_thrust(int port, int star, int vert)
+{
+     const Model &m = config_.model;
+     double thrust_port = port * (port >= 0 ? m.Ct_forw : m.Ct_back);
+     double thrust_star = star * (star >= 0 ? m.Ct_forw : m.Ct_back);
+     X_ = thrust_port + thrust_star;
+     N_ = thrust_star - thrust_port;
+     Z_ = vert * (vert >= 0 ? m.Ct_vert_forw : m.Ct_vert_back);
+}
+
+// One step of the model. Each velocity's own drag is taken at the end of
+// the step (implicit), the coupling terms at the start. F, when given,
+// receives the Jacobian of the step.
+void NavEstimator::step(StateVector &x, double dt, StateMatrix *F) const
+{
+     const Model &m = config_.model;
+     double u = x(Surge);
+     double v = x(Sway);
+     double w = x(Heave);
+     double r = x(YawRate);
+
+     double den_u = 1 - dt * (m.Xu + m.Xuu * fabs(u)) / m.X_udot;
+     double den_v = 1 - dt * (m.Yv + m.Yvv * fabs(v)) / m.Y_vdot;
+     double den_w = 1 - dt * (m.Zw + m.Zww * fabs(w)) / m.Z_wdot;
+     double den_r = 1 - dt * (m.Nr + m.Nrr * fabs(r)) / m.N_rdot;
+
+     double u1 = (u + dt * (-m.Y_vdot * v * r + X_) / m.X_udot) / den_u;
+     double v1 = (v + dt * m.X_udot * u * r / m.Y_vdot) / den_v;
+     double w1 = (w + dt * Z_ / m.Z_wdot) / den_w;
+     double r1 = (r + dt * N_ / m.N_rdot) / den_r;
+
+     double c1 = cos(roll_), s1 = sin(roll_);
+     double c2 = cos(pitch_), s2 = sin(pitch_);
+     double c3 = cos(x(Yaw)), s3 = sin(x(Yaw));
+
+     Eigen::Matrix3d R;
+     R << c3*c2, c3*s2*s1 - s3*c1, s3*s1 + c3*c1*s2,
+          s3*c2, c1*c3 + s1*s2*s3, c1*s2*s3 - c3*s1,
+          -s2,   c2*s1,            c1*c2;
+     Eigen::Vector3d velocity(u1, v1, w1);
+     Eigen::Vector3d rate = R * velocity;
+
+     // Pitch rate is not known, it is taken as zero
+     double yaw_gain = c1 / c2;
+
+     x(North) += dt * rate(0);
+     x(East) += dt * rate(1);
+     x(Down) += dt * rate(2);
+     x(Surge) = u1;
+     x(Sway) = v1;
+     x(Heave) = w1;
+     x(Yaw) = wrap_2pi(x(Yaw) + dt * yaw_gain * r1);
+     x(YawRate) = r1;
+
+     if (F == NULL) {
+          return;
+     }
+     StateMatrix &J = *F;
+     J.setIdentity();
+     J(Surge, Surge) = (1 + u1 * dt * m.Xuu * sign(u) / m.X_udot) / den_u;
+     J(Surge, Sway) = -dt * m.Y_vdot * r / m.X_udot / den_u;
+     J(Surge, YawRate) = -dt * m.Y_vdot * v / m.X_udot / den_u;
+     J(Sway, Surge) = dt * m.X_udot * r / m.Y_vdot / den_v;
+     J(Sway, Sway) = (1 + v1 * dt * m.Yvv * sign(v) / m.Y_vdot) / den_v;
+     J(Sway, YawRate) = dt * m.X_udot * u / m.Y_vdot / den_v;
+     J(Heave, Heave) = (1 + w1 * dt * m.Zww * sign(w) / m.Z_wdot) / den_w;
+     J(YawRate, YawRate) = (1 + r1 * dt * m.Nrr * sign(r) / m.N_rdot) /
+          den_r;
+     J(Yaw, YawRate) = dt * yaw_gain * J(YawRate, YawRate);
+
+     // Position through the new velocities, and through the yaw that
+     // rotated them: d(R)/d(yaw) moves row 1 into row 0, row 0 into row 1
+     J.block<3, State_Count>(North, 0) +=
+          dt * R * J.block<3, State_Count>(Surge, 0);
+     J(North, Yaw) = -dt * rate(1);
+     J(East, Yaw) = dt * rate(0);
+}
+
+void NavEstimator::predict(double dt)
+{
+     if (dt <= 0) {
+          return;
+     }
+     int steps = (int)ceil(dt / config_.max_step);
+     double h = dt / steps;
+     StateMatrix F;
+     for (int i = 0; i < steps; i++) {
+          step(x_, h, &F);
+          P_ = F * P_ * F.transpose() + Q_ * h;
+     }
+}
+
+// What the accelerometers should read, with gravity removed: the model's
+// velocity derivatives plus the rotation of the body frame. Rows 2 to 5
+// of H receive their Jacobian.
+void NavEstimator::accelerations(const StateVector &x, double accel[4],
+                                 MeasurementMatrix *H) const
+{
+     const Model &m = config_.model;
+     double u = x(Surge);
+     double v = x(Sway);
+     double w = x(Heave);
+     double r = x(YawRate);
+
+     double u_dot = (-m.Y_vdot * v * r + m.Xu * u + m.Xuu * u * fabs(u) +
+                     X_) / m.X_udot;
+     double v_dot = (m.X_udot * u * r + m.Yv * v + m.Yvv * v * fabs(v)) /
+          m.Y_vdot;
+     double w_dot = (m.Zw * w + m.Zww * w * fabs(w) + Z_) / m.Z_wdot;
+     double r_dot = (m.Nr * r + m.Nrr * r * fabs(r) + N_) / m.N_rdot;
+
+     accel[0] = u_dot - r * v;
+     accel[1] = v_dot + r * u;
+     accel[2] = w_dot;
+     accel[3] = r_dot;
+
+     if (H == NULL) {
+          return;
+     }
+     MeasurementMatrix &J = *H;
+     J(Surge_Measurement, Surge) = (m.Xu + 2 * m.Xuu * fabs(u)) / m.X_udot;
+     J(Surge_Measurement, Sway) = -m.Y_vdot * r / m.X_udot - r;
+     J(Surge_Measurement, YawRate) = -m.Y_vdot * v / m.X_udot - v;
+     J(Sway_Measurement, Surge) = m.X_udot * r / m.Y_vdot + r;
+     J(Sway_Measurement, Sway) = (m.Yv + 2 * m.Yvv * fabs(v)) / m.Y_vdot;
+     J(Sway_Measurement, YawRate) = m.X_udot * u / m.Y_vdot + u;
+     J(Heave_Measurement, Heave) = (m.Zw + 2 * m.Zww * fabs(w)) / m.Z_wdot;
+     J(YawAccel_Measurement, YawRate) = (m.Nr + 2 * m.Nrr * fabs(r)) /
+          m.N_rdot;
+}
+
+void NavEstimator::update(const NavData &nav)
+{
+     roll_ = nav.roll * M_PI / 180.0;
+     pitch_ = nav.pitch * M_PI / 180.0;
+     double heading = wrap_2pi(nav.heading * M_PI / 180.0);
+     updates_++;
+
+     // Nothing to fuse yet: yaw and depth start where the vehicle is
+     if (!initialized_) {
+          x_(Yaw) = heading;
+          x_(Down) = nav.depth;
+          initialized_ = true;
+          return;
+     }
+
+     MeasurementMatrix H;
+     H.setZero();
+     H(Heading_Measurement, Yaw) = 1;
+     H(Depth_Measurement, Down) = 1;
+     double accel[4];
+     accelerations(x_, accel, &H);
+
+     // The accelerometers read specific force; gravity in the body frame
+     // is added back to get the acceleration
+     double c1 = cos(roll_), s1 = sin(roll_);
+     double c2 = cos(pitch_), s2 = sin(pitch_);
+     double g = config_.gravity;
+
+     MeasurementVector y;
+     y(Heading_Measurement) = wrap_pi(heading - x_(Yaw));
+     y(Depth_Measurement) = nav.depth - x_(Down);
+     y(Surge_Measurement) = config_.accel_scale[0] * nav.surge_accel -
+          g * s2 - accel[0];
+     y(Sway_Measurement) = config_.accel_scale[1] * nav.sway_accel +
+          g * c2 * s1 - accel[1];
+     y(Heave_Measurement) = config_.accel_scale[2] * nav.heave_accel +
+          g * c2 * c1 - accel[2];
+     y(YawAccel_Measurement) = config_.yaw_accel_scale * nav.yaw_accel -
+          accel[3];
+
+     // K = P H' S^-1, through the Cholesky factor of S; P is symmetric
+     Eigen::Matrix<double, Measurement_Count, State_Count> HP = H * P_;
+     InnovationMatrix S = HP * H.transpose() + R_;
+     Eigen::Matrix<double, State_Count, Measurement_Count> K =
+          S.llt().solve(HP).transpose();
+
+     x_ += K * y;
+     x_(Yaw) = wrap_2pi(x_(Yaw));
+     P_ -= K * HP;
+     P_ = 0.5 * (P_ + P_.transpose()).eval();
+}
+
+void NavEstimator::extrapolate(double dt, Estimate &estimate) const
+{
+     StateVector x = x_;
+     if (dt > 0) {
+          int steps = (int)ceil(dt / config_.max_step);
+          double h = dt / steps;
+          for (int i = 0; i < steps; i++) {
+               step(x, h, NULL);
+          }
+     }
+
+     estimate.north = x(North);
+     estimate.east = x(East);
+     estimate.down = x(Down);
+     estimate.surge = x(Surge);
+     estimate.sway = x(Sway);
+     estimate.heave = x(Heave);
+     estimate.roll = roll_;
+     estimate.pitch = pitch_;
+     estimate.yaw = x(Yaw);
+     estimate.yaw_rate = x(YawRate);
+     estimate.position_sigma = sqrt(P_(North, North) + P_(East, East));
+     estimate.updates = updates_;
+}
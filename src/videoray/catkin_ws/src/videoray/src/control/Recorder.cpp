@@ -0,0 +1,230 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include "Recorder.h"
+
+Recorder::Recorder(ros::NodeHandle &n, const std::vector<std::string> &topics,
+                   const Config &config) : config_(config)
+{
+     ring_bytes_ = 0;
+     pending_bytes_ = 0;
+     writing_bytes_ = 0;
+     recording_ = false;
+     running_ = true;
+     bag_busy_ = false;
+     close_requested_ = false;
+     memset(&stats_, 0, sizeof(stats_));
+
+     // Subscribe to any message type, the way rosbag record does
+     for (unsigned int i = 0; i < topics.size(); i++) {
+          ros::SubscribeOptions ops;
+          ops.topic = topics[i];
+          ops.queue_size = 100;
+          ops.md5sum = ros::message_traits::md5sum<Message>();
+          ops.datatype = ros::message_traits::datatype<Message>();
+          ops.helper = boost::make_shared<
+               ros::SubscriptionCallbackHelperT<
+                    const ros::MessageEvent<Message const> &> >(
+                         boost::bind(&Recorder::callback, this, _1,
+                                     topics[i]));
+          subs_.push_back(n.subscribe(ops));
+     }
+
+     thread_ = std::thread(&Recorder::writer, this);
+}
+
+Recorder::~Recorder()
+{
+     // Unsubscribe first so that no callback runs while tearing down
+     subs_.clear();
+     stop();
+     {
+          std::lock_guard<std::mutex> lock(mutex_);
+          running_ = false;
+     }
+     cond_.notify_one();
+     thread_.join();
+}
+
+void Recorder::callback(const ros::MessageEvent<Message const> &event,
+                        const std::string &topic)
+{
+     Entry entry;
+     entry.topic = topic;
+     entry.time = event.getReceiptTime();
+     entry.msg = event.getMessage();
+     entry.connection_header = event.getConnectionHeaderPtr();
+     entry.size = entry.msg->size();
+
+     std::lock_guard<std::mutex> lock(mutex_);
+     if (recording_) {
+          if (pending_bytes_ + writing_bytes_ + entry.size >
+              config_.memory_limit) {
+               stats_.dropped++;
+               stats_.dropped_bytes += entry.size;
+               return;
+          }
+          pending_.push_back(entry);
+          pending_bytes_ += entry.size;
+          cond_.notify_one();
+          return;
+     }
+
+     // Idle: keep the last pre_trigger seconds, within the byte ceiling
+     ring_.push_back(entry);
+     ring_bytes_ += entry.size;
+     ros::Time oldest = entry.time - ros::Duration(config_.pre_trigger);
+     while (!ring_.empty() && (ring_.front().time < oldest ||
+                               ring_bytes_ > config_.pre_trigger_bytes)) {
+          ring_bytes_ -= ring_.front().size;
+          ring_.pop_front();
+     }
+}
+
+Recorder::Status_t Recorder::start()
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     if (recording_ || bag_busy_) {
+          return Recorder::Failure;
+     }
+
+     char date[32];
+     time_t now = time(NULL);
+     strftime(date, sizeof(date), "%Y-%m-%d-%H-%M-%S", localtime(&now));
+     filename_ = config_.directory + "/" + config_.prefix + "_" + date +
+          ".bag";
+
+     // The pre-trigger ring is the beginning of the bag
+     pending_.swap(ring_);
+     pending_bytes_ = ring_bytes_;
+     ring_.clear();
+     ring_bytes_ = 0;
+
+     recording_ = true;
+     bag_busy_ = true;
+     close_requested_ = false;
+     cond_.notify_one();
+     return Recorder::Success;
+}
+
+void Recorder::stop()
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     if (!recording_) {
+          return;
+     }
+     recording_ = false;
+     close_requested_ = true;
+     cond_.notify_one();
+}
+
+bool Recorder::recording()
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     return recording_;
+}
+
+std::string Recorder::filename()
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     return filename_;
+}
+
+Recorder::Stats Recorder::stats()
+{
+     std::lock_guard<std::mutex> lock(mutex_);
+     Stats stats = stats_;
+     stats.queued_bytes = pending_bytes_ + writing_bytes_;
+     return stats;
+}
+
+// Writer thread: opens the bag, writes the queued messages in batches and
+// closes the bag once stop() was called and the queue is empty.
+void Recorder::writer()
+{
+     bool open = false;
+     bool failed = false;
+     std::string active;
+
+     std::unique_lock<std::mutex> lock(mutex_);
+     for (;;) {
+          cond_.wait(lock, [this, open, failed] {
+                    return !running_ || !pending_.empty() ||
+                         close_requested_ || (bag_busy_ && !open && !failed);
+               });
+          if (!running_ && pending_.empty() && !close_requested_) {
+               break;
+          }
+
+          // Disk access happens without the lock, the callbacks keep
+          // queueing meanwhile
+          std::deque<Entry> batch;
+          batch.swap(pending_);
+          writing_bytes_ = pending_bytes_;
+          pending_bytes_ = 0;
+          bool close = close_requested_;
+          close_requested_ = false;
+          bool busy = bag_busy_;
+          std::string filename = filename_;
+          lock.unlock();
+
+          if (busy && !open && !failed) {
+               active = filename + ".active";
+               try {
+                    bag_.open(active, rosbag::bagmode::Write);
+                    if (config_.lz4) {
+                         bag_.setCompression(rosbag::compression::LZ4);
+                    }
+                    bag_.setChunkThreshold(config_.chunk_size);
+                    open = true;
+                    printf("Recorder: logging to %s\n", filename.c_str());
+               } catch (rosbag::BagException &e) {
+                    printf("Recorder: cannot open %s: %s\n", active.c_str(),
+                           e.what());
+                    failed = true;
+               }
+          }
+
+          unsigned long messages = 0;
+          unsigned long bytes = 0;
+          if (open) {
+               for (unsigned int i = 0; i < batch.size(); i++) {
+                    const Entry &e = batch[i];
+                    try {
+                         bag_.write(e.topic, e.time, e.msg,
+                                    e.connection_header);
+                         messages++;
+                         bytes += e.size;
+                    } catch (rosbag::BagException &ex) {
+                         printf("Recorder: write failed: %s\n", ex.what());
+                    }
+               }
+          }
+
+          if (close) {
+               if (open) {
+                    bag_.close();
+                    if (rename(active.c_str(), filename.c_str()) != 0) {
+                         printf("Recorder: cannot rename %s\n",
+                                active.c_str());
+                    }
+                    printf("Recorder: closed %s\n", filename.c_str());
+               }
+               open = false;
+               failed = false;
+          }
+
+          lock.lock();
+          writing_bytes_ = 0;
+          stats_.messages += messages;
+          stats_.bytes += bytes;
+          if (close) {
+               bag_busy_ = false;
+          }
+     }
+}
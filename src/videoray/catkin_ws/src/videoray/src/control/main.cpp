@@ -1,5 +1,7 @@
 #include <iostream>
 #include <fstream>
+#include <stdio.h>
+#include <math.h>
 #include "ros/ros.h"
 #include "std_msgs/String.h"
 #include "std_msgs/Bool.h"
@@ -7,6 +9,9 @@
 #include <geometry_msgs/Quaternion.h>
 #include <geometry_msgs/TwistStamped.h>
 #include "VideoRayComm.h"
+#include "ControlLoop.h"
+#include "Recorder.h"
+#include "LinkHealth.h"
 #include <syllo_common/Filter.h>
 #include <syllo_common/SylloNode.h>
 #include <syllo_common/Orientation.h>
@@ -15,6 +20,7 @@
 #include "videoray/DesiredTrajectory.h"
 #include "videoray/Status.h"
 #include "videoray/UHRIComm.h"
+#include <diagnostic_msgs/DiagnosticArray.h>
 
 #include <sstream>
 
@@ -128,6 +134,49 @@ typedef enum Attention {
 #define BLINK_ON_DUR (2.0/10.0*1e9)
 #define BLINK_OFF_DUR (2.0/10.0*1e9)
 
+// Logged by the sonar/video logging button (button 6)
+const char *RECORD_TOPICS[] = {
+     "/pose_only", 
+     "/rosout", 
+     "/rosout_agg", 
+     "/rqt_autopilot/desired_trajectory", 
+     "/rqt_compass/pose", 
+     "/rqt_thrust_monitor/throttle_cmd", 
+     "/videoray/accelerations", 
+     "/rqt_uhri/uhri_comm", 
+     "/videoray/joystick", 
+     "/videoray/rqt_blueview/sonar_enable_log", 
+     "/videoray/rqt_blueview/sonar_max_range", 
+     "/videoray/rqt_blueview/sonar_min_range", 
+     "/videoray/rqt_blueview/sonar_thresh", 
+     "/rqt_experiment_notes/experiment_notes"
+};
+
+// Minimum time between two deadline miss reports (seconds)
+#define MISS_REPORT_PERIOD 1.0
+
+// ~<axis>_kp, _ki, _kd set the gains at standstill, ~<axis>_kp_fast etc.
+// those at full forward thrust
+void get_gains(SylloNode &node, const std::string &axis,
+               Autopilot::Schedule &schedule)
+{
+     Autopilot::Gains &slow = schedule.gains[0];
+     Autopilot::Gains &fast = schedule.gains[schedule.count - 1];
+     node.get_param("~" + axis + "_kp", slow.kp);
+     node.get_param("~" + axis + "_ki", slow.ki);
+     node.get_param("~" + axis + "_kd", slow.kd);
+     node.get_param("~" + axis + "_kp_fast", fast.kp);
+     node.get_param("~" + axis + "_ki_fast", fast.ki);
+     node.get_param("~" + axis + "_kd_fast", fast.kd);
+}
+
+// Queues a camera menu key for the next vehicle I/O cycle
+void cam_cmd(ControlLoop::Command &command, VideoRayComm::CamCtrl_t key)
+{
+     command.cam_cmd = key;
+     command.cam_seq++;
+}
+
 int main(int argc, char **argv)
 {     
 
@@ -142,6 +191,12 @@ int main(int argc, char **argv)
      std::string save_directory;
      syllo_node_.get_param("~save_directory", save_directory);
 
+     // Serial port of the vehicle (or of videoray_emulator)
+     std::string device = "/dev/ttyUSB0";
+     double baud = 115200;
+     syllo_node_.get_param("~device", device);
+     syllo_node_.get_param("~baud", baud);
+
      ros::Subscriber joystick_sub_ = n_.subscribe<>("joystick", 1, callback_joystick);
      ros::Subscriber autopilot_sub_ = n_.subscribe<>("desired_trajectory", 1, callback_desired_trajectory);
      ros::Subscriber uhri_comm_sub_ = n_.subscribe<>("uhri_comm", 1, callback_uhri_comm);
@@ -151,12 +206,90 @@ int main(int argc, char **argv)
      ros::Publisher twist_pub_ = n_.advertise<geometry_msgs::TwistStamped>("accelerations",1);
      ros::Publisher enable_log_pub_ = n_.advertise<std_msgs::Bool>("sonar_enable_log",1);
      ros::Publisher videoray_status_pub_ = n_.advertise<videoray::Status>("videoray_status",1);
+     ros::Publisher diagnostics_pub_ = n_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics",1);
 
-     //geometry_msgs::PoseStamped pose_stamped_;
+     geometry_msgs::PoseStamped pose_stamped_;
      geometry_msgs::TwistStamped twist_stamped_;
 
-     VideoRayComm::Status_t status;
-     VideoRayComm comm;
+     VideoRayComm comm(device, (unsigned int)baud);
+     if (!comm.healthy()) {
+          return -1;
+     }
+
+     // The transmit budget is one control cycle worth of line time
+     double tick_rate = 50;
+     syllo_node_.get_param("~tick_rate", tick_rate);
+     comm.set_cycle_rate(tick_rate);
+
+     // Only changed registers are written between keep-alives, 0 sends the
+     // whole control block every cycle
+     double delta_writes = 1;
+     syllo_node_.get_param("~delta_writes", delta_writes);
+     comm.set_delta_writes(delta_writes != 0);
+
+     // Optional capture of the raw tether traffic, for videoray_replay
+     std::string capture_file = "";
+     syllo_node_.get_param("~capture_file", capture_file);
+     if (capture_file != "") {
+          comm.start_capture(capture_file);
+     }
+
+     // In-process recorder, the topics are subscribed from the start so
+     // that the log can begin with the last few seconds before the button
+     std::vector<std::string> record_topics(RECORD_TOPICS, RECORD_TOPICS + 
+                                            sizeof(RECORD_TOPICS) / 
+                                            sizeof(RECORD_TOPICS[0]));
+     Recorder::Config record_config;
+     record_config.directory = save_directory;
+     record_config.prefix = "videoray";
+     record_config.pre_trigger = 5.0;
+     record_config.pre_trigger_bytes = 16 * 1024 * 1024;
+     record_config.memory_limit = 64 * 1024 * 1024;
+     record_config.lz4 = false;
+     record_config.chunk_size = 768 * 1024;
+     double record_lz4 = 0;
+     double record_memory_mb = record_config.memory_limit / (1024 * 1024);
+     syllo_node_.get_param("~record_pre_trigger", record_config.pre_trigger);
+     syllo_node_.get_param("~record_memory_mb", record_memory_mb);
+     syllo_node_.get_param("~record_lz4", record_lz4);
+     record_config.memory_limit = (size_t)(record_memory_mb * 1024 * 1024);
+     record_config.lz4 = record_lz4 != 0;
+     Recorder recorder(n_, record_topics, record_config);
+
+     // Vehicle I/O runs on its own deadline-driven thread, this thread
+     // only hands it the latest command and publishes the telemetry
+     double rt_priority = 0;
+     syllo_node_.get_param("~rt_priority", rt_priority);
+     ControlLoop control_loop(comm);
+     double nav_rate = tick_rate;
+     double status_rate = 1.0;
+     syllo_node_.get_param("~nav_rate", nav_rate);
+     syllo_node_.get_param("~status_rate", status_rate);
+     control_loop.set_rates(nav_rate, status_rate);
+
+     // Heading and depth held by the host instead of the vehicle, at the
+     // nav rate
+     double host_autopilot = 0;
+     syllo_node_.get_param("~host_autopilot", host_autopilot);
+     Autopilot::Config autopilot = Autopilot::default_config();
+     get_gains(syllo_node_, "heading", autopilot.heading);
+     get_gains(syllo_node_, "depth", autopilot.depth);
+     control_loop.set_autopilot(autopilot);
+
+     // Dead-reckoned pose at the control rate; without it the pose is the
+     // nav block's attitude and depth at the origin
+     double estimator = 1;
+     syllo_node_.get_param("~estimator", estimator);
+     if (estimator != 0) {
+          control_loop.set_estimator(NavEstimator::default_config());
+     }
+
+     ControlLoop::Command command;
+     memset(&command, 0, sizeof(command));
+     command.host_autopilot = host_autopilot != 0;
+     command.manip_state = VideoRayComm::Idle;
+     command.cam_cmd = VideoRayComm::Enable;
+     control_loop.start(tick_rate, (int)rt_priority);
 
      videoray::Status videoray_status_;
      videoray_status_.water_temp = 0;
@@ -167,6 +300,14 @@ int main(int argc, char **argv)
      videoray_status_.internal_relative_humidity = 0;
      videoray_status_.comm_err_count = 0;
      videoray_status_.firmware_version = 0;
+
+     // Tether health goes to /diagnostics and into videoray_status once
+     // per period, also while the vehicle does not answer at all
+     double diagnostics_rate = 1.0;
+     syllo_node_.get_param("~diagnostics_rate", diagnostics_rate);
+     LinkHealth link_health("videoray: tether", device);
+     ros::Time diagnostics_timer_ = ros::Time::now();
+     bool status_published_ = false;
      
      int vert_thrust_ = 0;
      int port_thrust_ = 0;
@@ -190,6 +331,11 @@ int main(int argc, char **argv)
      
 
      ros::Time timer_;
+     ros::Time miss_timer_ = ros::Time::now();
+     ros::Time overrun_timer_ = ros::Time::now();
+     unsigned long status_updates_ = 0;
+     unsigned long misses_ = 0;
+     unsigned long overruns_ = 0;
      
      while (ros::ok()) {                   
 
@@ -198,7 +344,7 @@ int main(int argc, char **argv)
                     if (!camera_config_) {
                          cout << "Camera Config Entered..." << endl;
                          camera_config_ = true;
-                         comm.set_cam_cmd(VideoRayComm::Enable);
+                         cam_cmd(command, VideoRayComm::Enable);
                     } else {
                          cout << "Camera Config Exit..." << endl;
                          camera_config_ = false;
@@ -230,13 +376,13 @@ int main(int argc, char **argv)
                     lights_ = saturate(lights_, LIGHTS_OFF, LIGHTS_ON);
                } else {
                     if (rising_edge(button_[3], button_prev_[3])) {
-                         comm.set_cam_cmd(VideoRayComm::Arrow_Up);
+                         cam_cmd(command, VideoRayComm::Arrow_Up);
                     } else if (rising_edge(button_[1], button_prev_[1])) {
-                         comm.set_cam_cmd(VideoRayComm::Arrow_Down);
+                         cam_cmd(command, VideoRayComm::Arrow_Down);
                     } else if (rising_edge(button_[0], button_prev_[0])) {
-                         comm.set_cam_cmd(VideoRayComm::Arrow_Left);
+                         cam_cmd(command, VideoRayComm::Arrow_Left);
                     } else if (rising_edge(button_[2], button_prev_[2])) {
-                         comm.set_cam_cmd(VideoRayComm::Arrow_Right);
+                         cam_cmd(command, VideoRayComm::Arrow_Right);
                     }
                }
                
@@ -254,22 +400,19 @@ int main(int argc, char **argv)
                     std_msgs::Bool msg;
                     if (enable_log_) {
                          cout << "STOP Sonar/Video Log" << endl;
-                         std::string cmd = "killall -INT record";
-                         system(cmd.c_str());
+                         recorder.stop();
                          
                          msg.data = false;
                          enable_log_ = false;
-                    } else {                                                  
+                         enable_log_pub_.publish(msg);
+                    } else if (recorder.start() == Recorder::Success) {
                          cout << "Start Sonar/Video Log" << endl;
-                         //std::string rosbag_str = "rosbag record -b 0 /pose_only /rosout /rosout_agg /rqt_autopilot/desired_trajectory /rqt_compass/pose /rqt_thrust_monitor/throttle_cmd /videoray/accelerations /videoray/joystick /videoray/rqt_blueview/sonar_enable_log /videoray/rqt_blueview/sonar_max_range /videoray/rqt_blueview/sonar_min_range /videoray/rqt_blueview/sonar_thresh -o /home/syllogismrxs/sonar_log/videoray &");
-                         std::string rosbag_str = "rosbag record -b 0 /pose_only /rosout /rosout_agg /rqt_autopilot/desired_trajectory /rqt_compass/pose /rqt_thrust_monitor/throttle_cmd /videoray/accelerations /rqt_uhri/uhri_comm /videoray/joystick /videoray/rqt_blueview/sonar_enable_log /videoray/rqt_blueview/sonar_max_range /videoray/rqt_blueview/sonar_min_range /videoray/rqt_blueview/sonar_thresh /rqt_experiment_notes/experiment_notes -o " + save_directory  + "/videoray &";
-                         
-                         system(rosbag_str.c_str());
-
                          msg.data = true;
                          enable_log_ = true;
+                         enable_log_pub_.publish(msg);
+                    } else {
+                         cout << "Previous log is still being written" << endl;
                     }
-                    enable_log_pub_.publish(msg);
                }
 
                // Reset button
@@ -395,106 +538,205 @@ int main(int argc, char **argv)
                          
           // Handle Auto heading command
           if (desired_trajectory_.heading_enabled) {
-               comm.set_desired_heading(desired_trajectory_.heading);
+               command.desired_heading = desired_trajectory_.heading;
           } else {
                // Disable auto heading
-               comm.set_desired_heading(-1);
+               command.desired_heading = -1;
           }
           
           // Handle Auto Depth Command
           if (desired_trajectory_.depth_enabled) {
-               comm.set_desired_depth(desired_trajectory_.depth);
+               command.desired_depth = desired_trajectory_.depth;
           } else {
                // Disable auto depth
-               comm.set_desired_depth(-1);
+               command.desired_depth = -1;
+          }
+
+          command.vert_thrust = vert_thrust_;
+          command.port_thrust = port_thrust_;
+          command.star_thrust = star_thrust_;
+          command.lights = lights_;
+          command.tilt = tilt_;
+          command.manip_state = manip_state_;
+
+          // Picked up by the I/O thread at its next deadline
+          control_loop.set_command(command);
+
+          ControlLoop::Timing timing = control_loop.timing();
+          if (timing.misses != misses_ && 
+              ros::Time::now() - miss_timer_ > ros::Duration(MISS_REPORT_PERIOD)) {
+               miss_timer_ = ros::Time::now();
+               printf("Control loop: %lu deadline misses in %lu cycles, "
+                      "lateness mean %.0f us, max %.0f us, jitter %.0f us\n",
+                      timing.misses - misses_, timing.cycles,
+                      timing.lateness_mean * 1e6, timing.lateness_max * 1e6,
+                      timing.jitter * 1e6);
+               misses_ = timing.misses;
+          }
+
+          // Link oversubscribed: jobs wait for a later cycle
+          BusScheduler::Stats bus = control_loop.bus_stats();
+          if (bus.overruns != overruns_ && 
+              ros::Time::now() - overrun_timer_ > ros::Duration(MISS_REPORT_PERIOD)) {
+               overrun_timer_ = ros::Time::now();
+               printf("Tether: %lu cycles could not carry every due request "
+                      "(last deferred: %s), %lu one-shots expired, link "
+                      "demand %.0f%%\n", bus.overruns - overruns_, 
+                      bus.last_deferred, bus.expired, 
+                      bus.utilization * 100);
+               overruns_ = bus.overruns;
+          }
+
+          // Telemetry requests are pipelined by the I/O thread, the blocks
+          // published below were requested during the previous cycles.
+          VideoRayComm::Telemetry telemetry = comm.telemetry();
+
+          videoray::Throttle throttle;
+          throttle.PortInput = port_thrust_;
+          throttle.StarInput = star_thrust_;
+          throttle.VertInput = vert_thrust_;
+          throttle_pub_.publish(throttle);
+
+          NavEstimator::Estimate estimate;
+          if (estimator != 0 && control_loop.estimate(estimate) &&
+              estimate.updates > 0) {
+               pose_stamped_.header.stamp = ros::Time().now();
+               pose_stamped_.pose.position.x = estimate.north;
+               pose_stamped_.pose.position.y = estimate.east;
+               pose_stamped_.pose.position.z = estimate.down;
+
+               geometry_msgs::Quaternion quat;
+               eulerToQuaternion_xyzw_deg(estimate.roll * 180.0 / M_PI,
+                                          estimate.pitch * 180.0 / M_PI,
+                                          estimate.yaw * 180.0 / M_PI,
+                                          quat.x, quat.y, quat.z, quat.w);
+               pose_stamped_.pose.orientation = quat;
+
+               pose_pub_.publish(pose_stamped_);
+               pose_only_pub_.publish(pose_stamped_.pose);
           }
 
-          status = comm.set_vertical_thruster(vert_thrust_);
-          status = comm.set_port_thruster(port_thrust_);
-          status = comm.set_starboard_thruster(star_thrust_);
-          status = comm.set_lights(lights_);
-          status = comm.set_camera_tilt(tilt_);
+          if (telemetry.nav_updates > 0) {
+               // Time stamp the message
+               pose_stamped_.header.stamp = ros::Time().now();
+               twist_stamped_.header.stamp = ros::Time().now();
+
+               if (estimator == 0) {
+                    // Populate x,y,z positions
+                    pose_stamped_.pose.position.x = 0;
+                    pose_stamped_.pose.position.y = 0;
+                    pose_stamped_.pose.position.z = telemetry.nav.depth;
+                         
+                    // Populate the orientation
+                    geometry_msgs::Quaternion quat;
+                    eulerToQuaternion_xyzw_deg(telemetry.nav.roll, 
+                                               telemetry.nav.pitch, 
+                                               telemetry.nav.heading,
+                                               quat.x, quat.y, quat.z, 
+                                               quat.w);
           
-          status = comm.send_control_command();
-          if (status != VideoRayComm::Success) {
-               cout << "Exec Transfer Error!" << endl;
-          }                   
-               
-          //status = comm.send_nav_data_command();
-          //if (status != VideoRayComm::Success) {
-          //     cout << "Exec Transfer Error!" << endl;
-          //}
-
-          //status = comm.set_manipulator_state(manip_state_);
-          //if (status != VideoRayComm::Success) {
-          //     cout << "Error: Set Manipulator State" << endl;
-          //}          
-
-          // Time stamp the message
-          //pose_stamped_.header.stamp = ros::Time().now();
-	  //twist_stamped_.header.stamp = ros::Time().now();
-
-          //// Populate x,y,z positions
-          //pose_stamped_.pose.position.x = 0;
-          //pose_stamped_.pose.position.y = 0;
-          //pose_stamped_.pose.position.z = comm.depth();
-          //          
-          //// Populate the orientation
-          //geometry_msgs::Quaternion quat;
-          //eulerToQuaternion_xyzw_deg(comm.roll(), comm.pitch(), comm.heading(),
-          //                           quat.x, quat.y, quat.z, quat.w);
-          //
-          //pose_stamped_.pose.orientation = quat;
-          //
-          //// Publish pose stamped and regular pose for rqt_pose_view
-          //pose_pub_.publish(pose_stamped_);
-          //pose_only_pub_.publish(pose_stamped_.pose);
+                    pose_stamped_.pose.orientation = quat;
           
-          //videoray::Throttle throttle;
-          //throttle.PortInput = port_thrust_;
-          //throttle.StarInput = star_thrust_;
-          //throttle.VertInput = vert_thrust_;
-          //throttle_pub_.publish(throttle);
-
-	  //// Linear accelerations
-	  //twist_stamped_.twist.linear.x = comm.surge_accel();
-	  //twist_stamped_.twist.linear.y = comm.sway_accel();
-	  //twist_stamped_.twist.linear.z = comm.heave_accel();
-          //
-	  //// Angular accelerations
-	  //twist_stamped_.twist.angular.x = comm.roll_accel();
-	  //twist_stamped_.twist.angular.y = comm.pitch_accel();
-	  //twist_stamped_.twist.angular.z = comm.yaw_accel();
-	  //
-	  //twist_pub_.publish(twist_stamped_);
-          //
-          //status = comm.request_status();
-          //if (status != VideoRayComm::Success) {
-          //     cout << "Exec Transfer Error!" << endl;
-          //}
-          //
-          //videoray_status_.internal_relative_humidity = comm.humidity();
-          //videoray_status_.water_temp = comm.water_temperature();
-          //videoray_status_.voltage_12V = comm.rov_voltage();
-          //
-          //videoray_status_pub_.publish(videoray_status_);
-
-          //cout << "------------------------------------" << endl;
-          //cout << "Heading: " << comm.heading() << endl;
-          //cout << "Pitch: " << comm.pitch() << endl;
-          //cout << "Roll: " << comm.roll() << endl;
-          //cout << "Depth: " << comm.depth() << endl;
-          //cout << "Yaw Accel: " << comm.yaw_accel() << endl;
-          //cout << "Pitch Accel: " << comm.pitch_accel() << endl;
-          //cout << "Roll Accel: " << comm.roll_accel() << endl;
-          //cout << "Surge Accel: " << comm.surge_accel() << endl;
-          //cout << "Sway Accel: " << comm.sway_accel() << endl;
-          //cout << "Heave Accel: " << comm.heave_accel() << endl;                    
-          //}	  
+                    // Publish pose stamped and regular pose for 
+                    // rqt_pose_view
+                    pose_pub_.publish(pose_stamped_);
+                    pose_only_pub_.publish(pose_stamped_.pose);
+               }
+
+               // Linear accelerations
+               twist_stamped_.twist.linear.x = telemetry.nav.surge_accel;
+               twist_stamped_.twist.linear.y = telemetry.nav.sway_accel;
+               twist_stamped_.twist.linear.z = telemetry.nav.heave_accel;
+          
+               // Angular accelerations
+               twist_stamped_.twist.angular.x = telemetry.nav.roll_accel;
+               twist_stamped_.twist.angular.y = telemetry.nav.pitch_accel;
+               twist_stamped_.twist.angular.z = telemetry.nav.yaw_accel;
+
+               twist_pub_.publish(twist_stamped_);
+          }
+
+          if (diagnostics_rate > 0 && ros::Time::now() - diagnostics_timer_ >
+              ros::Duration(1.0 / diagnostics_rate)) {
+               diagnostics_timer_ = ros::Time::now();
+               link_health.update(comm.link_stats(), comm.healthy(),
+                                  diagnostics_timer_.toSec());
+
+               diagnostic_msgs::DiagnosticArray diagnostics;
+               diagnostics.header.stamp = diagnostics_timer_;
+               diagnostics.status.resize(1);
+               link_health.fill_diagnostics(diagnostics.status[0]);
+               diagnostics_pub_.publish(diagnostics);
+
+               // No status block this period: the link fields still go out
+               if (!status_published_) {
+                    videoray_status_.header.stamp = diagnostics_timer_;
+                    link_health.fill_status(telemetry.status, 
+                                            videoray_status_);
+                    videoray_status_pub_.publish(videoray_status_);
+               }
+               status_published_ = false;
+          }
+
+          if (telemetry.status_updates != status_updates_) {
+               status_updates_ = telemetry.status_updates;
+
+               videoray_status_.header.stamp = ros::Time::now();
+               link_health.fill_status(telemetry.status, videoray_status_);
+               videoray_status_pub_.publish(videoray_status_);
+               status_published_ = true;
+          }
           
           syllo_node_.spin();
      }
 
+     control_loop.stop();
+
+     ControlLoop::Timing timing = control_loop.timing();
+     printf("Control loop: %lu cycles, %lu deadline misses, lateness mean "
+            "%.0f us, max %.0f us, jitter %.0f us, longest cycle %.0f us\n",
+            timing.cycles, timing.misses, timing.lateness_mean * 1e6,
+            timing.lateness_max * 1e6, timing.jitter * 1e6, 
+            timing.exec_max * 1e6);
+     if (timing.autopilot_ticks > 0) {
+          printf("Host autopilot: %lu ticks, mean %.2f us, max %.2f us\n",
+                 timing.autopilot_ticks, timing.autopilot_mean * 1e6,
+                 timing.autopilot_max * 1e6);
+     }
+     if (estimator != 0) {
+          printf("Nav estimator: mean %.2f us, max %.2f us per cycle\n",
+                 timing.estimator_mean * 1e6, timing.estimator_max * 1e6);
+     }
+
+     BusScheduler::Stats bus = control_loop.bus_stats();
+     printf("Tether: link demand %.0f%%, fullest cycle %.0f%%, %lu overruns, "
+            "%lu deferred, %lu one-shots sent, %lu expired\n",
+            bus.utilization * 100, bus.load_max * 100, bus.overruns, 
+            bus.deferred, bus.one_shots, bus.expired);
+
+     VideoRayComm::LinkStats link = comm.link_stats();
+     printf("Link: %lu requests, %lu timeouts, %lu sync errors, %lu checksum "
+            "errors, %lu bytes in, %lu bytes out\n", link.requests, 
+            link.timeouts, link.sync_errors, link.checksum_errors, 
+            link.bytes_in, link.bytes_out);
+     for (int i = 0; i < VideoRayComm::Transaction_Count; i++) {
+          const LatencyHistogram &latency = link.latency[i];
+          if (latency.count() == 0) {
+               continue;
+          }
+          printf("  %-8s %lu responses, latency p50 %.1f ms, p99 %.1f ms, "
+                 "max %.1f ms\n", 
+                 VideoRayComm::transaction_name((VideoRayComm::Transaction_t)i),
+                 latency.count(), latency.percentile(50) * 1e3, 
+                 latency.percentile(99) * 1e3, latency.max() * 1e3);
+     }
+
+     VideoRayComm::RegisterStats registers = comm.register_stats();
+     printf("Register writes: %lu control blocks, %lu deltas (%lu bytes), "
+            "%lu refreshes\n", registers.control_writes, 
+            registers.delta_writes, registers.delta_bytes, 
+            registers.refreshes);
+
      // Clean up syllo node
      syllo_node_.cleanup();
 
@@ -0,0 +1,356 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/uio.h>
+
+#include "VideoRayEmulator.h"
+
+// Offsets of the thruster commands in the control payload / CSR map
+#define PORT_THRUST 0
+#define STAR_THRUST 2
+#define VERT_THRUST 4
+
+#define STATUS_CSR_ADDR 0x7A
+
+// Crude vehicle response to thrust commands in [-100, 100]
+#define YAW_RATE_PER_THRUST   0.5     // deg/s
+#define DEPTH_RATE_PER_THRUST 0.005   // m/s
+
+static double monotonic_seconds()
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_seconds(double seconds)
+{
+     if (seconds <= 0) {
+          return;
+     }
+     struct timespec ts;
+     ts.tv_sec = (time_t)seconds;
+     ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+     while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR) {
+     }
+}
+
+static short get_short(const uint8_t *p)
+{
+     return (short)(p[0] | (p[1] << 8));
+}
+
+VideoRayEmulator::VideoRayEmulator() : receiver_(Packetizer::Device),
+                                       transmitter_(Packetizer::Device),
+                                       running_(false)
+{
+     master_fd_ = -1;
+     slave_fd_ = -1;
+
+     config_.latency = 0;
+     config_.jitter = 0;
+     config_.baud = 0;
+     config_.drop_prob = 0;
+     config_.corrupt_prob = 0;
+     config_.seed = 1;
+     rand_state_ = config_.seed;
+
+     memset(&stats_, 0, sizeof(stats_));
+     memset(csr_, 0, sizeof(csr_));
+     memset(manip_csr_, 0, sizeof(manip_csr_));
+
+     memset(&nav_, 0, sizeof(nav_));
+     nav_.device_id = VIDEORAY_ID;
+     nav_.heave_accel = 1.0;
+
+     memset(&status_, 0, sizeof(status_));
+     status_.water_temperature = 15;
+     status_.tether_voltage = 75;
+     status_.voltage_12v = 12;
+     status_.current_12v = 2;
+     status_.internal_temperature = 25;
+     status_.humidity = 30;
+     StatusBlock::encode(status_, csr_ + STATUS_CSR_ADDR);
+
+     last_update_ = monotonic_seconds();
+}
+
+VideoRayEmulator::~VideoRayEmulator()
+{
+     stop();
+     close();
+}
+
+VideoRayEmulator::Status_t VideoRayEmulator::open(const std::string &link)
+{
+     master_fd_ = posix_openpt(O_RDWR | O_NOCTTY);
+     if (master_fd_ < 0 || grantpt(master_fd_) != 0 ||
+         unlockpt(master_fd_) != 0) {
+          printf("VideoRayEmulator: cannot create pty: %s\n", strerror(errno));
+          close();
+          return VideoRayEmulator::Failure;
+     }
+     device_ = ptsname(master_fd_);
+
+     // Raw 8-bit line in both directions, no echo
+     struct termios options;
+     tcgetattr(master_fd_, &options);
+     cfmakeraw(&options);
+     tcsetattr(master_fd_, TCSANOW, &options);
+
+     // Holding the slave open keeps the master readable (no EIO) while the
+     // host reopens the port
+     slave_fd_ = ::open(device_.c_str(), O_RDWR | O_NOCTTY);
+     if (slave_fd_ < 0) {
+          printf("VideoRayEmulator: cannot open %s\n", device_.c_str());
+          close();
+          return VideoRayEmulator::Failure;
+     }
+
+     if (!link.empty()) {
+          unlink(link.c_str());
+          if (symlink(device_.c_str(), link.c_str()) != 0) {
+               printf("VideoRayEmulator: cannot link %s\n", link.c_str());
+               close();
+               return VideoRayEmulator::Failure;
+          }
+          link_ = link;
+     }
+     return VideoRayEmulator::Success;
+}
+
+void VideoRayEmulator::close()
+{
+     if (!link_.empty()) {
+          unlink(link_.c_str());
+          link_.clear();
+     }
+     if (slave_fd_ >= 0) {
+          ::close(slave_fd_);
+          slave_fd_ = -1;
+     }
+     if (master_fd_ >= 0) {
+          ::close(master_fd_);
+          master_fd_ = -1;
+     }
+}
+
+const std::string & VideoRayEmulator::device()
+{
+     return link_.empty() ? device_ : link_;
+}
+
+void VideoRayEmulator::set_config(const Config &config)
+{
+     config_ = config;
+     rand_state_ = config_.seed;
+}
+
+const VideoRayEmulator::Config & VideoRayEmulator::config()
+{
+     return config_;
+}
+
+const VideoRayEmulator::Stats & VideoRayEmulator::stats()
+{
+     return stats_;
+}
+
+const NavData & VideoRayEmulator::nav()
+{
+     return nav_;
+}
+
+const StatusData & VideoRayEmulator::status()
+{
+     return status_;
+}
+
+const uint8_t * VideoRayEmulator::registers()
+{
+     return csr_;
+}
+
+double VideoRayEmulator::uniform()
+{
+     return rand_r(&rand_state_) / (RAND_MAX + 1.0);
+}
+
+int VideoRayEmulator::step(double timeout)
+{
+     struct pollfd pfd;
+     pfd.fd = master_fd_;
+     pfd.events = POLLIN;
+     int ret = poll(&pfd, 1, (int)(timeout * 1000));
+     if (ret < 0) {
+          return errno == EINTR ? 0 : -1;
+     } else if (ret == 0) {
+          return 0;
+     }
+
+     int bytes = read(master_fd_, rx_buf_, sizeof(rx_buf_));
+     if (bytes < 0) {
+          return (errno == EAGAIN || errno == EINTR || errno == EIO) ? 0 : -1;
+     }
+
+     int handled = 0;
+     Packetizer::Frame request;
+     receiver_.feed(rx_buf_, bytes);
+     while (receiver_.next(request)) {
+          handle(request);
+          handled++;
+     }
+     return handled;
+}
+
+void VideoRayEmulator::handle(const Packetizer::Frame &request)
+{
+     stats_.requests++;
+     update_vehicle();
+
+     uint8_t *csr;
+     if (request.network_id == VIDEORAY_ID) {
+          csr = csr_;
+     } else if (request.network_id == MANIPULATOR_ID) {
+          csr = manip_csr_;
+     } else {
+          stats_.unknown++;
+          return;
+     }
+
+     // Every payload is a write to the register map at csr_addr
+     int length = request.length;
+     if (request.csr_addr + length > CSR_SIZE) {
+          length = CSR_SIZE - request.csr_addr;
+     }
+     memcpy(csr + request.csr_addr, request.payload, length);
+
+     uint8_t payload[Packetizer::MAX_PAYLOAD];
+     if (request.flags == 0x00) {
+          return;
+     } else if (request.flags == 0x03 || request.flags == 0x05) {
+          NavBlock::encode(nav_, payload);
+          respond(request, payload, NavBlock::size);
+     } else if (request.flags & 0x80) {
+          int count = request.flags & 0x7F;
+          if (request.csr_addr + count > CSR_SIZE) {
+               count = CSR_SIZE - request.csr_addr;
+          }
+          respond(request, csr + request.csr_addr, count);
+     } else {
+          respond(request, payload, 0);
+     }
+}
+
+void VideoRayEmulator::respond(const Packetizer::Frame &request,
+                               const uint8_t *payload, int length)
+{
+     if (uniform() < config_.drop_prob) {
+          stats_.dropped++;
+          return;
+     }
+
+     Packetizer::TxFrame frame;
+     transmitter_.set_network_id(request.network_id);
+     transmitter_.set_flags(request.flags);
+     transmitter_.set_csr_addr(request.csr_addr);
+     transmitter_.build_frame(frame, payload, length);
+
+     struct iovec iov[3];
+     int iovcnt = Packetizer::frame_iovec(&frame, 1, iov);
+
+     // Flip one bit of the header, payload or trailer
+     uint8_t corrupt[Packetizer::MAX_PAYLOAD];
+     if (uniform() < config_.corrupt_prob) {
+          int total = Packetizer::HEADER_SIZE + length + 1;
+          int pos = (int)(uniform() * total);
+          uint8_t bit = 1 << (int)(uniform() * 8);
+          if (pos < Packetizer::HEADER_SIZE) {
+               frame.header[pos] ^= bit;
+          } else if (pos < Packetizer::HEADER_SIZE + length) {
+               memcpy(corrupt, payload, length);
+               corrupt[pos - Packetizer::HEADER_SIZE] ^= bit;
+               iov[1].iov_base = corrupt;
+          } else {
+               frame.trailer ^= bit;
+          }
+          stats_.corrupted++;
+     }
+
+     double delay = config_.latency + config_.jitter * (2 * uniform() - 1);
+     if (config_.baud > 0) {
+          // 10 bits per byte on the wire (start, 8 data, stop)
+          delay += (Packetizer::HEADER_SIZE + length + 1) * 10.0 / config_.baud;
+     }
+     sleep_seconds(delay);
+
+     if (writev(master_fd_, iov, iovcnt) < 0) {
+          printf("VideoRayEmulator: write failed: %s\n", strerror(errno));
+          return;
+     }
+     stats_.responses++;
+}
+
+void VideoRayEmulator::update_vehicle()
+{
+     double now = monotonic_seconds();
+     double dt = now - last_update_;
+     last_update_ = now;
+
+     double port = get_short(csr_ + PORT_THRUST);
+     double star = get_short(csr_ + STAR_THRUST);
+     double vert = get_short(csr_ + VERT_THRUST);
+
+     // Starboard over port turns towards increasing heading, as in
+     // videoray_sim
+     nav_.heading += YAW_RATE_PER_THRUST * (star - port) * dt;
+     while (nav_.heading >= 360) {
+          nav_.heading -= 360;
+     }
+     while (nav_.heading < 0) {
+          nav_.heading += 360;
+     }
+
+     nav_.depth += DEPTH_RATE_PER_THRUST * vert * dt;
+     if (nav_.depth < 0) {
+          nav_.depth = 0;
+     }
+
+     // A little sensor noise on the attitude
+     nav_.pitch = 0.5 * (2 * uniform() - 1);
+     nav_.roll = 0.5 * (2 * uniform() - 1);
+     nav_.yaw_accel = YAW_RATE_PER_THRUST * (star - port) / 100.0;
+     nav_.surge_accel = (port + star) / 2000.0;
+}
+
+VideoRayEmulator::Status_t VideoRayEmulator::start()
+{
+     if (running_ || master_fd_ < 0) {
+          return VideoRayEmulator::Failure;
+     }
+     running_ = true;
+     thread_ = std::thread([this]() {
+               while (running_) {
+                    if (step(0.05) < 0) {
+                         printf("VideoRayEmulator: pty read failed\n");
+                         running_ = false;
+                    }
+               }
+          });
+     return VideoRayEmulator::Success;
+}
+
+void VideoRayEmulator::stop()
+{
+     running_ = false;
+     if (thread_.joinable()) {
+          thread_.join();
+     }
+}
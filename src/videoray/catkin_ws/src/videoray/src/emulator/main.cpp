@@ -0,0 +1,111 @@
+//
+// Stand-alone VideoRay emulator on a pseudo-terminal.
+//
+// $ rosrun videoray videoray_emulator --link /tmp/videoray --latency 0.002
+// $ rosrun videoray control _device:=/tmp/videoray
+//
+// Prints the request / response counters once per second and on exit.
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "VideoRayEmulator.h"
+
+using std::cout;
+using std::endl;
+
+static volatile sig_atomic_t quit_ = 0;
+
+static void signal_handler(int)
+{
+     quit_ = 1;
+}
+
+static void usage(const char *name)
+{
+     cout << "Usage: " << name << " [options]" << endl
+          << "  --link PATH        symlink to the pty slave (default: none)" << endl
+          << "  --latency SEC      response latency (default: 0)" << endl
+          << "  --jitter SEC       uniform +/- jitter on the latency (default: 0)" << endl
+          << "  --baud RATE        emulated line rate, 0 for pty speed (default: 115200)" << endl
+          << "  --drop PROB        probability of not answering (default: 0)" << endl
+          << "  --corrupt PROB     probability of a corrupted answer (default: 0)" << endl
+          << "  --seed N           fault generator seed (default: 1)" << endl;
+}
+
+static void print_stats(const VideoRayEmulator::Stats &stats)
+{
+     printf("requests: %lu, responses: %lu, dropped: %lu, corrupted: %lu, "
+            "unknown: %lu\n", stats.requests, stats.responses, stats.dropped,
+            stats.corrupted, stats.unknown);
+}
+
+int main(int argc, char **argv)
+{
+     VideoRayEmulator::Config config;
+     config.latency = 0;
+     config.jitter = 0;
+     config.baud = 115200;
+     config.drop_prob = 0;
+     config.corrupt_prob = 0;
+     config.seed = 1;
+     std::string link;
+
+     static struct option options[] = {
+          {"link",    required_argument, 0, 'l'},
+          {"latency", required_argument, 0, 't'},
+          {"jitter",  required_argument, 0, 'j'},
+          {"baud",    required_argument, 0, 'b'},
+          {"drop",    required_argument, 0, 'd'},
+          {"corrupt", required_argument, 0, 'c'},
+          {"seed",    required_argument, 0, 's'},
+          {"help",    no_argument,       0, 'h'},
+          {0, 0, 0, 0}
+     };
+
+     int opt;
+     while ((opt = getopt_long(argc, argv, "l:t:j:b:d:c:s:h", options,
+                               NULL)) != -1) {
+          switch (opt) {
+          case 'l': link = optarg; break;
+          case 't': config.latency = atof(optarg); break;
+          case 'j': config.jitter = atof(optarg); break;
+          case 'b': config.baud = atoi(optarg); break;
+          case 'd': config.drop_prob = atof(optarg); break;
+          case 'c': config.corrupt_prob = atof(optarg); break;
+          case 's': config.seed = atoi(optarg); break;
+          default:
+               usage(argv[0]);
+               return opt == 'h' ? 0 : -1;
+          }
+     }
+
+     VideoRayEmulator emulator;
+     emulator.set_config(config);
+     if (emulator.open(link) != VideoRayEmulator::Success) {
+          return -1;
+     }
+     cout << "VideoRay emulator on " << emulator.device() << endl;
+
+     signal(SIGINT, signal_handler);
+     signal(SIGTERM, signal_handler);
+
+     time_t last_print = time(NULL);
+     while (!quit_) {
+          if (emulator.step(0.05) < 0) {
+               cout << "Error reading the pty" << endl;
+               break;
+          }
+          if (time(NULL) != last_print) {
+               last_print = time(NULL);
+               print_stats(emulator.stats());
+          }
+     }
+     print_stats(emulator.stats());
+     return 0;
+}
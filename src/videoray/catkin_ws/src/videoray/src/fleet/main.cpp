@@ -0,0 +1,342 @@
+//
+// Drives several VideoRays, one serial port each, from a single process.
+//
+// $ rosrun videoray videoray_fleet _vehicles:=rov1:/dev/ttyUSB0,rov2:/dev/ttyUSB1
+//
+// Every vehicle gets its topics under /<name>/:
+//
+//   subscribed: throttle_cmd (videoray/Throttle), desired_trajectory
+//   published:  pose, pose_only, accelerations, videoray_status
+//
+// The tether health of every vehicle is published on /diagnostics once per
+// ~diagnostics_rate period.
+//
+// All ports are serviced by one EventLoop thread. A vehicle whose port
+// does not open, or fails later on, is reported and left out; the others
+// keep running.
+//
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <sstream>
+
+#include "ros/ros.h"
+#include <boost/bind.hpp>
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/Quaternion.h>
+#include <geometry_msgs/TwistStamped.h>
+#include "VideoRayComm.h"
+#include "ControlLoop.h"
+#include "EventLoop.h"
+#include "LinkHealth.h"
+#include <syllo_common/SylloNode.h>
+#include <syllo_common/Orientation.h>
+#include "videoray/Throttle.h"
+#include "videoray/DesiredTrajectory.h"
+#include "videoray/Status.h"
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+using std::cout;
+using std::endl;
+
+// Thrust commands the joystick node produces at most
+#define MAX_THRUST 99
+
+// Thrusters are stopped when no throttle_cmd arrived for this long (s)
+#define COMMAND_TIMEOUT 1.0
+
+struct Vehicle {
+     std::string name;
+     std::string device;
+     VideoRayComm *comm;
+     ControlLoop *control;
+     LinkHealth *health;
+
+     ControlLoop::Command command;
+     ros::Time command_time;
+
+     ros::Subscriber throttle_sub;
+     ros::Subscriber trajectory_sub;
+     ros::Publisher pose_pub;
+     ros::Publisher pose_only_pub;
+     ros::Publisher twist_pub;
+     ros::Publisher status_pub;
+
+     unsigned long nav_updates;
+     unsigned long status_updates;
+     bool status_published;
+     bool failed;
+};
+
+static int saturate_thrust(double thrust)
+{
+     if (thrust > MAX_THRUST) {
+          return MAX_THRUST;
+     } else if (thrust < -MAX_THRUST) {
+          return -MAX_THRUST;
+     }
+     return (int)thrust;
+}
+
+void callback_throttle(const videoray::ThrottleConstPtr &msg, Vehicle *v)
+{
+     v->command.port_thrust = saturate_thrust(msg->PortInput);
+     v->command.star_thrust = saturate_thrust(msg->StarInput);
+     v->command.vert_thrust = saturate_thrust(msg->VertInput);
+     v->command_time = ros::Time::now();
+}
+
+void callback_trajectory(const videoray::DesiredTrajectoryConstPtr &msg,
+                         Vehicle *v)
+{
+     v->command.desired_heading = msg->heading_enabled ? msg->heading : -1;
+     v->command.desired_depth = msg->depth_enabled ? msg->depth : -1;
+}
+
+// "rov1:/dev/ttyUSB0,rov2:/dev/ttyUSB1" -> name and device pairs
+static void parse_vehicles(const std::string &list,
+                           std::vector<Vehicle*> &vehicles)
+{
+     std::stringstream ss(list);
+     std::string item;
+     while (std::getline(ss, item, ',')) {
+          size_t colon = item.find(':');
+          if (colon == std::string::npos || colon == 0) {
+               printf("videoray_fleet: ignoring '%s', expected name:device\n",
+                      item.c_str());
+               continue;
+          }
+          Vehicle *v = new Vehicle();
+          v->name = item.substr(0, colon);
+          v->device = item.substr(colon + 1);
+          vehicles.push_back(v);
+     }
+}
+
+static void publish_telemetry(Vehicle &v)
+{
+     VideoRayComm::Telemetry telemetry = v.comm->telemetry();
+
+     if (telemetry.nav_updates != v.nav_updates) {
+          v.nav_updates = telemetry.nav_updates;
+
+          geometry_msgs::PoseStamped pose_stamped;
+          pose_stamped.header.stamp = ros::Time::now();
+          pose_stamped.pose.position.x = 0;
+          pose_stamped.pose.position.y = 0;
+          pose_stamped.pose.position.z = telemetry.nav.depth;
+
+          geometry_msgs::Quaternion quat;
+          eulerToQuaternion_xyzw_deg(telemetry.nav.roll, telemetry.nav.pitch,
+                                     telemetry.nav.heading,
+                                     quat.x, quat.y, quat.z, quat.w);
+          pose_stamped.pose.orientation = quat;
+
+          v.pose_pub.publish(pose_stamped);
+          v.pose_only_pub.publish(pose_stamped.pose);
+
+          geometry_msgs::TwistStamped twist_stamped;
+          twist_stamped.header.stamp = pose_stamped.header.stamp;
+          twist_stamped.twist.linear.x = telemetry.nav.surge_accel;
+          twist_stamped.twist.linear.y = telemetry.nav.sway_accel;
+          twist_stamped.twist.linear.z = telemetry.nav.heave_accel;
+          twist_stamped.twist.angular.x = telemetry.nav.roll_accel;
+          twist_stamped.twist.angular.y = telemetry.nav.pitch_accel;
+          twist_stamped.twist.angular.z = telemetry.nav.yaw_accel;
+          v.twist_pub.publish(twist_stamped);
+     }
+
+     if (telemetry.status_updates != v.status_updates) {
+          v.status_updates = telemetry.status_updates;
+
+          videoray::Status status;
+          status.header.stamp = ros::Time::now();
+          v.health->fill_status(telemetry.status, status);
+          v.status_pub.publish(status);
+          v.status_published = true;
+     }
+}
+
+// Closes the reporting period of every vehicle, the failed ones included
+static void publish_diagnostics(std::vector<Vehicle*> &vehicles,
+                                ros::Publisher &pub)
+{
+     diagnostic_msgs::DiagnosticArray diagnostics;
+     diagnostics.header.stamp = ros::Time::now();
+     diagnostics.status.resize(vehicles.size());
+     for (unsigned int i = 0; i < vehicles.size(); i++) {
+          Vehicle &v = *vehicles[i];
+          v.health->update(v.comm->link_stats(), !v.failed && 
+                           v.comm->healthy(), 
+                           diagnostics.header.stamp.toSec());
+          v.health->fill_diagnostics(diagnostics.status[i]);
+
+          // Vehicle silent this period: the link fields still go out
+          if (!v.failed && !v.status_published) {
+               videoray::Status status;
+               status.header.stamp = diagnostics.header.stamp;
+               v.health->fill_status(v.comm->status_data(), status);
+               v.status_pub.publish(status);
+          }
+          v.status_published = false;
+     }
+     pub.publish(diagnostics);
+}
+
+int main(int argc, char **argv)
+{
+     ros::init(argc, argv, "videoray_fleet");
+     ros::NodeHandle n_;
+
+     SylloNode syllo_node_;
+     syllo_node_.init();
+
+     std::string vehicle_list = "";
+     double baud = 115200;
+     double tick_rate = 50;
+     double nav_rate = -1;
+     double status_rate = 1.0;
+     double rt_priority = 0;
+     double delta_writes = 1;
+     double diagnostics_rate = 1.0;
+     syllo_node_.get_param("~vehicles", vehicle_list);
+     syllo_node_.get_param("~baud", baud);
+     syllo_node_.get_param("~tick_rate", tick_rate);
+     syllo_node_.get_param("~nav_rate", nav_rate);
+     syllo_node_.get_param("~status_rate", status_rate);
+     syllo_node_.get_param("~rt_priority", rt_priority);
+     syllo_node_.get_param("~delta_writes", delta_writes);
+     syllo_node_.get_param("~diagnostics_rate", diagnostics_rate);
+     if (nav_rate <= 0) {
+          nav_rate = tick_rate;
+     }
+
+     std::vector<Vehicle*> vehicles;
+     parse_vehicles(vehicle_list, vehicles);
+     if (vehicles.empty()) {
+          printf("videoray_fleet: no vehicles, set ~vehicles to "
+                 "name:device[,name:device...]\n");
+          return -1;
+     }
+
+     EventLoop event_loop;
+     int running = 0;
+     for (unsigned int i = 0; i < vehicles.size(); i++) {
+          Vehicle &v = *vehicles[i];
+          v.comm = new VideoRayComm(v.device, (unsigned int)baud,
+                                    VideoRayComm::Polled);
+          v.control = new ControlLoop(*v.comm);
+          v.health = new LinkHealth("videoray_fleet: " + v.name + " tether",
+                                    v.device);
+          v.nav_updates = 0;
+          v.status_updates = 0;
+          v.status_published = false;
+          v.failed = false;
+
+          memset(&v.command, 0, sizeof(v.command));
+          v.command.desired_heading = -1;
+          v.command.desired_depth = -1;
+          v.command.manip_state = VideoRayComm::Idle;
+          v.command.cam_cmd = VideoRayComm::Enable;
+          v.command_time = ros::Time::now();
+
+          v.comm->set_delta_writes(delta_writes != 0);
+          v.comm->set_cycle_rate(tick_rate);
+          v.control->set_rates(nav_rate, status_rate);
+          v.control->set_command(v.command);
+
+          if (event_loop.add(*v.comm, *v.control) != EventLoop::Success) {
+               printf("videoray_fleet: %s (%s) left out\n", v.name.c_str(),
+                      v.device.c_str());
+               v.failed = true;
+               continue;
+          }
+          running++;
+
+          v.throttle_sub = n_.subscribe<videoray::Throttle>(
+               v.name + "/throttle_cmd", 1,
+               boost::bind(callback_throttle, _1, &v));
+          v.trajectory_sub = n_.subscribe<videoray::DesiredTrajectory>(
+               v.name + "/desired_trajectory", 1,
+               boost::bind(callback_trajectory, _1, &v));
+          v.pose_pub = n_.advertise<geometry_msgs::PoseStamped>(
+               v.name + "/pose", 1);
+          v.pose_only_pub = n_.advertise<geometry_msgs::Pose>(
+               v.name + "/pose_only", 1);
+          v.twist_pub = n_.advertise<geometry_msgs::TwistStamped>(
+               v.name + "/accelerations", 1);
+          v.status_pub = n_.advertise<videoray::Status>(
+               v.name + "/videoray_status", 1);
+     }
+
+     if (running == 0) {
+          printf("videoray_fleet: no vehicle could be opened\n");
+          return -1;
+     }
+     printf("videoray_fleet: %d of %lu vehicles running\n", running,
+            (unsigned long)vehicles.size());
+     event_loop.start(tick_rate, (int)rt_priority);
+
+     ros::Publisher diagnostics_pub = 
+          n_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+     ros::Time diagnostics_time = ros::Time::now();
+
+     while (ros::ok()) {
+          ros::Time now = ros::Time::now();
+          if (diagnostics_rate > 0 && now - diagnostics_time >
+              ros::Duration(1.0 / diagnostics_rate)) {
+               diagnostics_time = now;
+               publish_diagnostics(vehicles, diagnostics_pub);
+          }
+          for (unsigned int i = 0; i < vehicles.size(); i++) {
+               Vehicle &v = *vehicles[i];
+               if (v.failed) {
+                    continue;
+               }
+               if (!v.comm->healthy()) {
+                    // Stop listening, the event loop already dropped it
+                    v.failed = true;
+                    v.throttle_sub.shutdown();
+                    v.trajectory_sub.shutdown();
+                    printf("videoray_fleet: lost %s (%s)\n", v.name.c_str(),
+                           v.device.c_str());
+                    continue;
+               }
+
+               // Stale throttle: stop the thrusters, keep the autopilots
+               if (now - v.command_time > ros::Duration(COMMAND_TIMEOUT)) {
+                    v.command.port_thrust = 0;
+                    v.command.star_thrust = 0;
+                    v.command.vert_thrust = 0;
+               }
+               v.control->set_command(v.command);
+               publish_telemetry(v);
+          }
+
+          syllo_node_.spin();
+     }
+
+     event_loop.stop();
+
+     EventLoop::Stats stats = event_loop.stats();
+     printf("Event loop: %lu cycles, %lu skipped, longest cycle %.0f us, "
+            "%.2f s CPU, %d vehicles running, %d failed\n", stats.cycles,
+            stats.skipped, stats.cycle_max * 1e6, stats.cpu_time,
+            stats.active, stats.failed);
+     for (unsigned int i = 0; i < vehicles.size(); i++) {
+          Vehicle &v = *vehicles[i];
+          ControlLoop::Timing timing = v.control->timing();
+          printf("%s: %lu cycles, lateness mean %.0f us, max %.0f us%s\n",
+                 v.name.c_str(), timing.cycles, timing.lateness_mean * 1e6,
+                 timing.lateness_max * 1e6, v.failed ? ", failed" : "");
+          delete v.health;
+          delete v.control;
+          delete v.comm;
+          delete vehicles[i];
+     }
+
+     syllo_node_.cleanup();
+
+     return 0;
+}
@@ -0,0 +1,207 @@
+//
+// Replays a tether capture (control node ~capture_file) through the host
+// decoder and the telemetry decoders, at the recorded pace or as fast as
+// possible.
+//
+// $ rosrun videoray videoray_replay dive.scap             (recorded speed)
+// $ rosrun videoray videoray_replay --rate 0 dive.scap    (maximum speed)
+// $ rosrun videoray videoray_replay --bytewise --dump dive.scap
+//
+// Received bytes go through Packetizer::feed/next like in VideoRayComm, or
+// one at a time through receive_packet with --bytewise. Nav and status
+// responses are decoded with the CSR block descriptions. Transmitted bytes
+// are decoded with a Device role packetizer to count the requests.
+//
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <syllo_serial/serialcapture.h>
+
+#include "Packetizer.h"
+#include "CsrMap.h"
+
+using std::cout;
+using std::endl;
+
+struct ReplayStats {
+     unsigned long records;
+     unsigned long rx_bytes;
+     unsigned long tx_bytes;
+     unsigned long requests;
+     unsigned long responses;
+     unsigned long nav;
+     unsigned long status;
+     unsigned long short_frames;    // telemetry responses too short to decode
+};
+
+static double monotonic_seconds()
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_until(double t)
+{
+     struct timespec ts;
+     ts.tv_sec = (time_t)t;
+     ts.tv_nsec = (long)((t - ts.tv_sec) * 1e9);
+     while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+     }
+}
+
+static void usage(const char *name)
+{
+     cout << "Usage: " << name << " [options] CAPTURE" << endl
+          << "  --rate FACTOR      replay speed, 1 is recorded speed, 0 is "
+          << "as fast as possible (default: 1)" << endl
+          << "  --bytewise         decode with receive_packet() one byte at "
+          << "a time" << endl
+          << "  --dump             print every decoded nav and status block"
+          << endl;
+}
+
+// Decodes the telemetry carried by a response, the same way VideoRayComm
+// does for its own requests
+static void decode_response(double t, unsigned char flags,
+                            unsigned char csr_addr, const uint8_t *payload,
+                            int length, bool dump, ReplayStats &stats)
+{
+     stats.responses++;
+     if (flags == 0x03 || flags == 0x05) {
+          if (length < NavBlock::size) {
+               stats.short_frames++;
+               return;
+          }
+          NavData nav;
+          NavBlock::decode(payload, nav);
+          stats.nav++;
+          if (dump) {
+               printf("%.6f nav heading %.1f depth %.1f pitch %.1f roll %.1f "
+                      "accel %.3f %.3f %.3f\n", t, nav.heading, nav.depth,
+                      nav.pitch, nav.roll, nav.surge_accel, nav.sway_accel,
+                      nav.heave_accel);
+          }
+     } else if (flags == 0x8E && csr_addr == 0x7A) {
+          if (length < StatusBlock::size) {
+               stats.short_frames++;
+               return;
+          }
+          StatusData status;
+          StatusBlock::decode(payload, status);
+          stats.status++;
+          if (dump) {
+               printf("%.6f status water %.1f C, 12V %.2f V %.2f A, "
+                      "internal %.1f C, humidity %.0f, comm errors %.0f\n",
+                      t, status.water_temperature, status.voltage_12v,
+                      status.current_12v, status.internal_temperature,
+                      status.humidity, status.comm_err_count);
+          }
+     }
+}
+
+int main(int argc, char **argv)
+{
+     double rate = 1.0;
+     bool bytewise = false;
+     bool dump = false;
+
+     static struct option options[] = {
+          {"rate",     required_argument, 0, 'r'},
+          {"bytewise", no_argument,       0, 'b'},
+          {"dump",     no_argument,       0, 'd'},
+          {"help",     no_argument,       0, 'h'},
+          {0, 0, 0, 0}
+     };
+
+     int opt;
+     while ((opt = getopt_long(argc, argv, "r:bdh", options, NULL)) != -1) {
+          switch (opt) {
+          case 'r': rate = atof(optarg); break;
+          case 'b': bytewise = true; break;
+          case 'd': dump = true; break;
+          default:
+               usage(argv[0]);
+               return opt == 'h' ? 0 : -1;
+          }
+     }
+     if (optind != argc - 1) {
+          usage(argv[0]);
+          return -1;
+     }
+
+     SerialCaptureReader reader;
+     if (reader.Open(argv[optind]) != 1) {
+          cout << "Cannot read capture " << argv[optind] << endl;
+          return -1;
+     }
+     printf("Capture %s, %u baud\n", argv[optind], reader.GetHeader().Bauds);
+
+     Packetizer receiver(Packetizer::Host);
+     Packetizer requests(Packetizer::Device);
+     ReplayStats stats = ReplayStats();
+
+     static uint8_t buf[65536];
+     SerialCaptureRecord record;
+     double start = monotonic_seconds();
+     double t = 0;
+     char ret;
+     while ((ret = reader.Next(&record, buf)) == 1) {
+          stats.records++;
+          t = record.Time_ns / 1e9;
+          if (rate > 0) {
+               sleep_until(start + t / rate);
+          }
+
+          Packetizer::Frame frame;
+          if (record.Direction == SerialCapture::Tx) {
+               stats.tx_bytes += record.Length;
+               requests.feed(buf, record.Length);
+               while (requests.next(frame)) {
+                    stats.requests++;
+               }
+          } else if (bytewise) {
+               stats.rx_bytes += record.Length;
+               for (int i = 0; i < record.Length; i++) {
+                    if (receiver.receive_packet(buf[i]) != Packetizer::Success) {
+                         continue;
+                    }
+                    char *payload;
+                    int length = receiver.get_payload(&payload);
+                    decode_response(t, receiver.flags(), receiver.csr_addr(),
+                                    (const uint8_t *)payload, length, dump,
+                                    stats);
+               }
+          } else {
+               stats.rx_bytes += record.Length;
+               receiver.feed(buf, record.Length);
+               while (receiver.next(frame)) {
+                    decode_response(t, frame.flags, frame.csr_addr,
+                                    frame.payload, frame.length, dump, stats);
+               }
+          }
+     }
+     double elapsed = monotonic_seconds() - start;
+     if (ret < 0) {
+          cout << "Capture truncated after " << stats.records << " records"
+               << endl;
+     }
+
+     const Packetizer::Stats &rx = receiver.stats();
+     printf("%lu records, %.3f s of traffic replayed in %.3f s (%.1f MB/s)\n",
+            stats.records, t, elapsed,
+            elapsed > 0 ? (stats.rx_bytes + stats.tx_bytes) / elapsed / 1e6 : 0);
+     printf("tx: %lu bytes, %lu requests\n", stats.tx_bytes, stats.requests);
+     printf("rx: %lu bytes, %lu responses (%lu nav, %lu status, %lu short)\n",
+            stats.rx_bytes, stats.responses, stats.nav, stats.status,
+            stats.short_frames);
+     printf("rx decoder: sync %lu, header checksum %lu, payload checksum %lu, "
+            "%lu bytes skipped\n", rx.sync_errors, rx.hdr_chk_errors,
+            rx.total_chk_errors, rx.skipped_bytes);
+     return 0;
+}
@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <random>
+#include <thread>
+
+#include "MonteCarlo.h"
+#include "MonteCarloKernel.h"
+#include "VideoRayModel.h"
+
+// Thruster input saturation of videoray_sim
+#define THRUST_LIMIT 150.0
+
+// A drawn coefficient keeps at least this share of its nominal value, so
+// no draw flips the sign of a drag or mass term
+#define MIN_FACTOR 0.1
+
+void monte_carlo_advance_generic(const mc::Lanes &lanes,
+                                 const mc::Input &input, double dt, int steps)
+{
+     mc::advance<Vec4>(lanes, input, dt, steps);
+}
+
+// Without MonteCarloAvx2.cpp in the build, Avx2_Kernel runs the generic
+// code and avx2_available() says so
+#ifndef MONTE_CARLO_AVX2
+void monte_carlo_advance_avx2(const mc::Lanes &lanes, const mc::Input &input,
+                              double dt, int steps)
+{
+     monte_carlo_advance_generic(lanes, input, dt, steps);
+}
+#endif
+
+static double monotonic_seconds()
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double saturate(double value)
+{
+     return std::max(-THRUST_LIMIT, std::min(THRUST_LIMIT, value));
+}
+
+MonteCarlo::Params MonteCarlo::pro3_params()
+{
+     Params params;
+     params.X_udot = VideoRayPro3::X_udot;
+     params.Y_vdot = VideoRayPro3::Y_vdot;
+     params.Z_wdot = VideoRayPro3::Z_wdot;
+     params.N_rdot = VideoRayPro3::N_rdot;
+     params.Xu = VideoRayPro3::Xu;
+     params.Yv = VideoRayPro3::Yv;
+     params.Nr = VideoRayPro3::Nr;
+     params.Zw = VideoRayPro3::Zw;
+     params.Xuu = VideoRayPro3::Xuu;
+     params.Yvv = VideoRayPro3::Yvv;
+     params.Nrr = VideoRayPro3::Nrr;
+     params.Zww = VideoRayPro3::Zww;
+     params.Ct_forw = VideoRayPro3::Ct_forw;
+     params.Ct_back = VideoRayPro3::Ct_back;
+     params.Ct_vert_forw = VideoRayPro3::Ct_vert_forw;
+     params.Ct_vert_back = VideoRayPro3::Ct_vert_back;
+     return params;
+}
+
+MonteCarlo::Config MonteCarlo::default_config()
+{
+     Config config;
+     memset(&config, 0, sizeof(config));
+     config.params = pro3_params();
+
+     // Wang's coefficients are partly theoretical, the thrust curve is
+     // a guess (see the octave file)
+     config.spread.added_mass = 0.1;
+     config.spread.linear_drag = 0.2;
+     config.spread.quadratic_drag = 0.2;
+     config.spread.thrust = 0.15;
+     config.spread.velocity = 0.02;
+     config.spread.position = 0;
+     config.spread.attitude = 0.02;
+
+     // RK4 stays stable on the Pro III yaw mode at this step
+     config.dt = 0.01;
+     config.record_period = 0;
+     config.runs = 1000;
+     config.threads = 0;
+     config.batch = 64;
+     config.seed = 1;
+     config.kernel = MonteCarlo::Auto_Kernel;
+     return config;
+}
+
+bool MonteCarlo::avx2_available()
+{
+#ifdef MONTE_CARLO_AVX2
+     __builtin_cpu_init();
+     return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+     return false;
+#endif
+}
+
+MonteCarlo::MonteCarlo(const Config &config) : next_batch_(0)
+{
+     samples_ = 0;
+     steps_ = 0;
+     kernel_ = MonteCarlo::Generic_Kernel;
+     set_config(config);
+}
+
+void MonteCarlo::set_config(const Config &config)
+{
+     config_ = config;
+}
+
+void MonteCarlo::set_mission(const std::vector<Segment> &mission)
+{
+     mission_ = mission;
+}
+
+// Cuts the mission into intervals of constant input that end at the
+// trajectory samples, sample 0 being the initial state
+void MonteCarlo::plan()
+{
+     plan_.clear();
+     long record_steps = 0;
+     if (config_.record_period > 0) {
+          record_steps = std::max(1L, lround(config_.record_period /
+                                             config_.dt));
+     }
+     samples_ = record_steps > 0 ? 1 : 0;
+
+     long total = 0;
+     for (size_t i = 0; i < mission_.size(); i++) {
+          const Segment &segment = mission_[i];
+          long steps = lround(segment.duration / config_.dt);
+          while (steps > 0) {
+               long run = steps;
+               bool record = false;
+               if (record_steps > 0) {
+                    long to_sample = record_steps - total % record_steps;
+                    if (to_sample <= steps) {
+                         run = to_sample;
+                         record = true;
+                    }
+               }
+               Interval interval;
+               interval.port = saturate(segment.port);
+               interval.star = saturate(segment.star);
+               interval.vert = saturate(segment.vert);
+               interval.steps = (int)run;
+               interval.record = record;
+               plan_.push_back(interval);
+               if (record) {
+                    samples_++;
+               }
+               steps -= run;
+               total += run;
+          }
+     }
+     steps_ = (double)total;
+}
+
+// Coefficients and initial state of one run, drawn from a generator
+// seeded by the run's index only
+void MonteCarlo::draw(int run, double *coef, double *state) const
+{
+     std::mt19937_64 rng(config_.seed * 0x9E3779B97F4A7C15ULL + run);
+     std::normal_distribution<double> normal(0.0, 1.0);
+     auto factor = [&rng, &normal](double sigma) {
+          return std::max(MIN_FACTOR, 1 + sigma * normal(rng));
+     };
+     const Spread &spread = config_.spread;
+     const Params &p = config_.params;
+
+     double X_udot = p.X_udot * factor(spread.added_mass);
+     double Y_vdot = p.Y_vdot * factor(spread.added_mass);
+     double Z_wdot = p.Z_wdot * factor(spread.added_mass);
+     double N_rdot = p.N_rdot * factor(spread.added_mass);
+     coef[mc::X_udot] = X_udot;
+     coef[mc::Y_vdot] = Y_vdot;
+     coef[mc::Inv_X_udot] = 1.0 / X_udot;
+     coef[mc::Inv_Y_vdot] = 1.0 / Y_vdot;
+     coef[mc::Inv_Z_wdot] = 1.0 / Z_wdot;
+     coef[mc::Inv_N_rdot] = 1.0 / N_rdot;
+
+     const double linear[4] = { p.Xu, p.Yv, p.Nr, p.Zw };
+     const double quadratic[4] = { p.Xuu, p.Yvv, p.Nrr, p.Zww };
+     for (int i = 0; i < 4; i++) {
+          coef[mc::Xu + i] = linear[i] * factor(spread.linear_drag);
+     }
+     for (int i = 0; i < 4; i++) {
+          coef[mc::Xuu + i] = quadratic[i] * factor(spread.quadratic_drag);
+     }
+
+     // One factor per thruster curve, forward and reverse together
+     double horizontal = factor(spread.thrust);
+     double vertical = factor(spread.thrust);
+     coef[mc::Ct_forw] = p.Ct_forw * horizontal;
+     coef[mc::Ct_back] = p.Ct_back * horizontal;
+     coef[mc::Ct_vert_forw] = p.Ct_vert_forw * vertical;
+     coef[mc::Ct_vert_back] = p.Ct_vert_back * vertical;
+
+     for (int s = 0; s < STATE_SIZE; s++) {
+          state[s] = config_.initial[s];
+     }
+     for (int s = U; s <= W; s++) {
+          state[s] += spread.velocity * normal(rng);
+     }
+     for (int s = XPos; s <= ZPos; s++) {
+          state[s] += spread.position * normal(rng);
+     }
+     for (int s = Phi; s <= Psi; s++) {
+          state[s] += spread.attitude * normal(rng);
+     }
+}
+
+static void record(const mc::Lanes &lanes, int first, int count, int sample,
+                   int samples, std::vector<float> &trajectory)
+{
+     for (int j = 0; j < count; j++) {
+          float *out = &trajectory[((size_t)(first + j) * samples + sample) *
+                                   4];
+          out[0] = (float)lanes.state[mc::XPos][j];
+          out[1] = (float)lanes.state[mc::YPos][j];
+          out[2] = (float)lanes.state[mc::ZPos][j];
+          out[3] = (float)lanes.state[mc::Psi][j];
+     }
+}
+
+// Worker thread: takes batches until none are left. The buffers are
+// allocated once per worker.
+void MonteCarlo::run_batches(Result &result)
+{
+     int batch = config_.batch;
+     std::vector<double> coef(mc::Coef_Count * batch);
+     std::vector<double> state(mc::State_Count * batch);
+     double draw_coef[mc::Coef_Count];
+     double draw_state[mc::State_Count];
+
+     mc::Lanes lanes;
+     for (int c = 0; c < mc::Coef_Count; c++) {
+          lanes.coef[c] = &coef[c * batch];
+     }
+     for (int s = 0; s < mc::State_Count; s++) {
+          lanes.state[s] = &state[s * batch];
+     }
+
+     void (*advance)(const mc::Lanes &, const mc::Input &, double, int) =
+          kernel_ == MonteCarlo::Avx2_Kernel ? monte_carlo_advance_avx2 :
+          monte_carlo_advance_generic;
+
+     while (true) {
+          int first = next_batch_.fetch_add(1) * batch;
+          if (first >= config_.runs) {
+               break;
+          }
+          int count = std::min(batch, config_.runs - first);
+
+          // Padding lanes repeat the last run and are not reported
+          lanes.count = (count + Vec4::WIDTH - 1) / Vec4::WIDTH * Vec4::WIDTH;
+          for (int j = 0; j < lanes.count; j++) {
+               draw(first + std::min(j, count - 1), draw_coef, draw_state);
+               for (int c = 0; c < mc::Coef_Count; c++) {
+                    lanes.coef[c][j] = draw_coef[c];
+               }
+               for (int s = 0; s < mc::State_Count; s++) {
+                    lanes.state[s][j] = draw_state[s];
+               }
+          }
+
+          int sample = 0;
+          if (samples_ > 0) {
+               record(lanes, first, count, sample++, samples_,
+                      result.trajectory);
+          }
+          for (size_t i = 0; i < plan_.size(); i++) {
+               const Interval &interval = plan_[i];
+               mc::Input input;
+               input.port = interval.port;
+               input.star = interval.star;
+               input.vert = interval.vert;
+               advance(lanes, input, config_.dt, interval.steps);
+               if (interval.record) {
+                    record(lanes, first, count, sample++, samples_,
+                           result.trajectory);
+               }
+          }
+
+          for (int j = 0; j < count; j++) {
+               double *out = &result.final_state[(size_t)(first + j) *
+                                                 STATE_SIZE];
+               for (int s = 0; s < STATE_SIZE; s++) {
+                    out[s] = lanes.state[s][j];
+               }
+          }
+     }
+}
+
+MonteCarlo::Status_t MonteCarlo::run(Result &result)
+{
+     if (config_.runs <= 0 || config_.dt <= 0 || config_.batch <= 0 ||
+         mission_.empty()) {
+          printf("MonteCarlo: nothing to run (%d runs, dt %g, %d per batch, "
+                 "%d segments)\n", config_.runs, config_.dt, config_.batch,
+                 (int)mission_.size());
+          return MonteCarlo::Failure;
+     }
+     config_.batch = (config_.batch + Vec4::WIDTH - 1) / Vec4::WIDTH *
+          Vec4::WIDTH;
+     plan();
+
+     kernel_ = config_.kernel;
+     if (kernel_ == MonteCarlo::Auto_Kernel) {
+          kernel_ = avx2_available() ? MonteCarlo::Avx2_Kernel :
+               MonteCarlo::Generic_Kernel;
+     } else if (kernel_ == MonteCarlo::Avx2_Kernel && !avx2_available()) {
+          printf("MonteCarlo: no AVX2 on this CPU or in this build, using "
+                 "the generic kernel\n");
+          kernel_ = MonteCarlo::Generic_Kernel;
+     }
+
+     int batches = (config_.runs + config_.batch - 1) / config_.batch;
+     int threads = config_.threads;
+     if (threads <= 0) {
+          threads = std::max(1, (int)std::thread::hardware_concurrency());
+     }
+     threads = std::min(threads, batches);
+
+     result.runs = config_.runs;
+     result.samples = samples_;
+     result.final_state.assign((size_t)config_.runs * STATE_SIZE, 0.0);
+     result.trajectory.assign((size_t)config_.runs * samples_ * 4, 0.0f);
+     result.vehicle_steps = steps_ * config_.runs;
+     result.kernel = kernel_;
+     result.threads = threads;
+
+     double start = monotonic_seconds();
+     next_batch_ = 0;
+     std::vector<std::thread> workers;
+     for (int i = 1; i < threads; i++) {
+          workers.push_back(std::thread(&MonteCarlo::run_batches, this,
+                                        std::ref(result)));
+     }
+     run_batches(result);
+     for (size_t i = 0; i < workers.size(); i++) {
+          workers[i].join();
+     }
+     result.elapsed = monotonic_seconds() - start;
+     return MonteCarlo::Success;
+}
+
+static void fill_stat(std::vector<double> &values, MonteCarlo::Stat &stat)
+{
+     memset(&stat, 0, sizeof(stat));
+     size_t n = values.size();
+     if (n == 0) {
+          return;
+     }
+     double sum = 0, sum_sq = 0;
+     for (size_t i = 0; i < n; i++) {
+          sum += values[i];
+          sum_sq += values[i] * values[i];
+     }
+     stat.mean = sum / n;
+     double variance = sum_sq / n - stat.mean * stat.mean;
+     stat.sigma = variance > 0 ? sqrt(variance) : 0;
+
+     std::sort(values.begin(), values.end());
+     stat.min = values[0];
+     stat.p05 = values[(size_t)(0.05 * (n - 1) + 0.5)];
+     stat.p50 = values[(size_t)(0.50 * (n - 1) + 0.5)];
+     stat.p95 = values[(size_t)(0.95 * (n - 1) + 0.5)];
+     stat.max = values[n - 1];
+}
+
+void MonteCarlo::summarize(const Result &result, Summary &summary)
+{
+     int n = result.runs;
+     std::vector<double> values(n);
+     const double *final_state = result.final_state.data();
+
+     double mean_x = 0, mean_y = 0, sin_sum = 0, cos_sum = 0;
+     for (int i = 0; i < n; i++) {
+          const double *s = final_state + (size_t)i * STATE_SIZE;
+          mean_x += s[XPos] / n;
+          mean_y += s[YPos] / n;
+          sin_sum += sin(s[Psi]);
+          cos_sum += cos(s[Psi]);
+     }
+
+     for (int i = 0; i < n; i++) {
+          values[i] = final_state[(size_t)i * STATE_SIZE + XPos];
+     }
+     fill_stat(values, summary.x);
+     for (int i = 0; i < n; i++) {
+          values[i] = final_state[(size_t)i * STATE_SIZE + YPos];
+     }
+     fill_stat(values, summary.y);
+     for (int i = 0; i < n; i++) {
+          values[i] = final_state[(size_t)i * STATE_SIZE + ZPos];
+     }
+     fill_stat(values, summary.depth);
+
+     // Headings are unwrapped around the circular mean, so a spread
+     // across north does not show up as 360 degrees
+     double mean_yaw = atan2(sin_sum, cos_sum);
+     for (int i = 0; i < n; i++) {
+          double yaw = final_state[(size_t)i * STATE_SIZE + Psi];
+          double offset = remainder(yaw - mean_yaw, 2 * M_PI);
+          values[i] = (mean_yaw + offset) * 180.0 / M_PI;
+     }
+     fill_stat(values, summary.heading);
+
+     for (int i = 0; i < n; i++) {
+          const double *s = final_state + (size_t)i * STATE_SIZE;
+          values[i] = hypot(s[U], s[V]);
+     }
+     fill_stat(values, summary.speed);
+     for (int i = 0; i < n; i++) {
+          const double *s = final_state + (size_t)i * STATE_SIZE;
+          values[i] = hypot(s[XPos] - mean_x, s[YPos] - mean_y);
+     }
+     fill_stat(values, summary.miss);
+}
@@ -0,0 +1,10 @@
+// Built with -mavx2 -mfma, see CMakeLists.txt. Only MonteCarlo calls into
+// this file, after checking the CPU.
+
+#include "MonteCarloKernel.h"
+
+void monte_carlo_advance_avx2(const mc::Lanes &lanes, const mc::Input &input,
+                              double dt, int steps)
+{
+     mc::advance<Avx2Vec4>(lanes, input, dt, steps);
+}
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+
+#include <ros/callback_queue.h>
+#include <rosgraph_msgs/Clock.h>
+
+#include "SimClock.h"
+
+SimClock::Config SimClock::default_config()
+{
+     Config config;
+     memset(&config, 0, sizeof(config));
+     config.rate = 10;
+     config.sim_time = false;
+     config.real_time_factor = 1.0;
+     config.lockstep = false;
+     config.lockstep_timeout = 1.0;
+     return config;
+}
+
+void SimClock::get_params(Config &config)
+{
+     ros::NodeHandle private_node("~");
+     private_node.param("rate", config.rate, config.rate);
+     private_node.param("sim_time", config.sim_time, config.sim_time);
+     private_node.param("real_time_factor", config.real_time_factor,
+                        config.real_time_factor);
+     private_node.param("lockstep", config.lockstep, config.lockstep);
+     private_node.param("lockstep_timeout", config.lockstep_timeout,
+                        config.lockstep_timeout);
+
+     if (config.rate <= 0) {
+          ROS_WARN("Invalid ~rate %f, using 10 Hz", config.rate);
+          config.rate = 10;
+     }
+     if (config.real_time_factor < 0) {
+          config.real_time_factor = 0;
+     }
+}
+
+SimClock::SimClock(ros::NodeHandle &node, const Config &config)
+     : config_(config), rate_(config.rate), period_(1.0 / config.rate),
+       dt_(0), commands_(0), commands_seen_(0), timeout_reported_(false)
+{
+     memset(&stats_, 0, sizeof(stats_));
+     wall_start_ = ros::WallTime::now();
+
+     if (!config_.sim_time) {
+          if (config_.lockstep) {
+               ROS_WARN("~lockstep needs ~sim_time, ignored");
+          }
+          time_ = ros::Time::now();
+          return;
+     }
+
+     bool use_sim_time = false;
+     ros::param::get("/use_sim_time", use_sim_time);
+     if (!use_sim_time) {
+          ROS_WARN("~sim_time is set but /use_sim_time is not, other nodes "
+                   "stay on the wall clock");
+     }
+     clock_pub_ = node.advertise<rosgraph_msgs::Clock>("/clock", 1);
+
+     // Simulated time starts at the current wall second, so stamps and
+     // logs stay readable; only differences matter to the model
+     time_ = ros::Time(floor(wall_start_.toSec()));
+     dt_ = period_.toSec();
+     sim_origin_ = time_;
+     wall_origin_ = wall_start_;
+     publish_clock();
+}
+
+void SimClock::step()
+{
+     stats_.steps++;
+
+     if (!config_.sim_time) {
+          rate_.sleep();
+          ros::Time now = ros::Time::now();
+          dt_ = (now - time_).toSec();
+          stats_.sim_elapsed += dt_;
+          time_ = now;
+          stats_.wall_elapsed = (ros::WallTime::now() - wall_start_).toSec();
+          return;
+     }
+
+     time_ += period_;
+     stats_.sim_elapsed += dt_;
+
+     // Hold the step until the wall clock catches up with it. A loop that
+     // falls more than a step behind (slow model, lockstep wait) starts
+     // pacing again from here rather than racing to make up the time.
+     if (config_.real_time_factor > 0) {
+          ros::WallTime target = wall_origin_ + ros::WallDuration(
+               (time_ - sim_origin_).toSec() / config_.real_time_factor);
+          ros::WallTime now = ros::WallTime::now();
+          if (now < target) {
+               ros::WallTime::sleepUntil(target);
+          } else if ((now - target).toSec() >
+                     dt_ / config_.real_time_factor) {
+               sim_origin_ = time_;
+               wall_origin_ = now;
+          }
+     }
+
+     commands_seen_ = commands_;
+     publish_clock();
+     if (config_.lockstep) {
+          wait_for_command();
+     }
+     stats_.wall_elapsed = (ros::WallTime::now() - wall_start_).toSec();
+}
+
+void SimClock::publish_clock()
+{
+     rosgraph_msgs::Clock clock;
+     clock.clock = time_;
+     clock_pub_.publish(clock);
+
+     // This node follows its own clock without waiting for /clock to come
+     // back through the subscription
+     ros::Time::setNow(time_);
+}
+
+void SimClock::print_stats() const
+{
+     printf("Simulated %.1f s in %.1f s, %lu steps, %lu lockstep timeouts\n",
+            stats_.sim_elapsed, stats_.wall_elapsed, stats_.steps,
+            stats_.lockstep_timeouts);
+}
+
+void SimClock::wait_for_command()
+{
+     ros::CallbackQueue *queue = ros::getGlobalCallbackQueue();
+     ros::WallTime deadline = ros::WallTime::now() +
+          ros::WallDuration(config_.lockstep_timeout);
+
+     while (commands_ == commands_seen_ && ros::ok()) {
+          ros::WallTime now = ros::WallTime::now();
+          if (now >= deadline) {
+               stats_.lockstep_timeouts++;
+               if (!timeout_reported_) {
+                    ROS_WARN("Lockstep: no controller output within %g s, "
+                             "stepping without it", config_.lockstep_timeout);
+                    timeout_reported_ = true;
+               }
+               return;
+          }
+          queue->callAvailable(deadline - now);
+     }
+}
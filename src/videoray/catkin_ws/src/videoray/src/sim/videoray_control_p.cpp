@@ -94,7 +94,15 @@ int main(int argc, char **argv)
                                             1, 
                                             odomCallback);
      
-     ros::Rate loop_rate(10);
+     // With /use_sim_time the loop runs on the simulator's /clock, and
+     // ros::Time stays zero until the first tick arrives. Under lockstep
+     // the simulator waits for one throttle command per step, so ~rate
+     // should match the simulator's.
+     double rate = 10;
+     ros::NodeHandle private_node("~");
+     private_node.param("rate", rate, rate);
+     ros::Time::waitForValid();
+     ros::Rate loop_rate(rate);
 
      geometry_msgs::Quaternion quat;
 
@@ -122,7 +130,7 @@ int main(int argc, char **argv)
           speed_err = speed_ref - odom_.twist.twist.linear.x;
 
           heading = normDegrees(yaw_*180/PI);
-          ROS_INFO("Actual heading: %f", heading);
+          ROS_DEBUG("Actual heading: %f", heading);
           heading_err = heading_ref - heading;
           
           if (abs(heading_err) < 180) {
@@ -10,19 +10,29 @@
 
 #include <boost/numeric/odeint.hpp>
 
+#include "SimClock.h"
+#include "SimIntegrator.h"
+#include "VideoRayModel.h"
+
 using std::cout;
 using std::endl;
 
 using namespace boost::numeric::odeint;
 
 typedef boost::array< double , 6 > state_type;
+typedef VideoRayModel<VideoRayPro3> model_type;
 
 #define PI (3.14159265359)
 
+SimClock *sim_clock_ = NULL;
+
 videoray::Throttle throttle_;
 void throttleCallback(const videoray::Throttle::ConstPtr& msg)
 {
      throttle_ = *msg;
+     if (sim_clock_ != NULL) {
+          sim_clock_->command_received();
+     }
      //// Left Throttle Conversion:
      //left_vel_ = saturate(msg->LeftThrottle, -100, 100);
      //left_vel_ = normalize(left_vel_, -100, 100, -1, 1);
@@ -42,77 +52,6 @@ void odomCallback(const nav_msgs::Odometry::ConstPtr& msg)
      odom_ = *msg;
 }
 
-// Linear and angular velocity states
-double u;
-double v;
-double w;
-double p;
-double q;
-double r;
-          
-// Added Mass Terms
-double X_udot = 1.94; // inertia matrix M (m11)
-double Y_vdot = 6.05; // inertia matrix M (m22)
-double Z_wdot = 3.95; // m33
-double N_rdot = 1.18e-2; // vehicle's motion of inertia about z-axis
-// (6,6) entry of the vehicle inertia Matrix M
-
-// Linear Drag Coefficients
-double Xu = -0.95;
-double Yv = -5.87;
-double Nr = -0.023;
-double Zw = -3.70;
-
-// Quadratic Drag Coefficients
-double Xuu = -6.04;
-double Yvv = -30.73;
-double Nrr = -0.45;
-double Zww = -26.36;
-
-double Ct_forw = 0.026667;
-double Ct_back = 0.026667;
-double Ct_vert_forw = 0.026667;
-double Ct_vert_back = 0.026667;
-
-double u_sat_low = -150;
-double u_sat_high = 150;
-     
-// Control inputs
-double X = 0;
-double N = 0;
-double Z = 0;
-
-double u_port = 0;
-double u_star = 0;
-double u_vert = 0;
-
-void videoray_model( const state_type &x , state_type &dxdt , double t )
-{
-/// States: 
-/// 0:  u     : surge velocity
-/// 1:  v     : sway velocity
-/// 2:  w     : heave velocity
-/// 3:  p     : roll rate
-/// 4:  q     : pitch rate
-/// 5:  r     : yaw rate
-     u = x[0];
-     v = x[1];
-     w = x[2];
-     p = x[3];
-     q = x[4];
-     r = x[5];
-          
-     // Calculate fixed frame velocity rates
-     dxdt[0] = (-Y_vdot*v*r + Xu*u + Xuu*u*abs(u) + X) / X_udot;
-     dxdt[1] = (X_udot*u*r + Yv*v + Yvv*v*abs(v)) / Y_vdot;
-     dxdt[2] = (Zw*w + Zww*w*abs(w) + Z) / Z_wdot;
-
-     // Calculate fixed frame orientation rates
-     dxdt[3] = 0;
-     dxdt[4] = 0;
-     dxdt[5] = (Nr*r + Nrr*r*abs(r) + N) / N_rdot;     
-}
-
 //
 // Converts input throttle commands to simulated linear and angular velocities.
 //
@@ -149,38 +88,6 @@ double normalize(double input, const double &in_min, const double &in_max,
      return input;
 }
 
-double thrust_port = 0, thrust_star = 0;
-void processThrottleCmds()
-{
-     u_port = saturate(throttle_.PortInput, u_sat_low, u_sat_high);
-     u_star = saturate(throttle_.StarInput, u_sat_low, u_sat_high);
-     u_vert = saturate(throttle_.VertInput, u_sat_low, u_sat_high);
-
-     // Ct is different for reverse and forward
-     if ( u_port >= 0 ) {
-          thrust_port = u_port * Ct_forw;
-     } else {
-          thrust_port = u_port * Ct_back;
-     }
-
-     if ( u_star >= 0 ) {
-          thrust_star = u_star * Ct_forw;
-     } else {
-          thrust_star = u_star * Ct_back;
-     }
-
-     X = thrust_port + thrust_star;
-     N = thrust_star - thrust_port;
-
-     // Ct is different for reverse and forward
-     if ( u_vert >= 0 ) {
-          Z = u_vert * Ct_vert_forw;
-     } else {
-          Z = u_vert * Ct_vert_back;
-     }
-
-}
-
 void quaternionToEuler(const double &q0, const double &q1, 
                        const double &q2, const double &q3,
                        double &roll, double &pitch, double &yaw)
@@ -190,8 +97,6 @@ void quaternionToEuler(const double &q0, const double &q1,
      yaw = atan2(2*(q0*q3 + q1*q2), 1 - 2*(q2*q2 + q3*q3) );
 }
 
-runge_kutta4< state_type > stepper; 
-
 int main(int argc, char **argv)
 {
      ros::init(argc, argv, "videoray_sim");     
@@ -203,25 +108,26 @@ int main(int argc, char **argv)
      ros::Subscriber odom_sub = n.subscribe("odometry", 1, 
                                             odomCallback);
      
-     double rate = 10;
-     ros::Rate loop_rate(rate);
+     // Real time at 10 Hz unless ~sim_time, ~rate or ~real_time_factor say
+     // otherwise
+     SimClock::Config clock_config = SimClock::default_config();
+     SimClock::get_params(clock_config);
+     SimClock sim_clock(n, clock_config);
+     sim_clock_ = &sim_clock;
+     double rate = clock_config.rate;
+
+     // rosenbrock4 unless ~stepper says otherwise, sampled every 1/rate
+     SimIntegrator<state_type>::Config integrator_config =
+          SimIntegrator<state_type>::default_config();
+     SimIntegrator<state_type>::get_params(integrator_config);
+     SimIntegrator<state_type> integrator(integrator_config);
+     model_type model;
 
-     ros::Time begin = ros::Time::now();
-     ros::Time curr_time = begin;
-     ros::Time prev_time = begin;
-     ros::Duration dt = curr_time - prev_time;
-     
      while (ros::ok())
      {
           //cout << "*" << std::flush;
           
 
-          curr_time = ros::Time::now();
-          dt = curr_time - prev_time;
-          prev_time = curr_time;
-
-          //cout << dt.toSec() << endl << std::flush;
-
           // Update state vector with odometry data from morse...
           state_type x = {0,0,0,0,0,0};
           x[0] = odom_.twist.twist.linear.x;
@@ -231,7 +137,8 @@ int main(int argc, char **argv)
           x[4] = odom_.twist.twist.angular.y;
           x[5] = odom_.twist.twist.angular.z;
 
-          processThrottleCmds();
+          model.set_throttle(throttle_.PortInput, throttle_.StarInput,
+                             throttle_.VertInput);
 
           //geometry_msgs::Quaternion quat = odom_.pose.pose.orientation;
           //quaternionToEuler(quat.x, quat.y, quat.z, quat.w,
@@ -242,11 +149,9 @@ int main(int argc, char **argv)
           //                                  curr_time.toSec() , 
           //                                  (curr_time + dt).toSec(), 
           //                                  dt.toSec());
-          boost::numeric::odeint::integrate(videoray_model, 
-                                            x, 
-                                            curr_time.toSec() , 
-                                            curr_time.toSec() + 1.0/rate, 
-                                            1.0/rate);
+          // x comes from morse every period, so the stepper always
+          // starts afresh from it
+          integrator.advance(model, x, 1.0/rate, true);
 
           //ROS_INFO("========================");
           //ROS_INFO("Current: %f, \tdt: %f", curr_time.toSec(), dt.toSec());
@@ -275,7 +180,11 @@ int main(int argc, char **argv)
 
           ros::spinOnce();
 
-          loop_rate.sleep();
+          sim_clock.step();
      }
+
+     sim_clock.print_stats();
+     integrator.print_stats();
+     sim_clock_ = NULL;
      return 0;
 }
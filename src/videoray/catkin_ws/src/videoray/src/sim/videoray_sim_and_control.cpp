@@ -11,12 +11,17 @@
 
 #include <boost/numeric/odeint.hpp>
 
+#include "SimClock.h"
+#include "SimIntegrator.h"
+#include "VideoRayModel.h"
+
 using std::cout;
 using std::endl;
 
 using namespace boost::numeric::odeint;
 
 typedef boost::array< double , 12 > state_type;
+typedef VideoRayModel<VideoRayPro3> model_type;
 
 #define PI (3.14159265359)
 
@@ -28,125 +33,8 @@ void odomCallback(const nav_msgs::Odometry::ConstPtr& msg)
 
 state_type x_ = {0,0,0,0,0,0,0,0,0,0,0,0};
 
-// Linear and angular velocity states
-double u;
-double v;
-double w;
-double p;
-double q;
-double r;
-          
-// Added Mass Terms
-double X_udot = 1.94; // inertia matrix M (m11)
-double Y_vdot = 6.05; // inertia matrix M (m22)
-double Z_wdot = 3.95; // m33
-double N_rdot = 0.1;
-//double N_rdot = 1.18e-2; // vehicle's motion of inertia about z-axis
-// (6,6) entry of the vehicle inertia Matrix M
-
-// Linear Drag Coefficients
-double Xu = -0.95;
-double Yv = -5.87;
-double Nr = -0.023;
-double Zw = -3.70;
-
-// Quadratic Drag Coefficients
-double Xuu = -6.04;
-double Yvv = -30.73;
-double Nrr = -0.45;
-double Zww = -26.36;
-
-double Ct_forw = 0.026667;
-double Ct_back = 0.026667;
-double Ct_vert_forw = 0.026667;
-double Ct_vert_back = 0.026667;
-
-double u_sat_low = -150;
-double u_sat_high = 150;
-     
-// Control inputs
-double X = 0;
-double N = 0;
-double Z = 0;
-
-double u_port = 0;
-double u_star = 0;
-double u_vert = 0;
-
-double xpos  = 0;
-double ypos  = 0;
-double zpos  = 0;
-double phi   = 0;
-double theta = 0;
-double psi   = 0;
-
-double c1 = 0;
-double c2 = 0;
-double c3 = 0;
-double s1 = 0;
-double s2 = 0;
-double s3 = 0;
-double t2 = 0;
-
 videoray::Throttle throttle_;
 
-void videoray_model( const state_type &x , state_type &dxdt , double t )
-{
-/// States: 
-/// 0:  u     : surge velocity
-/// 1:  v     : sway velocity
-/// 2:  w     : heave velocity
-/// 3:  p     : roll rate
-/// 4:  q     : pitch rate
-/// 5:  r     : yaw rate
-/// 6:  xpos  : earth x-pos
-/// 7:  ypos  : earth y-pos
-/// 8:  zpos  : earth z-pos
-/// 9:  phi   : roll angle
-/// 10: theta : pitch angle
-/// 11: psi   : yaw angle
-     u = x[0];
-     v = x[1];
-     w = x[2];
-     p = x[3];
-     q = x[4];
-     r = x[5];
-     xpos  = x[6];
-     ypos  = x[7];
-     zpos  = x[8];
-     phi   = x[9];
-     theta = x[10];
-     psi   = x[11];
-          
-     // Calculate fixed frame velocity rates
-     dxdt[0] = (-Y_vdot*v*r + Xu*u + Xuu*u*abs(u) + X) / X_udot;
-     dxdt[1] = (X_udot*u*r + Yv*v + Yvv*v*abs(v)) / Y_vdot;
-     dxdt[2] = (Zw*w + Zww*w*abs(w) + Z) / Z_wdot;
-
-     // Calculate fixed frame orientation rates
-     dxdt[3] = 0;
-     dxdt[4] = 0;
-     dxdt[5] = (Nr*r + Nrr*r*abs(r) + N) / N_rdot;     
-
-     c1 = cos(phi);
-     c2 = cos(theta); 
-     c3 = cos(psi); 
-     s1 = sin(phi); 
-     s2 = sin(theta); 
-     s3 = sin(psi); 
-     t2 = tan(theta);
-
-     // Calculate inertial frame position
-     dxdt[6] = c3*c2*u + (c3*s2*s1-s3*c1)*v + (s3*s1+c3*c1*s2)*w;
-     dxdt[7] = s3*c2*u + (c1*c3+s1*s2*s3)*v + (c1*s2*s3-c3*s1)*w;
-     dxdt[8] = -s2*u + c2*s1*v + c1*c2*w;
-
-     // Calculate inertial frame orientations
-     dxdt[9] = p + (q*s1 + r*c1)*t2;
-     dxdt[10] = q*c1 - r*s1;
-     dxdt[11] = (q*s1 + r*c1)* (1 / cos(theta));
-}
-
 //
 // Converts input throttle commands to simulated linear and angular velocities.
 //
@@ -183,38 +71,6 @@ double normalize(double input, const double &in_min, const double &in_max,
      return input;
 }
 
-double thrust_port = 0, thrust_star = 0;
-void processThrottleCmds()
-{
-     u_port = saturate(throttle_.PortInput, u_sat_low, u_sat_high);
-     u_star = saturate(throttle_.StarInput, u_sat_low, u_sat_high);
-     u_vert = saturate(throttle_.VertInput, u_sat_low, u_sat_high);
-
-     // Ct is different for reverse and forward
-     if ( u_port >= 0 ) {
-          thrust_port = u_port * Ct_forw;
-     } else {
-          thrust_port = u_port * Ct_back;
-     }
-
-     if ( u_star >= 0 ) {
-          thrust_star = u_star * Ct_forw;
-     } else {
-          thrust_star = u_star * Ct_back;
-     }
-
-     X = thrust_port + thrust_star;
-     N = thrust_star - thrust_port;
-
-     // Ct is different for reverse and forward
-     if ( u_vert >= 0 ) {
-          Z = u_vert * Ct_vert_forw;
-     } else {
-          Z = u_vert * Ct_vert_back;
-     }
-
-}
-
 double normDegrees(double input)
 {
      if (input < 0) {
@@ -249,20 +105,33 @@ double depth_ref = 0;
 double speed_ref = 0;
 double heading_ref = 0;
 
+// The desired_* topics are the controller output lockstep waits for
+SimClock *sim_clock_ = NULL;
+
+void commandReceived()
+{
+     if (sim_clock_ != NULL) {
+          sim_clock_->command_received();
+     }
+}
+
 void desiredVelocityCallback(const std_msgs::Float32::ConstPtr& msg)
 {
      speed_ref = msg->data;
+     commandReceived();
 }
 
 void desiredHeadingCallback(const std_msgs::Float32::ConstPtr& msg)
 {
      heading_ref = normDegrees(msg->data - 90);
      //heading_ref = msg->data;
+     commandReceived();
 }
 
 void desiredDepthCallback(const std_msgs::Float32::ConstPtr& msg)
 {
      depth_ref = msg->data;
+     commandReceived();
 }
 
 //geometry_msgs::Quaternion quat_;
@@ -352,30 +221,40 @@ int main(int argc, char **argv)
                                                      1, 
                                                      desiredDepthCallback);
      
-     //double rate = 30;
-     double rate = 10;
-     ros::Rate loop_rate(rate);
-
-     ros::Time begin = ros::Time::now();
+     // Real time at 10 Hz unless ~sim_time, ~rate or ~real_time_factor say
+     // otherwise
+     SimClock::Config clock_config = SimClock::default_config();
+     SimClock::get_params(clock_config);
+     SimClock sim_clock(n, clock_config);
+     sim_clock_ = &sim_clock;
+
+     ros::Time begin = sim_clock.now();
      ros::Time curr_time = begin;
      ros::Time prev_time = begin;
      ros::Duration dt = curr_time - prev_time;
      
      geometry_msgs::Quaternion quat;
 
-     runge_kutta4< state_type > stepper;
-     //runge_kutta_dopri5< state_type > stepper;
-     //adams_bashforth_moulton< 2 , state_type > stepper;
+     // rosenbrock4 unless ~stepper says otherwise, sampled every 1/rate
+     SimIntegrator<state_type>::Config integrator_config =
+          SimIntegrator<state_type>::default_config();
+     SimIntegrator<state_type>::get_params(integrator_config);
+     SimIntegrator<state_type> integrator(integrator_config);
+     model_type model;
+     double rate = clock_config.rate;
+
+     // Thrust of the previous period, the stepper restarts when it changes
+     double X_prev = 0, N_prev = 0, Z_prev = 0;
 
      while (ros::ok())
      {
           //cout << "*" << std::flush;
           
-          curr_time = ros::Time::now();
-          dt = curr_time - prev_time;
+          curr_time = sim_clock.now();
+          dt = ros::Duration(sim_clock.dt());
           prev_time = curr_time;
 
-          ROS_INFO("dt: %f\n", dt.toSec());
+          ROS_DEBUG("dt: %f\n", dt.toSec());
 
           //cout << dt.toSec() << endl << std::flush;
 
@@ -390,7 +269,8 @@ int main(int argc, char **argv)
           
           execControlLaw();
 
-          processThrottleCmds();
+          model.set_throttle(throttle_.PortInput, throttle_.StarInput,
+                             throttle_.VertInput);
 
           //geometry_msgs::Quaternion quat = odom_.pose.pose.orientation;
           //quaternionToEuler(quat.x, quat.y, quat.z, quat.w,
@@ -407,23 +287,28 @@ int main(int argc, char **argv)
           //                                  curr_time.toSec() + 1.0/rate, 
           //                                  1.0/rate);
 
-          stepper.do_step(videoray_model, x_ , curr_time.toSec() , dt.toSec() );
-
-          ROS_INFO("========================");
-          ROS_INFO("Current: %f, \tdt: %f", curr_time.toSec(), dt.toSec());
-          ROS_INFO("Surge: %f", x_[0]);
-          ROS_INFO("Sway: %f", x_[1]);
-          ROS_INFO("Heave: %f", x_[2]);
+          bool restart = (model.X() != X_prev || model.N() != N_prev ||
+                          model.Z() != Z_prev);
+          X_prev = model.X();
+          N_prev = model.N();
+          Z_prev = model.Z();
+          integrator.advance(model, x_, 1.0/rate, restart);
+
+          ROS_DEBUG("========================");
+          ROS_DEBUG("Current: %f, \tdt: %f", curr_time.toSec(), dt.toSec());
+          ROS_DEBUG("Surge: %f", x_[0]);
+          ROS_DEBUG("Sway: %f", x_[1]);
+          ROS_DEBUG("Heave: %f", x_[2]);
           
-          ROS_INFO("3: %f", x_[3]);
-          ROS_INFO("4: %f", x_[4]);
-          ROS_INFO("5: %f", x_[5]);
-          ROS_INFO("6: %f", x_[6]);
-          ROS_INFO("7: %f", x_[7]);
-          ROS_INFO("8: %f", x_[8]);
-          ROS_INFO("9: %f", x_[9]);
-          ROS_INFO("10: %f", x_[10]);
-          ROS_INFO("11: %f", x_[11]);
+          ROS_DEBUG("3: %f", x_[3]);
+          ROS_DEBUG("4: %f", x_[4]);
+          ROS_DEBUG("5: %f", x_[5]);
+          ROS_DEBUG("6: %f", x_[6]);
+          ROS_DEBUG("7: %f", x_[7]);
+          ROS_DEBUG("8: %f", x_[8]);
+          ROS_DEBUG("9: %f", x_[9]);
+          ROS_DEBUG("10: %f", x_[10]);
+          ROS_DEBUG("11: %f", x_[11]);
           
           //velocity_linear_.x = x[0];
           //velocity_linear_.y = x[1];
@@ -482,7 +367,11 @@ int main(int argc, char **argv)
 
           ros::spinOnce();
 
-          loop_rate.sleep();
+          sim_clock.step();
      }
+
+     sim_clock.print_stats();
+     integrator.print_stats();
+     sim_clock_ = NULL;
      return 0;
 }